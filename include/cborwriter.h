@@ -0,0 +1,57 @@
+///
+/// CborWriter - Minimal CBOR (RFC 8949) encoder into a fixed buffer
+/// 
+/// We only need the handful of types our telemetry uses: unsigned and
+/// negative integers, floats, text strings, booleans, arrays and maps.
+/// Writing never allocates; if the buffer runs out we set an overflow
+/// flag and the caller discards the message.
+///
+
+#ifndef CBORWRITER_H
+#define CBORWRITER_H
+
+#include <Arduino.h>
+
+class CborWriter {
+public:
+	CborWriter(uint8_t* buffer, size_t capacity);
+	
+	/// Start a definite-length array or map with the given number of items/pairs
+	void beginArray(size_t items);
+	void beginMap(size_t pairs);
+	
+	/// Write scalar values
+	void writeUInt(uint64_t value);
+	void writeInt(int64_t value);
+	void writeFloat(float value);
+	void writeBool(bool value);
+	void writeString(const char* text);
+	
+	/// Write a map key followed by a value
+	/// We use these for the common "short string key" pattern
+	void writeKey(const char* key);
+	
+	/// Get number of bytes written so far
+	[[nodiscard]] size_t getLength() const;
+	
+	/// Check if any write did not fit into the buffer
+	[[nodiscard]] bool hasOverflowed() const;
+	
+	/// Rewind to an earlier length (used to drop a partially written item)
+	void truncate(size_t length);
+
+private:
+	uint8_t* buffer;
+	size_t capacity;
+	size_t length;
+	bool overflowed;
+	
+	/// Write a major type with its argument in the shortest encoding
+	void writeHead(uint8_t majorType, uint64_t argument);
+	
+	/// Append raw bytes, tracking overflow
+	void writeBytes(const uint8_t* data, size_t size);
+	void writeByte(uint8_t value);
+};
+
+#endif /// CBORWRITER_H
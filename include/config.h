@@ -6,6 +6,8 @@
 #define RELAY_PIN 2
 #define I2C_SDA_PIN 19
 #define I2C_SCL_PIN 22
+#define I2C_CLOCK_HZ 400000      /// Fast mode; VEML7700 supports up to 400 kHz
+#define I2C_MAX_RETRIES 2        /// Retries per sensor transaction before counting a failure
 
 #define WIFI_SSID "YOUR_WIFI_NAME"
 #define WIFI_PASSWORD "YOUR_WIFI_PASSWORD"
@@ -16,6 +18,19 @@
 #define NTP_SERVER "pool.ntp.org"
 #define TIMEZONE_OFFSET_HOURS 2  /// Berlin = UTC+1
 #define NTP_UPDATE_INTERVAL_MS 86400000  /// 24 hours
+#define NTP_SERVER_ATTEMPTS 2                 /// Pool addresses tried per sync before waiting for the next retry
+#define DNS_CACHE_MAX_ADDRESSES 4             /// Addresses kept per lookup; pool.ntp.org answers with 4
+#define DNS_CACHE_MIN_TTL_S 60                /// Floor for TTLs, against answers with TTL 0
+#define DNS_CACHE_MAX_TTL_S 86400             /// Ceiling for TTLs, so a pool change reaches us within a day
+#define DNS_QUERY_TIMEOUT_MS 2000             /// Wait this long for the DNS server's answer
+
+/// Local SNTP Time Master (the other units set NTP_SERVER to the master's IP address)
+#define SNTP_SERVER_ENABLED 0                 /// 1 = answer SNTP requests on UDP port 123 once synced
+#define SNTP_SERVER_STRATUM 3                 /// Advertised stratum; pool servers are usually stratum 2
+#define SNTP_MASTER_SYNC_INTERVAL_MS 3600000  /// The master syncs hourly, so crystal drift stays in the tens of ms
+#define SNTP_MAX_SYNC_AGE_MS 21600000         /// Stop answering when our last sync is older than 6 hours
+#define SNTP_CLOCK_ERROR_MS 500               /// Our error right after a sync; NTPClient keeps whole seconds
+#define SNTP_MAX_REQUESTS_PER_POLL 4          /// Requests answered per idle poll; more wait in the socket
 
 /// Plant Light Schedule (24-hour format)
 #define LIGHT_START_HOUR 8
@@ -25,6 +40,114 @@
 #define LIGHT_THRESHOLD_LUX 100.0  /// Turn on lights below this level
 #define SENSOR_SAMPLES 5           /// Number of readings to average
 #define CHECK_INTERVAL_MS 30000    /// Check every 30 seconds
+#define SENSOR_READ_INTERVAL_MS 2000  /// Sensor updates every 2 seconds
+#define LOOP_DELAY_MS 500             /// Main loop pacing delay
+
+/// Sensor Power Configuration (VEML7700 datasheet, typical values)
+#define SENSOR_ACTIVE_CURRENT_UA 45.0    /// Supply current while converting
+#define SENSOR_SHUTDOWN_CURRENT_UA 0.5   /// Supply current in shutdown
+#define SENSOR_WAKEUP_TIME_MS 3          /// Time from power-on to start of conversion
+
+/// Spectral Daylight Estimation (ALS/WHITE channel ratio)
+/// Calibrate by logging the ratio in pure daylight and with only our lamps on
+#define SPECTRAL_DAYLIGHT_ENABLED 1       /// Ignore our own lamp light while the relay is on
+#define DAYLIGHT_ALS_WHITE_RATIO 0.60     /// Sunlight: strong red/IR raises the WHITE channel
+#define LAMP_ALS_WHITE_RATIO 0.90         /// LED lamps: little IR, ALS close to WHITE
+#define SPECTRAL_RATIO_SMOOTHING_SHIFT 3  /// EMA weight 1/8 per sample
+
+/// Sensor Recovery Configuration
+#define SENSOR_MAX_CONSECUTIVE_FAILURES 3     /// Failed reads before we re-probe the sensor
+#define SENSOR_CONFIG_VERIFY_READINGS 30      /// Verify sensor configuration every N readings
+#define SENSOR_RECOVERY_BACKOFF_MS 1000       /// First retry delay after sensor loss
+#define SENSOR_RECOVERY_MAX_BACKOFF_MS 60000  /// Cap for exponential recovery backoff
+#define SENSOR_RESTART_AFTER_MS 1800000       /// Restart only after 30 minutes without recovery
+
+/// Raw Sample Streaming (calibration captures, record with tools/sensor_capture.py)
+#define STREAM_BAUD_RATE 921600               /// UART rate while a stream runs
+#define STREAM_MAX_DURATION_S 3600            /// Longest stream we start; streams always stop themselves
+
+/// Daily Summary Configuration
+#define DAILY_SUMMARY_DAYS 365                /// Days kept in the flash ring
+#define DAILY_SUMMARY_CHECKPOINT_MS 900000    /// Save the running day every 15 minutes
+#define LUX_TO_PPFD 0.0185                    /// umol/m2/s per lux (sunlight approximation)
+
+/// Telemetry Configuration (MQTT)
+#define TELEMETRY_ENABLED 1
+#define MQTT_BROKER_HOST "192.168.1.10"
+#define MQTT_BROKER_PORT 1883
+#define MQTT_TOPIC_PREFIX "plantlight"
+#define MQTT_KEEPALIVE_S 60
+#define MQTT_QOS 1                            /// 0 = fire and forget, 1 = acknowledged
+#define MQTT_MAX_INFLIGHT 2                   /// Unacknowledged QoS 1 messages on the wire
+#define MQTT_ACK_TIMEOUT_MS 10000             /// Retransmit if no PUBACK within this time
+#define TELEMETRY_BATCH_INTERVAL_MS 60000     /// One message per minute
+#define TELEMETRY_QUEUE_DEPTH 8               /// Outbound messages kept while the broker is unreachable
+#define TELEMETRY_MAX_PAYLOAD 768             /// Bytes per CBOR message
+#define TELEMETRY_SPOOL_SLOTS 256             /// Messages kept in flash while offline (~4 h, 194 KB)
+#define TELEMETRY_FLUSH_MAX_BYTES 4096        /// Largest backlog batch published at once
+#define TELEMETRY_FLUSH_INTERVAL_MS 1000      /// Pause between acknowledged backlog batches
+#define MQTT_TLS_ENABLED 0                    /// 1 = connect to the broker over TLS
+#define MQTT_TLS_PORT 8883
+#define MQTT_TLS_CA_CERT_PATH "/mqtt_ca.pem"  /// CA certificate for the broker, PEM in LittleFS
+#define TLS_HANDSHAKE_TIMEOUT_MS 15000        /// Give up on a handshake after this long
+#define TLS_WRITE_TIMEOUT_MS 5000             /// Give up on a write the socket does not take
+
+/// HTTP Configuration
+#define HTTP_ENABLED 1
+#define HTTP_PORT 80
+#define HTTP_REQUEST_TIMEOUT_MS 2000          /// Drop clients that do not finish their request
+#define HTTP_POLL_INTERVAL_MS 10              /// Worst-case wait before a request is picked up
+#define HTTP_RECORDS_PER_POLL 16              /// History slots read per poll, empty ones included
+#define HTTP_POINTS_PER_POLL 64               /// Rollup points streamed per poll
+#define HTTP_EXPORT_SLICE_US 4000             /// Longest export slice per poll; the loop runs in between
+#define HTTP_ASSET_BYTES_PER_POLL 2048        /// Dashboard file bytes sent per poll
+#define HTTP_SEND_BACKLOG_SIZE 6144           /// Response bytes held for a slow client; fits the largest metrics group
+#define HTTP_SEND_STALL_MS 5000               /// Drop a client that takes none of our response for this long
+#define HTTP_ASSET_MAX_AGE_S 31536000         /// Browser cache lifetime of versioned dashboard files (1 year)
+#define WS_MAX_CLIENTS 4                      /// Dashboards connected to /ws at once
+#define WS_CLIENT_MIN_INTERVAL_MS 500         /// Fastest live update rate per dashboard
+
+/// Time-Series Store Configuration
+#define TSDB_ENABLED 1
+#define TSDB_BLOCK_SIZE 2048                  /// Compressed block, appended to flash in one write
+#define TSDB_SEGMENT_BLOCKS 32                /// Blocks per segment file (64 KB)
+#define TSDB_MIN_FREE_BYTES 131072            /// Oldest segments are deleted to keep this much flash free
+#define TSDB_LUX_MANTISSA_BITS 10             /// Float mantissa bits kept for lux (~0.1% resolution)
+#define TSDB_INDEX_SEGMENTS 64                /// Segments per series tracked by the RAM index
+#define TSDB_QUERY_BLOCKS_PER_POLL 2          /// Blocks decoded per HTTP poll by range queries
+#define TSDB_FLUSH_INTERVAL_MS 3600000        /// Longest a sample waits in RAM before its open block is checkpointed
+
+/// Rollup Configuration (RAM, lost on restart)
+#define ROLLUP_MINUTE_SLOTS 360               /// 6 hours at 1 minute
+#define ROLLUP_QUARTER_SLOTS 672              /// 7 days at 15 minutes
+#define ROLLUP_HOUR_SLOTS 720                 /// 30 days at 1 hour
+
+/// OTA Configuration
+#define OTA_ENABLED 1
+#define OTA_SERVER_HOST "192.168.1.10"
+#define OTA_SERVER_PORT 8070
+#define OTA_CHECK_INTERVAL_MS 21600000        /// Ask the update server every 6 hours
+#define OTA_READ_TIMEOUT_MS 15000             /// Abort a download that stalls this long
+#define OTA_CONFIRM_AFTER_MS 60000            /// Healthy run time before a new image is confirmed
+#define OTA_CONFIRM_TIMEOUT_MS 600000         /// Roll back if a new image is not confirmed in time
+#define OTA_MAX_BOOT_ATTEMPTS 3               /// Roll back after this many unconfirmed boots
+
+/// Logging Configuration
+#define SERIAL_BAUD_RATE 115200               /// Console UART rate
+#define LOG_LEVEL 3                           /// Highest level compiled in: 0 off, 1 error, 2 warn, 3 info, 4 debug
+#define LOG_RING_SLOTS 64                     /// Buffered messages, must be a power of two
+#define LOG_SLOT_SIZE 122                     /// Longest message in bytes; longer ones are truncated
+#define LOG_DRAIN_INTERVAL_MS 20              /// Drain task sleep when the ring is empty
+#define LOG_BINARY 0                          /// 1 = compact binary frames, decode with tools/log_decoder.py
+
+/// Remote Syslog Configuration (text logging only)
+#define SYSLOG_ENABLED 0                      /// 1 = also forward log messages over UDP
+#define SYSLOG_HOST "192.168.1.10"            /// Collector IP address; no DNS lookup in the log path
+#define SYSLOG_PORT 514
+#define SYSLOG_HOSTNAME "plantlight"          /// HOSTNAME field of every message
+#define SYSLOG_FACILITY 16                    /// local0
+#define SYSLOG_MAX_DATAGRAM 1232              /// Bytes per batch; stays below the path MTU, so no fragments
+#define SYSLOG_BATCH_INTERVAL_MS 1000         /// Longest a message waits for its batch to fill
 
 /// Safety Configuration
 #define MIN_SWITCH_INTERVAL_MS 60000  /// Minimum 1 minute between relay switches
@@ -0,0 +1,134 @@
+///
+/// DailySummary - Compact per-day history kept in flash for a year
+/// 
+/// We accumulate lamp time, switching, light statistics and health
+/// counters incrementally while the controller runs, and write one
+/// 32-byte record per day into a fixed ring file on LittleFS. The ring
+/// has one slot per day of the year, so reading the full history is a
+/// single sequential read of the file.
+///
+
+#ifndef DAILYSUMMARY_H
+#define DAILYSUMMARY_H
+
+#include <Arduino.h>
+#include <FS.h>
+#include "timemanager.h"
+#include "lightsensor.h"
+#include "relaycontroller.h"
+#include "plantcontroller.h"
+
+/// One day of history as stored in flash (little-endian, 32 bytes)
+struct __attribute__((packed)) DailySummaryRecord {
+	uint32_t day;              /// Local days since 1970-01-01 (0 = empty slot)
+	uint16_t lampOnMinutes;    /// Minutes with the relay on
+	uint16_t switchCount;      /// Relay state changes
+	float minLux;              /// Lowest sensor reading
+	float maxLux;              /// Highest sensor reading
+	float meanLux;             /// Mean of all sensor readings
+	uint16_t dliCentimol;      /// Estimated daily light integral in 0.01 mol/m2/day
+	uint16_t noTimeMinutes;    /// Minutes without valid NTP time
+	uint16_t sensorErrors;     /// Failed sensor bus transactions
+	uint16_t sampleCount;      /// Sensor readings folded into the statistics
+	uint8_t version;           /// Record layout version
+	uint8_t flags;             /// DAILY_FLAG_* bits
+	uint16_t checksum;         /// CRC-16/CCITT over the preceding 30 bytes
+};
+
+static_assert(sizeof(DailySummaryRecord) == 32, "DailySummaryRecord must stay 32 bytes");
+
+/// Record flags
+static constexpr uint8_t DAILY_FLAG_IN_PROGRESS = 0x01;  /// Day not finished yet (checkpoint)
+static constexpr uint8_t DAILY_FLAG_PARTIAL = 0x02;      /// Controller was not running the whole day
+
+class DailySummary {
+public:
+	DailySummary(TimeManager* timeManager, LightSensor* lightSensor,
+				RelayController* relayController, PlantController* plantController);
+	
+	/// Open (and if needed create) the ring file and resume today's record
+	/// We expect LittleFS to be mounted already
+	void begin();
+	
+	/// Integrate lamp and time-validity durations, handle day rollover and checkpoints
+	/// We call this on every loop iteration; it does no flash I/O except at boundaries
+	void update();
+	
+	/// Write today's record to flash now instead of at the next checkpoint
+	/// We call this before a restart so the day's aggregates survive it
+	void checkpoint();
+	
+	/// Fold a new sensor reading into today's light statistics
+	void addSample(float lux);
+	
+	/// Get the record being accumulated for today
+	[[nodiscard]] DailySummaryRecord getCurrentRecord() const;
+	
+	/// Read up to maxRecords stored days in slot order with one sequential read
+	/// Returns number of valid records copied (empty or corrupt slots are skipped)
+	[[nodiscard]] size_t readHistory(DailySummaryRecord* records, size_t maxRecords) const;
+	
+	/// Open the ring file for a walk over all slots starting at firstSlot (0 - DAILY_SUMMARY_DAYS-1)
+	/// We use this to stream history record by record without reopening the file
+	[[nodiscard]] File openHistory(size_t firstSlot) const;
+	
+	/// Read the next slot of a walk from openHistory(), wrapping at the end of the ring
+	/// Returns false for empty or corrupt slots
+	[[nodiscard]] bool readNextRecord(File& file, DailySummaryRecord& record) const;
+	
+	/// Get the path of the ring file for direct streaming
+	[[nodiscard]] static const char* getStoragePath();
+	
+	/// Get number of records written since startup
+	[[nodiscard]] unsigned long getRecordsWritten() const;
+	
+	/// Check if the ring file was opened and can take records
+	[[nodiscard]] bool isStorageReady() const;
+
+private:
+	TimeManager* timeManager;
+	LightSensor* lightSensor;
+	RelayController* relayController;
+	PlantController* plantController;
+	
+	/// Running accumulators for the current day
+	unsigned long currentDay;
+	unsigned long lampOnMs;
+	unsigned long noTimeMs;
+	unsigned long lastUpdateTime;
+	unsigned long lastSampleTime;
+	unsigned long lastCheckpointTime;
+	unsigned long relayChangesAtDayStart;
+	unsigned long sensorErrorsAtDayStart;
+	unsigned long resumedSwitches;
+	unsigned long resumedSensorErrors;
+	float minLux;
+	float maxLux;
+	double luxSum;
+	double photonSum;          /// Integrated PPFD in umol/m2
+	uint32_t sampleCount;
+	uint8_t flags;
+	unsigned long recordsWritten;
+	bool storageReady;
+	
+	/// Start a fresh day, carrying counter baselines forward
+	void startDay(unsigned long day);
+	
+	/// Load a checkpoint of today's record from flash, if one exists
+	void resumeDay(unsigned long day);
+	
+	/// Write the current record into its ring slot
+	void writeRecord(bool inProgress);
+	
+	/// Read one slot from the ring, returning false if empty or corrupt
+	[[nodiscard]] bool readSlot(unsigned long day, DailySummaryRecord& record) const;
+	
+	/// Compute the record checksum
+	[[nodiscard]] static uint16_t computeChecksum(const DailySummaryRecord& record);
+	
+	/// Get the current sensor error counter and relay change counter
+	[[nodiscard]] unsigned long getSensorErrorTotal() const;
+	[[nodiscard]] unsigned long getRelayChangeTotal() const;
+};
+
+#endif /// DAILYSUMMARY_H
@@ -0,0 +1,100 @@
+///
+/// DnsCache - Addresses of one hostname kept for their DNS TTL
+/// 
+/// We send our own DNS query for A records to the DNS server DHCP gave us
+/// and keep every address in the answer until the shortest TTL runs out.
+/// That matters for pools like pool.ntp.org, which answer with several
+/// servers: lwIP's resolver would give us a single address and hide the
+/// TTL. When a server does not answer, rotate() moves on to the next
+/// address without another lookup.
+///
+/// The address that last worked is kept in NVS. After a reboot, or while
+/// DNS itself is failing, we can still reach that server.
+///
+/// A hostname that is already a dotted quad is used as is, without any
+/// lookup.
+///
+
+#ifndef DNSCACHE_H
+#define DNSCACHE_H
+
+#include <Arduino.h>
+#include <WiFi.h>
+#include <WiFiUdp.h>
+#include <Preferences.h>
+#include "config.h"
+#include "latencyhistogram.h"
+
+class DnsCache {
+public:
+	static constexpr int MAX_ADDRESSES = DNS_CACHE_MAX_ADDRESSES;
+	
+	/// namespaceName identifies the NVS namespace that keeps the last good address
+	DnsCache(const char* hostname, const char* namespaceName);
+	
+	/// Load the last good address from NVS
+	void begin();
+	
+	/// Resolve again if the cached addresses have expired
+	/// Blocks for up to DNS_QUERY_TIMEOUT_MS; returns false if no address is known at all
+	[[nodiscard]] bool refresh();
+	
+	/// Get the address to use now; the last good one if nothing is cached
+	/// Returns false when there is no address at all
+	[[nodiscard]] bool getAddress(IPAddress& address) const;
+	
+	/// Report that the current address answered; it becomes the last good one
+	void markGood();
+	
+	/// Move to the next cached address after the current one failed
+	void rotate();
+	
+	/// Get number of cached addresses (0 when only the last good one is known)
+	[[nodiscard]] int getAddressCount() const;
+	
+	/// Get seconds until the cached addresses expire, 0 if expired
+	[[nodiscard]] unsigned long getSecondsToExpiry() const;
+	
+	/// Get lookup counters since startup
+	[[nodiscard]] unsigned long getLookupCount() const;
+	[[nodiscard]] unsigned long getLookupFailures() const;
+	
+	/// Get number of times we moved on to another address
+	[[nodiscard]] unsigned long getRotationCount() const;
+	
+	/// Get DNS query round trip times
+	[[nodiscard]] const LatencyHistogram& getLookupLatency() const;
+
+private:
+	const char* hostname;
+	const char* namespaceName;
+	Preferences preferences;
+	
+	IPAddress addresses[MAX_ADDRESSES];
+	int addressCount;
+	int currentIndex;
+	unsigned long resolvedAt;             /// millis() of the last successful lookup
+	unsigned long ttlMs;
+	IPAddress lastGood;
+	bool hasLastGood;
+	
+	/// Statistics
+	unsigned long lookupCount;
+	unsigned long lookupFailures;
+	unsigned long rotationCount;
+	LatencyHistogram lookupLatency;
+	
+	/// Send one A query and wait for the answer; fills addresses on success
+	[[nodiscard]] bool resolve();
+	
+	/// Encode the query; returns its length or 0 if the name does not fit
+	[[nodiscard]] size_t buildQuery(uint8_t* packet, size_t capacity, uint16_t id) const;
+	
+	/// Parse an answer to our query into addresses and ttlMs
+	[[nodiscard]] bool parseResponse(const uint8_t* packet, size_t length, uint16_t id);
+	
+	/// Skip a possibly compressed name; returns the offset after it or 0 if malformed
+	[[nodiscard]] static size_t skipName(const uint8_t* packet, size_t length, size_t offset);
+};
+
+#endif /// DNSCACHE_H
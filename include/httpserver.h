@@ -0,0 +1,277 @@
+///
+/// HttpServer - Zero-allocation HTTP status and control endpoint
+/// 
+/// We serve a handful of JSON endpoints from the control loop without
+/// String concatenation or heap use. Requests are read into a fixed
+/// buffer and responses are formatted straight into a fixed send buffer
+/// from the live component state. Long responses are streamed a few
+/// records per poll so the control loop never waits on a slow client.
+///
+/// Endpoints:
+///   GET  /api/status    Current snapshot of sensor, relay and control state
+///   GET  /api/counters  Monotonic counters for all components
+///   GET  /api/history   Daily summary records, oldest first
+///   GET  /api/profile   Hourly lux quantile sketches as the binary image that
+///                       tools/merge_lux_profiles.py merges across controllers
+///   POST /api/override  Body "automatic=false" or {"automatic":false}
+///   GET  /api/range     ?series=lux|relay|decision&from=&to= (local epoch seconds)
+///                       summary of stored samples in the range
+///   GET  /api/rollup    ?res=1m|15m|1h[&from=&to=] aggregated lux and relay on-time,
+///                       as [start, min, max, mean, count, relay_on_s] rows
+///   GET  /api/export    ?series=lux|relay|decision[&from=&to=][&format=csv|blocks]
+///                       stored samples as CSV, or the compressed blocks as stored,
+///                       each sent as header + timestamp column + value column bytes
+///   POST /api/ota       Check the update server for new firmware now
+///   POST /api/stream    ?seconds=N streams raw sensor samples over serial, 0 stops
+///   GET  /metrics       Prometheus text exposition of counters and latencies
+///   GET  /              Dashboard page; its files are sent gzip-compressed from flash
+///                       with strong ETags, and If-None-Match is answered with 304
+///   GET  /ws            WebSocket upgrade; the connection is handed to LiveUpdates
+///
+
+#ifndef HTTPSERVER_H
+#define HTTPSERVER_H
+
+#include <Arduino.h>
+#include <WiFi.h>
+#include "config.h"
+#include "responsewriter.h"
+#include "latencyhistogram.h"
+#include "looptimings.h"
+#include "wifimanager.h"
+#include "timemanager.h"
+#include "lightsensor.h"
+#include "relaycontroller.h"
+#include "plantcontroller.h"
+#include "dailysummary.h"
+#include "luxprofile.h"
+#include "telemetrypublisher.h"
+#include "timeseriesstore.h"
+#include "timeseriesquery.h"
+#include "luxrollups.h"
+#include "otaupdater.h"
+#include "webassets.h"
+#include "liveupdates.h"
+#include "sntpserver.h"
+
+enum class HttpState {
+	Idle,            /// Waiting for a client
+	ReadingRequest,  /// Collecting request line, headers and body
+	Streaming,       /// Sending a long response across several polls
+	Draining         /// Response complete, waiting for the socket to take its tail
+};
+
+enum class HttpStream {
+	None,
+	History,
+	Metrics,
+	Range,
+	Rollup,
+	Export,
+	Asset,
+	Profile
+};
+
+class HttpServer {
+public:
+	static constexpr size_t REQUEST_BUFFER_SIZE = 1024;  /// Browsers send 500-800 bytes of headers
+	static constexpr size_t SEND_BUFFER_SIZE = 1024;
+	
+	HttpServer(WiFiManager* wifiManager, TimeManager* timeManager, LightSensor* lightSensor,
+			RelayController* relayController, PlantController* plantController);
+	
+	/// Attach optional data sources once they exist
+	void attachHistory(DailySummary* dailySummary);
+	void attachProfile(const LuxProfile* luxProfile);
+	void attachTelemetry(TelemetryPublisher* telemetryPublisher);
+	void attachLoopTimings(const LoopTimings* loopTimings);
+	void attachTimeSeries(TimeSeriesStore* timeSeriesStore);
+	void attachRollups(const LuxRollups* luxRollups);
+	void attachOta(OtaUpdater* otaUpdater);
+	void attachLiveUpdates(LiveUpdates* liveUpdates);
+	void attachSntpServer(const SntpServer* sntpServer);
+	
+	/// Start listening
+	void begin();
+	
+	/// Make progress on the current request; never blocks on a client
+	/// Call this frequently - it bounds how long a request waits
+	void poll();
+	
+	/// Check if a long response is being streamed or drained, so poll() has work every time
+	[[nodiscard]] bool isStreamingResponse() const;
+	
+	/// Get number of requests answered
+	[[nodiscard]] unsigned long getRequestCount() const;
+	
+	/// Get number of requests answered with 4xx/5xx or dropped
+	[[nodiscard]] unsigned long getErrorCount() const;
+	
+	/// Get number of clients dropped for not finishing their request
+	[[nodiscard]] unsigned long getTimeoutCount() const;
+	
+	/// Get number of manual override requests accepted
+	[[nodiscard]] unsigned long getOverrideCount() const;
+	
+	/// Get number of dashboard files sent, and of those answered with 304 instead
+	[[nodiscard]] unsigned long getAssetCount() const;
+	[[nodiscard]] unsigned long getNotModifiedCount() const;
+	
+	/// Get total response bytes sent
+	[[nodiscard]] unsigned long getBytesSent() const;
+	
+	/// Get request handling latency (request received to response sent)
+	[[nodiscard]] const LatencyHistogram& getRequestLatency() const;
+
+private:
+	WiFiManager* wifiManager;
+	TimeManager* timeManager;
+	LightSensor* lightSensor;
+	RelayController* relayController;
+	PlantController* plantController;
+	DailySummary* dailySummary;
+	const LuxProfile* luxProfile;
+	TelemetryPublisher* telemetryPublisher;
+	const LoopTimings* loopTimings;
+	TimeSeriesStore* timeSeriesStore;
+	TimeSeriesQuery* query;
+	const LuxRollups* luxRollups;
+	OtaUpdater* otaUpdater;
+	LiveUpdates* liveUpdates;
+	const SntpServer* sntpServer;
+	
+	WiFiServer server;
+	WiFiClient client;
+	HttpState state;
+	
+	/// Request being read
+	char requestBuffer[REQUEST_BUFFER_SIZE + 1];
+	size_t requestLength;
+	unsigned long requestStartTime;
+	
+	/// Response being written, and what the socket has not taken of it yet
+	uint8_t sendBuffer[SEND_BUFFER_SIZE];
+	uint8_t sendBacklog[HTTP_SEND_BACKLOG_SIZE];
+	ResponseWriter writer;
+	unsigned long handlingStartMicros;
+	
+	/// Streaming progress
+	HttpStream stream;
+	size_t streamStart;
+	size_t streamCursor;
+	bool streamFirstItem;
+	
+	/// Range query accumulators
+	unsigned long rangeCount;
+	double rangeSum;
+	double rangeMin;
+	double rangeMax;
+	uint32_t rangeFirst;
+	uint32_t rangeLast;
+	unsigned long rangeStartMicros;
+	bool rangeIsFloat;
+	
+	/// Rollup stream parameters
+	RollupResolution rollupResolution;
+	uint32_t rollupTo;
+	
+	/// Export stream parameters
+	TimeSeries exportSeries;
+	bool exportBlocks;
+	
+	/// History ring being streamed, open for the whole response
+	File historyFile;
+	
+	/// Dashboard file being sent
+	const WebAsset* asset;
+	
+	/// Query string of the current request (after '?'), empty if none
+	const char* requestQuery;
+	
+	/// Header lines of the current request, each starting with CRLF
+	const char* requestHeaders;
+	
+	/// Statistics
+	unsigned long requestCount;
+	unsigned long errorCount;
+	unsigned long timeoutCount;
+	unsigned long overrideCount;
+	unsigned long assetCount;
+	unsigned long notModifiedCount;
+	LatencyHistogram requestLatency;
+	
+	/// Accept a waiting client if we are idle
+	void acceptClient();
+	
+	/// Read available bytes; returns true once the full request is buffered
+	[[nodiscard]] bool readRequest();
+	
+	/// Route a complete request to its handler
+	void dispatch();
+	
+	/// Endpoint handlers
+	void handleStatus();
+	void handleCounters();
+	void handleHistory();
+	void handleProfile();
+	void handleOverride(const char* body);
+	void handleOta();
+	void handleStream();
+	void handleMetrics();
+	void handleRange();
+	void handleRollup();
+	void handleExport();
+	void handleAsset(const WebAsset* asset);
+	void handleWebSocket();
+	
+	/// Write one rollup row as a JSON array
+	void writeRollupRow(uint32_t start, const RollupBucket& bucket);
+	
+	/// Write the summary of a finished range query
+	void finishRange();
+	
+	/// Write one stored sample as a CSV row
+	void writeExportRow(uint32_t timestamp, uint32_t value);
+	
+	/// Send the next time slice of an export; returns false once it is complete
+	[[nodiscard]] bool continueExport();
+	
+	/// Read the series query parameter (lux if absent); sends 400 and returns false if unknown
+	[[nodiscard]] bool parseSeriesParameter(TimeSeries& series);
+	
+	/// Write one group of metrics; returns false once all groups are written
+	[[nodiscard]] bool writeMetricsSection(size_t section);
+	
+	/// Write a single-sample gauge or counter with its HELP and TYPE lines
+	void writeMetric(const char* name, const char* type, const char* help, double value);
+	
+	/// Write HELP and TYPE lines for a histogram family
+	void writeHistogramHeader(const char* name, const char* help);
+	
+	/// Write one latency histogram as cumulative buckets in seconds
+	void writeHistogram(const char* name, const char* label, const LatencyHistogram& histogram);
+	
+	/// Send the next slice of a streamed response
+	void continueStream();
+	
+	/// Send a small JSON error body
+	void sendError(int statusCode, const char* message);
+	
+	/// Close the connection and record statistics
+	/// A successful response still in the backlog is left to poll() to drain first
+	void finishRequest(bool success);
+	
+	/// Find the Content-Length header value, 0 if absent
+	[[nodiscard]] size_t parseContentLength(const char* headers) const;
+	
+	/// Copy a request header value; returns false if it is missing or does not fit
+	[[nodiscard]] static bool getHeader(const char* headers, const char* name, char* value, size_t size);
+	
+	/// Copy a query string parameter value; returns false if it is missing
+	[[nodiscard]] static bool getQueryParameter(const char* query, const char* key, char* value, size_t size);
+	
+	/// Parse an override body; returns false if no boolean was found
+	[[nodiscard]] static bool parseAutomaticFlag(const char* body, bool& automatic);
+};
+
+#endif /// HTTPSERVER_H
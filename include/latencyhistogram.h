@@ -0,0 +1,58 @@
+///
+/// LatencyHistogram - Fixed-size latency distribution tracking
+/// 
+/// We record durations into power-of-two microsecond buckets so that
+/// recording is constant time and the memory footprint never grows.
+/// This lets us watch bus transactions and loop timing over weeks
+/// without any allocation on the hot path.
+///
+
+#ifndef LATENCYHISTOGRAM_H
+#define LATENCYHISTOGRAM_H
+
+#include <Arduino.h>
+
+class LatencyHistogram {
+public:
+	/// Bucket i counts samples below (FIRST_BUCKET_US << i); the last bucket is open-ended
+	static constexpr int BUCKET_COUNT = 16;
+	static constexpr unsigned long FIRST_BUCKET_US = 16;
+	
+	LatencyHistogram();
+	
+	/// Record one duration in microseconds
+	void record(unsigned long durationUs);
+	
+	/// Clear all buckets and summary values
+	void reset();
+	
+	/// Get number of recorded samples
+	[[nodiscard]] unsigned long getCount() const;
+	
+	/// Get smallest, largest and mean recorded duration in microseconds
+	[[nodiscard]] unsigned long getMin() const;
+	[[nodiscard]] unsigned long getMax() const;
+	[[nodiscard]] unsigned long getMean() const;
+	
+	/// Get sum of all recorded durations in microseconds
+	[[nodiscard]] uint64_t getSum() const;
+	
+	/// Get sample count of a single bucket
+	[[nodiscard]] unsigned long getBucketCount(int bucket) const;
+	
+	/// Get the exclusive upper bound of a bucket in microseconds (ULONG_MAX for the last)
+	[[nodiscard]] static unsigned long getBucketUpperBound(int bucket);
+	
+	/// Estimate a percentile (0-100) as the upper bound of the bucket containing it
+	/// We accept the bucket resolution since we only need to spot trends
+	[[nodiscard]] unsigned long getPercentile(int percentile) const;
+
+private:
+	unsigned long buckets[BUCKET_COUNT];
+	unsigned long count;
+	uint64_t sum;
+	unsigned long minValue;
+	unsigned long maxValue;
+};
+
+#endif /// LATENCYHISTOGRAM_H
@@ -3,8 +3,20 @@
 /// 
 /// We implement smoothing and averaging to get stable light readings
 /// despite potential noise or rapid changes in ambient conditions.
-/// The sensor provides calibrated lux values which we can directly
-/// compare against meaningful thresholds.
+/// Samples are kept as raw ALS counts and thresholds are converted to
+/// counts once, so decisions stay in integer arithmetic; lux values are
+/// only computed when someone asks for them.
+///
+/// For calibration we can stream every raw ALS/WHITE pair at the fastest
+/// integration time. A task of its own samples the sensor and queues each
+/// pair as a packet with the logger, which owns the UART and switches to
+/// COBS framing at STREAM_BAUD_RATE while the stream runs. Packets are 21
+/// bytes, little endian:
+///   'S', uint32 sequence, uint32 micros(), uint16 ALS, uint16 WHITE,
+///   uint16 integration ms, float lux per count, CRC-16/CCITT-FALSE
+/// The sequence advances for every sampling period, so a gap on the host
+/// means a lost sample. The I2C bus is shared with the control loop under
+/// a mutex, and the loop keeps deciding on the coarser 25 ms counts.
 ///
 
 #ifndef LIGHTSENSOR_H
@@ -12,6 +24,28 @@
 
 #include <Arduino.h>
 #include <Adafruit_VEML7700.h>
+#include <freertos/semphr.h>
+#include "latencyhistogram.h"
+
+/// Sensor power modes, from highest to lowest average current
+/// PowerSave modes let the sensor sleep 0.5/1/2/4 s between conversions,
+/// Shutdown powers it down between our reads and wakes it just in time
+enum class SensorPowerMode {
+	Continuous,
+	PowerSave1,
+	PowerSave2,
+	PowerSave3,
+	PowerSave4,
+	Shutdown
+};
+
+/// Averaged light compared with a threshold
+/// Unknown while the averaging window is empty, at startup and after a sensor reset
+enum class LightLevel {
+	Unknown,
+	Below,
+	AtOrAbove
+};
 
 class LightSensor {
 public:
@@ -22,6 +56,27 @@ public:
 	/// We configure gain and integration time for indoor plant lighting scenarios
 	[[nodiscard]] bool begin();
 	
+	/// Tell the sensor how often updateReading() will be called
+	/// We pick the lowest-current power mode that still delivers a fresh conversion per read
+	void setSamplingInterval(unsigned long intervalMs);
+	
+	/// Handle sensor power timing; call on every loop iteration
+	/// In Shutdown mode we wake the sensor so a conversion completes right before the next read
+	void service();
+	
+	/// Get the power mode currently in use
+	[[nodiscard]] SensorPowerMode getPowerMode() const;
+	
+	/// Get a short name for a power mode
+	[[nodiscard]] static const char* getPowerModeString(SensorPowerMode mode);
+	
+	/// Estimate average sensor supply current in microamps for a power mode
+	/// We derive this from the conversion duty cycle at the current sampling interval
+	[[nodiscard]] float estimateSupplyCurrent(SensorPowerMode mode) const;
+	
+	/// Estimate average sensor supply current in microamps for the active mode
+	[[nodiscard]] float getEstimatedSupplyCurrent() const;
+	
 	/// Take a new sensor reading and update internal average
 	/// Returns true if reading was successful, false if sensor error
 	[[nodiscard]] bool updateReading();
@@ -34,9 +89,40 @@ public:
 	/// We provide this for diagnostics and calibration purposes
 	[[nodiscard]] float getLastRawLux() const;
 	
-	/// Check if current light level is below the configured threshold
+	/// Get the most recent reading as raw ALS counts
+	[[nodiscard]] uint16_t getLastRawCounts() const;
+	
+	/// Get the smoothed light level as raw ALS counts
+	[[nodiscard]] uint16_t getAverageCounts() const;
+	
+	/// Get the most recent WHITE channel reading as raw counts
+	[[nodiscard]] uint16_t getLastWhiteCounts() const;
+	
+	/// Get the smoothed ALS/WHITE spectral ratio (0 until both channels saw light)
+	/// Sunlight and LED lamps have clearly different ratios, which we use to tell them apart
+	[[nodiscard]] float getSpectralRatio() const;
+	
+	/// Estimate the share of the current light that is daylight (0.0 - 1.0)
+	/// We model the reading as a mix of two sources with the configured calibration ratios
+	[[nodiscard]] float getDaylightFraction() const;
+	
+	/// Get the smoothed light level attributed to daylight in lux
+	[[nodiscard]] float getDaylightLux() const;
+	
+	/// Compare the daylight part of the current light with a threshold
+	/// We use this while our lamps are on so they do not switch themselves off
+	[[nodiscard]] LightLevel compareDaylightToThreshold(float thresholdLux) const;
+	
+	/// Convert a lux value to raw ALS counts for the active gain and integration time
+	[[nodiscard]] uint32_t luxToCounts(float lux) const;
+	
+	/// Convert raw ALS counts to lux for the active gain and integration time
+	[[nodiscard]] float countsToLux(uint32_t counts) const;
+	
+	/// Compare the current light level with the configured threshold
 	/// We use this for the main plant light control decision
-	[[nodiscard]] bool isBelowThreshold(float thresholdLux) const;
+	/// The threshold is converted to counts once and cached, so the comparison is integer-only
+	[[nodiscard]] LightLevel compareToThreshold(float thresholdLux) const;
 	
 	/// Check if sensor is responding and providing valid data
 	/// We use this to detect hardware failures or connection issues
@@ -46,33 +132,209 @@ public:
 	/// We track this to validate sensor reliability over time
 	[[nodiscard]] unsigned long getReadingCount() const;
 	
+	/// Get number of failed reading attempts since initialization
+	[[nodiscard]] unsigned long getFailedReadingCount() const;
+	
 	/// Reset the averaging buffer and statistics
 	/// We use this when we want to start fresh after a configuration change
 	void resetAveraging();
+	
+	/// Check if the sensor is currently lost and waiting for recovery
+	/// We report this separately from health so callers can tell stale data from a dead bus
+	[[nodiscard]] bool isRecovering() const;
+	
+	/// Get number of successful recoveries since startup
+	[[nodiscard]] unsigned long getRecoveryCount() const;
+	
+	/// Get number of recovery attempts since startup (successful or not)
+	[[nodiscard]] unsigned long getRecoveryAttempts() const;
+	
+	/// Get duration of the last successful recovery in milliseconds
+	/// We measure from the first detected failure until the sensor delivered data again
+	[[nodiscard]] unsigned long getLastRecoveryDuration() const;
+	
+	/// Get the longest recovery duration seen since startup in milliseconds
+	[[nodiscard]] unsigned long getLongestRecoveryDuration() const;
+	
+	/// Get how long the sensor has been lost in milliseconds (0 if healthy)
+	[[nodiscard]] unsigned long getTimeSinceFailure() const;
+	
+	/// Check if recovery has failed for so long that only a restart can help
+	/// We keep this conservative so a flaky cable never causes reboot loops
+	[[nodiscard]] bool needsRestart() const;
+	
+	/// Get latency distribution of sensor bus transactions in microseconds
+	/// We use this to keep bus time low and spot a degrading cable early
+	[[nodiscard]] const LatencyHistogram& getTransactionLatency() const;
+	
+	/// Get number of I2C transactions issued to the sensor (including retries)
+	[[nodiscard]] unsigned long getTransactionCount() const;
+	
+	/// Get number of failed I2C transactions
+	[[nodiscard]] unsigned long getTransactionErrors() const;
+	
+	/// Get number of failed transactions for a Wire error code (1-5)
+	/// 2 = address NACK, 3 = data NACK, 5 = timeout; 4 counts short reads
+	[[nodiscard]] unsigned long getTransactionErrors(uint8_t errorCode) const;
+	
+	/// Get number of transactions that succeeded only after a retry
+	[[nodiscard]] unsigned long getTransactionRetries() const;
+	
+	/// Stream raw samples over serial for durationS seconds (capped at STREAM_MAX_DURATION_S)
+	/// Calling it again while streaming only moves the end time
+	[[nodiscard]] bool startStreaming(unsigned long durationS);
+	
+	/// Stop streaming and restore the normal integration time and power mode
+	void stopStreaming();
+	
+	/// Check if a raw sample stream is running
+	[[nodiscard]] bool isStreaming() const;
+	
+	/// Get number of sample packets queued by all streams since startup
+	[[nodiscard]] unsigned long getStreamPacketsSent() const;
+	
+	/// Get number of samples lost by all streams since startup (bus error or log ring full)
+	[[nodiscard]] unsigned long getStreamPacketsDropped() const;
 
 private:
 	Adafruit_VEML7700 veml;
 	
-	/// Circular buffer for averaging light readings
-	float* readingBuffer;
+	/// Circular buffer of raw ALS counts with a running sum for averaging
+	uint16_t* readingBuffer;
 	int bufferSize;
 	int bufferIndex;
 	bool bufferFull;
+	uint32_t bufferSum;
 	
 	/// Current state tracking
-	float currentAverageLux;
-	float lastRawLux;
+	uint16_t lastRawCounts;
+	uint16_t lastWhiteCounts;
+	uint32_t spectralRatioQ8;  /// Smoothed ALS/WHITE ratio in 1/256 units
 	unsigned long readingCount;
+	unsigned long failedReadingCount;
 	unsigned long lastReadingTime;
 	bool sensorInitialized;
 	
-	/// Calculate the current average from the buffer
-	/// We recalculate this each time to handle the circular buffer properly
-	void calculateAverage();
+	/// Failure detection and recovery state
+	int consecutiveFailures;
+	unsigned long failureStartTime;
+	unsigned long lastRecoveryAttempt;
+	unsigned long recoveryBackoff;
+	unsigned long recoveryAttempts;
+	unsigned long recoveryCount;
+	unsigned long lastRecoveryDuration;
+	unsigned long longestRecoveryDuration;
+	
+	/// Active sensor configuration and its lux per raw count
+	uint8_t gainSetting;
+	uint8_t integrationTimeSetting;
+	float luxPerCount;
+	
+	/// Power mode and sampling timing
+	SensorPowerMode powerMode;
+	unsigned long samplingInterval;
+	unsigned long lastReadAttempt;
+	unsigned long wakeTime;
+	bool sensorAwake;
+	
+	/// Threshold pre-converted to counts for the active configuration
+	mutable float cachedThresholdLux;
+	mutable uint32_t cachedThresholdCounts;
+	
+	/// Bus transaction statistics
+	static constexpr int I2C_ERROR_CODES = 6;
+	LatencyHistogram transactionLatency;
+	unsigned long transactionCount;
+	unsigned long transactionErrors[I2C_ERROR_CODES];
+	unsigned long transactionRetries;
+	
+	/// Raw sample streaming state
+	SemaphoreHandle_t busMutex;           /// Recursive; the stream task and the loop share Wire
+	volatile bool streaming;
+	volatile bool streamTaskRunning;
+	unsigned long streamEndTime;
+	uint8_t normalIntegrationTime;
+	SensorPowerMode normalPowerMode;
+	uint32_t streamSequence;
+	volatile unsigned long streamPacketsSent;
+	volatile unsigned long streamPacketsDropped;
+	unsigned long streamSentAtStart;      /// Counters when the current stream started, for its summary
+	unsigned long streamDroppedAtStart;
+	
+	/// Take and release the I2C bus
+	void lockBus();
+	void unlockBus();
+	
+	/// FreeRTOS task entry point for streaming
+	static void streamTaskEntry(void* parameter);
+	void runStreamTask();
+	
+	/// Read one ALS/WHITE pair and queue it as a packet
+	void streamSample();
+	
+	/// Read a 16-bit sensor register with timing, retries and error accounting
+	/// We talk to the sensor directly so every transaction is measured and checked
+	[[nodiscard]] bool readRegister(uint8_t reg, uint16_t& value);
+	
+	/// Issue one timed register read transaction and return the Wire error code
+	uint8_t readRegisterOnce(uint8_t reg, uint16_t& value);
+	
+	/// Write a 16-bit sensor register with timing, retries and error accounting
+	[[nodiscard]] bool writeRegister(uint8_t reg, uint16_t value);
+	
+	/// Build the configuration register word for our gain and integration time
+	[[nodiscard]] uint16_t buildConfigWord(bool shutdown) const;
+	
+	/// Apply the selected power mode to the sensor
+	[[nodiscard]] bool applyPowerMode();
+	
+	/// Power the sensor up or down between reads in Shutdown mode
+	[[nodiscard]] bool setSensorAwake(bool awake);
+	
+	/// Get how long a fresh conversion takes to become available in a power mode
+	[[nodiscard]] unsigned long getRefreshTime(SensorPowerMode mode) const;
+	
+	/// Get how early we must wake the sensor before a read in Shutdown mode
+	[[nodiscard]] unsigned long getWakeLeadTime() const;
+	
+	/// Get the integration time in milliseconds for a register setting
+	[[nodiscard]] static unsigned long integrationTimeToMs(uint8_t integrationTime);
+	
+	/// Compute lux per raw count for the given gain and integration time
+	[[nodiscard]] static float computeLuxPerCount(uint8_t gain, uint8_t integrationTime);
+	
+	/// Apply gain, integration time and enable the sensor
+	/// We share this between first initialization and recovery
+	[[nodiscard]] bool configureSensor();
+	
+	/// Check that the sensor acknowledges its address and still holds our configuration
+	/// A power blip silently resets the VEML7700 to defaults, which this detects
+	[[nodiscard]] bool verifySensor();
+	
+	/// Release a stuck bus by clocking SCL and issuing a STOP, then restart Wire
+	/// Returns true if SDA is released afterwards
+	bool recoverBus();
+	
+	/// Record a failed reading and mark the sensor lost after repeated failures
+	void handleReadFailure();
+	
+	/// Mark the sensor as lost and start the recovery timer
+	void markSensorLost();
+	
+	/// Attempt bus recovery and sensor re-initialization if the backoff has elapsed
+	/// We implement exponential backoff to avoid hammering a dead bus
+	[[nodiscard]] bool attemptRecovery();
+	
+	/// Get number of samples currently held in the buffer
+	[[nodiscard]] int getSampleCount() const;
+	
+	/// Fold a new ALS/WHITE pair into the smoothed spectral ratio
+	/// We use an integer EMA so the filter stays free of float math
+	void updateSpectralRatio(uint16_t alsCounts, uint16_t whiteCounts);
 	
 	/// Add a new reading to the circular buffer
-	/// We manage the buffer index and full state automatically
-	void addToBuffer(float newReading);
+	/// We manage the buffer index, full state and running sum automatically
+	void addToBuffer(uint16_t newReading);
 };
 
 #endif /// LIGHTSENSOR_H
\ No newline at end of file
@@ -0,0 +1,150 @@
+///
+/// LiveUpdates - WebSocket push of live readings to dashboards
+/// 
+/// HttpServer upgrades GET /ws and hands the connection to us, so a
+/// dashboard holds one socket instead of opening a TCP connection per
+/// poll. Whenever a sample is taken or a decision made we encode what
+/// changed since the previous update into one frame and send that same
+/// buffer to every client. Sockets are written without blocking; a
+/// client that is throttled, or whose socket is full, skips updates. We
+/// keep the state it was last sent and, once it may be written again,
+/// send it one delta covering everything it missed. Only a newly
+/// connected client receives a keyframe with the whole state.
+///
+/// Frames are binary WebSocket messages:
+///   flags byte (bit 0: keyframe), field mask byte, then for each field in
+///   the mask, in bit order, zigzag varint (value - previous value); a
+///   keyframe is encoded against an all-zero state, so values are absolute
+/// Fields: 0 lux x10, 1 relay on, 2 decision << 4 | reason, 3 automatic,
+///   4 local epoch seconds, 5 sensor healthy, 6 DLI x100, 7 lamp-on minutes
+///
+
+#ifndef LIVEUPDATES_H
+#define LIVEUPDATES_H
+
+#include <Arduino.h>
+#include <WiFi.h>
+#include "config.h"
+#include "latencyhistogram.h"
+#include "timemanager.h"
+#include "lightsensor.h"
+#include "relaycontroller.h"
+#include "plantcontroller.h"
+#include "dailysummary.h"
+
+class LiveUpdates {
+public:
+	static constexpr int FIELD_COUNT = 8;
+	static constexpr size_t FRAME_SIZE = 4 + FIELD_COUNT * 5;   /// WebSocket header, flags, mask, varints
+	static constexpr size_t INPUT_SIZE = 128;                  /// Largest client frame we accept
+	
+	LiveUpdates(TimeManager* timeManager, LightSensor* lightSensor, RelayController* relayController,
+			PlantController* plantController, DailySummary* dailySummary);
+	
+	/// Check if another client can be accepted
+	[[nodiscard]] bool hasFreeSlot() const;
+	
+	/// Take over an upgraded connection and send it the current state
+	/// Returns false if all client slots are in use
+	[[nodiscard]] bool adopt(const WiFiClient& connection);
+	
+	/// Push what changed since the last update to every client
+	/// Call after a sensor sample or a control decision
+	void publish();
+	
+	/// Answer pings and closes, finish partial writes and catch up skipped clients
+	/// Call this frequently; it never blocks
+	void poll();
+	
+	/// Compute the Sec-WebSocket-Accept value for a client key (29 bytes with the terminator)
+	static void computeAcceptKey(const char* key, char* accept, size_t size);
+	
+	/// Get number of connected clients
+	[[nodiscard]] int getClientCount() const;
+	
+	/// Get update counters since startup
+	[[nodiscard]] unsigned long getUpdateCount() const;
+	[[nodiscard]] unsigned long getFramesSent() const;
+	[[nodiscard]] unsigned long getKeyframesSent() const;
+	[[nodiscard]] unsigned long getFramesSkipped() const;
+	[[nodiscard]] unsigned long getBytesSent() const;
+	[[nodiscard]] unsigned long getConnectionCount() const;
+	
+	/// Get time spent encoding and fanning out each update
+	[[nodiscard]] const LatencyHistogram& getPublishLatency() const;
+
+private:
+	struct LiveState {
+		int32_t fields[FIELD_COUNT];
+	};
+	
+	struct Frame {
+		uint8_t data[FRAME_SIZE];
+		size_t length;
+		unsigned long sequence;           /// Update the frame brings a client to
+	};
+	
+	struct Client {
+		WiFiClient connection;
+		bool active;
+		LiveState state;                  /// State as of the last frame sent to this client
+		unsigned long lastSentAt;
+		uint8_t pending[FRAME_SIZE];      /// Unsent tail of a frame the socket did not take
+		size_t pendingLength;
+		uint8_t input[INPUT_SIZE];
+		size_t inputLength;
+	};
+	
+	TimeManager* timeManager;
+	LightSensor* lightSensor;
+	RelayController* relayController;
+	PlantController* plantController;
+	DailySummary* dailySummary;
+	
+	Client clients[WS_MAX_CLIENTS];
+	LiveState sentState;                  /// State as of the last update
+	unsigned long sequence;
+	Frame delta;
+	Frame keyframe;
+	
+	/// Statistics
+	unsigned long updateCount;
+	unsigned long framesSent;
+	unsigned long keyframesSent;
+	unsigned long framesSkipped;
+	unsigned long bytesSent;
+	unsigned long connectionCount;
+	LatencyHistogram publishLatency;
+	
+	/// Read the current state of all components
+	[[nodiscard]] LiveState captureState() const;
+	
+	/// Encode state against previous as one binary WebSocket message
+	static void encodeFrame(Frame& frame, const LiveState& state, const LiveState& previous, bool isKeyframe);
+	
+	/// Encode the keyframe for the current state unless it is up to date
+	void prepareKeyframe();
+	
+	/// Check if a client may be sent an update now
+	[[nodiscard]] bool isReady(const Client& client, unsigned long now) const;
+	
+	/// Check if a client skipped updates and has not been caught up yet
+	[[nodiscard]] bool isBehind(const Client& client) const;
+	
+	/// Send a client one delta from the state it was last sent to the current one
+	void catchUp(Client& client);
+	
+	/// Send a whole frame; keeps what the socket did not take for poll() to finish
+	void sendFrame(Client& client, const uint8_t* data, size_t length);
+	
+	/// Write without blocking; returns bytes the socket took, drops the client on error
+	size_t writeSocket(Client& client, const uint8_t* data, size_t length);
+	
+	/// Process complete frames from a client; returns false once it should be dropped
+	[[nodiscard]] bool readInput(Client& client);
+	
+	/// Close and free a client slot
+	void dropClient(Client& client);
+};
+
+#endif /// LIVEUPDATES_H
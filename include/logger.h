@@ -0,0 +1,332 @@
+///
+/// Logger - Asynchronous buffered logging with compile-time levels
+/// 
+/// We format each message straight into a slot of a fixed ring and let a
+/// low-priority task write the ring to the UART. A log call costs one
+/// vsnprintf and never waits for the serial port; when the ring is full
+/// the message is dropped and counted instead. Slots are claimed with a
+/// compare-and-swap on a sequence number per slot, so the control loop,
+/// the network tasks and HTTP handlers can log concurrently without a lock.
+///
+/// Use the LOG_ERROR/LOG_WARN/LOG_INFO/LOG_DEBUG macros. Levels above
+/// LOG_LEVEL compile to nothing, arguments included.
+///
+/// With LOG_BINARY we skip formatting on the device altogether, in the
+/// style of defmt. Each call site keeps its format string in a named
+/// static whose address identifies the message. We send that address,
+/// relative to logFormatAnchor, plus the raw argument values, and
+/// tools/log_decoder.py formats them on the host from the strings it
+/// extracts from firmware.elf. Frames are COBS encoded and end in 0x00:
+///   zigzag varint (format address - anchor address), then per argument
+///   signed integers as zigzag varint, unsigned integers as varint,
+///   floating point as float32 little endian, strings as varint
+///   (length << 1) + bytes, or for strings in flash, varint
+///   (zigzag(address - anchor address) << 1 | 1) so constants cost 2-3 bytes
+/// The stored format string is prefixed with its level letter (E/W/I/D).
+///
+/// Other components can send their own binary packets through the same
+/// ring with writePacket(), so a single task owns the UART. While such a
+/// stream is running we switch to framed output: every message goes out
+/// as a COBS frame whose first byte says what it holds (FRAME_TEXT,
+/// FRAME_BINARY or the packet's own type), and the port may run faster.
+///
+/// With SYSLOG_ENABLED the drain task also forwards every text message to
+/// a syslog collector over UDP (see syslogforwarder.h).
+///
+
+#ifndef LOGGER_H
+#define LOGGER_H
+
+#include <Arduino.h>
+#include <atomic>
+#include <string.h>
+#include "config.h"
+
+#if SYSLOG_ENABLED
+#include "syslogforwarder.h"
+
+static_assert(!LOG_BINARY, "SYSLOG_ENABLED needs text logging; binary records can only be formatted on the host");
+#endif
+
+#ifdef ESP_PLATFORM
+#include <soc/soc.h>
+#endif
+
+#define LOG_LEVEL_ERROR 1
+#define LOG_LEVEL_WARN 2
+#define LOG_LEVEL_INFO 3
+#define LOG_LEVEL_DEBUG 4
+
+enum class LogLevel : uint8_t {
+	Error = LOG_LEVEL_ERROR,
+	Warn = LOG_LEVEL_WARN,
+	Info = LOG_LEVEL_INFO,
+	Debug = LOG_LEVEL_DEBUG
+};
+
+/// Reference point for binary message ids; the host finds its address in the ELF
+extern "C" const char logFormatAnchor[];
+
+/// Serializes binary log arguments; stops at the end of the buffer
+class LogEncoder {
+public:
+	LogEncoder(uint8_t* data, size_t capacity) : data(data), capacity(capacity), length(0), overflowed(false) {}
+	
+	void putVarint(uint32_t value) {
+		while (value >= 0x80) {
+			this->putByte((uint8_t)(value | 0x80));
+			value >>= 7;
+		}
+		this->putByte((uint8_t)value);
+	}
+	
+	void putSigned(int32_t value) {
+		this->putVarint(zigzag(value));
+	}
+	
+	void put(bool value) { this->putSigned(value); }
+	
+	/// Narrow types need their own overloads: promoted to int they would be zigzag
+	/// encoded, while the decoder reads %u, %x and %c as plain varints
+	void put(char value) { this->putVarint((uint8_t)value); }
+	void put(signed char value) { this->putSigned(value); }
+	void put(unsigned char value) { this->putVarint(value); }
+	void put(short value) { this->putSigned(value); }
+	void put(unsigned short value) { this->putVarint(value); }
+	
+	void put(int value) { this->putSigned(value); }
+	void put(long value) { this->putSigned((int32_t)value); }
+	void put(unsigned int value) { this->putVarint(value); }
+	void put(unsigned long value) { this->putVarint((uint32_t)value); }
+	
+	void put(double value) {
+		float single = (float)value;
+		uint8_t bytes[sizeof(float)];
+		memcpy(bytes, &single, sizeof(float));
+		for (size_t i = 0; i < sizeof(float); i++) {
+			this->putByte(bytes[i]);
+		}
+	}
+	
+	void put(const char* value) {
+		/// We send literals and other flash constants by address; the host has the ELF
+		if (isInFlash(value)) {
+			this->putVarint(zigzag((int32_t)(value - logFormatAnchor)) << 1 | 1);
+			return;
+		}
+		
+		size_t stringLength = value ? strlen(value) : 0;
+		this->putVarint(stringLength << 1);
+		for (size_t i = 0; i < stringLength; i++) {
+			this->putByte((uint8_t)value[i]);
+		}
+	}
+	
+	[[nodiscard]] size_t getLength() const { return this->length; }
+	[[nodiscard]] bool hasOverflowed() const { return this->overflowed; }
+
+private:
+	uint8_t* data;
+	size_t capacity;
+	size_t length;
+	bool overflowed;
+	
+	static uint32_t zigzag(int32_t value) {
+		return ((uint32_t)value << 1) ^ (uint32_t)(value >> 31);
+	}
+	
+	static bool isInFlash(const char* value) {
+#ifdef SOC_DROM_LOW
+		return (uintptr_t)value >= SOC_DROM_LOW && (uintptr_t)value < SOC_DROM_HIGH;
+#else
+		(void)value;
+		return false;
+#endif
+	}
+	
+	void putByte(uint8_t byte) {
+		if (this->length < this->capacity) {
+			this->data[this->length++] = byte;
+		} else {
+			this->overflowed = true;
+		}
+	}
+};
+
+class Logger {
+public:
+	static constexpr uint32_t SLOT_COUNT = LOG_RING_SLOTS;
+	static constexpr size_t SLOT_TEXT_SIZE = LOG_SLOT_SIZE;
+	
+	static_assert((SLOT_COUNT & (SLOT_COUNT - 1)) == 0, "LOG_RING_SLOTS must be a power of two");
+	static_assert(SLOT_TEXT_SIZE <= 256, "LOG_SLOT_SIZE must fit the 8-bit length");
+	
+	/// First byte of a message frame in framed output; packet types must differ
+	static constexpr uint8_t FRAME_TEXT = 'L';
+	static constexpr uint8_t FRAME_BINARY = 'B';
+	
+	Logger();
+	
+	/// Start the drain task
+	void begin();
+	
+	/// Format one message into the ring; drops it if the ring is full
+	void log(LogLevel level, const char* format, ...) __attribute__((format(printf, 3, 4)));
+	
+	/// Queue a call site's format id and raw arguments; drops the record if the ring is full
+	template <typename... Args>
+	void logBinary(LogLevel level, const char* format, Args... args) {
+		uint32_t startCycles = ESP.getCycleCount();
+		uint32_t position;
+		Slot* slot = this->acquireSlot(position);
+		if (!slot) {
+			return;
+		}
+		
+		LogEncoder encoder((uint8_t*)slot->text, SLOT_TEXT_SIZE);
+		encoder.putSigned((int32_t)(format - logFormatAnchor));
+		(encoder.put(args), ...);
+		this->publishSlot(slot, position, level, encoder.getLength(), encoder.hasOverflowed(), startCycles);
+	}
+	
+	/// Never called; lets the compiler check binary call sites against their format
+	static void checkFormat(const char*, ...) __attribute__((format(printf, 1, 2))) {}
+	
+	/// Wait for a free slot instead of dropping - for setup, where nothing is time critical
+	void setWaitWhenFull(bool wait);
+	
+	/// Queue a binary packet to go out as one COBS frame; returns false if the ring is full
+	/// The first byte is the packet type. Packets never wait and are not counted as messages
+	[[nodiscard]] bool writePacket(const uint8_t* data, size_t length);
+	
+	/// Switch between plain and framed output and change the UART baud rate
+	/// We queue the switch behind everything logged so far, so no message is sent at the wrong rate
+	void setOutputMode(bool framed, unsigned long baudRate);
+	
+	/// Write out everything buffered, e.g. before a restart; gives up after timeoutMs
+	void flush(unsigned long timeoutMs = 500);
+	
+	/// Get number of messages accepted into the ring
+	[[nodiscard]] unsigned long getMessagesLogged() const;
+	
+	/// Get number of messages dropped because the ring was full
+	[[nodiscard]] unsigned long getMessagesDropped() const;
+	
+	/// Get number of messages cut to fit a slot
+	[[nodiscard]] unsigned long getMessagesTruncated() const;
+	
+	/// Get number of bytes written to the UART
+	[[nodiscard]] unsigned long getBytesWritten() const;
+	
+	/// Get most slots ever in use at once
+	[[nodiscard]] uint32_t getHighWaterMark() const;
+	
+	/// Get recent mean CPU cycles spent inside a log call, formatting or encoding included
+	[[nodiscard]] uint32_t getMeanCallCycles() const;
+	
+	/// Get number of messages forwarded to the syslog collector, and dropped on the way
+	/// Both stay 0 unless SYSLOG_ENABLED
+	[[nodiscard]] unsigned long getSyslogMessagesSent() const;
+	[[nodiscard]] unsigned long getSyslogMessagesDropped() const;
+	
+	/// Get number of syslog datagrams sent
+	[[nodiscard]] unsigned long getSyslogDatagramsSent() const;
+
+private:
+	enum class SlotKind : uint8_t {
+		Message,
+		Packet,
+		OutputMode                        /// text holds the framed flag and the baud rate
+	};
+	
+	struct Slot {
+		std::atomic<uint32_t> sequence;   /// Position it is free for, or position + 1 once filled
+		uint8_t length;
+		LogLevel level;
+		SlotKind kind;
+		char text[SLOT_TEXT_SIZE];        /// Message text, or the binary record with LOG_BINARY
+	};
+	
+	Slot slots[SLOT_COUNT];
+	std::atomic<uint32_t> enqueuePosition;
+	uint32_t dequeuePosition;
+	std::atomic_flag draining;
+	volatile bool waitWhenFull;
+	bool started;
+	bool framed;                          /// Owned by the consumer; changed only through the ring
+#if SYSLOG_ENABLED
+	SyslogForwarder syslog;               /// Owned by the consumer, like framed
+#endif
+	
+	/// Statistics
+	std::atomic<uint32_t> messagesLogged;
+	std::atomic<uint32_t> messagesDropped;
+	std::atomic<uint32_t> messagesTruncated;
+	volatile unsigned long bytesWritten;
+	volatile uint32_t highWaterMark;
+	volatile uint32_t meanCallCycles;
+	
+	/// Claim the next free slot; returns nullptr if the ring is full
+	[[nodiscard]] Slot* claimSlot(uint32_t& position);
+	
+	/// Claim a slot, waiting if configured to; counts a drop and returns nullptr otherwise
+	[[nodiscard]] Slot* acquireSlot(uint32_t& position);
+	
+	/// Claim a slot, waiting as long as it takes for the drain task to free one
+	[[nodiscard]] Slot* waitForSlot(uint32_t& position);
+	
+	/// Hand a filled slot to the drain task
+	void publishSlot(Slot* slot, uint32_t position, LogLevel level, size_t length, bool truncated, uint32_t startCycles);
+	
+	/// Write filled slots to the UART; returns false once the ring is empty
+	bool drain();
+	
+	/// Write one record as a COBS frame, after a type byte unless type is 0
+	void writeFrame(uint8_t type, const uint8_t* data, size_t length);
+	
+	/// Carry out a queued output mode switch
+	void applyOutputMode(const Slot* slot);
+	
+	/// FreeRTOS task entry point
+	static void taskEntry(void* parameter);
+	void runTask();
+};
+
+extern Logger logger;
+
+#if LOG_BINARY
+/// The static's name is what tools/log_decoder.py looks for in the ELF symbol table
+#define LOG_AT(level, tag, format, ...) do { \
+		static const char logFormat[] __attribute__((used)) = tag format; \
+		if (false) { Logger::checkFormat(format, ##__VA_ARGS__); } \
+		logger.logBinary(level, logFormat, ##__VA_ARGS__); \
+	} while (0)
+#else
+#define LOG_AT(level, tag, format, ...) logger.log(level, format, ##__VA_ARGS__)
+#endif
+
+#if LOG_LEVEL >= LOG_LEVEL_ERROR
+#define LOG_ERROR(format, ...) LOG_AT(LogLevel::Error, "E", format, ##__VA_ARGS__)
+#else
+#define LOG_ERROR(...) do {} while (0)
+#endif
+
+#if LOG_LEVEL >= LOG_LEVEL_WARN
+#define LOG_WARN(format, ...) LOG_AT(LogLevel::Warn, "W", format, ##__VA_ARGS__)
+#else
+#define LOG_WARN(...) do {} while (0)
+#endif
+
+#if LOG_LEVEL >= LOG_LEVEL_INFO
+#define LOG_INFO(format, ...) LOG_AT(LogLevel::Info, "I", format, ##__VA_ARGS__)
+#else
+#define LOG_INFO(...) do {} while (0)
+#endif
+
+#if LOG_LEVEL >= LOG_LEVEL_DEBUG
+#define LOG_DEBUG(format, ...) LOG_AT(LogLevel::Debug, "D", format, ##__VA_ARGS__)
+#else
+#define LOG_DEBUG(...) do {} while (0)
+#endif
+
+#endif /// LOGGER_H
@@ -0,0 +1,19 @@
+///
+/// LoopTimings - Per-phase latency of the main control loop
+/// 
+/// We time the expensive phases of loop() so regressions show up in
+/// monitoring instead of as a sluggish relay.
+///
+
+#ifndef LOOPTIMINGS_H
+#define LOOPTIMINGS_H
+
+#include "latencyhistogram.h"
+
+struct LoopTimings {
+	LatencyHistogram work;      /// Whole loop body, excluding the idle wait
+	LatencyHistogram sensor;    /// LightSensor::updateReading()
+	LatencyHistogram control;   /// PlantController::update()
+};
+
+#endif /// LOOPTIMINGS_H
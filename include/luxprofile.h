@@ -0,0 +1,67 @@
+///
+/// LuxProfile - Per-hour lux distributions that survive reboots
+/// 
+/// We keep one QuantileSketch for every hour of the day so growers can
+/// see typical light levels (p10/p50/p90) across the day instead of just
+/// the current average. The whole day fits in under 4 KB of RAM and each
+/// hour is persisted to NVS when it ends.
+///
+
+#ifndef LUXPROFILE_H
+#define LUXPROFILE_H
+
+#include <Arduino.h>
+#include <Preferences.h>
+#include "quantilesketch.h"
+
+class LuxProfile {
+public:
+	static constexpr int HOURS_PER_DAY = 24;
+	
+	/// Size of the export image: header plus 24 sketches of 16-bit counters
+	static constexpr size_t EXPORT_HEADER_SIZE = 16;
+	static constexpr size_t EXPORT_SIZE = EXPORT_HEADER_SIZE + HOURS_PER_DAY * QuantileSketch::BUCKET_COUNT * sizeof(uint16_t);
+	
+	LuxProfile();
+	
+	/// Load persisted sketches from NVS
+	void begin();
+	
+	/// Add a lux sample taken during the given local hour (0-23)
+	/// We persist the previous hour's sketch when the hour changes
+	void addSample(int hour, float lux);
+	
+	/// Persist all modified hours immediately
+	void save();
+	
+	/// Get the sketch for one hour of the day
+	[[nodiscard]] const QuantileSketch& getHour(int hour) const;
+	
+	/// Estimate a quantile (0.0 - 1.0) for one hour of the day in lux
+	[[nodiscard]] float getHourlyQuantile(int hour, float quantile) const;
+	
+	/// Estimate a quantile (0.0 - 1.0) over the whole day in lux
+	/// We merge the hourly sketches on the fly since they merge exactly
+	[[nodiscard]] float getDailyQuantile(float quantile) const;
+	
+	/// Write part of the profile in the host merge format, starting at offset into the image
+	/// Returns the number of bytes written, 0 once offset reaches EXPORT_SIZE
+	[[nodiscard]] size_t exportSlice(size_t offset, uint8_t* buffer, size_t bufferSize) const;
+	
+	/// Forget all collected samples, in RAM and in NVS
+	void clear();
+
+private:
+	Preferences preferences;
+	QuantileSketch hourly[HOURS_PER_DAY];
+	uint32_t dirtyHours;   /// Bit per hour with unsaved samples
+	int currentHour;
+	
+	/// Persist a single hour's sketch
+	void saveHour(int hour);
+	
+	/// Build the NVS key for an hour ("h00" - "h23")
+	static void getHourKey(int hour, char* key, size_t keySize);
+};
+
+#endif /// LUXPROFILE_H
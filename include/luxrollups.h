@@ -0,0 +1,122 @@
+///
+/// LuxRollups - Cascaded 1 min / 15 min / 1 h aggregates of lux and relay on-time
+/// 
+/// We fold every sensor reading into the open one-minute bucket. When a
+/// minute closes it is pushed into the minute ring and merged into the
+/// open quarter-hour bucket, which in turn feeds the hour, so each sample
+/// costs O(1) no matter how many levels exist. Rings hold contiguous
+/// buckets, which lets a 30-day chart be drawn from 720 hourly points.
+///
+
+#ifndef LUXROLLUPS_H
+#define LUXROLLUPS_H
+
+#include <Arduino.h>
+#include "config.h"
+#include "timemanager.h"
+
+enum class RollupResolution {
+	Minute = 0,
+	QuarterHour = 1,
+	Hour = 2
+};
+
+/// One aggregated interval; 16 bytes so the three rings stay under 28 KB
+struct RollupBucket {
+	float minLux;
+	float maxLux;
+	float meanLux;
+	uint16_t count;            /// Sensor readings folded in (0 = no data)
+	uint16_t relayOnSeconds;   /// Seconds the relay was on during the interval
+};
+
+class RollupRing {
+public:
+	RollupRing(RollupBucket* slots, size_t capacity, uint32_t resolutionSeconds);
+	
+	/// Append the bucket that starts at the given time, inserting empty
+	/// buckets for any intervals without data since the previous one
+	void push(uint32_t start, const RollupBucket& bucket);
+	
+	/// Get number of buckets held (at most the capacity)
+	[[nodiscard]] size_t getSize() const;
+	
+	/// Get a bucket by age (0 = oldest)
+	[[nodiscard]] const RollupBucket& getBucket(size_t index) const;
+	
+	/// Get the start time of a bucket by age (0 = oldest)
+	[[nodiscard]] uint32_t getBucketStart(size_t index) const;
+	
+	/// Find the oldest bucket that ends after a timestamp
+	[[nodiscard]] size_t findFirst(uint32_t timestamp) const;
+	
+	/// Get the interval length in seconds
+	[[nodiscard]] uint32_t getResolution() const;
+
+private:
+	RollupBucket* slots;
+	size_t capacity;
+	uint32_t resolution;
+	size_t head;          /// Slot the next bucket goes to
+	size_t size;
+	uint32_t newestStart;
+};
+
+class LuxRollups {
+public:
+	static constexpr int LEVEL_COUNT = 3;
+	
+	explicit LuxRollups(TimeManager* timeManager);
+	
+	/// Fold a sensor reading and the current relay state into the open minute
+	void addSample(float lux, bool relayOn);
+	
+	/// Get the ring of closed buckets for a resolution
+	[[nodiscard]] const RollupRing& getRing(RollupResolution resolution) const;
+	
+	/// Get the open (not yet closed) bucket for a resolution
+	[[nodiscard]] RollupBucket getOpenBucket(RollupResolution resolution) const;
+	
+	/// Get the start time of the open bucket for a resolution (0 if none)
+	[[nodiscard]] uint32_t getOpenBucketStart(RollupResolution resolution) const;
+	
+	/// Get the short name of a resolution ("1m", "15m", "1h")
+	[[nodiscard]] static const char* getResolutionName(RollupResolution resolution);
+	
+	/// Parse a resolution name; returns false if unknown
+	[[nodiscard]] static bool parseResolution(const char* name, RollupResolution& resolution);
+
+private:
+	/// Accumulator for a bucket that is still open
+	struct OpenBucket {
+		uint32_t start;
+		float minLux;
+		float maxLux;
+		double luxSum;
+		uint32_t count;
+		uint32_t relayOnMs;
+	};
+	
+	TimeManager* timeManager;
+	RollupBucket minuteSlots[ROLLUP_MINUTE_SLOTS];
+	RollupBucket quarterSlots[ROLLUP_QUARTER_SLOTS];
+	RollupBucket hourSlots[ROLLUP_HOUR_SLOTS];
+	RollupRing rings[LEVEL_COUNT];
+	OpenBucket open[LEVEL_COUNT];
+	unsigned long lastSampleMillis;
+	bool lastRelayOn;
+	
+	/// Close the open bucket of a level and cascade it into the next level
+	void closeBucket(int level);
+	
+	/// Merge a closed bucket's totals into an open bucket
+	static void mergeInto(OpenBucket& target, const OpenBucket& source);
+	
+	/// Convert an open bucket into its stored form
+	[[nodiscard]] static RollupBucket toBucket(const OpenBucket& bucket);
+	
+	/// Reset an open bucket to empty at the given start time
+	static void resetOpen(OpenBucket& bucket, uint32_t start);
+};
+
+#endif /// LUXROLLUPS_H
@@ -0,0 +1,68 @@
+///
+/// MqttClient - Minimal MQTT 3.1.1 publisher over any Arduino Client
+/// 
+/// We implement only what telemetry needs: CONNECT, PUBLISH with QoS 0/1,
+/// PUBACK handling and keep-alive pings. All packets are built in small
+/// fixed buffers and the payload is written straight from the caller's
+/// memory, so publishing never allocates.
+///
+
+#ifndef MQTTCLIENT_H
+#define MQTTCLIENT_H
+
+#include <Arduino.h>
+#include <Client.h>
+
+class MqttClient {
+public:
+	explicit MqttClient(Client* client);
+	
+	/// Open the TCP connection and perform the MQTT handshake
+	/// Blocks for up to timeoutMs; we only call this from the telemetry task
+	[[nodiscard]] bool connect(const char* host, uint16_t port, const char* clientId,
+							uint16_t keepAliveSeconds, unsigned long timeoutMs);
+	
+	/// Close the connection (sends DISCONNECT if still connected)
+	void disconnect();
+	
+	/// Check if the session is established and the socket is still open
+	[[nodiscard]] bool isConnected();
+	
+	/// Publish a message; returns false if the socket write failed
+	/// For QoS 1 the caller chooses the packet id and may set dup on retransmission
+	[[nodiscard]] bool publish(const char* topic, const uint8_t* payload, size_t length,
+							uint8_t qos, uint16_t packetId, bool dup);
+	
+	/// Process incoming packets and keep-alive; call frequently
+	/// Returns the packet id of an acknowledged QoS 1 publish, or 0 if none
+	[[nodiscard]] uint16_t loop();
+	
+	/// Get number of bytes written to and read from the socket since startup
+	[[nodiscard]] unsigned long getBytesSent() const;
+	[[nodiscard]] unsigned long getBytesReceived() const;
+
+private:
+	Client* client;
+	bool sessionEstablished;
+	uint16_t keepAliveSeconds;
+	unsigned long lastSendTime;
+	unsigned long lastReceiveTime;
+	bool pingOutstanding;
+	unsigned long bytesSent;
+	unsigned long bytesReceived;
+	
+	/// Write bytes to the socket and account for them
+	[[nodiscard]] bool writeAll(const uint8_t* data, size_t length);
+	
+	/// Encode the MQTT variable-length "remaining length" field
+	[[nodiscard]] static size_t encodeRemainingLength(uint8_t* out, size_t length);
+	
+	/// Read one packet header and its body into a small buffer
+	/// Bodies larger than the buffer are skipped; returns packet type or 0
+	[[nodiscard]] uint8_t readPacket(uint8_t* body, size_t bodySize, size_t& bodyLength);
+	
+	/// Read a single byte, waiting up to timeoutMs for it
+	[[nodiscard]] int readByte(unsigned long timeoutMs);
+};
+
+#endif /// MQTTCLIENT_H
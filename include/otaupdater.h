@@ -0,0 +1,164 @@
+///
+/// OtaUpdater - Delta firmware updates from a local update server
+/// 
+/// We identify the running image by its SHA-256 and ask the update server
+/// for a patch from exactly that image. Patches are COPY/INSERT streams
+/// (see tools/make_delta.py): COPY reuses a range of the running image and
+/// INSERT carries new bytes. We apply the stream straight into the
+/// inactive OTA partition through a 1 KB buffer, so RAM use does not
+/// depend on image or patch size. The server may also answer with a full
+/// image, which we stream the same way.
+///
+/// Everything runs in a low-priority task; the control loop keeps
+/// switching the relay during the download. A new image is only marked
+/// valid after its local components (sensor, relay, storage; not the
+/// network) have run healthy for OTA_CONFIRM_AFTER_MS. Otherwise we
+/// roll back, either through the bootloader's pending-verify state or,
+/// when the bootloader lacks rollback support, by pointing the boot
+/// partition back at the previous image recorded in NVS.
+///
+/// Patch layout (little endian):
+///   "PLD1", uint32 old size, uint32 new size, old SHA-256, new SHA-256
+///   then opcodes: 0x01 COPY varint offset, varint length
+///                 0x02 INSERT varint length, data
+///                 0x00 END
+///
+
+#ifndef OTAUPDATER_H
+#define OTAUPDATER_H
+
+#include <Arduino.h>
+#include <WiFi.h>
+#include <Preferences.h>
+#include <esp_partition.h>
+#include "config.h"
+
+enum class OtaState {
+	Idle,            /// Waiting for the next check
+	Checking,        /// Asking the update server
+	Downloading,     /// Applying a patch or image into the inactive partition
+	UpToDate,        /// Server has nothing newer
+	ReadyToReboot,   /// New image written and verified
+	Failed           /// Last attempt failed, see getLastError()
+};
+
+class OtaUpdater {
+public:
+	static constexpr size_t BUFFER_SIZE = 1024;
+	static constexpr size_t HASH_SIZE = 32;
+	
+	OtaUpdater();
+	
+	/// Handle boot confirmation state and start the update task
+	void begin();
+	
+	/// Confirm or roll back a freshly installed image
+	/// Call from the loop with the controller's overall health
+	void update(bool healthy);
+	
+	/// Ask the task to check the server now instead of waiting for the interval
+	void requestCheck();
+	
+	/// Check if a verified image, or a rollback to the previous one, is waiting for a restart
+	[[nodiscard]] bool isRebootPending() const;
+	
+	/// Restart into the new image, or roll back to the previous one
+	/// Call once the loop has saved its state; we do not restart on our own after begin()
+	void restart();
+	
+	/// Check if the running image still awaits confirmation
+	[[nodiscard]] bool isPendingConfirmation() const;
+	
+	/// Get the current state and a short reason for the last failure
+	[[nodiscard]] OtaState getState() const;
+	[[nodiscard]] static const char* getStateString(OtaState state);
+	[[nodiscard]] const char* getLastError() const;
+	
+	/// Get the running image hash as lowercase hex (empty until computed)
+	[[nodiscard]] const char* getRunningHash() const;
+	
+	/// Get statistics of the last download
+	[[nodiscard]] unsigned long getBytesDownloaded() const;
+	[[nodiscard]] unsigned long getImageBytes() const;
+	[[nodiscard]] unsigned long getBytesCopied() const;
+	[[nodiscard]] unsigned long getLastDuration() const;
+	[[nodiscard]] bool wasLastUpdateDelta() const;
+	
+	/// Get lifetime counters
+	[[nodiscard]] unsigned long getCheckCount() const;
+	[[nodiscard]] unsigned long getUpdateCount() const;
+	[[nodiscard]] unsigned long getFailureCount() const;
+
+private:
+	Preferences preferences;
+	volatile OtaState state;
+	const char* lastError;
+	volatile bool checkRequested;
+	bool pendingConfirmation;
+	const char* rollbackReason;           /// Set when a rollback waits for restart()
+	unsigned long healthySince;
+	unsigned long bootTime;
+	
+	const esp_partition_t* runningPartition;
+	uint32_t runningSize;
+	uint8_t runningHash[HASH_SIZE];
+	char runningHashHex[HASH_SIZE * 2 + 1];
+	
+	/// Transfer state, only touched by the task
+	WiFiClient client;
+	uint8_t buffer[BUFFER_SIZE];
+	size_t contentRemaining;
+	
+	/// Statistics
+	volatile unsigned long bytesDownloaded;
+	volatile unsigned long imageBytes;
+	volatile unsigned long bytesCopied;
+	volatile unsigned long lastDuration;
+	volatile bool lastUpdateDelta;
+	unsigned long checkCount;
+	unsigned long updateCount;
+	unsigned long failureCount;
+	
+	/// Task entry point and body
+	static void taskEntry(void* parameter);
+	void runTask();
+	
+	/// Ask the server for an update and apply it
+	void checkForUpdate();
+	
+	/// Send the request and parse the status line and headers
+	/// Returns the HTTP status code, or 0 on a connection error
+	[[nodiscard]] int openRequest();
+	
+	/// Apply a COPY/INSERT patch from the response body
+	[[nodiscard]] bool applyPatch();
+	
+	/// Stream a full image from the response body (first byte already read)
+	[[nodiscard]] bool applyFullImage(uint8_t firstByte);
+	
+	/// Read exactly length bytes from the connection within the read timeout
+	[[nodiscard]] bool readRaw(uint8_t* target, size_t length);
+	
+	/// Read one header line without its CRLF; returns false on timeout or overflow
+	[[nodiscard]] bool readLine(char* line, size_t size);
+	
+	/// Read exactly length bytes of the response body
+	[[nodiscard]] bool readBody(uint8_t* target, size_t length);
+	
+	/// Read a LEB128 varint from the response body
+	[[nodiscard]] bool readVarint(uint32_t& value);
+	
+	/// Hash the first length bytes of a partition
+	[[nodiscard]] bool hashPartition(const esp_partition_t* partition, uint32_t length, uint8_t* hash);
+	
+	/// Record a failed attempt
+	void fail(const char* reason);
+	
+	/// Mark the running image valid and forget the fallback partition
+	void confirmImage();
+	
+	/// Return to the previous image and restart
+	void rollBack(const char* reason);
+};
+
+#endif /// OTAUPDATER_H
@@ -61,6 +61,10 @@ public:
 	/// Check if all required components are healthy
 	[[nodiscard]] bool areAllComponentsHealthy() const;
 	
+	/// Check if the on-board sensor and relay work, whatever the network does
+	/// We leave out NTP time and the relay's switch interval: neither says the firmware is broken
+	[[nodiscard]] bool areLocalComponentsHealthy() const;
+	
 	/// Get number of successful control decisions made
 	[[nodiscard]] unsigned long getDecisionCount() const;
 	
@@ -73,6 +77,22 @@ public:
 	
 	/// Check if automatic control is currently enabled
 	[[nodiscard]] bool isAutomaticControlEnabled() const;
+	
+	/// Get the configured schedule window, start inclusive and end exclusive
+	[[nodiscard]] int getScheduleStartHour() const;
+	[[nodiscard]] int getScheduleEndHour() const;
+	
+	/// Get the ambient light level below which the lamp is switched on
+	[[nodiscard]] float getLightThreshold() const;
+	
+	/// Check if the current time is inside the schedule window
+	[[nodiscard]] bool isWithinSchedule() const;
+	
+	/// Get descriptive string for decision type
+	[[nodiscard]] const char* getDecisionString(ControlDecision decision) const;
+	
+	/// Get descriptive string for decision reason
+	[[nodiscard]] const char* getReasonString(ControlReason reason) const;
 
 private:
 	/// Component references
@@ -99,8 +119,7 @@ private:
 	/// Core decision logic methods
 	/// We break down the decision process into clear steps
 	[[nodiscard]] ControlDecision analyzeConditions(ControlReason& reason) const;
-	[[nodiscard]] bool isWithinSchedule() const;
-	[[nodiscard]] bool isAmbientLightLow() const;
+	[[nodiscard]] LightLevel getAmbientLightLevel() const;
 	[[nodiscard]] bool shouldRelayBeOn() const;
 	
 	/// Execute the control decision
@@ -109,12 +128,6 @@ private:
 	
 	/// Validate component health
 	[[nodiscard]] bool validateComponents(ControlReason& reason) const;
-	
-	/// Get descriptive string for decision type
-	[[nodiscard]] const char* getDecisionString(ControlDecision decision) const;
-	
-	/// Get descriptive string for decision reason
-	[[nodiscard]] const char* getReasonString(ControlReason reason) const;
 };
 
 #endif /// PLANTCONTROLLER_H
\ No newline at end of file
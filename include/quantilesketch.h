@@ -0,0 +1,65 @@
+///
+/// QuantileSketch - Constant-memory streaming quantile estimator for lux
+/// 
+/// We count samples in logarithmically spaced buckets (each bucket is 20%
+/// wider than the previous one), so any quantile is known to within about
+/// ±10% relative error. Updates are O(1), memory is fixed, and two sketches
+/// merge exactly by adding bucket counts, which lets the host combine
+/// profiles from the whole fleet.
+///
+
+#ifndef QUANTILESKETCH_H
+#define QUANTILESKETCH_H
+
+#include <Arduino.h>
+
+class QuantileSketch {
+public:
+	/// Bucket 0 holds values below MIN_LUX; bucket i covers [MIN_LUX * GAMMA^(i-1), MIN_LUX * GAMMA^i)
+	/// 80 buckets reach above 120000 lux, the top of the VEML7700 range
+	static constexpr int BUCKET_COUNT = 80;
+	static constexpr float MIN_LUX = 0.1f;
+	static constexpr float GAMMA = 1.2f;
+	
+	QuantileSketch();
+	
+	/// Add one lux sample
+	void add(float lux);
+	
+	/// Merge another sketch into this one
+	void merge(const QuantileSketch& other);
+	
+	/// Merge several sketches into this one at once
+	/// We scale the sum only once, so every input keeps the same weight whatever the order
+	void merge(const QuantileSketch* others, size_t count);
+	
+	/// Remove all samples
+	void clear();
+	
+	/// Get number of samples represented by the sketch
+	[[nodiscard]] uint32_t getCount() const;
+	
+	/// Estimate a quantile (0.0 - 1.0) in lux
+	/// We return the geometric center of the bucket that holds the requested rank
+	[[nodiscard]] float getQuantile(float quantile) const;
+	
+	/// Access raw bucket counts for persistence and export
+	[[nodiscard]] const uint16_t* getBuckets() const;
+	[[nodiscard]] uint16_t* getBuckets();
+	
+	/// Recompute the sample count after buckets were loaded from storage
+	void recount();
+
+private:
+	uint16_t buckets[BUCKET_COUNT];
+	uint32_t count;
+	
+	/// Map a lux value to its bucket index
+	[[nodiscard]] static int getBucketIndex(float lux);
+	
+	/// Halve every bucket so counts never overflow
+	/// We keep the distribution shape and slowly favour recent days
+	void decay();
+};
+
+#endif /// QUANTILESKETCH_H
@@ -37,9 +37,13 @@ public:
 	/// Force relay to OFF state immediately (emergency stop)
 	/// We bypass safety delays in emergency situations
 	void emergencyStop();
+	
+	/// Check if begin() configured the relay output
+	[[nodiscard]] bool isReady() const;
 
 private:
 	const int relayPin;
+	bool ready;
 	bool currentState;
 	unsigned long lastSwitchTime;
 	unsigned long minSwitchInterval;
@@ -0,0 +1,91 @@
+///
+/// ResponseWriter - HTTP response generation into a fixed send buffer
+/// 
+/// We format headers and body text straight into one static buffer and
+/// hand it to the socket whenever it fills up. Bodies of unknown length
+/// use chunked transfer encoding, so no response is ever assembled in
+/// RAM and no String or heap allocation is involved.
+///
+/// The socket is written without blocking. Whatever it does not take
+/// waits in a fixed backlog buffer until drain() gets it out, so callers
+/// stream the next part of a response only once the backlog is empty.
+/// A client that stops reading fails the response instead of stalling
+/// us: either its backlog overflows or it takes nothing for
+/// HTTP_SEND_STALL_MS.
+///
+
+#ifndef RESPONSEWRITER_H
+#define RESPONSEWRITER_H
+
+#include <Arduino.h>
+#include <WiFi.h>
+
+class ResponseWriter {
+public:
+	ResponseWriter(uint8_t* buffer, size_t capacity, uint8_t* backlog, size_t backlogCapacity);
+	
+	/// Attach the connection the next response goes to
+	void attach(WiFiClient* client);
+	
+	/// Write the status line and headers
+	/// A negative contentLength selects chunked transfer encoding
+	void beginResponse(int statusCode, const char* contentType, long contentLength,
+					const char* extraHeaders = nullptr);
+	
+	/// Append body data; the buffer is flushed to the socket when full
+	void print(const char* text);
+	void printf(const char* format, ...) __attribute__((format(printf, 2, 3)));
+	void write(const uint8_t* data, size_t length);
+	
+	/// Append a JSON string literal with escaping
+	void printJsonString(const char* text);
+	
+	/// Send everything buffered so far, as far as the socket takes it now
+	void flush();
+	
+	/// Finish the response (terminating chunk for chunked bodies) and flush
+	void end();
+	
+	/// Hand more of the backlog to the socket; never blocks
+	void drain();
+	
+	/// Get bytes buffered but not yet sent
+	[[nodiscard]] size_t getPending() const;
+	
+	/// Get bytes the socket has not taken yet, waiting for drain()
+	[[nodiscard]] size_t getBacklog() const;
+	
+	/// Get total bytes written to sockets since startup
+	[[nodiscard]] unsigned long getBytesSent() const;
+	
+	/// Check if a socket write failed during the current response
+	[[nodiscard]] bool hasFailed() const;
+	
+	/// Get the reason phrase for a status code
+	[[nodiscard]] static const char* getStatusText(int statusCode);
+
+private:
+	uint8_t* buffer;
+	size_t capacity;
+	size_t length;
+	uint8_t* backlog;
+	size_t backlogCapacity;
+	size_t backlogLength;
+	WiFiClient* client;
+	bool chunked;
+	bool inBody;
+	bool failed;
+	unsigned long lastProgressAt;
+	unsigned long bytesSent;
+	
+	/// Send raw bytes, optionally framed as one chunk
+	void sendRaw(const uint8_t* data, size_t length);
+	
+	/// Send bytes after the backlog, keeping what the socket does not take
+	void queue(const uint8_t* data, size_t length);
+	
+	/// Write without blocking; returns bytes the socket took, fails the response on error
+	size_t writeSocket(const uint8_t* data, size_t length);
+};
+
+#endif /// RESPONSEWRITER_H
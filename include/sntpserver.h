@@ -0,0 +1,86 @@
+///
+/// SntpServer - Local SNTP time master for the other controllers on site
+/// 
+/// One controller per site can answer SNTP requests (RFC 4330) on UDP
+/// port 123, so the others sync over the LAN instead of each going out
+/// to pool.ntp.org through the site uplink. Point them at the master by
+/// setting NTP_SERVER to its IP address.
+///
+/// We only answer while our own TimeManager has a recent sync. Without
+/// one we stay silent, so a client keeps its own time or tries another
+/// server instead of adopting a wrong clock. Our reply carries what a
+/// full NTP client needs to judge us: upstream round trip as root delay,
+/// and as root dispersion our error right after a sync plus the drift
+/// allowance for the time since.
+///
+/// poll() runs in the main loop's idle phase, next to the HTTP server.
+/// The socket is non-blocking and each poll answers at most
+/// SNTP_MAX_REQUESTS_PER_POLL requests, so a burst of clients costs the
+/// control loop a bounded amount of time; the rest wait in the socket for
+/// the next poll. A request waits at most one poll interval before we
+/// stamp its receive time, which is small against our own clock error.
+/// Keeping to the main loop also means TimeManager is never read while
+/// a sync changes it.
+///
+
+#ifndef SNTPSERVER_H
+#define SNTPSERVER_H
+
+#include <Arduino.h>
+#include "config.h"
+#include "timemanager.h"
+#include "latencyhistogram.h"
+
+class SntpServer {
+public:
+	static constexpr size_t PACKET_SIZE = 48;
+	
+	explicit SntpServer(const TimeManager* timeManager);
+	~SntpServer();
+	
+	/// Open the UDP socket; returns false if port 123 cannot be bound
+	[[nodiscard]] bool begin();
+	
+	/// Answer waiting requests; never blocks
+	void poll();
+	
+	/// Get number of requests answered
+	[[nodiscard]] unsigned long getRequestsServed() const;
+	
+	/// Get number of requests left unanswered because our time was not synced or too old
+	[[nodiscard]] unsigned long getRequestsUnsynced() const;
+	
+	/// Get number of datagrams that were not SNTP client requests
+	[[nodiscard]] unsigned long getRequestsMalformed() const;
+	
+	/// Get number of replies the network stack did not accept
+	[[nodiscard]] unsigned long getSendFailures() const;
+	
+	/// Get time from reading a request to sending its reply
+	[[nodiscard]] const LatencyHistogram& getServeLatency() const;
+
+private:
+	const TimeManager* timeManager;
+	int socketFd;
+	
+	/// Statistics
+	unsigned long requestsServed;
+	unsigned long requestsUnsynced;
+	unsigned long requestsMalformed;
+	unsigned long sendFailures;
+	LatencyHistogram serveLatency;
+	
+	/// Check if our time is good enough to hand out
+	[[nodiscard]] bool canServe() const;
+	
+	/// Fill the reply header fields that do not depend on the request timing
+	void buildReply(const uint8_t* request, uint8_t* reply) const;
+	
+	/// Store UTC milliseconds as a 64-bit NTP timestamp
+	static void writeTimestamp(uint8_t* field, uint64_t utcMs);
+	
+	/// Store a duration as a 32-bit NTP short format value (16.16 seconds)
+	static void writeShort(uint8_t* field, uint64_t microseconds);
+};
+
+#endif /// SNTPSERVER_H
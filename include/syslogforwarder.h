@@ -0,0 +1,69 @@
+///
+/// SyslogForwarder - Batched UDP copy of the log for a remote collector
+/// 
+/// The logger's drain task hands us every message it writes to the UART.
+/// We render each one as an RFC 5424 syslog line and pack as many lines
+/// as fit into one datagram, separated by newlines, so a burst of log
+/// output costs a handful of packets instead of one per message. A batch
+/// goes out when the next line would not fit, once it has waited
+/// SYSLOG_BATCH_INTERVAL_MS, or on flush.
+///
+/// Sending never blocks the drain task: the socket is non-blocking and
+/// the collector is addressed by IP, so there is no DNS lookup either.
+/// While WiFi is down, or when the stack has no buffer for a datagram, the
+/// messages are dropped and counted; the UART copy is unaffected.
+///
+/// Only the drain task may call append() and poll(); the counters can be
+/// read from anywhere.
+///
+
+#ifndef SYSLOGFORWARDER_H
+#define SYSLOGFORWARDER_H
+
+#include <Arduino.h>
+#include "config.h"
+
+class SyslogForwarder {
+public:
+	SyslogForwarder();
+	
+	/// Add one message to the current batch; severity is the syslog severity (0-7)
+	void append(uint8_t severity, const char* text, size_t length);
+	
+	/// Send the batch if it has waited long enough; call whenever the drain task wakes
+	void poll();
+	
+	/// Send the batch now, e.g. before a restart
+	void flush();
+	
+	/// Get number of messages delivered to the network stack
+	[[nodiscard]] unsigned long getMessagesSent() const;
+	
+	/// Get number of messages dropped because the network was down or busy
+	[[nodiscard]] unsigned long getMessagesDropped() const;
+	
+	/// Get number of datagrams and bytes sent
+	[[nodiscard]] unsigned long getDatagramsSent() const;
+	[[nodiscard]] unsigned long getBytesSent() const;
+
+private:
+	char batch[SYSLOG_MAX_DATAGRAM];
+	size_t batchLength;
+	uint16_t batchMessages;
+	unsigned long batchStartedAt;
+	int socketFd;
+	
+	/// Statistics
+	volatile unsigned long messagesSent;
+	volatile unsigned long messagesDropped;
+	volatile unsigned long datagramsSent;
+	volatile unsigned long bytesSent;
+	
+	/// Open the UDP socket if needed; returns false while the network is down
+	[[nodiscard]] bool ensureSocket();
+	
+	/// Send the batch as one datagram and start a new one
+	void sendBatch();
+};
+
+#endif /// SYSLOGFORWARDER_H
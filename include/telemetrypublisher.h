@@ -0,0 +1,213 @@
+///
+/// TelemetryPublisher - Batched CBOR telemetry over MQTT
+/// 
+/// We collect sensor samples and control decisions in a fixed batch and
+/// encode it as one compact CBOR message per minute. Messages go into a
+/// bounded outbound queue that a low-priority task publishes with QoS 1,
+/// so network stalls never block the control loop and memory use stays
+/// fixed no matter how long the broker is unreachable.
+///
+/// While offline the task moves queued messages into a TelemetrySpool in
+/// flash instead of dropping them. Once the broker is back we publish
+/// fresh messages first and drain the spool behind them: up to
+/// TELEMETRY_FLUSH_MAX_BYTES of stored messages per publish, sent as one
+/// CBOR array to <topic>/backlog, with one batch in flight at a time and
+/// a pause of TELEMETRY_FLUSH_INTERVAL_MS between batches.
+///
+/// With MQTT_TLS_ENABLED the session runs over a TlsClient, which resumes
+/// the previous TLS session when we reconnect after a WiFi or broker drop.
+///
+
+#ifndef TELEMETRYPUBLISHER_H
+#define TELEMETRYPUBLISHER_H
+
+#include <Arduino.h>
+#include <WiFi.h>
+#include <freertos/semphr.h>
+#include "config.h"
+#include "mqttclient.h"
+#include "telemetryspool.h"
+#include "tlsclient.h"
+#include "timemanager.h"
+#include "lightsensor.h"
+#include "plantcontroller.h"
+
+class TelemetryPublisher {
+public:
+	/// Batch capacity; a full batch is flushed early
+	static constexpr int MAX_BATCH_SAMPLES = 64;
+	static constexpr int MAX_BATCH_DECISIONS = 16;
+	
+	TelemetryPublisher(TimeManager* timeManager, LightSensor* lightSensor);
+	
+	/// Start the background publishing task
+	void begin();
+	
+	/// Add a sensor sample (raw counts) to the current batch
+	void addSample(uint16_t alsCounts, uint16_t whiteCounts);
+	
+	/// Add a control decision to the current batch
+	void addDecision(ControlDecision decision, ControlReason reason, bool relayOn);
+	
+	/// Flush the batch into the outbound queue when the batch interval has elapsed
+	/// We only encode here; no network I/O happens on the calling thread
+	void update();
+	
+	/// Check if the broker session is currently up
+	[[nodiscard]] bool isConnected() const;
+	
+	/// Get number of messages currently waiting in the outbound queue
+	[[nodiscard]] int getQueueDepth() const;
+	
+	/// Get message counters since startup
+	[[nodiscard]] unsigned long getMessagesQueued() const;
+	[[nodiscard]] unsigned long getMessagesAcked() const;
+	[[nodiscard]] unsigned long getMessagesDropped() const;
+	[[nodiscard]] unsigned long getRetransmissions() const;
+	[[nodiscard]] unsigned long getConnectionCount() const;
+	
+	/// Get the TLS transport for its handshake statistics; nullptr without MQTT_TLS_ENABLED
+	[[nodiscard]] const TlsClient* getTlsClient() const;
+	
+	/// Get CBOR payload bytes and total MQTT bytes written to the socket
+	[[nodiscard]] unsigned long getPayloadBytes() const;
+	[[nodiscard]] unsigned long getWireBytes() const;
+	
+	/// Get flash spool state: messages waiting, ring size, and counters since startup
+	[[nodiscard]] uint32_t getSpoolDepth() const;
+	[[nodiscard]] uint32_t getSpoolCapacity() const;
+	[[nodiscard]] unsigned long getMessagesSpooled() const;
+	[[nodiscard]] unsigned long getMessagesFlushed() const;
+	[[nodiscard]] unsigned long getSpoolOverwritten() const;
+	[[nodiscard]] unsigned long getBacklogBatches() const;
+	
+	/// Get the rate the last complete spool drain achieved, in messages and payload bytes per second
+	[[nodiscard]] float getFlushMessagesPerSecond() const;
+	[[nodiscard]] float getFlushBytesPerSecond() const;
+	
+	/// Get acknowledged messages and wire bytes extrapolated per hour of uptime
+	[[nodiscard]] unsigned long getMessagesPerHour() const;
+	[[nodiscard]] unsigned long getWireBytesPerHour() const;
+
+private:
+	enum class SlotState : uint8_t {
+		Free,
+		Pending,
+		InFlight
+	};
+	
+	struct OutboundMessage {
+		SlotState state;
+		uint8_t attempts;
+		uint16_t packetId;
+		uint16_t length;
+		unsigned long sentAt;
+		uint8_t payload[TELEMETRY_MAX_PAYLOAD];
+	};
+	
+	struct BatchSample {
+		uint16_t offsetDs;     /// Time since batch start in 0.1 s
+		uint16_t alsCounts;
+		uint16_t whiteCounts;
+	};
+	
+	struct BatchDecision {
+		uint16_t offsetDs;
+		uint8_t decision;
+		uint8_t reason;
+		bool relayOn;
+	};
+	
+	TimeManager* timeManager;
+	LightSensor* lightSensor;
+	
+	/// Network side, only touched by the publishing task
+#if MQTT_TLS_ENABLED
+	TlsClient networkClient;
+#else
+	WiFiClient networkClient;
+#endif
+	MqttClient mqtt;
+	char clientId[24];
+	char topic[64];
+	char backlogTopic[72];
+	uint8_t sendBuffer[TELEMETRY_MAX_PAYLOAD];
+	unsigned long lastConnectAttempt;
+	unsigned long reconnectInterval;
+	uint16_t nextPacketId;
+	volatile bool connected;
+	
+	/// Current batch, only touched by the loop thread
+	BatchSample samples[MAX_BATCH_SAMPLES];
+	BatchDecision decisions[MAX_BATCH_DECISIONS];
+	int sampleCount;
+	int decisionCount;
+	unsigned long batchStartTime;
+	unsigned long batchEpoch;
+	
+	/// Outbound queue shared between loop and task, guarded by queueMutex
+	SemaphoreHandle_t queueMutex;
+	OutboundMessage queue[TELEMETRY_QUEUE_DEPTH];
+	int queueHead;
+	int queueCount;
+	
+	/// Flash spool and the backlog batch read from it, only touched by the task
+	TelemetrySpool spool;
+	bool spoolReady;
+	uint8_t* backlogBuffer;
+	size_t backlogLength;
+	int backlogMessages;
+	uint32_t backlogConsumed;
+	uint16_t backlogPacketId;          /// 0 when no batch is in flight
+	unsigned long backlogSentAt;
+	unsigned long lastBacklogAck;
+	unsigned long drainStartTime;      /// 0 when the spool is not being drained
+	unsigned long drainMessages;
+	unsigned long drainBytes;
+	
+	/// Statistics
+	unsigned long startTime;
+	unsigned long messagesQueued;
+	unsigned long messagesAcked;
+	unsigned long messagesDropped;
+	unsigned long retransmissions;
+	unsigned long connectionCount;
+	unsigned long payloadBytes;
+	unsigned long messagesFlushed;
+	unsigned long backlogBatches;
+	float flushMessagesPerSecond;
+	float flushBytesPerSecond;
+	
+	/// Start a new empty batch
+	void resetBatch();
+	
+	/// Encode the current batch as CBOR into the outbound queue
+	void flushBatch();
+	
+	/// Task entry point and body
+	static void taskEntry(void* parameter);
+	void runTask();
+	
+	/// Keep the broker session up and move messages out of the queue
+	void serviceConnection();
+	
+	/// Publish pending messages and retransmit timed-out ones
+	void sendPending();
+	
+	/// Move every unacknowledged message from the RAM queue into the flash spool
+	void spillQueue();
+	
+	/// Publish the next batch from the spool when the rate limit allows
+	void sendBacklog();
+	
+	/// Release a backlog batch acknowledged by the broker
+	void handleBacklogAck();
+	
+	/// Release a message acknowledged by the broker
+	void handleAck(uint16_t packetId);
+	
+	/// Drop freed slots from the head of the ring
+	void compactQueue();
+};
+
+#endif /// TELEMETRYPUBLISHER_H
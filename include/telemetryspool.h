@@ -0,0 +1,79 @@
+///
+/// TelemetrySpool - Flash-backed outbound telemetry queue
+/// 
+/// We keep telemetry messages that could not be published in a ring of
+/// fixed-size slots in one preallocated LittleFS file, so a long WiFi or
+/// broker outage loses nothing up to TELEMETRY_SPOOL_SLOTS messages and
+/// only the oldest after that. Each slot holds a sequence number, the
+/// message length, a CRC-16 and the CBOR payload. Messages are released
+/// only once the broker acknowledged them; the release point is kept in a
+/// small file, and the ring is rebuilt from the slot headers at boot.
+/// Delivery is at least once: a reset between publish and release sends
+/// a batch again.
+///
+/// Only the telemetry task touches the spool; the counters may be read
+/// from anywhere.
+///
+
+#ifndef TELEMETRYSPOOL_H
+#define TELEMETRYSPOOL_H
+
+#include <Arduino.h>
+#include "config.h"
+
+class TelemetrySpool {
+public:
+	TelemetrySpool();
+	
+	/// Create the ring file if needed and find the unreleased messages in it
+	/// We expect LittleFS to be mounted already; returns false if the spool is unusable
+	bool begin();
+	
+	/// Append a message, overwriting the oldest one when the ring is full
+	bool push(const uint8_t* payload, size_t length);
+	
+	/// Read the oldest messages into buffer as one CBOR array of their payloads
+	/// Returns the bytes written (0 if empty); consumed is what release() must be given,
+	/// which also counts corrupt slots we skipped
+	[[nodiscard]] size_t readBatch(uint8_t* buffer, size_t capacity, int& messages, uint32_t& consumed);
+	
+	/// Drop messages from the front once the broker acknowledged them
+	void release(uint32_t count);
+	
+	/// Get number of messages waiting, and the most the ring holds
+	[[nodiscard]] uint32_t getDepth() const;
+	[[nodiscard]] uint32_t getCapacity() const;
+	
+	/// Get message counters since startup
+	[[nodiscard]] unsigned long getMessagesSpooled() const;
+	[[nodiscard]] unsigned long getMessagesReleased() const;
+	[[nodiscard]] unsigned long getMessagesOverwritten() const;
+	[[nodiscard]] unsigned long getCorruptSlots() const;
+
+private:
+	struct __attribute__((packed)) SlotHeader {
+		uint32_t sequence;         /// 0 = never written
+		uint16_t length;
+		uint16_t checksum;         /// CRC-16/CCITT over sequence, length and payload
+	};
+	
+	static constexpr size_t SLOT_SIZE = sizeof(SlotHeader) + TELEMETRY_MAX_PAYLOAD;
+	
+	bool ready;
+	uint32_t head;                 /// Sequence the next message gets
+	uint32_t tail;                 /// Oldest unreleased sequence
+	
+	/// Statistics
+	unsigned long messagesSpooled;
+	unsigned long messagesReleased;
+	unsigned long messagesOverwritten;
+	unsigned long corruptSlots;
+	
+	/// Persist the release point
+	void saveTail();
+	
+	/// CRC-16/CCITT-FALSE, continued from crc
+	[[nodiscard]] static uint16_t updateChecksum(uint16_t crc, const uint8_t* data, size_t length);
+};
+
+#endif /// TELEMETRYSPOOL_H
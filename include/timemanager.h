@@ -6,6 +6,17 @@
 /// The manager handles timezone offsets and provides easy access
 /// to current time information.
 ///
+/// We resolve the NTP server name ourselves through a DnsCache and hand
+/// NTPClient a numeric address. A sync then costs no DNS round trip
+/// while the pool's TTL lasts. When a server does not answer, the next
+/// attempt goes to another address from the same answer, and if DNS is
+/// down we fall back to the last server that worked. DNS lookup time
+/// and NTP round trip time are recorded in separate histograms.
+///
+/// For the local SNTP server we also keep a UTC clock in milliseconds.
+/// It is anchored at each successful sync to the middle of the NTP round
+/// trip and runs on millis() from there.
+///
 
 #ifndef TIMEMANAGER_H
 #define TIMEMANAGER_H
@@ -13,6 +24,8 @@
 #include <Arduino.h>
 #include <WiFiUdp.h>
 #include <NTPClient.h>
+#include "dnscache.h"
+#include "latencyhistogram.h"
 
 class TimeManager {
 public:
@@ -40,6 +53,21 @@ public:
 	/// Get current minute (0-59)
 	[[nodiscard]] int getCurrentMinute() const;
 	
+	/// Get current local time as Unix timestamp (timezone offset applied)
+	/// Returns 0 when time is not available
+	[[nodiscard]] unsigned long getEpochTime() const;
+	
+	/// Get current UTC time in milliseconds since 1970-01-01
+	/// Returns 0 when time is not available
+	[[nodiscard]] uint64_t getUtcMillis() const;
+	
+	/// Get UTC time of the last successful sync in milliseconds, 0 if never synced
+	[[nodiscard]] uint64_t getLastSyncUtcMillis() const;
+	
+	/// Get current local day number (days since 1970-01-01), or 0 without valid time
+	/// We use this to detect day boundaries for daily records
+	[[nodiscard]] unsigned long getEpochDay() const;
+	
 	/// Get current time as formatted string (HH:MM:SS)
 	[[nodiscard]] String getCurrentTimeString() const;
 	
@@ -61,18 +89,36 @@ public:
 	
 	/// Get number of successful syncs since startup
 	[[nodiscard]] unsigned long getSyncCount() const;
+	
+	/// Get number of NTP requests that got no answer
+	[[nodiscard]] unsigned long getSyncFailures() const;
+	
+	/// Get the address cache for the NTP server name
+	[[nodiscard]] const DnsCache& getServerCache() const;
+	
+	/// Get NTP request round trip times (10 ms resolution, NTPClient polls that often)
+	[[nodiscard]] const LatencyHistogram& getNtpRoundTrip() const;
 
 private:
 	WiFiUDP ntpUDP;
 	NTPClient* ntpClient;
 	
 	const char* ntpServer;
+	DnsCache serverCache;
+	char serverAddress[16];               /// Numeric address NTPClient sends to, no lookup needed
 	int timezoneOffsetSeconds;
 	unsigned long syncInterval;
 	unsigned long lastSyncAttempt;
 	unsigned long lastSuccessfulSync;
 	unsigned long syncCount;
+	unsigned long syncFailures;
 	bool timeValid;
+	uint64_t syncUtcMillis;               /// UTC at the anchor below
+	unsigned long syncAnchorMillis;       /// millis() when the server's answer was current
+	LatencyHistogram ntpRoundTrip;
+	
+	/// Point NTPClient at the cached address, or at the name if we have none
+	void selectServer();
 	
 	/// Check if enough time has passed for next sync attempt
 	[[nodiscard]] bool shouldAttemptSync() const;
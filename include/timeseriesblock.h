@@ -0,0 +1,129 @@
+///
+/// TimeSeriesBlock - Gorilla-style compressed block of timestamped samples
+/// 
+/// We pack samples into a fixed-size block with two columns: timestamps
+/// grow from the front using delta-of-delta encoding and values grow from
+/// the back, either XOR-compressed floats or small integers that cost one
+/// bit when unchanged. A block is full when the columns meet, so every
+/// block on flash has the same size and can be located by offset alone.
+///
+/// Layout:
+///   [0]      magic
+///   [1]      series type (TimeSeriesType)
+///   [2..3]   sample count
+///   [4..7]   timestamp of the first sample (local epoch seconds)
+///   [8..9]   bits used by the timestamp column
+///   [10..11] bits used by the value column
+///   [12..]   timestamp column, read forwards
+///   [..end]  value column, read backwards from the last byte
+///
+
+#ifndef TIMESERIESBLOCK_H
+#define TIMESERIESBLOCK_H
+
+#include <Arduino.h>
+#include "config.h"
+
+enum class TimeSeriesType : uint8_t {
+	FloatXor = 1,    /// 32-bit float values, XOR against the previous value
+	SmallInt = 2     /// 8-bit values, one bit when unchanged
+};
+
+class TimeSeriesBlock {
+public:
+	static constexpr size_t BLOCK_SIZE = TSDB_BLOCK_SIZE;
+	static constexpr size_t HEADER_SIZE = 12;
+	static constexpr uint8_t MAGIC = 0xD7;
+	
+	TimeSeriesBlock();
+	
+	/// Start an empty block
+	void reset(TimeSeriesType type);
+	
+	/// Append a sample; returns false (and leaves the block untouched) when full
+	[[nodiscard]] bool append(uint32_t timestamp, uint32_t value);
+	
+	/// Get the raw block image, header included
+	[[nodiscard]] const uint8_t* getData() const;
+	
+	/// Get number of samples in the block
+	[[nodiscard]] uint16_t getCount() const;
+	
+	/// Get the timestamp of the first and last sample
+	[[nodiscard]] uint32_t getFirstTimestamp() const;
+	[[nodiscard]] uint32_t getLastTimestamp() const;
+	
+	/// Get number of payload bits used by both columns
+	[[nodiscard]] size_t getUsedBits() const;
+	
+	/// Check that a raw block has a valid header
+	[[nodiscard]] static bool isValid(const uint8_t* data);
+	
+	/// Read the first timestamp of a raw block without decoding it
+	[[nodiscard]] static uint32_t readFirstTimestamp(const uint8_t* data);
+	
+	/// Get number of bytes a column of a raw block occupies
+	/// The bytes between the columns are unused, so a block can be sent as
+	/// the header and timestamp column followed by the tail holding the value column
+	[[nodiscard]] static size_t getColumnBytes(const uint8_t* data, bool valueColumn);
+
+private:
+	uint8_t data[BLOCK_SIZE];
+	TimeSeriesType type;
+	uint16_t count;
+	uint32_t firstTimestamp;
+	uint32_t lastTimestamp;
+	int32_t lastDelta;
+	uint32_t lastValue;
+	uint8_t lastLeading;
+	uint8_t lastTrailing;
+	size_t timeBits;
+	size_t valueBits;
+	
+	/// Encode the timestamp and value columns for one sample
+	void encodeTimestamp(uint32_t timestamp);
+	void encodeValue(uint32_t value);
+	
+	/// Write the header fields from the current state
+	void writeHeader();
+	
+	/// Append bits (MSB first) to the forward or backward column
+	void writeBits(bool valueColumn, uint32_t bits, uint8_t length);
+};
+
+class TimeSeriesBlockReader {
+public:
+	/// Decode a raw block; the data must stay valid while reading
+	/// Without data the reader is empty until reset() is called
+	explicit TimeSeriesBlockReader(const uint8_t* data = nullptr);
+	
+	/// Restart decoding, e.g. after the buffer was refilled with another block
+	void reset(const uint8_t* data);
+	
+	/// Decode the next sample; returns false at the end of the block
+	[[nodiscard]] bool next(uint32_t& timestamp, uint32_t& value);
+	
+	/// Get the series type stored in the block
+	[[nodiscard]] TimeSeriesType getType() const;
+	
+	/// Get number of samples in the block
+	[[nodiscard]] uint16_t getCount() const;
+
+private:
+	const uint8_t* data;
+	TimeSeriesType type;
+	uint16_t count;
+	uint16_t index;
+	uint32_t lastTimestamp;
+	int32_t lastDelta;
+	uint32_t lastValue;
+	uint8_t lastLeading;
+	uint8_t lastTrailing;
+	size_t timePosition;
+	size_t valuePosition;
+	
+	/// Read bits (MSB first) from the forward or backward column
+	[[nodiscard]] uint32_t readBits(bool valueColumn, uint8_t length);
+};
+
+#endif /// TIMESERIESBLOCK_H
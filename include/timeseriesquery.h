@@ -0,0 +1,70 @@
+///
+/// TimeSeriesQuery - Streaming range query over stored sensor history
+/// 
+/// We locate the first relevant block with the store's sparse index and
+/// then decode one block at a time into a fixed buffer, so a query uses
+/// the same memory and seek cost whether the store holds a day or months.
+/// The block still being filled in RAM is copied in last, which makes the
+/// newest samples visible before they reach flash.
+///
+
+#ifndef TIMESERIESQUERY_H
+#define TIMESERIESQUERY_H
+
+#include <Arduino.h>
+#include "timeseriesstore.h"
+
+class TimeSeriesQuery {
+public:
+	explicit TimeSeriesQuery(const TimeSeriesStore* store);
+	
+	/// Start a query for samples with from <= timestamp <= to
+	void begin(TimeSeries series, uint32_t from, uint32_t to);
+	
+	/// Get the next matching sample; returns false when the range is exhausted
+	/// Only the first block can hold samples before the range, so a call
+	/// never decodes more than two blocks
+	[[nodiscard]] bool next(uint32_t& timestamp, uint32_t& value);
+	
+	/// Get the next raw block that may hold samples in the range; nullptr when done
+	/// Blocks are returned whole, so the first and last may reach outside the range.
+	/// The data stays valid until the next call. Do not mix with next() in one query
+	[[nodiscard]] const uint8_t* nextBlock();
+	
+	/// Check if all matching samples have been returned
+	[[nodiscard]] bool isDone() const;
+	
+	/// Get number of blocks loaded (flash reads plus the open RAM block)
+	[[nodiscard]] unsigned long getBlocksRead() const;
+	
+	/// Get number of block header reads spent locating the first block
+	[[nodiscard]] unsigned long getHeaderReads() const;
+	
+	/// Convert a stored lux value back to a float
+	[[nodiscard]] static float toFloat(uint32_t value);
+
+private:
+	const TimeSeriesStore* store;
+	uint8_t buffer[TimeSeriesBlock::BLOCK_SIZE];
+	TimeSeriesBlockReader reader;
+	TimeSeries series;
+	uint32_t from;
+	uint32_t to;
+	uint32_t segment;
+	uint16_t blockIndex;
+	bool readingOpenBlock;
+	bool done;
+	unsigned long blocksRead;
+	unsigned long headerReads;
+	
+	/// Load the next block into the buffer; returns false when no blocks remain
+	[[nodiscard]] bool loadNextBlock();
+	
+	/// Binary search the block headers of the current segment for the start block
+	void seekWithinSegment();
+	
+	/// Read a whole block of a segment into the buffer
+	[[nodiscard]] bool readBlock(uint32_t segment, uint16_t block);
+};
+
+#endif /// TIMESERIESQUERY_H
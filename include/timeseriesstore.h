@@ -0,0 +1,171 @@
+///
+/// TimeSeriesStore - Compressed append-only sensor history on LittleFS
+/// 
+/// We keep the raw lux series, relay transitions and control decisions
+/// as Gorilla-compressed TimeSeriesBlocks. Each series fills one block in
+/// RAM and appends it to its current segment file in a single write once
+/// full, so flash sees one program per block instead of one per sample.
+/// Segments are numbered files of TSDB_SEGMENT_BLOCKS blocks; the oldest
+/// are deleted when free space runs low, which bounds flash use.
+///
+/// Slow series like relay and decisions take days to fill a block, so we
+/// also checkpoint each open block to its own file: at most every
+/// TSDB_FLUSH_INTERVAL_MS, only when it gained samples, and only the used
+/// bytes of its two columns. begin() resumes the block from there, and
+/// sealing the block deletes the checkpoint.
+///
+/// We index the history sparsely: RAM holds the first timestamp of each
+/// segment, and the block headers on flash hold the first timestamp of
+/// each block. A lookup is two binary searches whose cost depends only on
+/// the segment size, never on how much history is stored.
+///
+
+#ifndef TIMESERIESSTORE_H
+#define TIMESERIESSTORE_H
+
+#include <Arduino.h>
+#include "config.h"
+#include "timeseriesblock.h"
+#include "timemanager.h"
+#include "plantcontroller.h"
+
+enum class TimeSeries : uint8_t {
+	Lux = 0,        /// Raw lux readings, float
+	Relay = 1,      /// Relay state, written on change
+	Decision = 2    /// Control decision << 4 | reason
+};
+
+class TimeSeriesStore {
+public:
+	static constexpr int SERIES_COUNT = 3;
+	
+	explicit TimeSeriesStore(TimeManager* timeManager);
+	
+	/// Create the storage directory and find existing segments
+	void begin();
+	
+	/// Record a lux reading at the current time
+	void addLux(float lux);
+	
+	/// Record the relay state (only transitions are stored)
+	void addRelayState(bool on);
+	
+	/// Record a control decision
+	void addDecision(ControlDecision decision, ControlReason reason);
+	
+	/// Checkpoint an open block whose oldest unsaved sample has waited TSDB_FLUSH_INTERVAL_MS,
+	/// at most one per call
+	void update();
+	
+	/// Checkpoint every open block with unsaved samples (before a restart)
+	void flush();
+	
+	/// Get the name used for a series in file names
+	[[nodiscard]] static const char* getSeriesName(TimeSeries series);
+	
+	/// Find a series by its name; returns false if there is none
+	[[nodiscard]] static bool parseSeriesName(const char* name, TimeSeries& series);
+	
+	/// Format the path of a segment file
+	static void formatSegmentPath(TimeSeries series, uint32_t segment, char* buffer, size_t size);
+	
+	/// Get the oldest and newest segment numbers of a series
+	[[nodiscard]] uint32_t getFirstSegment(TimeSeries series) const;
+	[[nodiscard]] uint32_t getLastSegment(TimeSeries series) const;
+	
+	/// Find the segment that holds a timestamp (the first segment if it is older)
+	[[nodiscard]] uint32_t findSegment(TimeSeries series, uint32_t timestamp) const;
+	
+	/// Get the first timestamp of a segment from the RAM index
+	[[nodiscard]] uint32_t getSegmentStart(TimeSeries series, uint32_t segment) const;
+	
+	/// Get the block still being filled in RAM for a series
+	[[nodiscard]] const TimeSeriesBlock& getOpenBlock(TimeSeries series) const;
+	
+	/// Get number of samples stored (flash and RAM) since startup
+	[[nodiscard]] unsigned long getSampleCount(TimeSeries series) const;
+	
+	/// Get number of samples skipped because time was not valid
+	[[nodiscard]] unsigned long getSkippedSamples() const;
+	
+	/// Get number of blocks and bytes appended to flash since startup
+	[[nodiscard]] unsigned long getBlocksWritten() const;
+	[[nodiscard]] unsigned long getBytesWritten() const;
+	
+	/// Get number of block writes that failed
+	[[nodiscard]] unsigned long getWriteErrors() const;
+	
+	/// Check if the store directory exists and blocks can be written
+	[[nodiscard]] bool isStorageReady() const;
+	
+	/// Get number of segments deleted to free space
+	[[nodiscard]] unsigned long getSegmentsDeleted() const;
+	
+	/// Get compressed bytes per lux sample, including block overhead
+	[[nodiscard]] float getBytesPerSample() const;
+	
+	/// Estimate compressed lux bytes per day at the configured sample rate
+	[[nodiscard]] float getBytesPerDay() const;
+	
+	/// Estimate how many days of history fit in the filesystem
+	[[nodiscard]] float getEstimatedRetentionDays() const;
+	
+	/// Estimate erase cycles per flash block per day, assuming every append
+	/// also rewrites one partially filled filesystem block
+	[[nodiscard]] float getWearCyclesPerDay() const;
+
+private:
+	struct SeriesState {
+		TimeSeriesBlock block;
+		uint32_t firstSegment;
+		uint32_t lastSegment;
+		uint16_t blocksInSegment;
+		uint32_t segmentStart[TSDB_INDEX_SEGMENTS];  /// First timestamp, indexed by segment % TSDB_INDEX_SEGMENTS
+		unsigned long sampleCount;
+		unsigned long blocksWritten;
+		uint16_t savedCount;                         /// Samples of the open block in its checkpoint
+		unsigned long dirtySince;                    /// millis() of the first sample not in the checkpoint
+	};
+	
+	TimeManager* timeManager;
+	SeriesState series[SERIES_COUNT];
+	bool storageReady;
+	bool relayKnown;
+	bool lastRelayState;
+	unsigned long skippedSamples;
+	unsigned long writeErrors;
+	unsigned long segmentsDeleted;
+	
+	/// Append one sample, writing the block out first if it is full
+	void appendSample(TimeSeries series, uint32_t value);
+	
+	/// Append the open block to the current segment and start a new one
+	void writeBlock(TimeSeries series);
+	
+	/// Write the used part of the open block to its checkpoint file
+	void saveOpenBlock(TimeSeries series);
+	
+	/// Resume open blocks from their checkpoint files
+	void loadOpenBlocks();
+	
+	/// Delete oldest segments until TSDB_MIN_FREE_BYTES are free and every
+	/// series fits in the index
+	void enforceRetention();
+	
+	/// Delete the oldest segment of a series
+	void deleteOldestSegment(int series);
+	
+	/// Build the checkpoint file path of a series
+	static void formatOpenBlockPath(TimeSeries series, char* buffer, size_t size);
+	
+	/// Find existing segments of all series on flash
+	void scanSegments();
+	
+	/// Fill the RAM index from the first block header of every segment
+	void loadIndex();
+	
+	/// Get the block type used for a series
+	[[nodiscard]] static TimeSeriesType getSeriesType(TimeSeries series);
+};
+
+#endif /// TIMESERIESSTORE_H
@@ -0,0 +1,125 @@
+///
+/// TlsClient - TLS over a WiFiClient that resumes sessions across reconnects
+/// 
+/// A full TLS handshake costs the ESP32 one to three seconds of CPU for the
+/// key exchange and certificate chain checks, plus a heap allocation of
+/// every mbedtls context. We do that work once. The CA certificate is
+/// parsed and the random generator seeded in begin(), and one SSL context
+/// is reset and reused for every connection. After a successful
+/// handshake we keep the session (session id or ticket, whichever the
+/// server issues) and offer it on the next connect. A broker that still
+/// knows it resumes without key exchange or certificate checks, so after
+/// a WiFi flap the secure channel is back after a single round trip. A
+/// broker that refuses gets a normal full handshake, which verifies the
+/// chain again.
+///
+/// Every handshake is timed. Wall time is split into time spent waiting
+/// for the network and the rest, which approximates the CPU time the
+/// handshake cost us.
+///
+/// The client is not thread safe; like WiFiClient it belongs to one task.
+///
+
+#ifndef TLSCLIENT_H
+#define TLSCLIENT_H
+
+#include <Arduino.h>
+#include <Client.h>
+#include <WiFi.h>
+#include <mbedtls/ssl.h>
+#include <mbedtls/entropy.h>
+#include <mbedtls/ctr_drbg.h>
+#include <mbedtls/x509_crt.h>
+#include "config.h"
+
+/// Timing of one TLS handshake
+struct TlsHandshakeStats {
+	bool resumed;                     /// Session was resumed, no key exchange or certificate checks
+	unsigned long tcpConnectMs;       /// TCP connect before the handshake
+	unsigned long handshakeMs;        /// Wall time of the handshake
+	unsigned long cpuMs;              /// handshakeMs minus time waiting for the network
+	unsigned long bytesReceived;      /// Handshake bytes from the server (certificates dominate)
+};
+
+class TlsClient : public Client {
+public:
+	TlsClient();
+	~TlsClient() override;
+	
+	/// Load the CA certificate from LittleFS and set up the TLS configuration
+	/// Returns false if the certificate is missing or invalid; connect() then fails
+	[[nodiscard]] bool begin(const char* caCertPath);
+	
+	/// Open TCP, then TLS, offering the cached session; blocks for up to TLS_HANDSHAKE_TIMEOUT_MS
+	int connect(IPAddress ip, uint16_t port) override;
+	int connect(const char* host, uint16_t port) override;
+	
+	size_t write(uint8_t byte) override;
+	size_t write(const uint8_t* buffer, size_t size) override;
+	int available() override;
+	int read() override;
+	int read(uint8_t* buffer, size_t size) override;
+	int peek() override;
+	void flush() override;
+	void stop() override;
+	uint8_t connected() override;
+	operator bool() override;
+	
+	/// Forget the cached session so the next connect does a full handshake
+	void clearSession();
+	
+	/// Get number of handshakes since startup, by kind
+	[[nodiscard]] unsigned long getFullHandshakes() const;
+	[[nodiscard]] unsigned long getResumedHandshakes() const;
+	[[nodiscard]] unsigned long getFailedHandshakes() const;
+	
+	/// Get total handshake wall and CPU time since startup
+	[[nodiscard]] unsigned long getHandshakeMsTotal() const;
+	[[nodiscard]] unsigned long getHandshakeCpuMsTotal() const;
+	
+	/// Get timing of the most recent successful handshake
+	[[nodiscard]] const TlsHandshakeStats& getLastHandshake() const;
+	
+	/// Check if a session is cached for the next connect
+	[[nodiscard]] bool hasSession() const;
+
+private:
+	WiFiClient tcp;
+	bool configured;
+	bool established;
+	bool sessionCached;
+	int peeked;                           /// Byte returned by peek(), or -1
+	
+	mbedtls_entropy_context entropy;
+	mbedtls_ctr_drbg_context drbg;
+	mbedtls_x509_crt caCert;
+	mbedtls_ssl_config config;
+	mbedtls_ssl_context ssl;
+	mbedtls_ssl_session session;
+	
+	/// Handshake in progress
+	bool certificateChecked;              /// Set by the verify callback, so only on full handshakes
+	unsigned long waitMs;
+	unsigned long handshakeBytes;
+	
+	/// Statistics
+	unsigned long fullHandshakes;
+	unsigned long resumedHandshakes;
+	unsigned long failedHandshakes;
+	unsigned long handshakeMsTotal;
+	unsigned long handshakeCpuMsTotal;
+	TlsHandshakeStats lastHandshake;
+	
+	/// Run the handshake on the open TCP connection
+	[[nodiscard]] bool handshake(const char* host, unsigned long tcpConnectMs);
+	
+	/// Decrypt the next record if needed; returns plaintext bytes ready to read
+	[[nodiscard]] int pendingBytes();
+	
+	/// mbedtls callbacks
+	static int sendCallback(void* context, const unsigned char* buffer, size_t length);
+	static int receiveCallback(void* context, unsigned char* buffer, size_t length);
+	static int verifyCallback(void* context, mbedtls_x509_crt* certificate, int depth, uint32_t* flags);
+};
+
+#endif /// TLSCLIENT_H
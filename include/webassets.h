@@ -0,0 +1,32 @@
+///
+/// WebAssets - Dashboard files compressed at build time and kept in flash
+/// 
+/// tools/web_assets.py gzips everything in web/ when the firmware is
+/// built and turns it into const arrays, which the linker leaves in flash.
+/// We send those bytes as they are with Content-Encoding: gzip, so a file
+/// is never compressed, decompressed or copied whole into RAM here.
+/// Each asset carries a strong ETag (a hash of its compressed bytes);
+/// immutable assets are referenced by pages with that hash in their URL.
+///
+
+#ifndef WEBASSETS_H
+#define WEBASSETS_H
+
+#include <Arduino.h>
+
+struct WebAsset {
+	const char* path;          /// Request path, "/" for index.html
+	const char* contentType;
+	const char* etag;          /// Quoted, ready for the ETag header
+	bool immutable;            /// Versioned by URL; may be cached for HTTP_ASSET_MAX_AGE_S
+	const uint8_t* data;       /// Gzip stream in flash
+	size_t length;
+};
+
+/// Find the asset served at a path; nullptr if there is none
+[[nodiscard]] const WebAsset* findWebAsset(const char* path);
+
+/// Get total compressed bytes of all assets
+[[nodiscard]] size_t getWebAssetBytes();
+
+#endif /// WEBASSETS_H
@@ -0,0 +1,122 @@
+///
+/// CborWriter Implementation
+/// 
+/// We always pick the shortest head encoding so small counters and
+/// time deltas cost a single byte on the wire.
+///
+
+#include "cborwriter.h"
+
+static constexpr uint8_t CBOR_UNSIGNED = 0;
+static constexpr uint8_t CBOR_NEGATIVE = 1;
+static constexpr uint8_t CBOR_TEXT = 3;
+static constexpr uint8_t CBOR_ARRAY = 4;
+static constexpr uint8_t CBOR_MAP = 5;
+static constexpr uint8_t CBOR_SIMPLE = 7;
+
+CborWriter::CborWriter(uint8_t* buffer, size_t capacity)
+	: buffer(buffer)
+	, capacity(capacity)
+	, length(0)
+	, overflowed(false)
+{
+	/// We write straight into the caller's buffer
+}
+
+void CborWriter::beginArray(size_t items) {
+	this->writeHead(CBOR_ARRAY, items);
+}
+
+void CborWriter::beginMap(size_t pairs) {
+	this->writeHead(CBOR_MAP, pairs);
+}
+
+void CborWriter::writeUInt(uint64_t value) {
+	this->writeHead(CBOR_UNSIGNED, value);
+}
+
+void CborWriter::writeInt(int64_t value) {
+	if (value >= 0) {
+		this->writeHead(CBOR_UNSIGNED, (uint64_t)value);
+	} else {
+		/// We encode -1 - n as major type 1 with argument n
+		this->writeHead(CBOR_NEGATIVE, (uint64_t)(-1 - value));
+	}
+}
+
+void CborWriter::writeFloat(float value) {
+	/// We always use single precision; it is exact for our sensor values
+	uint32_t bits;
+	memcpy(&bits, &value, sizeof(bits));
+	this->writeByte((CBOR_SIMPLE << 5) | 26);
+	for (int shift = 24; shift >= 0; shift -= 8) {
+		this->writeByte((uint8_t)(bits >> shift));
+	}
+}
+
+void CborWriter::writeBool(bool value) {
+	this->writeByte((CBOR_SIMPLE << 5) | (value ? 21 : 20));
+}
+
+void CborWriter::writeString(const char* text) {
+	size_t size = strlen(text);
+	this->writeHead(CBOR_TEXT, size);
+	this->writeBytes((const uint8_t*)text, size);
+}
+
+void CborWriter::writeKey(const char* key) {
+	this->writeString(key);
+}
+
+size_t CborWriter::getLength() const {
+	return this->length;
+}
+
+bool CborWriter::hasOverflowed() const {
+	return this->overflowed;
+}
+
+void CborWriter::truncate(size_t length) {
+	if (length <= this->length) {
+		this->length = length;
+		this->overflowed = false;
+	}
+}
+
+void CborWriter::writeHead(uint8_t majorType, uint64_t argument) {
+	uint8_t major = majorType << 5;
+	
+	if (argument < 24) {
+		this->writeByte(major | (uint8_t)argument);
+	} else if (argument <= 0xFF) {
+		this->writeByte(major | 24);
+		this->writeByte((uint8_t)argument);
+	} else if (argument <= 0xFFFF) {
+		this->writeByte(major | 25);
+		this->writeByte((uint8_t)(argument >> 8));
+		this->writeByte((uint8_t)argument);
+	} else if (argument <= 0xFFFFFFFFULL) {
+		this->writeByte(major | 26);
+		for (int shift = 24; shift >= 0; shift -= 8) {
+			this->writeByte((uint8_t)(argument >> shift));
+		}
+	} else {
+		this->writeByte(major | 27);
+		for (int shift = 56; shift >= 0; shift -= 8) {
+			this->writeByte((uint8_t)(argument >> shift));
+		}
+	}
+}
+
+void CborWriter::writeBytes(const uint8_t* data, size_t size) {
+	if (this->overflowed || this->length + size > this->capacity) {
+		this->overflowed = true;
+		return;
+	}
+	memcpy(this->buffer + this->length, data, size);
+	this->length += size;
+}
+
+void CborWriter::writeByte(uint8_t value) {
+	this->writeBytes(&value, 1);
+}
@@ -0,0 +1,335 @@
+///
+/// DailySummary Implementation
+/// 
+/// We keep only running sums in RAM and touch flash at day boundaries
+/// and at checkpoints, so the daily history costs a few hundred bytes
+/// of flash writes per day.
+///
+
+#include "dailysummary.h"
+#include "logger.h"
+#include "config.h"
+#include <LittleFS.h>
+
+static const char* DAILY_SUMMARY_PATH = "/daily.bin";
+static constexpr uint8_t DAILY_RECORD_VERSION = 1;
+
+DailySummary::DailySummary(TimeManager* timeManager, LightSensor* lightSensor,
+						RelayController* relayController, PlantController* plantController)
+	: timeManager(timeManager)
+	, lightSensor(lightSensor)
+	, relayController(relayController)
+	, plantController(plantController)
+	, currentDay(0)
+	, lampOnMs(0)
+	, noTimeMs(0)
+	, lastUpdateTime(0)
+	, lastSampleTime(0)
+	, lastCheckpointTime(0)
+	, relayChangesAtDayStart(0)
+	, sensorErrorsAtDayStart(0)
+	, resumedSwitches(0)
+	, resumedSensorErrors(0)
+	, minLux(NAN)
+	, maxLux(NAN)
+	, luxSum(0.0)
+	, photonSum(0.0)
+	, sampleCount(0)
+	, flags(DAILY_FLAG_PARTIAL)
+	, recordsWritten(0)
+	, storageReady(false)
+{
+	/// We treat the first day as partial since we did not see its start
+}
+
+void DailySummary::begin() {
+	const size_t ringSize = DAILY_SUMMARY_DAYS * sizeof(DailySummaryRecord);
+	
+	/// We preallocate the whole ring so slot writes never grow the file
+	File file = LittleFS.open(DAILY_SUMMARY_PATH, FILE_READ);
+	bool valid = file && file.size() == ringSize;
+	file.close();
+	
+	if (!valid) {
+		file = LittleFS.open(DAILY_SUMMARY_PATH, FILE_WRITE);
+		if (!file) {
+			LOG_ERROR("DailySummary: ✗ Cannot create history file");
+			return;
+		}
+		
+		DailySummaryRecord empty;
+		memset(&empty, 0, sizeof(empty));
+		for (int i = 0; i < DAILY_SUMMARY_DAYS; i++) {
+			file.write((const uint8_t*)&empty, sizeof(empty));
+		}
+		file.close();
+		LOG_INFO("DailySummary: Created empty history ring");
+	}
+	
+	this->storageReady = true;
+	this->lastUpdateTime = millis();
+	this->lastCheckpointTime = millis();
+	this->relayChangesAtDayStart = this->getRelayChangeTotal();
+	this->sensorErrorsAtDayStart = this->getSensorErrorTotal();
+	
+	LOG_INFO("DailySummary: Ready (%d day ring)", DAILY_SUMMARY_DAYS);
+}
+
+void DailySummary::update() {
+	unsigned long now = millis();
+	unsigned long elapsed = now - this->lastUpdateTime;
+	this->lastUpdateTime = now;
+	
+	/// We integrate durations first so they count towards the day they happened in
+	if (this->relayController->getRelayState()) {
+		this->lampOnMs += elapsed;
+	}
+	
+	if (!this->timeManager || !this->timeManager->hasValidTime()) {
+		this->noTimeMs += elapsed;
+		return; /// We cannot detect day boundaries without time
+	}
+	
+	unsigned long today = this->timeManager->getEpochDay();
+	if (this->currentDay == 0) {
+		/// We adopt the first valid day and merge any checkpoint saved before a reboot
+		this->resumeDay(today);
+	} else if (today != this->currentDay) {
+		this->writeRecord(false);
+		this->startDay(today);
+	}
+	
+	if (now - this->lastCheckpointTime >= DAILY_SUMMARY_CHECKPOINT_MS) {
+		this->lastCheckpointTime = now;
+		this->writeRecord(true);
+	}
+}
+
+void DailySummary::checkpoint() {
+	this->lastCheckpointTime = millis();
+	this->writeRecord(true);
+}
+
+void DailySummary::addSample(float lux) {
+	unsigned long now = millis();
+	
+	this->minLux = isnan(this->minLux) ? lux : min(this->minLux, lux);
+	this->maxLux = isnan(this->maxLux) ? lux : max(this->maxLux, lux);
+	this->luxSum += lux;
+	this->sampleCount++;
+	
+	/// We integrate PPFD over the time since the previous sample
+	/// Gaps longer than a few intervals (sensor lost) are not extrapolated
+	if (this->lastSampleTime != 0) {
+		unsigned long dt = min(now - this->lastSampleTime, (unsigned long)(4 * SENSOR_READ_INTERVAL_MS));
+		this->photonSum += lux * LUX_TO_PPFD * (dt / 1000.0);
+	}
+	this->lastSampleTime = now;
+}
+
+DailySummaryRecord DailySummary::getCurrentRecord() const {
+	DailySummaryRecord record;
+	memset(&record, 0, sizeof(record));
+	
+	record.day = this->currentDay;
+	record.lampOnMinutes = (uint16_t)min(this->lampOnMs / 60000UL, 1440UL);
+	record.noTimeMinutes = (uint16_t)min(this->noTimeMs / 60000UL, 1440UL);
+	record.switchCount = (uint16_t)min(this->resumedSwitches + this->getRelayChangeTotal() - this->relayChangesAtDayStart, 65535UL);
+	record.sensorErrors = (uint16_t)min(this->resumedSensorErrors + this->getSensorErrorTotal() - this->sensorErrorsAtDayStart, 65535UL);
+	record.minLux = this->sampleCount > 0 ? this->minLux : 0.0f;
+	record.maxLux = this->sampleCount > 0 ? this->maxLux : 0.0f;
+	record.meanLux = this->sampleCount > 0 ? (float)(this->luxSum / this->sampleCount) : 0.0f;
+	record.sampleCount = (uint16_t)min(this->sampleCount, (uint32_t)65535);
+	
+	/// We convert umol/m2 to 0.01 mol/m2
+	record.dliCentimol = (uint16_t)min(this->photonSum / 10000.0, 65535.0);
+	
+	record.version = DAILY_RECORD_VERSION;
+	record.flags = this->flags;
+	record.checksum = computeChecksum(record);
+	return record;
+}
+
+size_t DailySummary::readHistory(DailySummaryRecord* records, size_t maxRecords) const {
+	if (!this->storageReady) {
+		return 0;
+	}
+	
+	File file = LittleFS.open(DAILY_SUMMARY_PATH, FILE_READ);
+	if (!file) {
+		return 0;
+	}
+	
+	/// We read all slots in one go, then drop empty and corrupt ones in place
+	size_t slots = min(maxRecords, (size_t)DAILY_SUMMARY_DAYS);
+	size_t bytesRead = file.read((uint8_t*)records, slots * sizeof(DailySummaryRecord));
+	file.close();
+	
+	size_t valid = 0;
+	for (size_t i = 0; i < bytesRead / sizeof(DailySummaryRecord); i++) {
+		if (records[i].day != 0 && records[i].checksum == computeChecksum(records[i])) {
+			records[valid++] = records[i];
+		}
+	}
+	return valid;
+}
+
+File DailySummary::openHistory(size_t firstSlot) const {
+	if (!this->storageReady || firstSlot >= DAILY_SUMMARY_DAYS) {
+		return File();
+	}
+	
+	File file = LittleFS.open(DAILY_SUMMARY_PATH, FILE_READ);
+	if (file) {
+		file.seek(firstSlot * sizeof(DailySummaryRecord), SeekSet);
+	}
+	return file;
+}
+
+bool DailySummary::readNextRecord(File& file, DailySummaryRecord& record) const {
+	if (!file) {
+		return false;
+	}
+	
+	/// The walk continues at slot 0 after the last slot; this is the only seek
+	if (file.position() >= DAILY_SUMMARY_DAYS * sizeof(DailySummaryRecord)) {
+		file.seek(0, SeekSet);
+	}
+	size_t bytesRead = file.read((uint8_t*)&record, sizeof(record));
+	
+	return bytesRead == sizeof(record)
+		&& record.day != 0
+		&& record.checksum == computeChecksum(record);
+}
+
+const char* DailySummary::getStoragePath() {
+	return DAILY_SUMMARY_PATH;
+}
+
+unsigned long DailySummary::getRecordsWritten() const {
+	return this->recordsWritten;
+}
+
+bool DailySummary::isStorageReady() const {
+	return this->storageReady;
+}
+
+void DailySummary::startDay(unsigned long day) {
+	this->currentDay = day;
+	this->lampOnMs = 0;
+	this->noTimeMs = 0;
+	this->relayChangesAtDayStart = this->getRelayChangeTotal();
+	this->sensorErrorsAtDayStart = this->getSensorErrorTotal();
+	this->resumedSwitches = 0;
+	this->resumedSensorErrors = 0;
+	this->minLux = NAN;
+	this->maxLux = NAN;
+	this->luxSum = 0.0;
+	this->photonSum = 0.0;
+	this->sampleCount = 0;
+	this->flags = 0;
+	this->lastCheckpointTime = millis();
+}
+
+void DailySummary::resumeDay(unsigned long day) {
+	this->currentDay = day;
+	this->flags |= DAILY_FLAG_PARTIAL;
+	
+	DailySummaryRecord saved;
+	if (!this->readSlot(day, saved)) {
+		return;
+	}
+	
+	/// We fold the checkpoint into what we accumulated since boot
+	this->lampOnMs += saved.lampOnMinutes * 60000UL;
+	this->noTimeMs += saved.noTimeMinutes * 60000UL;
+	this->resumedSwitches = saved.switchCount;
+	this->resumedSensorErrors = saved.sensorErrors;
+	this->photonSum += saved.dliCentimol * 10000.0;
+	
+	if (saved.sampleCount > 0) {
+		this->minLux = isnan(this->minLux) ? saved.minLux : min(this->minLux, saved.minLux);
+		this->maxLux = isnan(this->maxLux) ? saved.maxLux : max(this->maxLux, saved.maxLux);
+		this->luxSum += (double)saved.meanLux * saved.sampleCount;
+		this->sampleCount += saved.sampleCount;
+	}
+	
+	LOG_INFO("DailySummary: Resumed today's record from checkpoint");
+}
+
+void DailySummary::writeRecord(bool inProgress) {
+	if (!this->storageReady || this->currentDay == 0) {
+		return;
+	}
+	
+	if (inProgress) {
+		this->flags |= DAILY_FLAG_IN_PROGRESS;
+	} else {
+		this->flags &= ~DAILY_FLAG_IN_PROGRESS;
+	}
+	DailySummaryRecord record = this->getCurrentRecord();
+	
+	/// We overwrite the slot for this day in place; the file size never changes
+	File file = LittleFS.open(DAILY_SUMMARY_PATH, "r+");
+	if (!file) {
+		LOG_ERROR("DailySummary: ✗ Cannot open history file");
+		return;
+	}
+	
+	size_t slot = this->currentDay % DAILY_SUMMARY_DAYS;
+	file.seek(slot * sizeof(DailySummaryRecord), SeekSet);
+	size_t written = file.write((const uint8_t*)&record, sizeof(record));
+	file.close();
+	
+	if (written != sizeof(record)) {
+		LOG_ERROR("DailySummary: ✗ Short write to history file");
+		return;
+	}
+	
+	this->recordsWritten++;
+	
+	if (!inProgress) {
+		LOG_INFO("DailySummary: ✓ Stored day %lu (lamp %d min, %d switches, DLI %.2f mol/m2)",
+			(unsigned long)record.day, record.lampOnMinutes, record.switchCount, record.dliCentimol / 100.0f);
+	}
+}
+
+bool DailySummary::readSlot(unsigned long day, DailySummaryRecord& record) const {
+	if (!this->storageReady) {
+		return false;
+	}
+	
+	File file = LittleFS.open(DAILY_SUMMARY_PATH, FILE_READ);
+	if (!file) {
+		return false;
+	}
+	
+	file.seek((day % DAILY_SUMMARY_DAYS) * sizeof(DailySummaryRecord), SeekSet);
+	size_t bytesRead = file.read((uint8_t*)&record, sizeof(record));
+	file.close();
+	
+	return bytesRead == sizeof(record)
+		&& record.day == day
+		&& record.checksum == computeChecksum(record);
+}
+
+uint16_t DailySummary::computeChecksum(const DailySummaryRecord& record) {
+	/// We use CRC-16/CCITT-FALSE over everything but the checksum field
+	const uint8_t* data = (const uint8_t*)&record;
+	uint16_t crc = 0xFFFF;
+	for (size_t i = 0; i < offsetof(DailySummaryRecord, checksum); i++) {
+		crc ^= (uint16_t)data[i] << 8;
+		for (int bit = 0; bit < 8; bit++) {
+			crc = (crc & 0x8000) ? (crc << 1) ^ 0x1021 : crc << 1;
+		}
+	}
+	return crc;
+}
+
+unsigned long DailySummary::getSensorErrorTotal() const {
+	return this->lightSensor->getTransactionErrors();
+}
+
+unsigned long DailySummary::getRelayChangeTotal() const {
+	return this->plantController->getRelayChanges();
+}
@@ -0,0 +1,284 @@
+///
+/// DnsCache Implementation
+/// 
+/// Queries follow RFC 1035: one question, recursion desired, sent from a
+/// random port with a random id so stray or spoofed answers are ignored.
+/// We read only the answer section and take A records in class IN,
+/// skipping the CNAMEs pools put in front of them.
+///
+
+#include "dnscache.h"
+#include "logger.h"
+
+static constexpr uint16_t DNS_PORT = 53;
+static constexpr uint16_t DNS_TYPE_A = 1;
+static constexpr uint16_t DNS_CLASS_IN = 1;
+static constexpr size_t DNS_HEADER_SIZE = 12;
+static constexpr size_t DNS_PACKET_SIZE = 512;
+
+DnsCache::DnsCache(const char* hostname, const char* namespaceName)
+	: hostname(hostname)
+	, namespaceName(namespaceName)
+	, addressCount(0)
+	, currentIndex(0)
+	, resolvedAt(0)
+	, ttlMs(0)
+	, hasLastGood(false)
+	, lookupCount(0)
+	, lookupFailures(0)
+	, rotationCount(0)
+{
+}
+
+void DnsCache::begin() {
+	/// A numeric hostname, such as a local SNTP master, is its own answer and never expires
+	IPAddress numeric;
+	if (numeric.fromString(this->hostname)) {
+		this->addresses[0] = numeric;
+		this->addressCount = 1;
+		this->resolvedAt = millis();
+		this->ttlMs = ULONG_MAX;
+	}
+	
+	this->preferences.begin(this->namespaceName, false);
+	uint32_t stored = this->preferences.getUInt("ip", 0);
+	if (stored != 0) {
+		this->lastGood = IPAddress(stored);
+		this->hasLastGood = true;
+		LOG_INFO("DnsCache: Last good address for %s is %s", this->hostname, this->lastGood.toString().c_str());
+	}
+}
+
+bool DnsCache::refresh() {
+	if (this->addressCount > 0 && millis() - this->resolvedAt < this->ttlMs) {
+		return true;
+	}
+	
+	/// We keep expired addresses when the lookup fails; a stale server beats none
+	if (WiFi.status() == WL_CONNECTED && this->resolve()) {
+		return true;
+	}
+	return this->addressCount > 0 || this->hasLastGood;
+}
+
+bool DnsCache::getAddress(IPAddress& address) const {
+	if (this->addressCount > 0) {
+		address = this->addresses[this->currentIndex];
+		return true;
+	}
+	if (this->hasLastGood) {
+		address = this->lastGood;
+		return true;
+	}
+	return false;
+}
+
+void DnsCache::markGood() {
+	IPAddress address;
+	if (!this->getAddress(address) || (this->hasLastGood && address == this->lastGood)) {
+		return;
+	}
+	
+	/// We only write NVS when the working server changes
+	this->lastGood = address;
+	this->hasLastGood = true;
+	this->preferences.putUInt("ip", (uint32_t)address);
+}
+
+void DnsCache::rotate() {
+	if (this->addressCount > 1) {
+		this->currentIndex = (this->currentIndex + 1) % this->addressCount;
+		this->rotationCount++;
+	}
+}
+
+int DnsCache::getAddressCount() const {
+	return this->addressCount;
+}
+
+unsigned long DnsCache::getSecondsToExpiry() const {
+	unsigned long age = millis() - this->resolvedAt;
+	if (this->addressCount == 0 || age >= this->ttlMs) {
+		return 0;
+	}
+	return (this->ttlMs - age) / 1000;
+}
+
+unsigned long DnsCache::getLookupCount() const {
+	return this->lookupCount;
+}
+
+unsigned long DnsCache::getLookupFailures() const {
+	return this->lookupFailures;
+}
+
+unsigned long DnsCache::getRotationCount() const {
+	return this->rotationCount;
+}
+
+const LatencyHistogram& DnsCache::getLookupLatency() const {
+	return this->lookupLatency;
+}
+
+bool DnsCache::resolve() {
+	this->lookupCount++;
+	
+	uint8_t packet[DNS_PACKET_SIZE];
+	uint16_t id = (uint16_t)random(0x10000);
+	size_t queryLength = this->buildQuery(packet, sizeof(packet), id);
+	if (queryLength == 0) {
+		this->lookupFailures++;
+		return false;
+	}
+	
+	WiFiUDP udp;
+	if (!udp.begin((uint16_t)random(49152, 65536))) {
+		this->lookupFailures++;
+		return false;
+	}
+	
+	unsigned long startMicros = micros();
+	bool resolved = false;
+	if (udp.beginPacket(WiFi.dnsIP(), DNS_PORT) && udp.write(packet, queryLength) == queryLength && udp.endPacket()) {
+		unsigned long startTime = millis();
+		while (!resolved && millis() - startTime < DNS_QUERY_TIMEOUT_MS) {
+			int length = udp.parsePacket();
+			if (length <= 0) {
+				delay(1);
+				continue;
+			}
+			int bytesRead = udp.read(packet, sizeof(packet));
+			resolved = bytesRead > 0 && this->parseResponse(packet, bytesRead, id);
+		}
+	}
+	udp.stop();
+	
+	if (!resolved) {
+		this->lookupFailures++;
+		LOG_WARN("DnsCache: ✗ Lookup of %s failed, keeping %d cached address(es)", this->hostname,
+			this->addressCount > 0 ? this->addressCount : (this->hasLastGood ? 1 : 0));
+		return false;
+	}
+	
+	this->lookupLatency.record(micros() - startMicros);
+	this->resolvedAt = millis();
+	
+	/// We start at the server that worked last, if the pool still lists it
+	this->currentIndex = 0;
+	for (int i = 0; i < this->addressCount; i++) {
+		if (this->hasLastGood && this->addresses[i] == this->lastGood) {
+			this->currentIndex = i;
+		}
+	}
+	LOG_INFO("DnsCache: %s -> %d address(es), TTL %lu s, %lu us", this->hostname, this->addressCount,
+		this->ttlMs / 1000, micros() - startMicros);
+	return true;
+}
+
+size_t DnsCache::buildQuery(uint8_t* packet, size_t capacity, uint16_t id) const {
+	size_t nameLength = strlen(this->hostname);
+	if (DNS_HEADER_SIZE + nameLength + 2 + 4 > capacity) {
+		return 0;
+	}
+	
+	/// Header: id, flags with recursion desired, one question
+	memset(packet, 0, DNS_HEADER_SIZE);
+	packet[0] = id >> 8;
+	packet[1] = id & 0xFF;
+	packet[2] = 0x01;
+	packet[5] = 1;
+	
+	/// Name as length-prefixed labels
+	size_t offset = DNS_HEADER_SIZE;
+	const char* label = this->hostname;
+	while (*label) {
+		const char* dot = strchr(label, '.');
+		size_t labelLength = dot ? (size_t)(dot - label) : strlen(label);
+		if (labelLength == 0 || labelLength > 63) {
+			return 0;
+		}
+		packet[offset++] = (uint8_t)labelLength;
+		memcpy(packet + offset, label, labelLength);
+		offset += labelLength;
+		label += labelLength + (dot ? 1 : 0);
+	}
+	packet[offset++] = 0;
+	
+	packet[offset++] = 0;
+	packet[offset++] = DNS_TYPE_A;
+	packet[offset++] = 0;
+	packet[offset++] = DNS_CLASS_IN;
+	return offset;
+}
+
+bool DnsCache::parseResponse(const uint8_t* packet, size_t length, uint16_t id) {
+	if (length < DNS_HEADER_SIZE || ((packet[0] << 8) | packet[1]) != id || !(packet[2] & 0x80)) {
+		return false;
+	}
+	if ((packet[3] & 0x0F) != 0) {
+		return false;
+	}
+	
+	uint16_t questions = (packet[4] << 8) | packet[5];
+	uint16_t answers = (packet[6] << 8) | packet[7];
+	size_t offset = DNS_HEADER_SIZE;
+	for (uint16_t i = 0; i < questions; i++) {
+		offset = skipName(packet, length, offset);
+		if (offset == 0 || offset + 4 > length) {
+			return false;
+		}
+		offset += 4;
+	}
+	
+	IPAddress found[MAX_ADDRESSES];
+	int foundCount = 0;
+	uint32_t minTtl = UINT32_MAX;
+	for (uint16_t i = 0; i < answers; i++) {
+		offset = skipName(packet, length, offset);
+		if (offset == 0 || offset + 10 > length) {
+			break;
+		}
+		uint16_t type = (packet[offset] << 8) | packet[offset + 1];
+		uint16_t recordClass = (packet[offset + 2] << 8) | packet[offset + 3];
+		uint32_t ttl = ((uint32_t)packet[offset + 4] << 24) | ((uint32_t)packet[offset + 5] << 16)
+			| ((uint32_t)packet[offset + 6] << 8) | packet[offset + 7];
+		uint16_t dataLength = (packet[offset + 8] << 8) | packet[offset + 9];
+		offset += 10;
+		if (offset + dataLength > length) {
+			break;
+		}
+		
+		if (type == DNS_TYPE_A && recordClass == DNS_CLASS_IN && dataLength == 4 && foundCount < MAX_ADDRESSES) {
+			found[foundCount++] = IPAddress(packet[offset], packet[offset + 1], packet[offset + 2], packet[offset + 3]);
+			minTtl = min(minTtl, ttl);
+		}
+		offset += dataLength;
+	}
+	
+	if (foundCount == 0) {
+		return false;
+	}
+	for (int i = 0; i < foundCount; i++) {
+		this->addresses[i] = found[i];
+	}
+	this->addressCount = foundCount;
+	
+	/// We keep to the TTL within limits: pools answer with short ones, broken servers with zero
+	this->ttlMs = constrain(minTtl, (uint32_t)DNS_CACHE_MIN_TTL_S, (uint32_t)DNS_CACHE_MAX_TTL_S) * 1000UL;
+	return true;
+}
+
+size_t DnsCache::skipName(const uint8_t* packet, size_t length, size_t offset) {
+	while (offset < length) {
+		uint8_t labelLength = packet[offset];
+		if (labelLength == 0) {
+			return offset + 1;
+		}
+		/// A compression pointer ends the name
+		if ((labelLength & 0xC0) == 0xC0) {
+			return offset + 2 <= length ? offset + 2 : 0;
+		}
+		offset += labelLength + 1;
+	}
+	return 0;
+}
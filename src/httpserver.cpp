@@ -0,0 +1,1442 @@
+///
+/// HttpServer Implementation
+/// 
+/// We handle one client at a time. Small responses are produced in a
+/// single poll; history is streamed HTTP_RECORDS_PER_POLL records per
+/// poll with chunked encoding so the control loop keeps running.
+///
+
+#include "httpserver.h"
+#include "logger.h"
+
+/// We print non-finite floats as JSON null
+static void printJsonFloat(ResponseWriter& writer, float value, int decimals) {
+	if (isfinite(value)) {
+		writer.printf("%.*f", decimals, value);
+	} else {
+		writer.print("null");
+	}
+}
+
+HttpServer::HttpServer(WiFiManager* wifiManager, TimeManager* timeManager, LightSensor* lightSensor,
+					RelayController* relayController, PlantController* plantController)
+	: wifiManager(wifiManager)
+	, timeManager(timeManager)
+	, lightSensor(lightSensor)
+	, relayController(relayController)
+	, plantController(plantController)
+	, dailySummary(nullptr)
+	, luxProfile(nullptr)
+	, telemetryPublisher(nullptr)
+	, loopTimings(nullptr)
+	, timeSeriesStore(nullptr)
+	, query(nullptr)
+	, luxRollups(nullptr)
+	, otaUpdater(nullptr)
+	, liveUpdates(nullptr)
+	, sntpServer(nullptr)
+	, server(HTTP_PORT)
+	, state(HttpState::Idle)
+	, requestLength(0)
+	, requestStartTime(0)
+	, writer(sendBuffer, SEND_BUFFER_SIZE, sendBacklog, HTTP_SEND_BACKLOG_SIZE)
+	, handlingStartMicros(0)
+	, stream(HttpStream::None)
+	, streamStart(0)
+	, streamCursor(0)
+	, streamFirstItem(true)
+	, rangeCount(0)
+	, rangeSum(0.0)
+	, rangeMin(0.0)
+	, rangeMax(0.0)
+	, rangeFirst(0)
+	, rangeLast(0)
+	, rangeStartMicros(0)
+	, rangeIsFloat(true)
+	, rollupResolution(RollupResolution::Hour)
+	, rollupTo(0)
+	, exportSeries(TimeSeries::Lux)
+	, exportBlocks(false)
+	, asset(nullptr)
+	, requestQuery("")
+	, requestHeaders("")
+	, requestCount(0)
+	, errorCount(0)
+	, timeoutCount(0)
+	, overrideCount(0)
+	, assetCount(0)
+	, notModifiedCount(0)
+{
+	this->requestBuffer[0] = '\0';
+}
+
+void HttpServer::attachHistory(DailySummary* dailySummary) {
+	this->dailySummary = dailySummary;
+}
+
+void HttpServer::attachProfile(const LuxProfile* luxProfile) {
+	this->luxProfile = luxProfile;
+}
+
+void HttpServer::attachTelemetry(TelemetryPublisher* telemetryPublisher) {
+	this->telemetryPublisher = telemetryPublisher;
+}
+
+void HttpServer::attachLoopTimings(const LoopTimings* loopTimings) {
+	this->loopTimings = loopTimings;
+}
+
+void HttpServer::attachTimeSeries(TimeSeriesStore* timeSeriesStore) {
+	this->timeSeriesStore = timeSeriesStore;
+	if (timeSeriesStore && !this->query) {
+		/// We allocate the query and its block buffer once, at setup
+		this->query = new TimeSeriesQuery(timeSeriesStore);
+	}
+}
+
+void HttpServer::attachRollups(const LuxRollups* luxRollups) {
+	this->luxRollups = luxRollups;
+}
+
+void HttpServer::attachOta(OtaUpdater* otaUpdater) {
+	this->otaUpdater = otaUpdater;
+}
+
+void HttpServer::attachLiveUpdates(LiveUpdates* liveUpdates) {
+	this->liveUpdates = liveUpdates;
+}
+
+void HttpServer::attachSntpServer(const SntpServer* sntpServer) {
+	this->sntpServer = sntpServer;
+}
+
+void HttpServer::begin() {
+	this->server.begin();
+	this->server.setNoDelay(true);
+	
+	LOG_INFO("✓ HTTP server listening on port %d", HTTP_PORT);
+}
+
+void HttpServer::poll() {
+	/// We serve the upgraded connections first; they are cheap and never block
+	if (this->liveUpdates) {
+		this->liveUpdates->poll();
+	}
+	
+	switch (this->state) {
+		case HttpState::Idle:
+			this->acceptClient();
+			break;
+			
+		case HttpState::ReadingRequest:
+			if (!this->client.connected()) {
+				this->finishRequest(false);
+			} else if (this->readRequest()) {
+				this->handlingStartMicros = micros();
+				this->dispatch();
+			} else if (millis() - this->requestStartTime >= HTTP_REQUEST_TIMEOUT_MS) {
+				this->timeoutCount++;
+				this->sendError(408, "request timeout");
+			}
+			break;
+			
+		case HttpState::Streaming:
+			this->continueStream();
+			break;
+			
+		case HttpState::Draining:
+			this->writer.drain();
+			if (!this->client.connected() || this->writer.hasFailed()) {
+				this->finishRequest(false);
+			} else if (this->writer.getBacklog() == 0) {
+				this->finishRequest(true);
+			}
+			break;
+	}
+}
+
+bool HttpServer::isStreamingResponse() const {
+	return this->state == HttpState::Streaming || this->state == HttpState::Draining;
+}
+
+unsigned long HttpServer::getRequestCount() const {
+	return this->requestCount;
+}
+
+unsigned long HttpServer::getErrorCount() const {
+	return this->errorCount;
+}
+
+unsigned long HttpServer::getTimeoutCount() const {
+	return this->timeoutCount;
+}
+
+unsigned long HttpServer::getOverrideCount() const {
+	return this->overrideCount;
+}
+
+unsigned long HttpServer::getAssetCount() const {
+	return this->assetCount;
+}
+
+unsigned long HttpServer::getNotModifiedCount() const {
+	return this->notModifiedCount;
+}
+
+unsigned long HttpServer::getBytesSent() const {
+	return this->writer.getBytesSent();
+}
+
+const LatencyHistogram& HttpServer::getRequestLatency() const {
+	return this->requestLatency;
+}
+
+void HttpServer::acceptClient() {
+	if (!this->server.hasClient()) {
+		return;
+	}
+	
+	this->client = this->server.available();
+	if (!this->client) {
+		return;
+	}
+	
+	this->client.setNoDelay(true);
+	this->writer.attach(&this->client);
+	this->requestLength = 0;
+	this->requestBuffer[0] = '\0';
+	this->requestStartTime = millis();
+	this->state = HttpState::ReadingRequest;
+}
+
+bool HttpServer::readRequest() {
+	int available = this->client.available();
+	if (available > 0) {
+		size_t space = REQUEST_BUFFER_SIZE - this->requestLength;
+		size_t toRead = min((size_t)available, space);
+		if (toRead > 0) {
+			int bytesRead = this->client.read((uint8_t*)this->requestBuffer + this->requestLength, toRead);
+			if (bytesRead > 0) {
+				this->requestLength += bytesRead;
+				this->requestBuffer[this->requestLength] = '\0';
+			}
+		}
+	}
+	
+	char* headerEnd = strstr(this->requestBuffer, "\r\n\r\n");
+	if (!headerEnd) {
+		if (this->requestLength >= REQUEST_BUFFER_SIZE) {
+			/// We cannot hold the headers; answer now instead of waiting for the timeout
+			this->handlingStartMicros = micros();
+			this->sendError(413, "request too large");
+		}
+		return false;
+	}
+	
+	size_t headerLength = (headerEnd - this->requestBuffer) + 4;
+	size_t contentLength = this->parseContentLength(this->requestBuffer);
+	if (headerLength + contentLength > REQUEST_BUFFER_SIZE) {
+		this->handlingStartMicros = micros();
+		this->sendError(413, "request too large");
+		return false;
+	}
+	
+	return this->requestLength >= headerLength + contentLength;
+}
+
+void HttpServer::dispatch() {
+	/// We found the header end while reading, so the body pointer is always valid
+	char* body = strstr(this->requestBuffer, "\r\n\r\n") + 4;
+	
+	/// We end the header block after its last CRLF so header lookups never reach the body
+	body[-2] = '\0';
+	this->requestHeaders = strstr(this->requestBuffer, "\r\n");
+	
+	/// We split the request line in place: METHOD SP PATH[?QUERY] SP VERSION
+	char* method = this->requestBuffer;
+	char* path = strchr(method, ' ');
+	if (!path) {
+		this->sendError(400, "malformed request line");
+		return;
+	}
+	*path++ = '\0';
+	
+	char* pathEnd = strpbrk(path, " ?\r");
+	if (!pathEnd) {
+		this->sendError(400, "malformed request line");
+		return;
+	}
+	this->requestQuery = "";
+	if (*pathEnd == '?') {
+		char* queryEnd = strpbrk(pathEnd + 1, " \r");
+		if (queryEnd) {
+			*queryEnd = '\0';
+			this->requestQuery = pathEnd + 1;
+		}
+	}
+	*pathEnd = '\0';
+	
+	bool isGet = strcmp(method, "GET") == 0;
+	bool isPost = strcmp(method, "POST") == 0;
+	
+	if (strcmp(path, "/api/status") == 0) {
+		isGet ? this->handleStatus() : this->sendError(405, "use GET");
+	} else if (strcmp(path, "/api/counters") == 0) {
+		isGet ? this->handleCounters() : this->sendError(405, "use GET");
+	} else if (strcmp(path, "/api/history") == 0) {
+		isGet ? this->handleHistory() : this->sendError(405, "use GET");
+	} else if (strcmp(path, "/api/profile") == 0) {
+		isGet ? this->handleProfile() : this->sendError(405, "use GET");
+	} else if (strcmp(path, "/api/range") == 0) {
+		isGet ? this->handleRange() : this->sendError(405, "use GET");
+	} else if (strcmp(path, "/api/rollup") == 0) {
+		isGet ? this->handleRollup() : this->sendError(405, "use GET");
+	} else if (strcmp(path, "/api/export") == 0) {
+		isGet ? this->handleExport() : this->sendError(405, "use GET");
+	} else if (strcmp(path, "/metrics") == 0) {
+		isGet ? this->handleMetrics() : this->sendError(405, "use GET");
+	} else if (strcmp(path, "/api/override") == 0) {
+		isPost ? this->handleOverride(body) : this->sendError(405, "use POST");
+	} else if (strcmp(path, "/api/ota") == 0) {
+		isPost ? this->handleOta() : this->sendError(405, "use POST");
+	} else if (strcmp(path, "/api/stream") == 0) {
+		isPost ? this->handleStream() : this->sendError(405, "use POST");
+	} else if (strcmp(path, "/ws") == 0) {
+		isGet ? this->handleWebSocket() : this->sendError(405, "use GET");
+	} else if (const WebAsset* asset = findWebAsset(path)) {
+		isGet ? this->handleAsset(asset) : this->sendError(405, "use GET");
+	} else {
+		this->sendError(404, "not found");
+	}
+}
+
+void HttpServer::handleStatus() {
+	bool timeValid = this->timeManager && this->timeManager->hasValidTime();
+	bool sensorHealthy = this->lightSensor->isSensorHealthy();
+	
+	this->writer.beginResponse(200, "application/json", -1);
+	
+	this->writer.printf("{\"uptime_ms\":%lu,\"time\":%lu,\"time_valid\":%s",
+		millis(), timeValid ? this->timeManager->getEpochTime() : 0UL, timeValid ? "true" : "false");
+	
+	IPAddress ip = WiFi.localIP();
+	this->writer.printf(",\"wifi\":{\"connected\":%s,\"rssi\":%d,\"ip\":\"%u.%u.%u.%u\"}",
+		this->wifiManager->isConnected() ? "true" : "false", this->wifiManager->getSignalStrength(),
+		ip[0], ip[1], ip[2], ip[3]);
+	
+	this->writer.printf(",\"sensor\":{\"healthy\":%s,\"recovering\":%s,\"lux\":",
+		sensorHealthy ? "true" : "false", this->lightSensor->isRecovering() ? "true" : "false");
+	printJsonFloat(this->writer, sensorHealthy ? this->lightSensor->getCurrentLux() : NAN, 1);
+	this->writer.print(",\"raw_lux\":");
+	printJsonFloat(this->writer, sensorHealthy ? this->lightSensor->getLastRawLux() : NAN, 1);
+	this->writer.print(",\"daylight_lux\":");
+	printJsonFloat(this->writer, sensorHealthy ? this->lightSensor->getDaylightLux() : NAN, 1);
+	/// We report null while there is no reading to compare
+	LightLevel lightLevel = sensorHealthy ? this->lightSensor->compareToThreshold(LIGHT_THRESHOLD_LUX) : LightLevel::Unknown;
+	this->writer.printf(",\"below_threshold\":%s,\"power_mode\":\"%s\"}",
+		lightLevel == LightLevel::Unknown ? "null" : lightLevel == LightLevel::Below ? "true" : "false",
+		LightSensor::getPowerModeString(this->lightSensor->getPowerMode()));
+	
+	this->writer.printf(",\"schedule\":{\"start_hour\":%d,\"end_hour\":%d,\"active\":%s,\"threshold_lux\":%.1f}",
+		this->plantController->getScheduleStartHour(), this->plantController->getScheduleEndHour(),
+		this->plantController->isWithinSchedule() ? "true" : "false", this->plantController->getLightThreshold());
+	
+	this->writer.printf(",\"relay\":{\"on\":%s,\"can_switch\":%s}",
+		this->relayController->getRelayState() ? "true" : "false",
+		this->relayController->canSwitchRelay() ? "true" : "false");
+	
+	this->writer.printf(",\"control\":{\"automatic\":%s,\"healthy\":%s,\"decision\":",
+		this->plantController->isAutomaticControlEnabled() ? "true" : "false",
+		this->plantController->areAllComponentsHealthy() ? "true" : "false");
+	this->writer.printJsonString(this->plantController->getDecisionString(this->plantController->getLastDecision()));
+	this->writer.print(",\"reason\":");
+	this->writer.printJsonString(this->plantController->getReasonString(this->plantController->getLastReason()));
+	this->writer.printf(",\"decision_age_ms\":%lu}", millis() - this->plantController->getLastDecisionTime());
+	
+	if (this->dailySummary) {
+		DailySummaryRecord today = this->dailySummary->getCurrentRecord();
+		this->writer.printf(",\"today\":{\"day\":%lu,\"lamp_on_min\":%u,\"switches\":%u,\"dli\":%.2f}",
+			(unsigned long)today.day, today.lampOnMinutes, today.switchCount, today.dliCentimol / 100.0f);
+	}
+	
+	if (this->luxProfile) {
+		this->writer.print(",\"profile\":{\"p10\":");
+		printJsonFloat(this->writer, this->luxProfile->getDailyQuantile(0.1f), 1);
+		this->writer.print(",\"p50\":");
+		printJsonFloat(this->writer, this->luxProfile->getDailyQuantile(0.5f), 1);
+		this->writer.print(",\"p90\":");
+		printJsonFloat(this->writer, this->luxProfile->getDailyQuantile(0.9f), 1);
+		this->writer.print("}");
+	}
+	
+	this->writer.print("}");
+	this->writer.end();
+	this->finishRequest(!this->writer.hasFailed());
+}
+
+void HttpServer::handleCounters() {
+	const LatencyHistogram& busLatency = this->lightSensor->getTransactionLatency();
+	
+	this->writer.beginResponse(200, "application/json", -1);
+	
+	this->writer.printf("{\"uptime_ms\":%lu,\"free_heap\":%lu,\"min_free_heap\":%lu",
+		millis(), (unsigned long)ESP.getFreeHeap(), (unsigned long)ESP.getMinFreeHeap());
+	
+	this->writer.printf(",\"wifi\":{\"connection_attempts\":%lu}",
+		this->wifiManager->getConnectionAttempts());
+	if (this->timeManager) {
+		const DnsCache& serverCache = this->timeManager->getServerCache();
+		const LatencyHistogram& dnsLatency = serverCache.getLookupLatency();
+		const LatencyHistogram& ntpRoundTrip = this->timeManager->getNtpRoundTrip();
+		this->writer.printf(",\"time\":{\"sync_count\":%lu,\"sync_failures\":%lu"
+			",\"ntp_rtt_p50_us\":%lu,\"ntp_rtt_max_us\":%lu"
+			",\"dns\":{\"addresses\":%d,\"expires_in_s\":%lu,\"lookups\":%lu,\"failures\":%lu,\"rotations\":%lu"
+			",\"p50_us\":%lu,\"max_us\":%lu}}",
+			this->timeManager->getSyncCount(), this->timeManager->getSyncFailures(),
+			ntpRoundTrip.getPercentile(50), ntpRoundTrip.getMax(),
+			serverCache.getAddressCount(), serverCache.getSecondsToExpiry(), serverCache.getLookupCount(),
+			serverCache.getLookupFailures(), serverCache.getRotationCount(),
+			dnsLatency.getPercentile(50), dnsLatency.getMax());
+	} else {
+		this->writer.print(",\"time\":{\"sync_count\":0}");
+	}
+	if (this->sntpServer) {
+		const LatencyHistogram& serveLatency = this->sntpServer->getServeLatency();
+		this->writer.printf(",\"sntp\":{\"served\":%lu,\"unsynced\":%lu,\"malformed\":%lu,\"send_failures\":%lu"
+			",\"p50_us\":%lu,\"max_us\":%lu}",
+			this->sntpServer->getRequestsServed(), this->sntpServer->getRequestsUnsynced(),
+			this->sntpServer->getRequestsMalformed(), this->sntpServer->getSendFailures(),
+			serveLatency.getPercentile(50), serveLatency.getMax());
+	}
+	
+	this->writer.printf(",\"sensor\":{\"readings\":%lu,\"recoveries\":%lu,\"recovery_attempts\":%lu"
+		",\"i2c_transactions\":%lu,\"i2c_errors\":%lu,\"i2c_retries\":%lu"
+		",\"i2c_p50_us\":%lu,\"i2c_p99_us\":%lu,\"i2c_max_us\":%lu"
+		",\"stream_packets\":%lu,\"stream_dropped\":%lu}",
+		this->lightSensor->getReadingCount(), this->lightSensor->getRecoveryCount(),
+		this->lightSensor->getRecoveryAttempts(), this->lightSensor->getTransactionCount(),
+		this->lightSensor->getTransactionErrors(), this->lightSensor->getTransactionRetries(),
+		(unsigned long)busLatency.getPercentile(50), (unsigned long)busLatency.getPercentile(99),
+		(unsigned long)busLatency.getMax(), this->lightSensor->getStreamPacketsSent(),
+		this->lightSensor->getStreamPacketsDropped());
+	
+	this->writer.printf(",\"control\":{\"decisions\":%lu,\"relay_changes\":%lu}",
+		this->plantController->getDecisionCount(), this->plantController->getRelayChanges());
+	
+	if (this->dailySummary) {
+		this->writer.printf(",\"history\":{\"records_written\":%lu}", this->dailySummary->getRecordsWritten());
+	}
+	
+	if (this->telemetryPublisher) {
+		this->writer.printf(",\"telemetry\":{\"connected\":%s,\"queued\":%lu,\"acked\":%lu,\"dropped\":%lu"
+			",\"retransmissions\":%lu,\"wire_bytes\":%lu,\"spool_depth\":%lu,\"spool_capacity\":%lu"
+			",\"spooled\":%lu,\"flushed\":%lu,\"spool_overwritten\":%lu,\"backlog_batches\":%lu"
+			",\"flush_msgs_per_s\":%.1f,\"flush_bytes_per_s\":%.0f}",
+			this->telemetryPublisher->isConnected() ? "true" : "false",
+			this->telemetryPublisher->getMessagesQueued(), this->telemetryPublisher->getMessagesAcked(),
+			this->telemetryPublisher->getMessagesDropped(), this->telemetryPublisher->getRetransmissions(),
+			this->telemetryPublisher->getWireBytes(), (unsigned long)this->telemetryPublisher->getSpoolDepth(),
+			(unsigned long)this->telemetryPublisher->getSpoolCapacity(), this->telemetryPublisher->getMessagesSpooled(),
+			this->telemetryPublisher->getMessagesFlushed(), this->telemetryPublisher->getSpoolOverwritten(),
+			this->telemetryPublisher->getBacklogBatches(), this->telemetryPublisher->getFlushMessagesPerSecond(),
+			this->telemetryPublisher->getFlushBytesPerSecond());
+		
+		const TlsClient* tls = this->telemetryPublisher->getTlsClient();
+		if (tls) {
+			const TlsHandshakeStats& last = tls->getLastHandshake();
+			this->writer.printf(",\"tls\":{\"full_handshakes\":%lu,\"resumed_handshakes\":%lu,\"failed_handshakes\":%lu"
+				",\"handshake_ms_total\":%lu,\"handshake_cpu_ms_total\":%lu,\"session_cached\":%s"
+				",\"last\":{\"resumed\":%s,\"tcp_ms\":%lu,\"handshake_ms\":%lu,\"cpu_ms\":%lu,\"bytes_received\":%lu}}",
+				tls->getFullHandshakes(), tls->getResumedHandshakes(), tls->getFailedHandshakes(),
+				tls->getHandshakeMsTotal(), tls->getHandshakeCpuMsTotal(), tls->hasSession() ? "true" : "false",
+				last.resumed ? "true" : "false", last.tcpConnectMs, last.handshakeMs, last.cpuMs, last.bytesReceived);
+		}
+	}
+	
+	if (this->otaUpdater) {
+		this->writer.printf(",\"ota\":{\"state\":\"%s\",\"pending_confirmation\":%s,\"checks\":%lu"
+			",\"updates\":%lu,\"failures\":%lu,\"delta\":%s,\"downloaded_bytes\":%lu,\"image_bytes\":%lu"
+			",\"copied_bytes\":%lu,\"duration_ms\":%lu,\"last_error\":",
+			OtaUpdater::getStateString(this->otaUpdater->getState()),
+			this->otaUpdater->isPendingConfirmation() ? "true" : "false",
+			this->otaUpdater->getCheckCount(), this->otaUpdater->getUpdateCount(), this->otaUpdater->getFailureCount(),
+			this->otaUpdater->wasLastUpdateDelta() ? "true" : "false", this->otaUpdater->getBytesDownloaded(),
+			this->otaUpdater->getImageBytes(), this->otaUpdater->getBytesCopied(), this->otaUpdater->getLastDuration());
+		this->writer.printJsonString(this->otaUpdater->getLastError());
+		this->writer.print("}");
+	}
+	
+	this->writer.printf(",\"log\":{\"messages\":%lu,\"dropped\":%lu,\"truncated\":%lu,\"bytes\":%lu,\"peak_slots\":%lu"
+		",\"syslog\":{\"enabled\":%s,\"sent\":%lu,\"dropped\":%lu,\"datagrams\":%lu}}",
+		logger.getMessagesLogged(), logger.getMessagesDropped(), logger.getMessagesTruncated(),
+		logger.getBytesWritten(), (unsigned long)logger.getHighWaterMark(), SYSLOG_ENABLED ? "true" : "false",
+		logger.getSyslogMessagesSent(), logger.getSyslogMessagesDropped(), logger.getSyslogDatagramsSent());
+	
+	if (this->liveUpdates) {
+		const LatencyHistogram& publishLatency = this->liveUpdates->getPublishLatency();
+		this->writer.printf(",\"ws\":{\"clients\":%d,\"connections\":%lu,\"updates\":%lu,\"frames\":%lu"
+			",\"keyframes\":%lu,\"skipped\":%lu,\"bytes\":%lu,\"publish_p50_us\":%lu,\"publish_max_us\":%lu}",
+			this->liveUpdates->getClientCount(), this->liveUpdates->getConnectionCount(),
+			this->liveUpdates->getUpdateCount(), this->liveUpdates->getFramesSent(),
+			this->liveUpdates->getKeyframesSent(), this->liveUpdates->getFramesSkipped(),
+			this->liveUpdates->getBytesSent(), (unsigned long)publishLatency.getPercentile(50),
+			(unsigned long)publishLatency.getMax());
+	}
+	
+	this->writer.printf(",\"http\":{\"requests\":%lu,\"errors\":%lu,\"timeouts\":%lu,\"overrides\":%lu"
+		",\"assets\":%lu,\"not_modified\":%lu,\"bytes_sent\":%lu,\"p50_us\":%lu,\"p99_us\":%lu,\"max_us\":%lu}}",
+		this->requestCount, this->errorCount, this->timeoutCount, this->overrideCount,
+		this->assetCount, this->notModifiedCount,
+		this->writer.getBytesSent(), (unsigned long)this->requestLatency.getPercentile(50),
+		(unsigned long)this->requestLatency.getPercentile(99), (unsigned long)this->requestLatency.getMax());
+	
+	this->writer.end();
+	this->finishRequest(!this->writer.hasFailed());
+}
+
+void HttpServer::handleHistory() {
+	if (!this->dailySummary) {
+		this->sendError(503, "history not available");
+		return;
+	}
+	
+	this->writer.beginResponse(200, "application/json", -1);
+	this->writer.print("[");
+	
+	/// We start the walk just after today's slot so records come out oldest first
+	unsigned long today = this->timeManager ? this->timeManager->getEpochDay() : 0;
+	this->streamStart = (today + 1) % DAILY_SUMMARY_DAYS;
+	this->historyFile = this->dailySummary->openHistory(this->streamStart);
+	this->streamCursor = 0;
+	this->streamFirstItem = true;
+	this->stream = HttpStream::History;
+	this->state = HttpState::Streaming;
+	this->continueStream();
+}
+
+void HttpServer::handleProfile() {
+	if (!this->luxProfile) {
+		this->sendError(503, "lux profile not available");
+		return;
+	}
+	
+	this->writer.beginResponse(200, "application/octet-stream", LuxProfile::EXPORT_SIZE,
+		"Content-Disposition: attachment; filename=\"lux_profile.bin\"\r\n");
+	this->streamCursor = 0;
+	this->stream = HttpStream::Profile;
+	this->state = HttpState::Streaming;
+	this->continueStream();
+}
+
+void HttpServer::handleOverride(const char* body) {
+	bool automatic = true;
+	if (!parseAutomaticFlag(body, automatic)) {
+		this->sendError(400, "expected automatic=true|false");
+		return;
+	}
+	
+	this->plantController->setAutomaticControl(automatic);
+	this->overrideCount++;
+	
+	this->writer.beginResponse(200, "application/json", -1);
+	this->writer.printf("{\"automatic\":%s,\"relay\":%s}",
+		this->plantController->isAutomaticControlEnabled() ? "true" : "false",
+		this->relayController->getRelayState() ? "true" : "false");
+	this->writer.end();
+	this->finishRequest(!this->writer.hasFailed());
+}
+
+void HttpServer::handleOta() {
+	if (!this->otaUpdater) {
+		this->sendError(503, "updates not available");
+		return;
+	}
+	
+	/// We only queue the check; the download runs in the updater's own task
+	this->otaUpdater->requestCheck();
+	
+	this->writer.beginResponse(202, "application/json", -1);
+	this->writer.printf("{\"state\":\"%s\",\"running\":\"%s\"}",
+		OtaUpdater::getStateString(this->otaUpdater->getState()), this->otaUpdater->getRunningHash());
+	this->writer.end();
+	this->finishRequest(!this->writer.hasFailed());
+}
+
+void HttpServer::handleStream() {
+	char value[16];
+	if (!getQueryParameter(this->requestQuery, "seconds", value, sizeof(value))) {
+		this->sendError(400, "missing seconds");
+		return;
+	}
+	
+	unsigned long seconds = strtoul(value, nullptr, 10);
+	if (seconds == 0) {
+		this->lightSensor->stopStreaming();
+	} else if (!this->lightSensor->startStreaming(seconds)) {
+		this->sendError(503, "sensor not available");
+		return;
+	}
+	
+	this->writer.beginResponse(200, "application/json", -1);
+	this->writer.printf("{\"streaming\":%s,\"baud\":%lu,\"packets\":%lu,\"dropped\":%lu}",
+		this->lightSensor->isStreaming() ? "true" : "false", (unsigned long)STREAM_BAUD_RATE,
+		this->lightSensor->getStreamPacketsSent(), this->lightSensor->getStreamPacketsDropped());
+	this->writer.end();
+	this->finishRequest(!this->writer.hasFailed());
+}
+
+void HttpServer::handleMetrics() {
+	this->writer.beginResponse(200, "text/plain; version=0.0.4", -1);
+	
+	this->streamCursor = 0;
+	this->stream = HttpStream::Metrics;
+	this->state = HttpState::Streaming;
+	this->continueStream();
+}
+
+void HttpServer::handleRange() {
+	if (!this->timeSeriesStore || !this->query) {
+		this->sendError(503, "time-series store not available");
+		return;
+	}
+	
+	TimeSeries series;
+	if (!this->parseSeriesParameter(series)) {
+		return;
+	}
+	
+	char value[16];
+	if (!getQueryParameter(this->requestQuery, "from", value, sizeof(value))) {
+		this->sendError(400, "expected from and to");
+		return;
+	}
+	uint32_t from = strtoul(value, nullptr, 10);
+	
+	if (!getQueryParameter(this->requestQuery, "to", value, sizeof(value))) {
+		this->sendError(400, "expected from and to");
+		return;
+	}
+	uint32_t to = strtoul(value, nullptr, 10);
+	
+	this->rangeCount = 0;
+	this->rangeSum = 0.0;
+	this->rangeMin = INFINITY;
+	this->rangeMax = -INFINITY;
+	this->rangeFirst = 0;
+	this->rangeLast = 0;
+	this->rangeStartMicros = micros();
+	this->rangeIsFloat = series == TimeSeries::Lux;
+	this->query->begin(series, from, to);
+	
+	this->stream = HttpStream::Range;
+	this->state = HttpState::Streaming;
+	this->continueStream();
+}
+
+void HttpServer::finishRange() {
+	this->writer.beginResponse(200, "application/json", -1);
+	this->writer.printf("{\"count\":%lu,\"first\":%lu,\"last\":%lu,\"min\":",
+		this->rangeCount, (unsigned long)this->rangeFirst, (unsigned long)this->rangeLast);
+	printJsonFloat(this->writer, this->rangeCount > 0 ? this->rangeMin : NAN, 2);
+	this->writer.print(",\"max\":");
+	printJsonFloat(this->writer, this->rangeCount > 0 ? this->rangeMax : NAN, 2);
+	this->writer.print(",\"mean\":");
+	printJsonFloat(this->writer, this->rangeCount > 0 ? this->rangeSum / this->rangeCount : NAN, 2);
+	this->writer.printf(",\"blocks_read\":%lu,\"header_reads\":%lu,\"query_us\":%lu}",
+		this->query->getBlocksRead(), this->query->getHeaderReads(), micros() - this->rangeStartMicros);
+	this->writer.end();
+	this->finishRequest(!this->writer.hasFailed());
+}
+
+void HttpServer::handleRollup() {
+	if (!this->luxRollups) {
+		this->sendError(503, "rollups not available");
+		return;
+	}
+	
+	char value[16];
+	this->rollupResolution = RollupResolution::Hour;
+	if (getQueryParameter(this->requestQuery, "res", value, sizeof(value))
+		&& !LuxRollups::parseResolution(value, this->rollupResolution)) {
+		this->sendError(400, "res must be 1m, 15m or 1h");
+		return;
+	}
+	
+	uint32_t from = 0;
+	this->rollupTo = UINT32_MAX;
+	if (getQueryParameter(this->requestQuery, "from", value, sizeof(value))) {
+		from = strtoul(value, nullptr, 10);
+	}
+	if (getQueryParameter(this->requestQuery, "to", value, sizeof(value))) {
+		this->rollupTo = strtoul(value, nullptr, 10);
+	}
+	
+	this->writer.beginResponse(200, "application/json", -1);
+	this->writer.printf("{\"res\":\"%s\",\"columns\":[\"start\",\"min\",\"max\",\"mean\",\"count\",\"relay_on_s\"],\"rows\":[",
+		LuxRollups::getResolutionName(this->rollupResolution));
+	
+	/// We jump straight to the first bucket in range; rings are contiguous in time
+	this->streamCursor = this->luxRollups->getRing(this->rollupResolution).findFirst(from);
+	this->streamFirstItem = true;
+	this->stream = HttpStream::Rollup;
+	this->state = HttpState::Streaming;
+	this->continueStream();
+}
+
+void HttpServer::handleExport() {
+	if (!this->timeSeriesStore || !this->query) {
+		this->sendError(503, "time-series store not available");
+		return;
+	}
+	
+	if (!this->parseSeriesParameter(this->exportSeries)) {
+		return;
+	}
+	
+	char value[16];
+	this->exportBlocks = false;
+	if (getQueryParameter(this->requestQuery, "format", value, sizeof(value))) {
+		if (strcmp(value, "blocks") == 0) {
+			this->exportBlocks = true;
+		} else if (strcmp(value, "csv") != 0) {
+			this->sendError(400, "format must be csv or blocks");
+			return;
+		}
+	}
+	
+	uint32_t from = 0;
+	uint32_t to = UINT32_MAX;
+	if (getQueryParameter(this->requestQuery, "from", value, sizeof(value))) {
+		from = strtoul(value, nullptr, 10);
+	}
+	if (getQueryParameter(this->requestQuery, "to", value, sizeof(value))) {
+		to = strtoul(value, nullptr, 10);
+	}
+	
+	char headers[96];
+	const char* seriesName = TimeSeriesStore::getSeriesName(this->exportSeries);
+	snprintf(headers, sizeof(headers), "Content-Disposition: attachment; filename=\"%s.%s\"\r\n",
+		seriesName, this->exportBlocks ? "tsb" : "csv");
+	this->writer.beginResponse(200, this->exportBlocks ? "application/octet-stream" : "text/csv", -1, headers);
+	
+	if (!this->exportBlocks) {
+		switch (this->exportSeries) {
+			case TimeSeries::Lux: this->writer.print("timestamp,lux\n"); break;
+			case TimeSeries::Relay: this->writer.print("timestamp,relay\n"); break;
+			default: this->writer.print("timestamp,decision,reason\n"); break;
+		}
+	}
+	
+	this->query->begin(this->exportSeries, from, to);
+	this->stream = HttpStream::Export;
+	this->state = HttpState::Streaming;
+	this->continueStream();
+}
+
+void HttpServer::handleAsset(const WebAsset* asset) {
+	/// We compare weakly, as RFC 9110 asks for If-None-Match; any listed tag or * matches
+	char ifNoneMatch[160];
+	bool cached = getHeader(this->requestHeaders, "If-None-Match", ifNoneMatch, sizeof(ifNoneMatch))
+		&& (strcmp(ifNoneMatch, "*") == 0 || strstr(ifNoneMatch, asset->etag));
+	
+	/// Versioned files never change under their URL; pages are revalidated on every visit
+	char headers[160];
+	if (asset->immutable) {
+		snprintf(headers, sizeof(headers), "ETag: %s\r\nCache-Control: public, max-age=%lu, immutable\r\n"
+			"Content-Encoding: gzip\r\n", asset->etag, (unsigned long)HTTP_ASSET_MAX_AGE_S);
+	} else {
+		snprintf(headers, sizeof(headers), "ETag: %s\r\nCache-Control: no-cache\r\nContent-Encoding: gzip\r\n",
+			asset->etag);
+	}
+	
+	if (cached) {
+		this->notModifiedCount++;
+		/// Content-Length describes the file we did not send, which RFC 9110 allows
+		this->writer.beginResponse(304, asset->contentType, asset->length, headers);
+		this->writer.end();
+		this->finishRequest(!this->writer.hasFailed());
+		return;
+	}
+	
+	/// Every browser accepts gzip, so we never keep or produce an uncompressed copy
+	this->assetCount++;
+	this->writer.beginResponse(200, asset->contentType, asset->length, headers);
+	this->asset = asset;
+	this->streamCursor = 0;
+	this->stream = HttpStream::Asset;
+	this->state = HttpState::Streaming;
+	this->continueStream();
+}
+
+void HttpServer::handleWebSocket() {
+	if (!this->liveUpdates) {
+		this->sendError(503, "live updates not available");
+		return;
+	}
+	
+	char value[64];
+	if (!getHeader(this->requestHeaders, "Upgrade", value, sizeof(value)) || strcasecmp(value, "websocket") != 0) {
+		this->sendError(400, "expected a WebSocket upgrade");
+		return;
+	}
+	if (!getHeader(this->requestHeaders, "Sec-WebSocket-Version", value, sizeof(value)) || strcmp(value, "13") != 0) {
+		this->sendError(400, "unsupported WebSocket version");
+		return;
+	}
+	if (!getHeader(this->requestHeaders, "Sec-WebSocket-Key", value, sizeof(value))) {
+		this->sendError(400, "missing Sec-WebSocket-Key");
+		return;
+	}
+	if (!this->liveUpdates->hasFreeSlot()) {
+		this->sendError(503, "too many live update clients");
+		return;
+	}
+	
+	char accept[32];
+	LiveUpdates::computeAcceptKey(value, accept, sizeof(accept));
+	
+	/// We write the handshake ourselves; the writer's responses always close the connection
+	int length = snprintf((char*)this->sendBuffer, SEND_BUFFER_SIZE,
+		"HTTP/1.1 101 %s\r\nUpgrade: websocket\r\nConnection: Upgrade\r\nSec-WebSocket-Accept: %s\r\n\r\n",
+		ResponseWriter::getStatusText(101), accept);
+	if (this->client.write(this->sendBuffer, length) != (size_t)length
+		|| !this->liveUpdates->adopt(this->client)) {
+		this->finishRequest(false);
+		return;
+	}
+	
+	/// The connection is not ours to close any more
+	this->client = WiFiClient();
+	this->finishRequest(true);
+}
+
+void HttpServer::writeExportRow(uint32_t timestamp, uint32_t value) {
+	switch (this->exportSeries) {
+		case TimeSeries::Lux:
+			this->writer.printf("%lu,%.2f\n", (unsigned long)timestamp, TimeSeriesQuery::toFloat(value));
+			break;
+		case TimeSeries::Relay:
+			this->writer.printf("%lu,%lu\n", (unsigned long)timestamp, (unsigned long)value);
+			break;
+		default:
+			this->writer.printf("%lu,%s,%s\n", (unsigned long)timestamp,
+				this->plantController->getDecisionString((ControlDecision)(value >> 4)),
+				this->plantController->getReasonString((ControlReason)(value & 0x0F)));
+			break;
+	}
+}
+
+bool HttpServer::continueExport() {
+	/// We work for a fixed time per poll, so a long export only ever borrows idle time
+	unsigned long sliceStart = micros();
+	while (micros() - sliceStart < HTTP_EXPORT_SLICE_US && this->writer.getBacklog() == 0) {
+		if (this->exportBlocks) {
+			const uint8_t* block = this->query->nextBlock();
+			if (!block) {
+				return false;
+			}
+			
+			/// We leave out the unused bytes between the two columns
+			size_t valueBytes = TimeSeriesBlock::getColumnBytes(block, true);
+			this->writer.write(block, TimeSeriesBlock::HEADER_SIZE + TimeSeriesBlock::getColumnBytes(block, false));
+			this->writer.write(block + TimeSeriesBlock::BLOCK_SIZE - valueBytes, valueBytes);
+		} else {
+			uint32_t timestamp;
+			uint32_t value;
+			if (!this->query->next(timestamp, value)) {
+				return false;
+			}
+			this->writeExportRow(timestamp, value);
+		}
+		
+		if (this->writer.hasFailed()) {
+			return false;
+		}
+	}
+	return true;
+}
+
+bool HttpServer::parseSeriesParameter(TimeSeries& series) {
+	char value[16];
+	series = TimeSeries::Lux;
+	if (getQueryParameter(this->requestQuery, "series", value, sizeof(value))
+		&& !TimeSeriesStore::parseSeriesName(value, series)) {
+		this->sendError(400, "unknown series");
+		return false;
+	}
+	return true;
+}
+
+void HttpServer::writeRollupRow(uint32_t start, const RollupBucket& bucket) {
+	this->writer.printf(this->streamFirstItem ? "[%lu," : ",[%lu,", (unsigned long)start);
+	this->streamFirstItem = false;
+	printJsonFloat(this->writer, bucket.minLux, 1);
+	this->writer.print(",");
+	printJsonFloat(this->writer, bucket.maxLux, 1);
+	this->writer.print(",");
+	printJsonFloat(this->writer, bucket.meanLux, 1);
+	this->writer.printf(",%u,%u]", bucket.count, bucket.relayOnSeconds);
+}
+
+void HttpServer::continueStream() {
+	this->writer.drain();
+	if (!this->client.connected() || this->writer.hasFailed()) {
+		this->finishRequest(false);
+		return;
+	}
+	
+	/// We produce the next slice only once the socket has taken the previous one
+	if (this->writer.getBacklog() > 0) {
+		return;
+	}
+	
+	if (this->stream == HttpStream::History) {
+		/// Empty slots cost a read too, so every visited slot counts against the budget
+		size_t sliceEnd = min(this->streamCursor + HTTP_RECORDS_PER_POLL, (size_t)DAILY_SUMMARY_DAYS);
+		while (this->streamCursor < sliceEnd && this->writer.getBacklog() == 0) {
+			this->streamCursor++;
+			
+			DailySummaryRecord record;
+			if (!this->dailySummary->readNextRecord(this->historyFile, record)) {
+				continue;
+			}
+			
+			this->writer.print(this->streamFirstItem ? "{" : ",{");
+			this->streamFirstItem = false;
+			this->writer.printf("\"day\":%lu,\"lamp_on_min\":%u,\"switches\":%u,\"min_lux\":",
+				(unsigned long)record.day, record.lampOnMinutes, record.switchCount);
+			printJsonFloat(this->writer, record.minLux, 1);
+			this->writer.print(",\"max_lux\":");
+			printJsonFloat(this->writer, record.maxLux, 1);
+			this->writer.print(",\"mean_lux\":");
+			printJsonFloat(this->writer, record.meanLux, 1);
+			this->writer.printf(",\"dli\":%.2f,\"no_time_min\":%u,\"sensor_errors\":%u,\"samples\":%u"
+				",\"in_progress\":%s,\"partial\":%s}",
+				record.dliCentimol / 100.0f, record.noTimeMinutes, record.sensorErrors, record.sampleCount,
+				(record.flags & DAILY_FLAG_IN_PROGRESS) ? "true" : "false",
+				(record.flags & DAILY_FLAG_PARTIAL) ? "true" : "false");
+		}
+		
+		if (this->streamCursor >= DAILY_SUMMARY_DAYS) {
+			this->writer.print("]");
+			this->writer.end();
+			this->finishRequest(!this->writer.hasFailed());
+			return;
+		}
+	}
+	
+	if (this->stream == HttpStream::Metrics) {
+		/// We write one metric group per poll so a scrape never stalls the loop
+		if (!this->writeMetricsSection(this->streamCursor++)) {
+			this->writer.end();
+			this->finishRequest(!this->writer.hasFailed());
+			return;
+		}
+	}
+	
+	if (this->stream == HttpStream::Range) {
+		/// We decode a bounded number of blocks per poll
+		unsigned long blockBudget = this->query->getBlocksRead() + TSDB_QUERY_BLOCKS_PER_POLL;
+		uint32_t timestamp;
+		uint32_t raw;
+		while (this->query->getBlocksRead() < blockBudget && this->query->next(timestamp, raw)) {
+			double value = this->rangeIsFloat ? TimeSeriesQuery::toFloat(raw) : raw;
+			if (this->rangeCount == 0) {
+				this->rangeFirst = timestamp;
+			}
+			this->rangeLast = timestamp;
+			this->rangeCount++;
+			this->rangeSum += value;
+			this->rangeMin = min(this->rangeMin, value);
+			this->rangeMax = max(this->rangeMax, value);
+		}
+		
+		if (this->query->isDone()) {
+			this->finishRange();
+		}
+		return;
+	}
+	
+	if (this->stream == HttpStream::Rollup) {
+		const RollupRing& ring = this->luxRollups->getRing(this->rollupResolution);
+		int emitted = 0;
+		while (this->streamCursor < ring.getSize() && emitted < HTTP_POINTS_PER_POLL
+			&& this->writer.getBacklog() == 0) {
+			uint32_t start = ring.getBucketStart(this->streamCursor);
+			if (start > this->rollupTo) {
+				this->streamCursor = ring.getSize();
+				break;
+			}
+			this->writeRollupRow(start, ring.getBucket(this->streamCursor));
+			this->streamCursor++;
+			emitted++;
+		}
+		
+		if (this->streamCursor >= ring.getSize()) {
+			/// We finish with the partially filled bucket so charts reach the present
+			uint32_t openStart = this->luxRollups->getOpenBucketStart(this->rollupResolution);
+			if (openStart != 0 && openStart <= this->rollupTo) {
+				this->writeRollupRow(openStart, this->luxRollups->getOpenBucket(this->rollupResolution));
+			}
+			this->writer.print("]}");
+			this->writer.end();
+			this->finishRequest(!this->writer.hasFailed());
+			return;
+		}
+	}
+	
+	if (this->stream == HttpStream::Export) {
+		if (!this->continueExport()) {
+			this->writer.end();
+			this->finishRequest(!this->writer.hasFailed());
+			return;
+		}
+	}
+	
+	if (this->stream == HttpStream::Asset) {
+		/// We copy from flash a send buffer at a time; the file is never held in RAM
+		size_t length = min(this->asset->length - this->streamCursor, (size_t)HTTP_ASSET_BYTES_PER_POLL);
+		this->writer.write(this->asset->data + this->streamCursor, length);
+		this->streamCursor += length;
+		
+		if (this->streamCursor >= this->asset->length) {
+			this->writer.end();
+			this->finishRequest(!this->writer.hasFailed());
+			return;
+		}
+	}
+	
+	if (this->stream == HttpStream::Profile) {
+		/// We copy the sketches straight from RAM; the image is never assembled whole
+		uint8_t slice[256];
+		size_t sliceEnd = this->streamCursor + HTTP_ASSET_BYTES_PER_POLL;
+		while (this->streamCursor < sliceEnd) {
+			size_t length = this->luxProfile->exportSlice(this->streamCursor, slice, sizeof(slice));
+			if (length == 0) {
+				break;
+			}
+			this->writer.write(slice, length);
+			this->streamCursor += length;
+		}
+		
+		if (this->streamCursor >= LuxProfile::EXPORT_SIZE) {
+			this->writer.end();
+			this->finishRequest(!this->writer.hasFailed());
+			return;
+		}
+	}
+	
+	/// We push out whatever this slice produced so the client sees progress
+	this->writer.flush();
+}
+
+bool HttpServer::writeMetricsSection(size_t section) {
+	switch (section) {
+		case 0:
+			this->writeMetric("plantlight_uptime_seconds", "gauge", "Time since boot", millis() / 1000.0);
+			this->writeMetric("plantlight_heap_free_bytes", "gauge", "Free heap", ESP.getFreeHeap());
+			this->writeMetric("plantlight_heap_min_free_bytes", "gauge", "Lowest free heap since boot", ESP.getMinFreeHeap());
+			this->writeMetric("plantlight_heap_max_alloc_bytes", "gauge", "Largest allocatable heap block", ESP.getMaxAllocHeap());
+			this->writeMetric("plantlight_heap_size_bytes", "gauge", "Total heap size", ESP.getHeapSize());
+			return true;
+			
+		case 1:
+			this->writeMetric("plantlight_wifi_connected", "gauge", "WiFi connection state", this->wifiManager->isConnected());
+			this->writeMetric("plantlight_wifi_rssi_dbm", "gauge", "WiFi signal strength", this->wifiManager->getSignalStrength());
+			this->writeMetric("plantlight_wifi_connection_attempts_total", "counter", "WiFi connection attempts",
+				this->wifiManager->getConnectionAttempts());
+			this->writeMetric("plantlight_time_valid", "gauge", "NTP time is valid",
+				this->timeManager && this->timeManager->hasValidTime());
+			this->writeMetric("plantlight_ntp_syncs_total", "counter", "Successful NTP synchronizations",
+				this->timeManager ? this->timeManager->getSyncCount() : 0);
+			if (this->timeManager) {
+				const DnsCache& serverCache = this->timeManager->getServerCache();
+				this->writeMetric("plantlight_ntp_failures_total", "counter", "NTP requests without an answer",
+					this->timeManager->getSyncFailures());
+				this->writeMetric("plantlight_ntp_dns_lookups_total", "counter", "DNS lookups of the NTP server name",
+					serverCache.getLookupCount());
+				this->writeMetric("plantlight_ntp_dns_failures_total", "counter", "Failed DNS lookups of the NTP server name",
+					serverCache.getLookupFailures());
+				this->writeMetric("plantlight_ntp_server_rotations_total", "counter", "Moves to another NTP pool address",
+					serverCache.getRotationCount());
+				this->writeMetric("plantlight_ntp_dns_addresses", "gauge", "Cached NTP server addresses",
+					serverCache.getAddressCount());
+			}
+			if (this->sntpServer) {
+				this->writeMetric("plantlight_sntp_served_total", "counter", "SNTP requests answered",
+					this->sntpServer->getRequestsServed());
+				this->writeMetric("plantlight_sntp_unsynced_total", "counter", "SNTP requests left unanswered, our time not synced",
+					this->sntpServer->getRequestsUnsynced());
+				this->writeMetric("plantlight_sntp_malformed_total", "counter", "Datagrams on the SNTP port that were not client requests",
+					this->sntpServer->getRequestsMalformed());
+				this->writeMetric("plantlight_sntp_send_failures_total", "counter", "SNTP replies the network stack did not accept",
+					this->sntpServer->getSendFailures());
+			}
+			return true;
+			
+		case 2:
+			this->writeMetric("plantlight_sensor_healthy", "gauge", "Light sensor delivers fresh data",
+				this->lightSensor->isSensorHealthy());
+			this->writeMetric("plantlight_sensor_lux", "gauge", "Averaged ambient light",
+				this->lightSensor->isSensorHealthy() ? this->lightSensor->getCurrentLux() : NAN);
+			this->writeMetric("plantlight_sensor_daylight_lux", "gauge", "Ambient light attributed to daylight",
+				this->lightSensor->isSensorHealthy() ? this->lightSensor->getDaylightLux() : NAN);
+			this->writeMetric("plantlight_sensor_readings_total", "counter", "Successful sensor readings",
+				this->lightSensor->getReadingCount());
+			this->writeMetric("plantlight_sensor_read_failures_total", "counter", "Failed sensor readings",
+				this->lightSensor->getFailedReadingCount());
+			this->writeMetric("plantlight_sensor_recoveries_total", "counter", "Completed bus recoveries",
+				this->lightSensor->getRecoveryCount());
+			this->writeMetric("plantlight_i2c_transactions_total", "counter", "I2C register transactions",
+				this->lightSensor->getTransactionCount());
+			this->writeMetric("plantlight_i2c_errors_total", "counter", "Failed I2C transactions",
+				this->lightSensor->getTransactionErrors());
+			this->writeMetric("plantlight_i2c_retries_total", "counter", "Retried I2C transactions",
+				this->lightSensor->getTransactionRetries());
+			this->writeMetric("plantlight_sensor_supply_microamps", "gauge", "Estimated sensor supply current",
+				this->lightSensor->getEstimatedSupplyCurrent());
+			this->writeMetric("plantlight_sensor_streaming", "gauge", "Raw sample stream running",
+				this->lightSensor->isStreaming());
+			this->writeMetric("plantlight_sensor_stream_packets_total", "counter", "Raw samples sent by sensor streams",
+				this->lightSensor->getStreamPacketsSent());
+			this->writeMetric("plantlight_sensor_stream_dropped_total", "counter", "Raw samples lost by sensor streams",
+				this->lightSensor->getStreamPacketsDropped());
+			return true;
+			
+		case 3:
+			this->writeMetric("plantlight_relay_on", "gauge", "Relay state", this->relayController->getRelayState());
+			this->writeMetric("plantlight_relay_changes_total", "counter", "Relay state changes",
+				this->plantController->getRelayChanges());
+			this->writeMetric("plantlight_decisions_total", "counter", "Control decisions made",
+				this->plantController->getDecisionCount());
+			this->writeMetric("plantlight_automatic_control", "gauge", "Automatic control enabled",
+				this->plantController->isAutomaticControlEnabled());
+			return true;
+			
+		case 4:
+			if (this->dailySummary) {
+				this->writeMetric("plantlight_history_records_written_total", "counter", "Daily summary flash writes",
+					this->dailySummary->getRecordsWritten());
+			}
+			if (this->timeSeriesStore) {
+				this->writeMetric("plantlight_tsdb_blocks_written_total", "counter", "Time-series blocks appended to flash",
+					this->timeSeriesStore->getBlocksWritten());
+				this->writeMetric("plantlight_tsdb_write_errors_total", "counter", "Failed time-series block writes",
+					this->timeSeriesStore->getWriteErrors());
+				this->writeMetric("plantlight_tsdb_segments_deleted_total", "counter", "Segments deleted by retention",
+					this->timeSeriesStore->getSegmentsDeleted());
+				this->writeMetric("plantlight_tsdb_bytes_per_sample", "gauge", "Compressed bytes per lux sample",
+					this->timeSeriesStore->getBytesPerSample());
+				this->writeMetric("plantlight_tsdb_retention_days", "gauge", "Estimated days of history that fit",
+					this->timeSeriesStore->getEstimatedRetentionDays());
+				this->writeMetric("plantlight_tsdb_wear_cycles_per_day", "gauge", "Estimated erase cycles per flash block per day",
+					this->timeSeriesStore->getWearCyclesPerDay());
+			}
+			if (this->telemetryPublisher) {
+				this->writeMetric("plantlight_mqtt_connected", "gauge", "MQTT broker connection state",
+					this->telemetryPublisher->isConnected());
+				this->writeMetric("plantlight_mqtt_queue_depth", "gauge", "Telemetry messages waiting",
+					this->telemetryPublisher->getQueueDepth());
+				this->writeMetric("plantlight_mqtt_messages_acked_total", "counter", "Telemetry messages acknowledged",
+					this->telemetryPublisher->getMessagesAcked());
+				this->writeMetric("plantlight_mqtt_messages_dropped_total", "counter", "Telemetry messages dropped",
+					this->telemetryPublisher->getMessagesDropped());
+				this->writeMetric("plantlight_mqtt_wire_bytes_total", "counter", "MQTT bytes sent",
+					this->telemetryPublisher->getWireBytes());
+				this->writeMetric("plantlight_telemetry_spool_depth", "gauge", "Telemetry messages waiting in flash",
+					this->telemetryPublisher->getSpoolDepth());
+				this->writeMetric("plantlight_telemetry_spool_capacity", "gauge", "Telemetry messages the flash spool holds",
+					this->telemetryPublisher->getSpoolCapacity());
+				this->writeMetric("plantlight_telemetry_spooled_total", "counter", "Telemetry messages stored while offline",
+					this->telemetryPublisher->getMessagesSpooled());
+				this->writeMetric("plantlight_telemetry_flushed_total", "counter", "Spooled telemetry messages delivered",
+					this->telemetryPublisher->getMessagesFlushed());
+				this->writeMetric("plantlight_telemetry_spool_overwritten_total", "counter",
+					"Spooled telemetry messages lost to a full ring", this->telemetryPublisher->getSpoolOverwritten());
+				this->writeMetric("plantlight_telemetry_flush_bytes_per_second", "gauge",
+					"Payload throughput of the last complete spool flush", this->telemetryPublisher->getFlushBytesPerSecond());
+				
+				const TlsClient* tls = this->telemetryPublisher->getTlsClient();
+				if (tls) {
+					this->writeMetric("plantlight_mqtt_tls_full_handshakes_total", "counter", "TLS handshakes with key exchange",
+						tls->getFullHandshakes());
+					this->writeMetric("plantlight_mqtt_tls_resumed_handshakes_total", "counter", "TLS handshakes that resumed a session",
+						tls->getResumedHandshakes());
+					this->writeMetric("plantlight_mqtt_tls_failed_handshakes_total", "counter", "TLS handshakes that failed",
+						tls->getFailedHandshakes());
+					this->writeMetric("plantlight_mqtt_tls_handshake_seconds_total", "counter", "Wall time spent in TLS handshakes",
+						tls->getHandshakeMsTotal() / 1000.0);
+					this->writeMetric("plantlight_mqtt_tls_handshake_cpu_seconds_total", "counter",
+						"TLS handshake time not spent waiting for the network", tls->getHandshakeCpuMsTotal() / 1000.0);
+					this->writeMetric("plantlight_mqtt_tls_last_handshake_seconds", "gauge", "Wall time of the last TLS handshake",
+						tls->getLastHandshake().handshakeMs / 1000.0);
+				}
+			}
+			return true;
+			
+		case 5:
+			this->writeMetric("plantlight_http_requests_total", "counter", "HTTP requests answered", this->requestCount);
+			this->writeMetric("plantlight_http_errors_total", "counter", "HTTP requests failed", this->errorCount);
+			this->writeMetric("plantlight_http_response_bytes_total", "counter", "HTTP response bytes sent",
+				this->writer.getBytesSent());
+			this->writeMetric("plantlight_http_assets_total", "counter", "Dashboard files sent in full",
+				this->assetCount);
+			this->writeMetric("plantlight_http_not_modified_total", "counter", "Dashboard requests answered with 304",
+				this->notModifiedCount);
+			if (this->liveUpdates) {
+				this->writeMetric("plantlight_ws_clients", "gauge", "Connected live update clients",
+					this->liveUpdates->getClientCount());
+				this->writeMetric("plantlight_ws_updates_total", "counter", "Live updates encoded",
+					this->liveUpdates->getUpdateCount());
+				this->writeMetric("plantlight_ws_frames_total", "counter", "Live update frames sent to clients",
+					this->liveUpdates->getFramesSent());
+				this->writeMetric("plantlight_ws_keyframes_total", "counter", "Full-state frames sent to clients",
+					this->liveUpdates->getKeyframesSent());
+				this->writeMetric("plantlight_ws_skipped_total", "counter", "Updates skipped for throttled or full clients",
+					this->liveUpdates->getFramesSkipped());
+				this->writeMetric("plantlight_ws_bytes_total", "counter", "Live update bytes sent",
+					this->liveUpdates->getBytesSent());
+			}
+			this->writeMetric("plantlight_log_messages_total", "counter", "Log messages buffered",
+				logger.getMessagesLogged());
+			this->writeMetric("plantlight_log_dropped_total", "counter", "Log messages dropped on a full ring",
+				logger.getMessagesDropped());
+			this->writeMetric("plantlight_log_truncated_total", "counter", "Log messages cut to the slot size",
+				logger.getMessagesTruncated());
+			this->writeMetric("plantlight_log_peak_slots", "gauge", "Most log ring slots in use at once",
+				logger.getHighWaterMark());
+			if (SYSLOG_ENABLED) {
+				this->writeMetric("plantlight_syslog_sent_total", "counter", "Log messages forwarded to syslog",
+					logger.getSyslogMessagesSent());
+				this->writeMetric("plantlight_syslog_dropped_total", "counter", "Log messages not forwarded, network down or busy",
+					logger.getSyslogMessagesDropped());
+				this->writeMetric("plantlight_syslog_datagrams_total", "counter", "Syslog datagrams sent",
+					logger.getSyslogDatagramsSent());
+			}
+			if (this->otaUpdater) {
+				this->writeMetric("plantlight_ota_checks_total", "counter", "Firmware update checks",
+					this->otaUpdater->getCheckCount());
+				this->writeMetric("plantlight_ota_updates_total", "counter", "Firmware updates written",
+					this->otaUpdater->getUpdateCount());
+				this->writeMetric("plantlight_ota_failures_total", "counter", "Failed firmware updates and rollbacks",
+					this->otaUpdater->getFailureCount());
+				this->writeMetric("plantlight_ota_last_download_bytes", "gauge", "Bytes downloaded by the last update",
+					this->otaUpdater->getBytesDownloaded());
+				this->writeMetric("plantlight_ota_last_image_bytes", "gauge", "Image size written by the last update",
+					this->otaUpdater->getImageBytes());
+				this->writeMetric("plantlight_ota_pending_confirmation", "gauge", "Running image not yet confirmed",
+					this->otaUpdater->isPendingConfirmation());
+			}
+			return true;
+			
+		case 6:
+			this->writeHistogramHeader("plantlight_loop_phase_duration_seconds", "Main loop phase duration");
+			if (this->loopTimings) {
+				this->writeHistogram("plantlight_loop_phase_duration_seconds", "phase=\"work\"", this->loopTimings->work);
+			}
+			return true;
+			
+		case 7:
+			if (this->loopTimings) {
+				this->writeHistogram("plantlight_loop_phase_duration_seconds", "phase=\"sensor\"", this->loopTimings->sensor);
+			}
+			return true;
+			
+		case 8:
+			if (this->loopTimings) {
+				this->writeHistogram("plantlight_loop_phase_duration_seconds", "phase=\"control\"", this->loopTimings->control);
+			}
+			return true;
+			
+		case 9:
+			this->writeHistogramHeader("plantlight_i2c_transaction_duration_seconds", "I2C register transaction duration");
+			this->writeHistogram("plantlight_i2c_transaction_duration_seconds", nullptr,
+				this->lightSensor->getTransactionLatency());
+			return true;
+			
+		case 10:
+			this->writeHistogramHeader("plantlight_http_request_duration_seconds", "HTTP request handling duration");
+			this->writeHistogram("plantlight_http_request_duration_seconds", nullptr, this->requestLatency);
+			return true;
+			
+		case 11:
+			if (this->liveUpdates) {
+				this->writeHistogramHeader("plantlight_ws_publish_duration_seconds",
+					"Time to encode one live update and send it to all clients");
+				this->writeHistogram("plantlight_ws_publish_duration_seconds", nullptr,
+					this->liveUpdates->getPublishLatency());
+			}
+			return true;
+			
+		case 12:
+			if (this->timeManager) {
+				this->writeHistogramHeader("plantlight_ntp_dns_lookup_duration_seconds", "DNS lookup time of the NTP server name");
+				this->writeHistogram("plantlight_ntp_dns_lookup_duration_seconds", nullptr,
+					this->timeManager->getServerCache().getLookupLatency());
+				this->writeHistogramHeader("plantlight_ntp_round_trip_seconds", "NTP request round trip time");
+				this->writeHistogram("plantlight_ntp_round_trip_seconds", nullptr, this->timeManager->getNtpRoundTrip());
+			}
+			if (this->sntpServer) {
+				this->writeHistogramHeader("plantlight_sntp_serve_duration_seconds", "Time from reading an SNTP request to sending the reply");
+				this->writeHistogram("plantlight_sntp_serve_duration_seconds", nullptr, this->sntpServer->getServeLatency());
+			}
+			return true;
+			
+		default:
+			return false;
+	}
+}
+
+void HttpServer::writeMetric(const char* name, const char* type, const char* help, double value) {
+	this->writer.printf("# HELP %s %s\n# TYPE %s %s\n", name, help, name, type);
+	if (isfinite(value)) {
+		this->writer.printf("%s %.10g\n", name, value);
+	} else {
+		this->writer.printf("%s NaN\n", name);
+	}
+}
+
+void HttpServer::writeHistogramHeader(const char* name, const char* help) {
+	this->writer.printf("# HELP %s %s\n# TYPE %s histogram\n", name, help, name);
+}
+
+void HttpServer::writeHistogram(const char* name, const char* label, const LatencyHistogram& histogram) {
+	/// We emit cumulative counts; label is either null or a single name="value" pair
+	const char* separator = label ? "," : "";
+	label = label ? label : "";
+	
+	unsigned long cumulative = 0;
+	for (int bucket = 0; bucket < LatencyHistogram::BUCKET_COUNT - 1; bucket++) {
+		cumulative += histogram.getBucketCount(bucket);
+		this->writer.printf("%s_bucket{%s%sle=\"%g\"} %lu\n", name, label, separator,
+			LatencyHistogram::getBucketUpperBound(bucket) / 1000000.0, cumulative);
+	}
+	
+	this->writer.printf("%s_bucket{%s%sle=\"+Inf\"} %lu\n", name, label, separator, histogram.getCount());
+	if (*label) {
+		this->writer.printf("%s_sum{%s} %.6f\n", name, label, histogram.getSum() / 1000000.0);
+		this->writer.printf("%s_count{%s} %lu\n", name, label, histogram.getCount());
+	} else {
+		this->writer.printf("%s_sum %.6f\n", name, histogram.getSum() / 1000000.0);
+		this->writer.printf("%s_count %lu\n", name, histogram.getCount());
+	}
+}
+
+void HttpServer::sendError(int statusCode, const char* message) {
+	this->writer.beginResponse(statusCode, "application/json", -1);
+	this->writer.print("{\"error\":");
+	this->writer.printJsonString(message);
+	this->writer.print("}");
+	this->writer.end();
+	this->finishRequest(false);
+}
+
+void HttpServer::finishRequest(bool success) {
+	/// We keep the connection until the socket has taken the whole response
+	if (success && this->writer.getBacklog() > 0 && this->client.connected()) {
+		this->state = HttpState::Draining;
+		return;
+	}
+	
+	if (this->state != HttpState::Idle) {
+		if (success) {
+			this->requestCount++;
+			this->requestLatency.record(micros() - this->handlingStartMicros);
+		} else {
+			this->errorCount++;
+		}
+	}
+	
+	this->client.stop();
+	if (this->historyFile) {
+		this->historyFile.close();
+	}
+	this->stream = HttpStream::None;
+	this->requestLength = 0;
+	this->state = HttpState::Idle;
+}
+
+size_t HttpServer::parseContentLength(const char* headers) const {
+	const char* header = strcasestr(headers, "\r\nContent-Length:");
+	if (!header) {
+		return 0;
+	}
+	return strtoul(header + 17, nullptr, 10);
+}
+
+bool HttpServer::getHeader(const char* headers, const char* name, char* value, size_t size) {
+	size_t nameLength = strlen(name);
+	const char* line = headers;
+	
+	while ((line = strstr(line, "\r\n")) != nullptr) {
+		line += 2;
+		if (strncasecmp(line, name, nameLength) != 0 || line[nameLength] != ':') {
+			continue;
+		}
+		
+		const char* start = line + nameLength + 1;
+		while (*start == ' ' || *start == '\t') {
+			start++;
+		}
+		size_t length = strcspn(start, "\r");
+		while (length > 0 && (start[length - 1] == ' ' || start[length - 1] == '\t')) {
+			length--;
+		}
+		if (length >= size) {
+			return false;
+		}
+		memcpy(value, start, length);
+		value[length] = '\0';
+		return true;
+	}
+	return false;
+}
+
+bool HttpServer::getQueryParameter(const char* query, const char* key, char* value, size_t size) {
+	size_t keyLength = strlen(key);
+	const char* position = query;
+	
+	while (*position) {
+		if (strncmp(position, key, keyLength) == 0 && position[keyLength] == '=') {
+			const char* start = position + keyLength + 1;
+			size_t length = strcspn(start, "&");
+			if (length >= size) {
+				return false;
+			}
+			memcpy(value, start, length);
+			value[length] = '\0';
+			return true;
+		}
+		
+		/// We move on to the next key=value pair
+		position = strchr(position, '&');
+		if (!position) {
+			return false;
+		}
+		position++;
+	}
+	return false;
+}
+
+bool HttpServer::parseAutomaticFlag(const char* body, bool& automatic) {
+	const char* key = strstr(body, "automatic");
+	if (!key) {
+		return false;
+	}
+	
+	/// We accept both form encoding and a minimal JSON object
+	const char* value = key + 9;
+	while (*value == '"' || *value == ' ' || *value == ':' || *value == '=') {
+		value++;
+	}
+	
+	if (strncmp(value, "true", 4) == 0 || *value == '1') {
+		automatic = true;
+		return true;
+	}
+	if (strncmp(value, "false", 5) == 0 || *value == '0') {
+		automatic = false;
+		return true;
+	}
+	return false;
+}
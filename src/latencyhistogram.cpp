@@ -0,0 +1,90 @@
+///
+/// LatencyHistogram Implementation
+/// 
+/// We keep the bucket search to a short loop over fixed bounds so that
+/// recording a sample costs the same regardless of history length.
+///
+
+#include "latencyhistogram.h"
+
+LatencyHistogram::LatencyHistogram() {
+	this->reset();
+}
+
+void LatencyHistogram::record(unsigned long durationUs) {
+	/// We find the first bucket whose upper bound exceeds the duration
+	int bucket = 0;
+	while (bucket < BUCKET_COUNT - 1 && durationUs >= getBucketUpperBound(bucket)) {
+		bucket++;
+	}
+	
+	this->buckets[bucket]++;
+	this->count++;
+	this->sum += durationUs;
+	this->minValue = min(this->minValue, durationUs);
+	this->maxValue = max(this->maxValue, durationUs);
+}
+
+void LatencyHistogram::reset() {
+	for (int i = 0; i < BUCKET_COUNT; i++) {
+		this->buckets[i] = 0;
+	}
+	this->count = 0;
+	this->sum = 0;
+	this->minValue = ULONG_MAX;
+	this->maxValue = 0;
+}
+
+unsigned long LatencyHistogram::getCount() const {
+	return this->count;
+}
+
+unsigned long LatencyHistogram::getMin() const {
+	return this->count > 0 ? this->minValue : 0;
+}
+
+unsigned long LatencyHistogram::getMax() const {
+	return this->maxValue;
+}
+
+unsigned long LatencyHistogram::getMean() const {
+	if (this->count == 0) {
+		return 0;
+	}
+	return (unsigned long)(this->sum / this->count);
+}
+
+uint64_t LatencyHistogram::getSum() const {
+	return this->sum;
+}
+
+unsigned long LatencyHistogram::getBucketCount(int bucket) const {
+	if (bucket < 0 || bucket >= BUCKET_COUNT) {
+		return 0;
+	}
+	return this->buckets[bucket];
+}
+
+unsigned long LatencyHistogram::getBucketUpperBound(int bucket) {
+	if (bucket >= BUCKET_COUNT - 1) {
+		return ULONG_MAX;
+	}
+	return FIRST_BUCKET_US << bucket;
+}
+
+unsigned long LatencyHistogram::getPercentile(int percentile) const {
+	if (this->count == 0) {
+		return 0;
+	}
+	
+	/// We walk the buckets until we pass the requested rank
+	unsigned long rank = (unsigned long)(((uint64_t)this->count * percentile + 99) / 100);
+	unsigned long seen = 0;
+	for (int i = 0; i < BUCKET_COUNT; i++) {
+		seen += this->buckets[i];
+		if (seen >= rank && seen > 0) {
+			return min(getBucketUpperBound(i), this->maxValue);
+		}
+	}
+	return this->maxValue;
+}
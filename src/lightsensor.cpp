@@ -7,101 +7,389 @@
 ///
 
 #include "lightsensor.h"
+#include "logger.h"
 #include "config.h"
+#include <Wire.h>
+#include <stddef.h>
+
+/// VEML7700 register addresses and configuration fields
+static constexpr uint8_t VEML_REG_ALS_CONF = 0x00;
+static constexpr uint8_t VEML_REG_POWER_SAVE = 0x03;
+static constexpr uint8_t VEML_REG_ALS_DATA = 0x04;
+static constexpr uint8_t VEML_REG_WHITE_DATA = 0x05;
+static constexpr uint16_t VEML_CONF_GAIN_SHIFT = 11;
+static constexpr uint16_t VEML_CONF_IT_SHIFT = 6;
+static constexpr uint16_t VEML_CONF_SHUTDOWN = 0x0001;
+static constexpr uint16_t VEML_PSM_ENABLE = 0x0001;
+static constexpr uint16_t VEML_PSM_MODE_SHIFT = 1;
+static constexpr uint16_t VEML_CONF_CHECK_MASK = (0x03 << VEML_CONF_GAIN_SHIFT) | (0x0F << VEML_CONF_IT_SHIFT) | VEML_CONF_SHUTDOWN;
+
+/// Raw sample packet as queued with the logger (see lightsensor.h)
+struct __attribute__((packed)) StreamPacket {
+	uint8_t type;
+	uint32_t sequence;
+	uint32_t timestampMicros;
+	uint16_t alsCounts;
+	uint16_t whiteCounts;
+	uint16_t integrationMs;
+	float luxPerCount;
+	uint16_t checksum;          /// CRC-16/CCITT-FALSE over the preceding 19 bytes
+};
+
+static constexpr uint8_t STREAM_PACKET_TYPE = 'S';
+
+static uint16_t computePacketChecksum(const StreamPacket& packet) {
+	const uint8_t* data = (const uint8_t*)&packet;
+	uint16_t crc = 0xFFFF;
+	for (size_t i = 0; i < offsetof(StreamPacket, checksum); i++) {
+		crc ^= (uint16_t)data[i] << 8;
+		for (int bit = 0; bit < 8; bit++) {
+			crc = (crc & 0x8000) ? (crc << 1) ^ 0x1021 : crc << 1;
+		}
+	}
+	return crc;
+}
 
 LightSensor::LightSensor() 
 	: bufferSize(SENSOR_SAMPLES)
 	, bufferIndex(0)
 	, bufferFull(false)
-	, currentAverageLux(0.0f)
-	, lastRawLux(0.0f)
+	, bufferSum(0)
+	, lastRawCounts(0)
+	, lastWhiteCounts(0)
+	, spectralRatioQ8(0)
 	, readingCount(0)
+	, failedReadingCount(0)
 	, lastReadingTime(0)
 	, sensorInitialized(false)
+	, consecutiveFailures(0)
+	, failureStartTime(0)
+	, lastRecoveryAttempt(0)
+	, recoveryBackoff(SENSOR_RECOVERY_BACKOFF_MS)
+	, recoveryAttempts(0)
+	, recoveryCount(0)
+	, lastRecoveryDuration(0)
+	, longestRecoveryDuration(0)
+	, gainSetting(VEML7700_GAIN_1)
+	, integrationTimeSetting(VEML7700_IT_100MS)
+	, luxPerCount(computeLuxPerCount(VEML7700_GAIN_1, VEML7700_IT_100MS))
+	, powerMode(SensorPowerMode::Continuous)
+	, samplingInterval(SENSOR_READ_INTERVAL_MS)
+	, lastReadAttempt(0)
+	, wakeTime(0)
+	, sensorAwake(true)
+	, cachedThresholdLux(NAN)
+	, cachedThresholdCounts(0)
+	, transactionCount(0)
+	, transactionRetries(0)
+	, busMutex(xSemaphoreCreateRecursiveMutex())
+	, streaming(false)
+	, streamTaskRunning(false)
+	, streamEndTime(0)
+	, normalIntegrationTime(VEML7700_IT_100MS)
+	, normalPowerMode(SensorPowerMode::Continuous)
+	, streamSequence(0)
+	, streamPacketsSent(0)
+	, streamPacketsDropped(0)
+	, streamSentAtStart(0)
+	, streamDroppedAtStart(0)
 {
 	/// We allocate memory for the averaging buffer
 	/// Using dynamic allocation allows us to configure buffer size at compile time
-	this->readingBuffer = new float[this->bufferSize];
+	this->readingBuffer = new uint16_t[this->bufferSize];
 	
 	/// We initialize the buffer with zeros
 	for (int i = 0; i < this->bufferSize; i++) {
-		this->readingBuffer[i] = 0.0f;
+		this->readingBuffer[i] = 0;
+	}
+	
+	for (int i = 0; i < I2C_ERROR_CODES; i++) {
+		this->transactionErrors[i] = 0;
 	}
 }
 
 LightSensor::~LightSensor() {
+	this->stopStreaming();
+	
 	/// We clean up dynamically allocated memory
 	delete[] this->readingBuffer;
+	vSemaphoreDelete(this->busMutex);
 }
 
 bool LightSensor::begin() {
 	/// We initialize I2C communication with the VEML7700
-	if (!this->veml.begin()) {
-		Serial.println("LightSensor: Failed to initialize VEML7700");
+	if (!this->configureSensor()) {
+		LOG_ERROR("LightSensor: Failed to initialize VEML7700");
+		
+		/// We keep running and let updateReading() recover the sensor later
+		this->markSensorLost();
 		return false;
 	}
 	
-	/// We configure the sensor for optimal indoor lighting measurements
-	/// ALS_GAIN_1 and ALS_100MS provide good balance of sensitivity and speed
-	this->veml.setGain(VEML7700_GAIN_1);
-	this->veml.setIntegrationTime(VEML7700_IT_100MS);
+	this->resetAveraging();
 	
-	/// We enable the ambient light sensor
-	this->veml.enable(true);
+	LOG_INFO("LightSensor: VEML7700 initialized successfully");
+	LOG_INFO("Buffer size for averaging: %d", this->bufferSize);
 	
-	/// We wait for the sensor to stabilize after configuration
-	delay(150);
+	return true;
+}
+
+void LightSensor::setSamplingInterval(unsigned long intervalMs) {
+	this->samplingInterval = intervalMs;
 	
-	this->sensorInitialized = true;
-	this->resetAveraging();
+	/// We pick the mode with the lowest estimated current that still provides
+	/// at least one completed conversion between two consecutive reads
+	SensorPowerMode bestMode = SensorPowerMode::Continuous;
+	float bestCurrent = this->estimateSupplyCurrent(bestMode);
 	
-	Serial.println("LightSensor: VEML7700 initialized successfully");
-	Serial.print("Buffer size for averaging: ");
-	Serial.println(this->bufferSize);
+	LOG_INFO("LightSensor: Estimated supply current at %lums sampling:", intervalMs);
 	
-	return true;
+	for (int i = (int)SensorPowerMode::Continuous; i <= (int)SensorPowerMode::Shutdown; i++) {
+		SensorPowerMode mode = (SensorPowerMode)i;
+		float current = this->estimateSupplyCurrent(mode);
+		bool usable = mode == SensorPowerMode::Shutdown
+			? this->getWakeLeadTime() < intervalMs
+			: this->getRefreshTime(mode) <= intervalMs;
+		
+		LOG_INFO("  %s: %.1f uA%s", getPowerModeString(mode), current, usable ? "" : " (too slow)");
+		
+		if (usable && current < bestCurrent) {
+			bestMode = mode;
+			bestCurrent = current;
+		}
+	}
+	
+	this->powerMode = bestMode;
+	LOG_INFO("LightSensor: Using power mode %s", getPowerModeString(bestMode));
+	
+	if (this->sensorInitialized && !this->applyPowerMode()) {
+		this->handleReadFailure();
+	}
+}
+
+void LightSensor::service() {
+	/// We end a stream from the loop, where restoring the configuration cannot race a read
+	if (this->streaming && (long)(millis() - this->streamEndTime) >= 0) {
+		this->stopStreaming();
+	}
+	
+	if (!this->sensorInitialized || this->powerMode != SensorPowerMode::Shutdown || this->sensorAwake) {
+		return;
+	}
+	
+	/// We wake the sensor early enough that a full integration finishes before the next read
+	unsigned long sinceLastRead = millis() - this->lastReadAttempt;
+	if (sinceLastRead + this->getWakeLeadTime() >= this->samplingInterval) {
+		if (!this->setSensorAwake(true)) {
+			this->handleReadFailure();
+		}
+	}
+}
+
+SensorPowerMode LightSensor::getPowerMode() const {
+	return this->powerMode;
+}
+
+const char* LightSensor::getPowerModeString(SensorPowerMode mode) {
+	switch (mode) {
+		case SensorPowerMode::Continuous: return "Continuous";
+		case SensorPowerMode::PowerSave1: return "PSM1";
+		case SensorPowerMode::PowerSave2: return "PSM2";
+		case SensorPowerMode::PowerSave3: return "PSM3";
+		case SensorPowerMode::PowerSave4: return "PSM4";
+		case SensorPowerMode::Shutdown: return "Shutdown";
+		default: return "Unknown";
+	}
+}
+
+float LightSensor::estimateSupplyCurrent(SensorPowerMode mode) const {
+	/// We weight active and shutdown current by the fraction of time spent converting
+	/// With IT = 100 ms this reproduces the datasheet PSM figures (8/5/3/2 uA)
+	float activeTime = 0.0f;
+	float period = 1.0f;
+	
+	switch (mode) {
+		case SensorPowerMode::Continuous:
+			return SENSOR_ACTIVE_CURRENT_UA;
+		case SensorPowerMode::Shutdown:
+			activeTime = this->getWakeLeadTime();
+			period = max(this->samplingInterval, (unsigned long)1);
+			break;
+		default:
+			activeTime = integrationTimeToMs(this->integrationTimeSetting);
+			period = this->getRefreshTime(mode);
+			break;
+	}
+	
+	float duty = min(activeTime / period, 1.0f);
+	return SENSOR_ACTIVE_CURRENT_UA * duty + SENSOR_SHUTDOWN_CURRENT_UA * (1.0f - duty);
+}
+
+float LightSensor::getEstimatedSupplyCurrent() const {
+	return this->estimateSupplyCurrent(this->powerMode);
 }
 
 bool LightSensor::updateReading() {
+	this->lastReadAttempt = millis();
+	
 	if (!this->sensorInitialized) {
-		Serial.println("LightSensor: Sensor not initialized");
-		return false;
+		/// We try to bring the sensor back instead of failing forever
+		if (!this->attemptRecovery()) {
+			return false;
+		}
 	}
 	
-	/// We read the ambient light value in lux
-	float newReading = this->veml.readLux();
+	/// We periodically confirm the sensor still holds our configuration
+	/// A power blip resets it to defaults without any I2C error
+	if (this->readingCount > 0 && this->readingCount % SENSOR_CONFIG_VERIFY_READINGS == 0) {
+		if (!this->verifySensor()) {
+			LOG_WARN("LightSensor: Configuration lost, re-initializing sensor");
+			this->markSensorLost();
+			return false;
+		}
+	}
+	
+	/// In Shutdown mode we make sure the conversion started by service() has completed
+	if (this->powerMode == SensorPowerMode::Shutdown) {
+		if (!this->sensorAwake && !this->setSensorAwake(true)) {
+			this->handleReadFailure();
+			return false;
+		}
+		
+		unsigned long readyAfter = SENSOR_WAKEUP_TIME_MS + integrationTimeToMs(this->integrationTimeSetting);
+		unsigned long awakeFor = millis() - this->wakeTime;
+		if (awakeFor < readyAfter) {
+			delay(readyAfter - awakeFor);
+		}
+	}
+	
+	/// We read the raw ALS counts ourselves so bus errors are never mistaken for light
+	uint16_t rawCounts = 0;
+	if (!this->readRegister(VEML_REG_ALS_DATA, rawCounts)) {
+		LOG_WARN("LightSensor: ALS read transaction failed");
+		this->handleReadFailure();
+		return false;
+	}
 	
-	/// We validate the reading is reasonable
-	/// VEML7700 returns NaN or very large values on error
-	if (isnan(newReading) || newReading < 0 || newReading > 120000) {
-		Serial.print("LightSensor: Invalid reading detected: ");
-		Serial.println(newReading);
+	/// We read the WHITE channel in the same cycle; both come from the same integration
+	uint16_t whiteCounts = 0;
+	if (!this->readRegister(VEML_REG_WHITE_DATA, whiteCounts)) {
+		LOG_WARN("LightSensor: WHITE read transaction failed");
+		this->handleReadFailure();
 		return false;
 	}
+	this->lastWhiteCounts = whiteCounts;
+	this->updateSpectralRatio(rawCounts, whiteCounts);
+	
+	/// We power down again until service() wakes the sensor for the next read
+	if (this->powerMode == SensorPowerMode::Shutdown && !this->setSensorAwake(false)) {
+		LOG_WARN("LightSensor: Failed to shut sensor down");
+	}
 	
 	/// We store the raw reading for diagnostics
-	this->lastRawLux = newReading;
+	/// Every 16-bit count is a physically valid value, so no float validation is needed
+	this->lastRawCounts = rawCounts;
 	this->lastReadingTime = millis();
 	this->readingCount++;
+	this->consecutiveFailures = 0;
 	
 	/// We add the new reading to our averaging buffer
-	this->addToBuffer(newReading);
-	this->calculateAverage();
+	this->addToBuffer(rawCounts);
 	
 	return true;
 }
 
 float LightSensor::getCurrentLux() const {
-	return this->currentAverageLux;
+	/// We convert lazily; the control path never needs lux
+	int samplesCount = this->getSampleCount();
+	if (samplesCount == 0) {
+		return 0.0f;
+	}
+	return this->bufferSum * this->luxPerCount / samplesCount;
 }
 
 float LightSensor::getLastRawLux() const {
-	return this->lastRawLux;
+	return this->countsToLux(this->lastRawCounts);
+}
+
+uint16_t LightSensor::getLastRawCounts() const {
+	return this->lastRawCounts;
+}
+
+uint16_t LightSensor::getAverageCounts() const {
+	int samplesCount = this->getSampleCount();
+	if (samplesCount == 0) {
+		return 0;
+	}
+	return (uint16_t)(this->bufferSum / samplesCount);
+}
+
+uint16_t LightSensor::getLastWhiteCounts() const {
+	return this->lastWhiteCounts;
+}
+
+float LightSensor::getSpectralRatio() const {
+	return this->spectralRatioQ8 / 256.0f;
+}
+
+float LightSensor::getDaylightFraction() const {
+	float ratio = this->getSpectralRatio();
+	if (ratio <= 0.0f) {
+		return 0.0f; /// We have no spectral data (dark or not measured yet)
+	}
+	
+	/// We solve the two-source mix: r = (A_sun + A_lamp) / (W_sun + W_lamp)
+	/// The share of WHITE from the sun is (r_lamp - r) / (r_lamp - r_sun),
+	/// which we scale by r_sun / r to get the share of ALS (and thus lux)
+	const float sunRatio = DAYLIGHT_ALS_WHITE_RATIO;
+	const float lampRatio = LAMP_ALS_WHITE_RATIO;
+	float whiteShare = (lampRatio - ratio) / (lampRatio - sunRatio);
+	whiteShare = constrain(whiteShare, 0.0f, 1.0f);
+	
+	return constrain(whiteShare * sunRatio / ratio, 0.0f, 1.0f);
+}
+
+float LightSensor::getDaylightLux() const {
+	return this->getCurrentLux() * this->getDaylightFraction();
 }
 
-bool LightSensor::isBelowThreshold(float thresholdLux) const {
+LightLevel LightSensor::compareDaylightToThreshold(float thresholdLux) const {
+	if (this->spectralRatioQ8 == 0 || this->getSampleCount() == 0) {
+		/// We cannot separate sources yet, so we fall back to total light
+		return this->compareToThreshold(thresholdLux);
+	}
+	return this->getDaylightLux() < thresholdLux ? LightLevel::Below : LightLevel::AtOrAbove;
+}
+
+uint32_t LightSensor::luxToCounts(float lux) const {
+	if (lux <= 0.0f) {
+		return 0;
+	}
+	/// We round up so "below threshold in counts" matches "below threshold in lux"
+	return (uint32_t)ceilf(lux / this->luxPerCount);
+}
+
+float LightSensor::countsToLux(uint32_t counts) const {
+	return counts * this->luxPerCount;
+}
+
+LightLevel LightSensor::compareToThreshold(float thresholdLux) const {
+	/// We convert the threshold only when it (or the sensor configuration) changes
+	if (thresholdLux != this->cachedThresholdLux) {
+		this->cachedThresholdLux = thresholdLux;
+		this->cachedThresholdCounts = this->luxToCounts(thresholdLux);
+	}
+	
+	/// An empty window is no reading at all; 0 < 0 would call it bright
+	int samplesCount = this->getSampleCount();
+	if (samplesCount == 0) {
+		return LightLevel::Unknown;
+	}
+	
 	/// We use the averaged value for threshold comparison to avoid flickering
-	return this->currentAverageLux < thresholdLux;
+	/// Comparing sum against threshold * n avoids the division entirely
+	return this->bufferSum < this->cachedThresholdCounts * (uint32_t)samplesCount
+		? LightLevel::Below : LightLevel::AtOrAbove;
 }
 
 bool LightSensor::isSensorHealthy() const {
@@ -110,49 +398,268 @@ bool LightSensor::isSensorHealthy() const {
 	}
 	
 	/// We consider the sensor healthy if we've had recent successful readings
-	/// and the readings are within expected ranges
+	/// Raw counts are always in range, so recency is the only criterion left
 	unsigned long timeSinceLastReading = millis() - this->lastReadingTime;
 	bool recentReading = timeSinceLastReading < 60000; /// Within last minute
-	bool validReading = !isnan(this->lastRawLux) && this->lastRawLux >= 0;
+	bool hasSamples = this->getSampleCount() > 0;
 	
-	return recentReading && validReading;
+	return recentReading && hasSamples;
 }
 
 unsigned long LightSensor::getReadingCount() const {
 	return this->readingCount;
 }
 
+unsigned long LightSensor::getFailedReadingCount() const {
+	return this->failedReadingCount;
+}
+
+bool LightSensor::isRecovering() const {
+	return !this->sensorInitialized;
+}
+
+unsigned long LightSensor::getRecoveryCount() const {
+	return this->recoveryCount;
+}
+
+unsigned long LightSensor::getRecoveryAttempts() const {
+	return this->recoveryAttempts;
+}
+
+unsigned long LightSensor::getLastRecoveryDuration() const {
+	return this->lastRecoveryDuration;
+}
+
+unsigned long LightSensor::getLongestRecoveryDuration() const {
+	return this->longestRecoveryDuration;
+}
+
+unsigned long LightSensor::getTimeSinceFailure() const {
+	if (this->sensorInitialized) {
+		return 0;
+	}
+	return millis() - this->failureStartTime;
+}
+
+bool LightSensor::needsRestart() const {
+	/// We only ask for a restart once bus recovery has had a long, fair chance
+	return !this->sensorInitialized
+		&& this->recoveryAttempts > 0
+		&& this->getTimeSinceFailure() >= SENSOR_RESTART_AFTER_MS;
+}
+
+const LatencyHistogram& LightSensor::getTransactionLatency() const {
+	return this->transactionLatency;
+}
+
+unsigned long LightSensor::getTransactionCount() const {
+	return this->transactionCount;
+}
+
+unsigned long LightSensor::getTransactionErrors() const {
+	unsigned long total = 0;
+	for (int i = 1; i < I2C_ERROR_CODES; i++) {
+		total += this->transactionErrors[i];
+	}
+	return total;
+}
+
+unsigned long LightSensor::getTransactionErrors(uint8_t errorCode) const {
+	if (errorCode == 0 || errorCode >= I2C_ERROR_CODES) {
+		return 0;
+	}
+	return this->transactionErrors[errorCode];
+}
+
+unsigned long LightSensor::getTransactionRetries() const {
+	return this->transactionRetries;
+}
+
+bool LightSensor::startStreaming(unsigned long durationS) {
+	durationS = constrain(durationS, 1UL, (unsigned long)STREAM_MAX_DURATION_S);
+	
+	if (this->streaming) {
+		this->streamEndTime = millis() + durationS * 1000;
+		return true;
+	}
+	
+	if (!this->sensorInitialized) {
+		return false;
+	}
+	
+	/// We sample as fast as the sensor converts; the conversion has to run continuously for that
+	this->normalIntegrationTime = this->integrationTimeSetting;
+	this->normalPowerMode = this->powerMode;
+	this->integrationTimeSetting = VEML7700_IT_25MS;
+	this->powerMode = SensorPowerMode::Continuous;
+	
+	if (!this->configureSensor()) {
+		this->integrationTimeSetting = this->normalIntegrationTime;
+		this->powerMode = this->normalPowerMode;
+		this->markSensorLost();
+		return false;
+	}
+	
+	/// We drop samples taken at the old resolution
+	this->resetAveraging();
+	
+	unsigned long periodMs = integrationTimeToMs(this->integrationTimeSetting);
+	LOG_INFO("LightSensor: Streaming raw samples every %lums for %lus at %lu baud",
+		periodMs, durationS, (unsigned long)STREAM_BAUD_RATE);
+	logger.setOutputMode(true, STREAM_BAUD_RATE);
+	
+	/// The counters keep running across streams, so they stay monotonic for /metrics
+	this->streamSequence = 0;
+	this->streamSentAtStart = this->streamPacketsSent;
+	this->streamDroppedAtStart = this->streamPacketsDropped;
+	this->streamEndTime = millis() + durationS * 1000;
+	this->streaming = true;
+	this->streamTaskRunning = true;
+	
+	/// We sample above the network tasks so their bursts do not cause gaps
+	if (xTaskCreatePinnedToCore(streamTaskEntry, "stream", 3072, this, 2, nullptr, 0) != pdPASS) {
+		this->streamTaskRunning = false;
+		this->stopStreaming();
+		return false;
+	}
+	return true;
+}
+
+void LightSensor::stopStreaming() {
+	if (!this->streaming) {
+		return;
+	}
+	this->streaming = false;
+	
+	/// We wait for the task to finish its current sample before we touch the configuration
+	while (this->streamTaskRunning) {
+		vTaskDelay(1);
+	}
+	
+	LOG_INFO("LightSensor: Stream stopped - %lu samples sent, %lu dropped",
+		this->streamPacketsSent - this->streamSentAtStart, this->streamPacketsDropped - this->streamDroppedAtStart);
+	logger.setOutputMode(false, SERIAL_BAUD_RATE);
+	
+	this->integrationTimeSetting = this->normalIntegrationTime;
+	this->powerMode = this->normalPowerMode;
+	
+	if (!this->configureSensor()) {
+		this->markSensorLost();
+		return;
+	}
+	this->resetAveraging();
+}
+
+bool LightSensor::isStreaming() const {
+	return this->streaming;
+}
+
+unsigned long LightSensor::getStreamPacketsSent() const {
+	return this->streamPacketsSent;
+}
+
+unsigned long LightSensor::getStreamPacketsDropped() const {
+	return this->streamPacketsDropped;
+}
+
+void LightSensor::lockBus() {
+	xSemaphoreTakeRecursive(this->busMutex, portMAX_DELAY);
+}
+
+void LightSensor::unlockBus() {
+	xSemaphoreGiveRecursive(this->busMutex);
+}
+
+void LightSensor::streamTaskEntry(void* parameter) {
+	static_cast<LightSensor*>(parameter)->runStreamTask();
+}
+
+void LightSensor::runStreamTask() {
+	/// We pace reads by the integration time so each one finds a fresh conversion
+	const TickType_t period = pdMS_TO_TICKS(integrationTimeToMs(this->integrationTimeSetting));
+	TickType_t lastWake = xTaskGetTickCount();
+	
+	while (this->streaming) {
+		vTaskDelayUntil(&lastWake, period);
+		this->streamSample();
+	}
+	
+	this->streamTaskRunning = false;
+	vTaskDelete(nullptr);
+}
+
+void LightSensor::streamSample() {
+	uint32_t sequence = this->streamSequence++;
+	uint32_t timestamp = micros();
+	uint16_t alsCounts = 0;
+	uint16_t whiteCounts = 0;
+	
+	/// We hold the bus across both reads so the control loop cannot split the pair
+	this->lockBus();
+	bool readOk = this->readRegister(VEML_REG_ALS_DATA, alsCounts)
+		&& this->readRegister(VEML_REG_WHITE_DATA, whiteCounts);
+	this->unlockBus();
+	
+	if (!readOk) {
+		this->streamPacketsDropped++;
+		return;
+	}
+	
+	StreamPacket packet;
+	packet.type = STREAM_PACKET_TYPE;
+	packet.sequence = sequence;
+	packet.timestampMicros = timestamp;
+	packet.alsCounts = alsCounts;
+	packet.whiteCounts = whiteCounts;
+	packet.integrationMs = integrationTimeToMs(this->integrationTimeSetting);
+	packet.luxPerCount = this->luxPerCount;
+	packet.checksum = computePacketChecksum(packet);
+	if (logger.writePacket((const uint8_t*)&packet, sizeof(packet))) {
+		this->streamPacketsSent++;
+	} else {
+		this->streamPacketsDropped++;
+	}
+}
+
 void LightSensor::resetAveraging() {
 	/// We clear the averaging buffer and reset state
 	for (int i = 0; i < this->bufferSize; i++) {
-		this->readingBuffer[i] = 0.0f;
+		this->readingBuffer[i] = 0;
 	}
 	
 	this->bufferIndex = 0;
 	this->bufferFull = false;
-	this->currentAverageLux = 0.0f;
+	this->bufferSum = 0;
 	
-	Serial.println("LightSensor: Averaging buffer reset");
+	LOG_DEBUG("LightSensor: Averaging buffer reset");
 }
 
-void LightSensor::calculateAverage() {
-	float sum = 0.0f;
-	int samplesCount = this->bufferFull ? this->bufferSize : this->bufferIndex;
-	
-	/// We sum all valid samples in the buffer
-	for (int i = 0; i < samplesCount; i++) {
-		sum += this->readingBuffer[i];
+void LightSensor::updateSpectralRatio(uint16_t alsCounts, uint16_t whiteCounts) {
+	/// We skip near-dark samples where the ratio is dominated by noise
+	if (whiteCounts < 16) {
+		return;
 	}
 	
-	/// We calculate the average, avoiding division by zero
-	if (samplesCount > 0) {
-		this->currentAverageLux = sum / samplesCount;
-	} else {
-		this->currentAverageLux = 0.0f;
+	uint32_t ratioQ8 = ((uint32_t)alsCounts << 8) / whiteCounts;
+	if (this->spectralRatioQ8 == 0) {
+		this->spectralRatioQ8 = ratioQ8;
+		return;
 	}
+	
+	/// We apply ema += (x - ema) / 2^shift in signed integer arithmetic
+	int32_t delta = (int32_t)ratioQ8 - (int32_t)this->spectralRatioQ8;
+	this->spectralRatioQ8 = (uint32_t)((int32_t)this->spectralRatioQ8 + delta / (1 << SPECTRAL_RATIO_SMOOTHING_SHIFT));
 }
 
-void LightSensor::addToBuffer(float newReading) {
+int LightSensor::getSampleCount() const {
+	return this->bufferFull ? this->bufferSize : this->bufferIndex;
+}
+
+void LightSensor::addToBuffer(uint16_t newReading) {
+	/// We keep the running sum in step with the slot being overwritten
+	this->bufferSum -= this->readingBuffer[this->bufferIndex];
+	this->bufferSum += newReading;
+	
 	/// We add the new reading to the circular buffer
 	this->readingBuffer[this->bufferIndex] = newReading;
 	
@@ -164,4 +671,306 @@ void LightSensor::addToBuffer(float newReading) {
 		this->bufferIndex = 0;
 		this->bufferFull = true;
 	}
+}
+
+bool LightSensor::configureSensor() {
+	this->lockBus();
+	if (!this->veml.begin()) {
+		this->unlockBus();
+		return false;
+	}
+	
+	/// We configure the sensor for optimal indoor lighting measurements
+	/// ALS_GAIN_1 and ALS_100MS provide good balance of sensitivity and speed
+	this->veml.setGain(this->gainSetting);
+	this->veml.setIntegrationTime(this->integrationTimeSetting);
+	this->luxPerCount = computeLuxPerCount(this->gainSetting, this->integrationTimeSetting);
+	
+	/// We invalidate the cached threshold since counts mean something new now
+	this->cachedThresholdLux = NAN;
+	
+	/// We enable the sensor in the power mode chosen for our sampling interval
+	bool powerModeApplied = this->applyPowerMode();
+	this->unlockBus();
+	if (!powerModeApplied) {
+		return false;
+	}
+	
+	/// We wait for the first conversion to complete after configuration
+	if (this->sensorAwake) {
+		delay(integrationTimeToMs(this->integrationTimeSetting) + 50);
+	}
+	
+	this->sensorInitialized = true;
+	this->consecutiveFailures = 0;
+	return true;
+}
+
+bool LightSensor::verifySensor() {
+	/// We read the configuration register in one transaction; a NACK means the sensor is gone
+	uint16_t config = 0;
+	if (!this->readRegister(VEML_REG_ALS_CONF, config)) {
+		return false;
+	}
+	
+	/// We then check the configuration survived (defaults differ from our settings)
+	uint16_t expected = this->buildConfigWord(!this->sensorAwake);
+	if ((config & VEML_CONF_CHECK_MASK) != (expected & VEML_CONF_CHECK_MASK)) {
+		return false;
+	}
+	
+	/// We also check the power-save register, which resets to "disabled"
+	if (this->powerMode >= SensorPowerMode::PowerSave1 && this->powerMode <= SensorPowerMode::PowerSave4) {
+		uint16_t powerSave = 0;
+		if (!this->readRegister(VEML_REG_POWER_SAVE, powerSave)) {
+			return false;
+		}
+		return (powerSave & VEML_PSM_ENABLE) != 0;
+	}
+	return true;
+}
+
+bool LightSensor::recoverBus() {
+	/// We release the peripheral so we can drive the pins manually
+	this->lockBus();
+	Wire.end();
+	
+	pinMode(I2C_SDA_PIN, INPUT_PULLUP);
+	pinMode(I2C_SCL_PIN, OUTPUT_OPEN_DRAIN);
+	digitalWrite(I2C_SCL_PIN, HIGH);
+	delayMicroseconds(5);
+	
+	/// We clock SCL up to 9 times so a slave stuck mid-byte can finish and release SDA
+	for (int i = 0; i < 9 && digitalRead(I2C_SDA_PIN) == LOW; i++) {
+		digitalWrite(I2C_SCL_PIN, LOW);
+		delayMicroseconds(5);
+		digitalWrite(I2C_SCL_PIN, HIGH);
+		delayMicroseconds(5);
+	}
+	
+	/// We generate a STOP condition (SDA rising while SCL is high)
+	pinMode(I2C_SDA_PIN, OUTPUT_OPEN_DRAIN);
+	digitalWrite(I2C_SDA_PIN, LOW);
+	delayMicroseconds(5);
+	digitalWrite(I2C_SCL_PIN, HIGH);
+	delayMicroseconds(5);
+	digitalWrite(I2C_SDA_PIN, HIGH);
+	delayMicroseconds(5);
+	
+	pinMode(I2C_SDA_PIN, INPUT_PULLUP);
+	bool sdaReleased = digitalRead(I2C_SDA_PIN) == HIGH;
+	
+	/// We hand the pins back to the I2C peripheral
+	Wire.begin(I2C_SDA_PIN, I2C_SCL_PIN, I2C_CLOCK_HZ);
+	this->unlockBus();
+	
+	return sdaReleased;
+}
+
+void LightSensor::handleReadFailure() {
+	this->failedReadingCount++;
+	this->consecutiveFailures++;
+	
+	/// We tolerate isolated glitches and only re-probe after repeated failures
+	if (this->consecutiveFailures < SENSOR_MAX_CONSECUTIVE_FAILURES) {
+		return;
+	}
+	
+	if (!this->verifySensor()) {
+		LOG_WARN("LightSensor: Sensor not responding, starting recovery");
+		this->markSensorLost();
+	}
+}
+
+void LightSensor::markSensorLost() {
+	if (this->sensorInitialized || this->failureStartTime == 0) {
+		this->failureStartTime = millis();
+		this->lastRecoveryAttempt = this->failureStartTime;
+		this->recoveryBackoff = SENSOR_RECOVERY_BACKOFF_MS;
+	}
+	this->sensorInitialized = false;
+}
+
+bool LightSensor::attemptRecovery() {
+	/// We wait for the backoff interval between attempts
+	if (millis() - this->lastRecoveryAttempt < this->recoveryBackoff) {
+		return false;
+	}
+	
+	this->lastRecoveryAttempt = millis();
+	this->recoveryAttempts++;
+	
+	LOG_INFO("LightSensor: Recovery attempt #%lu", this->recoveryAttempts);
+	
+	if (!this->recoverBus()) {
+		LOG_WARN("LightSensor: SDA still held low after bus recovery");
+	}
+	
+	if (!this->configureSensor()) {
+		this->recoveryBackoff = min(this->recoveryBackoff * 2, (unsigned long)SENSOR_RECOVERY_MAX_BACKOFF_MS);
+		
+		LOG_WARN("LightSensor: ✗ Recovery failed, next attempt in %lu seconds", this->recoveryBackoff / 1000);
+		return false;
+	}
+	
+	/// We measure time-to-recover from the first detected failure
+	this->lastRecoveryDuration = millis() - this->failureStartTime;
+	this->longestRecoveryDuration = max(this->longestRecoveryDuration, this->lastRecoveryDuration);
+	this->recoveryCount++;
+	this->failureStartTime = 0;
+	this->recoveryBackoff = SENSOR_RECOVERY_BACKOFF_MS;
+	
+	/// We drop stale samples so the average reflects the recovered sensor
+	this->resetAveraging();
+	
+	LOG_INFO("LightSensor: ✓ Sensor recovered after %lums", this->lastRecoveryDuration);
+	
+	return true;
+}
+
+bool LightSensor::readRegister(uint8_t reg, uint16_t& value) {
+	this->lockBus();
+	bool success = false;
+	for (int attempt = 0; attempt <= I2C_MAX_RETRIES && !success; attempt++) {
+		uint8_t result = this->readRegisterOnce(reg, value);
+		if (result == 0) {
+			if (attempt > 0) {
+				this->transactionRetries++;
+			}
+			success = true;
+		} else {
+			this->transactionErrors[result < I2C_ERROR_CODES ? result : 4]++;
+		}
+	}
+	this->unlockBus();
+	return success;
+}
+
+uint8_t LightSensor::readRegisterOnce(uint8_t reg, uint16_t& value) {
+	unsigned long startTime = micros();
+	this->transactionCount++;
+	
+	/// We write the command code and read the little-endian word with a repeated start
+	Wire.beginTransmission(VEML7700_I2CADDR_DEFAULT);
+	Wire.write(reg);
+	uint8_t result = Wire.endTransmission(false);
+	
+	if (result == 0) {
+		if (Wire.requestFrom((uint8_t)VEML7700_I2CADDR_DEFAULT, (uint8_t)2) == 2) {
+			uint8_t low = Wire.read();
+			uint8_t high = Wire.read();
+			value = (uint16_t)(high << 8) | low;
+		} else {
+			result = 4; /// We report a short read as "other error"
+		}
+	}
+	
+	this->transactionLatency.record(micros() - startTime);
+	return result;
+}
+
+bool LightSensor::writeRegister(uint8_t reg, uint16_t value) {
+	this->lockBus();
+	bool success = false;
+	for (int attempt = 0; attempt <= I2C_MAX_RETRIES && !success; attempt++) {
+		unsigned long startTime = micros();
+		this->transactionCount++;
+		
+		/// We send the command code followed by the little-endian word
+		Wire.beginTransmission(VEML7700_I2CADDR_DEFAULT);
+		Wire.write(reg);
+		Wire.write((uint8_t)(value & 0xFF));
+		Wire.write((uint8_t)(value >> 8));
+		uint8_t result = Wire.endTransmission();
+		
+		this->transactionLatency.record(micros() - startTime);
+		
+		if (result == 0) {
+			if (attempt > 0) {
+				this->transactionRetries++;
+			}
+			success = true;
+		} else {
+			this->transactionErrors[result < I2C_ERROR_CODES ? result : 4]++;
+		}
+	}
+	this->unlockBus();
+	return success;
+}
+
+uint16_t LightSensor::buildConfigWord(bool shutdown) const {
+	return (this->gainSetting << VEML_CONF_GAIN_SHIFT)
+		| (this->integrationTimeSetting << VEML_CONF_IT_SHIFT)
+		| (shutdown ? VEML_CONF_SHUTDOWN : 0);
+}
+
+bool LightSensor::applyPowerMode() {
+	/// We program the power-save register first, then start or stop conversions
+	uint16_t powerSave = 0;
+	if (this->powerMode >= SensorPowerMode::PowerSave1 && this->powerMode <= SensorPowerMode::PowerSave4) {
+		uint16_t psmIndex = (int)this->powerMode - (int)SensorPowerMode::PowerSave1;
+		powerSave = (psmIndex << VEML_PSM_MODE_SHIFT) | VEML_PSM_ENABLE;
+	}
+	
+	if (!this->writeRegister(VEML_REG_POWER_SAVE, powerSave)) {
+		return false;
+	}
+	
+	return this->setSensorAwake(this->powerMode != SensorPowerMode::Shutdown);
+}
+
+bool LightSensor::setSensorAwake(bool awake) {
+	if (!this->writeRegister(VEML_REG_ALS_CONF, this->buildConfigWord(!awake))) {
+		return false;
+	}
+	
+	this->sensorAwake = awake;
+	if (awake) {
+		this->wakeTime = millis();
+	}
+	return true;
+}
+
+unsigned long LightSensor::getRefreshTime(SensorPowerMode mode) const {
+	unsigned long integrationMs = integrationTimeToMs(this->integrationTimeSetting);
+	
+	switch (mode) {
+		case SensorPowerMode::PowerSave1: return integrationMs + 500;
+		case SensorPowerMode::PowerSave2: return integrationMs + 1000;
+		case SensorPowerMode::PowerSave3: return integrationMs + 2000;
+		case SensorPowerMode::PowerSave4: return integrationMs + 4000;
+		case SensorPowerMode::Shutdown: return SENSOR_WAKEUP_TIME_MS + integrationMs;
+		default: return integrationMs;
+	}
+}
+
+unsigned long LightSensor::getWakeLeadTime() const {
+	/// We add one loop period because service() only runs between loop delays
+	return SENSOR_WAKEUP_TIME_MS + integrationTimeToMs(this->integrationTimeSetting) + LOOP_DELAY_MS;
+}
+
+unsigned long LightSensor::integrationTimeToMs(uint8_t integrationTime) {
+	switch (integrationTime) {
+		case VEML7700_IT_25MS: return 25;
+		case VEML7700_IT_50MS: return 50;
+		case VEML7700_IT_100MS: return 100;
+		case VEML7700_IT_200MS: return 200;
+		case VEML7700_IT_400MS: return 400;
+		case VEML7700_IT_800MS: return 800;
+		default: return 100;
+	}
+}
+
+float LightSensor::computeLuxPerCount(uint8_t gain, uint8_t integrationTime) {
+	/// We scale the datasheet resolution (0.0036 lx/count at gain 2, 800 ms)
+	float gainValue = 1.0f;
+	switch (gain) {
+		case VEML7700_GAIN_2: gainValue = 2.0f; break;
+		case VEML7700_GAIN_1: gainValue = 1.0f; break;
+		case VEML7700_GAIN_1_4: gainValue = 0.25f; break;
+		case VEML7700_GAIN_1_8: gainValue = 0.125f; break;
+	}
+	
+	float integrationMs = integrationTimeToMs(integrationTime);
+	return 0.0036f * (800.0f / integrationMs) * (2.0f / gainValue);
 }
\ No newline at end of file
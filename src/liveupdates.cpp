@@ -0,0 +1,388 @@
+///
+/// LiveUpdates Implementation
+/// 
+/// Everything runs on the main loop: publish() right after the data
+/// changed, poll() from the idle phase between loop iterations. Sockets
+/// are written with MSG_DONTWAIT, so a stalled client costs us a skipped
+/// frame instead of a blocked loop.
+///
+
+#include "liveupdates.h"
+#include "logger.h"
+#include <sys/socket.h>
+#include <errno.h>
+#include <mbedtls/sha1.h>
+#include <mbedtls/base64.h>
+
+/// RFC 6455 opcodes
+static constexpr uint8_t WS_OPCODE_BINARY = 0x2;
+static constexpr uint8_t WS_OPCODE_CLOSE = 0x8;
+static constexpr uint8_t WS_OPCODE_PING = 0x9;
+static constexpr uint8_t WS_OPCODE_PONG = 0xA;
+static constexpr uint8_t WS_FINAL = 0x80;
+
+static constexpr uint8_t FRAME_FLAG_KEYFRAME = 0x01;
+
+LiveUpdates::LiveUpdates(TimeManager* timeManager, LightSensor* lightSensor, RelayController* relayController,
+						PlantController* plantController, DailySummary* dailySummary)
+	: timeManager(timeManager)
+	, lightSensor(lightSensor)
+	, relayController(relayController)
+	, plantController(plantController)
+	, dailySummary(dailySummary)
+	, sentState()
+	, sequence(0)
+	, delta()
+	, keyframe()
+	, updateCount(0)
+	, framesSent(0)
+	, keyframesSent(0)
+	, framesSkipped(0)
+	, bytesSent(0)
+	, connectionCount(0)
+{
+	for (Client& client : this->clients) {
+		client.active = false;
+		client.state = {};
+		client.lastSentAt = 0;
+		client.pendingLength = 0;
+		client.inputLength = 0;
+	}
+	/// We force the first keyframe to be encoded
+	this->keyframe.sequence = ULONG_MAX;
+	this->sentState = this->captureState();
+}
+
+bool LiveUpdates::hasFreeSlot() const {
+	for (const Client& client : this->clients) {
+		if (!client.active) {
+			return true;
+		}
+	}
+	return false;
+}
+
+bool LiveUpdates::adopt(const WiFiClient& connection) {
+	for (Client& client : this->clients) {
+		if (client.active) {
+			continue;
+		}
+		
+		client.connection = connection;
+		client.connection.setNoDelay(true);
+		client.active = true;
+		client.lastSentAt = 0;
+		client.pendingLength = 0;
+		client.inputLength = 0;
+		this->connectionCount++;
+		
+		/// We start every client with the whole state
+		this->prepareKeyframe();
+		this->sendFrame(client, this->keyframe.data, this->keyframe.length);
+		if (client.active) {
+			this->keyframesSent++;
+			client.state = this->sentState;
+		}
+		
+		LOG_INFO("🔌 Live update client connected (%d of %d)", this->getClientCount(), WS_MAX_CLIENTS);
+		return true;
+	}
+	return false;
+}
+
+void LiveUpdates::publish() {
+	unsigned long startMicros = micros();
+	
+	LiveState state = this->captureState();
+	if (memcmp(&state, &this->sentState, sizeof(LiveState)) == 0) {
+		return;
+	}
+	
+	/// We encode the change once, whatever the number of clients
+	LiveState previous = this->sentState;
+	encodeFrame(this->delta, state, previous, false);
+	this->sentState = state;
+	this->sequence++;
+	this->delta.sequence = this->sequence;
+	this->updateCount++;
+	
+	unsigned long now = millis();
+	for (Client& client : this->clients) {
+		if (!client.active) {
+			continue;
+		}
+		
+		/// A throttled client keeps its state; poll() later sends it all it missed at once
+		if (!this->isReady(client, now)) {
+			this->framesSkipped++;
+			continue;
+		}
+		
+		/// The shared delta only applies to clients that have the previous state
+		if (memcmp(&client.state, &previous, sizeof(LiveState)) == 0) {
+			this->sendFrame(client, this->delta.data, this->delta.length);
+			if (client.active) {
+				client.state = state;
+			}
+		} else if (this->isBehind(client)) {
+			this->catchUp(client);
+		}
+	}
+	
+	this->publishLatency.record(micros() - startMicros);
+}
+
+void LiveUpdates::poll() {
+	unsigned long now = millis();
+	for (Client& client : this->clients) {
+		if (!client.active) {
+			continue;
+		}
+		
+		if (!client.connection.connected() || !this->readInput(client)) {
+			this->dropClient(client);
+			continue;
+		}
+		
+		if (client.pendingLength > 0) {
+			size_t written = this->writeSocket(client, client.pending, client.pendingLength);
+			memmove(client.pending, client.pending + written, client.pendingLength - written);
+			client.pendingLength -= written;
+			continue;
+		}
+		
+		if (this->isBehind(client) && this->isReady(client, now)) {
+			this->catchUp(client);
+		}
+	}
+}
+
+void LiveUpdates::computeAcceptKey(const char* key, char* accept, size_t size) {
+	/// RFC 6455: base64(SHA-1(key + fixed GUID))
+	static const char guid[] = "258EAFA5-E914-47DA-95CA-C5AB0DC85B11";
+	char input[64 + sizeof(guid)];
+	int length = snprintf(input, sizeof(input), "%.64s%s", key, guid);
+	
+	uint8_t digest[20];
+	mbedtls_sha1((const unsigned char*)input, length, digest);
+	
+	size_t written = 0;
+	if (mbedtls_base64_encode((unsigned char*)accept, size, &written, digest, sizeof(digest)) != 0) {
+		written = 0;
+	}
+	accept[min(written, size - 1)] = '\0';
+}
+
+int LiveUpdates::getClientCount() const {
+	int count = 0;
+	for (const Client& client : this->clients) {
+		count += client.active ? 1 : 0;
+	}
+	return count;
+}
+
+unsigned long LiveUpdates::getUpdateCount() const {
+	return this->updateCount;
+}
+
+unsigned long LiveUpdates::getFramesSent() const {
+	return this->framesSent;
+}
+
+unsigned long LiveUpdates::getKeyframesSent() const {
+	return this->keyframesSent;
+}
+
+unsigned long LiveUpdates::getFramesSkipped() const {
+	return this->framesSkipped;
+}
+
+unsigned long LiveUpdates::getBytesSent() const {
+	return this->bytesSent;
+}
+
+unsigned long LiveUpdates::getConnectionCount() const {
+	return this->connectionCount;
+}
+
+const LatencyHistogram& LiveUpdates::getPublishLatency() const {
+	return this->publishLatency;
+}
+
+LiveUpdates::LiveState LiveUpdates::captureState() const {
+	LiveState state = {};
+	bool healthy = this->lightSensor->isSensorHealthy();
+	bool timeValid = this->timeManager && this->timeManager->hasValidTime();
+	
+	state.fields[0] = healthy ? (int32_t)lroundf(this->lightSensor->getCurrentLux() * 10.0f) : 0;
+	state.fields[1] = this->relayController->getRelayState() ? 1 : 0;
+	state.fields[2] = ((int32_t)this->plantController->getLastDecision() << 4) | (int32_t)this->plantController->getLastReason();
+	state.fields[3] = this->plantController->isAutomaticControlEnabled() ? 1 : 0;
+	state.fields[4] = timeValid ? (int32_t)this->timeManager->getEpochTime() : 0;
+	state.fields[5] = healthy ? 1 : 0;
+	
+	if (this->dailySummary) {
+		DailySummaryRecord today = this->dailySummary->getCurrentRecord();
+		state.fields[6] = today.dliCentimol;
+		state.fields[7] = today.lampOnMinutes;
+	}
+	return state;
+}
+
+void LiveUpdates::encodeFrame(Frame& frame, const LiveState& state, const LiveState& previous, bool isKeyframe) {
+	/// We leave room for the two byte WebSocket header and fill it in last
+	uint8_t* out = frame.data + 2;
+	*out++ = isKeyframe ? FRAME_FLAG_KEYFRAME : 0;
+	uint8_t* mask = out++;
+	*mask = 0;
+	
+	for (int i = 0; i < FIELD_COUNT; i++) {
+		int32_t base = isKeyframe ? 0 : previous.fields[i];
+		if (!isKeyframe && state.fields[i] == base) {
+			continue;
+		}
+		*mask |= 1 << i;
+		
+		int32_t difference = (int32_t)((uint32_t)state.fields[i] - (uint32_t)base);
+		uint32_t value = ((uint32_t)difference << 1) ^ (uint32_t)(difference >> 31);
+		while (value >= 0x80) {
+			*out++ = (uint8_t)(value | 0x80);
+			value >>= 7;
+		}
+		*out++ = (uint8_t)value;
+	}
+	
+	/// Server frames are never masked, and ours always fit the 7-bit length
+	size_t payloadLength = out - (frame.data + 2);
+	frame.data[0] = WS_FINAL | WS_OPCODE_BINARY;
+	frame.data[1] = (uint8_t)payloadLength;
+	frame.length = payloadLength + 2;
+}
+
+void LiveUpdates::prepareKeyframe() {
+	if (this->keyframe.sequence == this->sequence) {
+		return;
+	}
+	LiveState zero = {};
+	encodeFrame(this->keyframe, this->sentState, zero, true);
+	this->keyframe.sequence = this->sequence;
+}
+
+bool LiveUpdates::isReady(const Client& client, unsigned long now) const {
+	return client.pendingLength == 0 && now - client.lastSentAt >= WS_CLIENT_MIN_INTERVAL_MS;
+}
+
+bool LiveUpdates::isBehind(const Client& client) const {
+	return memcmp(&client.state, &this->sentState, sizeof(LiveState)) != 0;
+}
+
+void LiveUpdates::catchUp(Client& client) {
+	/// Changes that cancelled out while the client waited are left out of the mask
+	Frame frame;
+	encodeFrame(frame, this->sentState, client.state, false);
+	this->sendFrame(client, frame.data, frame.length);
+	if (client.active) {
+		client.state = this->sentState;
+	}
+}
+
+void LiveUpdates::sendFrame(Client& client, const uint8_t* data, size_t length) {
+	size_t written = this->writeSocket(client, data, length);
+	if (!client.active) {
+		return;
+	}
+	
+	/// We finish a partly written frame before anything else goes to this client
+	if (written < length) {
+		client.pendingLength = length - written;
+		memcpy(client.pending, data + written, client.pendingLength);
+	}
+	this->framesSent++;
+	client.lastSentAt = millis();
+}
+
+size_t LiveUpdates::writeSocket(Client& client, const uint8_t* data, size_t length) {
+	ssize_t written = send(client.connection.fd(), data, length, MSG_DONTWAIT);
+	if (written < 0) {
+		if (errno != EAGAIN && errno != EWOULDBLOCK) {
+			this->dropClient(client);
+		}
+		return 0;
+	}
+	this->bytesSent += written;
+	return written;
+}
+
+bool LiveUpdates::readInput(Client& client) {
+	int available = client.connection.available();
+	if (available > 0 && client.inputLength < INPUT_SIZE) {
+		int bytesRead = client.connection.read(client.input + client.inputLength, INPUT_SIZE - client.inputLength);
+		if (bytesRead > 0) {
+			client.inputLength += bytesRead;
+		}
+	}
+	
+	while (client.inputLength >= 2) {
+		uint8_t opcode = client.input[0] & 0x0F;
+		size_t payloadLength = client.input[1] & 0x7F;
+		size_t headerLength = 2;
+		if (payloadLength == 126) {
+			if (client.inputLength < 4) {
+				return true;
+			}
+			payloadLength = (client.input[2] << 8) | client.input[3];
+			headerLength = 4;
+		} else if (payloadLength == 127) {
+			return false;
+		}
+		
+		/// Client frames must be masked (RFC 6455 5.1)
+		if (!(client.input[1] & 0x80)) {
+			return false;
+		}
+		headerLength += 4;
+		if (headerLength + payloadLength > INPUT_SIZE) {
+			return false;
+		}
+		if (client.inputLength < headerLength + payloadLength) {
+			return true;
+		}
+		
+		uint8_t* payload = client.input + headerLength;
+		const uint8_t* maskKey = payload - 4;
+		for (size_t i = 0; i < payloadLength; i++) {
+			payload[i] ^= maskKey[i & 3];
+		}
+		
+		if (opcode == WS_OPCODE_CLOSE) {
+			/// We echo the close, then drop the connection
+			uint8_t reply[2] = {WS_FINAL | WS_OPCODE_CLOSE, 0};
+			send(client.connection.fd(), reply, sizeof(reply), MSG_DONTWAIT);
+			return false;
+		}
+		if (opcode == WS_OPCODE_PING && payloadLength <= 125 && client.pendingLength == 0) {
+			uint8_t reply[2 + 125];
+			reply[0] = WS_FINAL | WS_OPCODE_PONG;
+			reply[1] = (uint8_t)payloadLength;
+			memcpy(reply + 2, payload, payloadLength);
+			send(client.connection.fd(), reply, payloadLength + 2, MSG_DONTWAIT);
+		}
+		
+		/// We ignore data messages and pongs; dashboards only listen
+		size_t frameLength = headerLength + payloadLength;
+		memmove(client.input, client.input + frameLength, client.inputLength - frameLength);
+		client.inputLength -= frameLength;
+	}
+	return true;
+}
+
+void LiveUpdates::dropClient(Client& client) {
+	if (!client.active) {
+		return;
+	}
+	client.connection.stop();
+	client.active = false;
+	client.pendingLength = 0;
+	client.inputLength = 0;
+	LOG_INFO("🔌 Live update client disconnected (%d left)", this->getClientCount());
+}
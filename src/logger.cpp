@@ -0,0 +1,346 @@
+///
+/// Logger Implementation
+/// 
+/// The ring is a bounded queue in the style of Vyukov's MPMC queue with a
+/// single consumer. A producer owns a slot from the successful CAS on
+/// enqueuePosition until it publishes the slot by advancing its sequence;
+/// the drain task only reads slots whose sequence says they are complete.
+///
+/// In binary mode the drain task also does the COBS framing, so a call
+/// site pays only for copying its arguments. Packets and output mode
+/// switches travel through the same ring as messages, which keeps them in
+/// order with the text around them.
+///
+/// The syslog forwarder is fed and polled only while holding the drain
+/// flag, so it has a single user like the UART.
+///
+
+#include "logger.h"
+#include <stdarg.h>
+
+Logger logger;
+
+extern "C" const char logFormatAnchor[] __attribute__((used)) = "logger";
+
+Logger::Logger()
+	: enqueuePosition(0)
+	, dequeuePosition(0)
+	, waitWhenFull(false)
+	, started(false)
+	, framed(false)
+	, messagesLogged(0)
+	, messagesDropped(0)
+	, messagesTruncated(0)
+	, bytesWritten(0)
+	, highWaterMark(0)
+	, meanCallCycles(0)
+{
+	this->draining.clear();
+	for (uint32_t i = 0; i < SLOT_COUNT; i++) {
+		this->slots[i].sequence.store(i, std::memory_order_relaxed);
+		this->slots[i].length = 0;
+	}
+}
+
+void Logger::begin() {
+	if (this->started) {
+		return;
+	}
+	this->started = true;
+	
+	/// We drain below every other task so logging only uses otherwise idle time
+	xTaskCreatePinnedToCore(taskEntry, "log", 3072, this, 0, nullptr, 0);
+}
+
+void Logger::log(LogLevel level, const char* format, ...) {
+	uint32_t startCycles = ESP.getCycleCount();
+	uint32_t position;
+	Slot* slot = this->acquireSlot(position);
+	if (!slot) {
+		return;
+	}
+	
+	va_list args;
+	va_start(args, format);
+	int length = vsnprintf(slot->text, SLOT_TEXT_SIZE, format, args);
+	va_end(args);
+	
+	bool truncated = length >= (int)SLOT_TEXT_SIZE;
+	if (length < 0) {
+		length = 0;
+	} else if (truncated) {
+		length = SLOT_TEXT_SIZE - 1;
+	}
+	this->publishSlot(slot, position, level, length, truncated, startCycles);
+}
+
+void Logger::setWaitWhenFull(bool wait) {
+	this->waitWhenFull = wait;
+}
+
+bool Logger::writePacket(const uint8_t* data, size_t length) {
+	if (length > SLOT_TEXT_SIZE) {
+		return false;
+	}
+	
+	uint32_t position;
+	Slot* slot = this->claimSlot(position);
+	if (!slot) {
+		return false;
+	}
+	
+	memcpy(slot->text, data, length);
+	slot->length = (uint8_t)length;
+	slot->kind = SlotKind::Packet;
+	slot->sequence.store(position + 1, std::memory_order_release);
+	return true;
+}
+
+void Logger::setOutputMode(bool framed, unsigned long baudRate) {
+	/// We must not lose the switch, so we wait for a slot whatever waitWhenFull says
+	uint32_t position;
+	Slot* slot = this->waitForSlot(position);
+	
+	uint32_t rate = baudRate;
+	slot->text[0] = framed ? 1 : 0;
+	memcpy(slot->text + 1, &rate, sizeof(rate));
+	slot->length = 1 + sizeof(rate);
+	slot->kind = SlotKind::OutputMode;
+	slot->sequence.store(position + 1, std::memory_order_release);
+}
+
+void Logger::flush(unsigned long timeoutMs) {
+	unsigned long startTime = millis();
+	while (millis() - startTime < timeoutMs) {
+		if (!this->drain() && this->dequeuePosition == this->enqueuePosition.load(std::memory_order_acquire)) {
+			break;
+		}
+	}
+	
+#if SYSLOG_ENABLED
+	if (!this->draining.test_and_set(std::memory_order_acquire)) {
+		this->syslog.flush();
+		this->draining.clear(std::memory_order_release);
+	}
+#endif
+	Serial.flush();
+}
+
+unsigned long Logger::getMessagesLogged() const {
+	return this->messagesLogged.load(std::memory_order_relaxed);
+}
+
+unsigned long Logger::getMessagesDropped() const {
+	return this->messagesDropped.load(std::memory_order_relaxed);
+}
+
+unsigned long Logger::getMessagesTruncated() const {
+	return this->messagesTruncated.load(std::memory_order_relaxed);
+}
+
+unsigned long Logger::getBytesWritten() const {
+	return this->bytesWritten;
+}
+
+uint32_t Logger::getHighWaterMark() const {
+	return this->highWaterMark;
+}
+
+uint32_t Logger::getMeanCallCycles() const {
+	return this->meanCallCycles;
+}
+
+unsigned long Logger::getSyslogMessagesSent() const {
+#if SYSLOG_ENABLED
+	return this->syslog.getMessagesSent();
+#else
+	return 0;
+#endif
+}
+
+unsigned long Logger::getSyslogMessagesDropped() const {
+#if SYSLOG_ENABLED
+	return this->syslog.getMessagesDropped();
+#else
+	return 0;
+#endif
+}
+
+unsigned long Logger::getSyslogDatagramsSent() const {
+#if SYSLOG_ENABLED
+	return this->syslog.getDatagramsSent();
+#else
+	return 0;
+#endif
+}
+
+Logger::Slot* Logger::acquireSlot(uint32_t& position) {
+	Slot* slot = this->claimSlot(position);
+	if (!slot && this->waitWhenFull) {
+		slot = this->waitForSlot(position);
+	}
+	
+	if (!slot) {
+		this->messagesDropped.fetch_add(1, std::memory_order_relaxed);
+	}
+	return slot;
+}
+
+Logger::Slot* Logger::waitForSlot(uint32_t& position) {
+	Slot* slot = this->claimSlot(position);
+	while (!slot) {
+		if (this->started) {
+			vTaskDelay(1);
+		} else {
+			this->drain();
+		}
+		slot = this->claimSlot(position);
+	}
+	return slot;
+}
+
+void Logger::publishSlot(Slot* slot, uint32_t position, LogLevel level, size_t length, bool truncated, uint32_t startCycles) {
+	slot->length = (uint8_t)length;
+	slot->level = level;
+	slot->kind = SlotKind::Message;
+	
+	/// We publish the slot only after its contents are complete
+	slot->sequence.store(position + 1, std::memory_order_release);
+	this->messagesLogged.fetch_add(1, std::memory_order_relaxed);
+	if (truncated) {
+		this->messagesTruncated.fetch_add(1, std::memory_order_relaxed);
+	}
+	
+	/// We keep a running mean over roughly the last 16 calls; racing updates only blur it
+	uint32_t cycles = ESP.getCycleCount() - startCycles;
+	uint32_t mean = this->meanCallCycles;
+	this->meanCallCycles = mean == 0 ? cycles : mean - mean / 16 + cycles / 16;
+}
+
+Logger::Slot* Logger::claimSlot(uint32_t& position) {
+	position = this->enqueuePosition.load(std::memory_order_relaxed);
+	while (true) {
+		Slot* slot = &this->slots[position & (SLOT_COUNT - 1)];
+		int32_t difference = (int32_t)(slot->sequence.load(std::memory_order_acquire) - position);
+		
+		if (difference == 0) {
+			/// We race other producers for this position; on failure position is reloaded
+			if (this->enqueuePosition.compare_exchange_weak(position, position + 1, std::memory_order_relaxed)) {
+				uint32_t used = position + 1 - this->dequeuePosition;
+				if (used > this->highWaterMark) {
+					this->highWaterMark = used;
+				}
+				return slot;
+			}
+		} else if (difference < 0) {
+			/// The slot still holds a message from one lap ago
+			return nullptr;
+		} else {
+			position = this->enqueuePosition.load(std::memory_order_relaxed);
+		}
+	}
+}
+
+bool Logger::drain() {
+	/// We allow a single consumer at a time; flush() may race the drain task
+	if (this->draining.test_and_set(std::memory_order_acquire)) {
+		return true;
+	}
+	
+	bool wrote = false;
+	while (true) {
+		Slot* slot = &this->slots[this->dequeuePosition & (SLOT_COUNT - 1)];
+		if (slot->sequence.load(std::memory_order_acquire) != this->dequeuePosition + 1) {
+			break;
+		}
+		
+		const uint8_t* data = (const uint8_t*)slot->text;
+		if (slot->kind == SlotKind::Packet) {
+			this->writeFrame(0, data, slot->length);
+		} else if (slot->kind == SlotKind::OutputMode) {
+			this->applyOutputMode(slot);
+		} else {
+#if LOG_BINARY
+			this->writeFrame(this->framed ? FRAME_BINARY : 0, data, slot->length);
+#else
+			if (this->framed) {
+				this->writeFrame(FRAME_TEXT, data, slot->length);
+			} else {
+				Serial.write(data, slot->length);
+				Serial.write((const uint8_t*)"\r\n", 2);
+				this->bytesWritten += slot->length + 2;
+			}
+#if SYSLOG_ENABLED
+			/// Syslog severities: 3 error, 4 warning, 6 informational, 7 debug
+			static const uint8_t severities[] = {0, 3, 4, 6, 7};
+			this->syslog.append(severities[(uint8_t)slot->level], slot->text, slot->length);
+#endif
+#endif
+		}
+		wrote = true;
+		
+		/// We hand the slot back to producers for the next lap
+		slot->sequence.store(this->dequeuePosition + SLOT_COUNT, std::memory_order_release);
+		this->dequeuePosition++;
+	}
+#if SYSLOG_ENABLED
+	this->syslog.poll();
+#endif
+	
+	this->draining.clear(std::memory_order_release);
+	return wrote;
+}
+
+void Logger::writeFrame(uint8_t type, const uint8_t* data, size_t length) {
+	/// We COBS-encode into a stack buffer: one overhead byte per 254 data bytes, the type and the delimiter
+	uint8_t frame[SLOT_TEXT_SIZE + SLOT_TEXT_SIZE / 254 + 4];
+	size_t codeIndex = 0;
+	size_t frameLength = 1;
+	uint8_t code = 1;
+	
+	for (size_t i = type ? 0 : 1; i <= length; i++) {
+		uint8_t byte = i == 0 ? type : data[i - 1];
+		if (byte != 0) {
+			frame[frameLength++] = byte;
+			code++;
+		}
+		if (byte == 0 || code == 0xFF) {
+			frame[codeIndex] = code;
+			codeIndex = frameLength++;
+			code = 1;
+		}
+	}
+	frame[codeIndex] = code;
+	frame[frameLength++] = 0x00;
+	
+	Serial.write(frame, frameLength);
+	this->bytesWritten += frameLength;
+}
+
+void Logger::applyOutputMode(const Slot* slot) {
+	uint32_t rate;
+	memcpy(&rate, slot->text + 1, sizeof(rate));
+	
+	/// We let the last bytes leave at the old rate before switching
+	Serial.flush();
+	Serial.updateBaudRate(rate);
+	this->framed = slot->text[0] != 0;
+	
+	/// We start framed output with a delimiter so the receiver drops whatever came before
+	if (this->framed) {
+		Serial.write((uint8_t)0x00);
+		this->bytesWritten++;
+	}
+}
+
+void Logger::taskEntry(void* parameter) {
+	static_cast<Logger*>(parameter)->runTask();
+}
+
+void Logger::runTask() {
+	for (;;) {
+		if (!this->drain()) {
+			vTaskDelay(pdMS_TO_TICKS(LOG_DRAIN_INTERVAL_MS));
+		}
+	}
+}
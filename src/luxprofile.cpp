@@ -0,0 +1,138 @@
+///
+/// LuxProfile Implementation
+/// 
+/// We store every hour under its own NVS key so an hour rollover only
+/// rewrites 160 bytes. The export image is a fixed little-endian layout
+/// that tools/merge_lux_profiles.py reads and merges across devices.
+///
+
+#include "luxprofile.h"
+#include "logger.h"
+
+static const char* LUX_PROFILE_NAMESPACE = "luxprofile";
+static const uint8_t EXPORT_MAGIC[4] = { 'L', 'X', 'Q', '1' };
+
+LuxProfile::LuxProfile()
+	: dirtyHours(0)
+	, currentHour(-1)
+{
+	/// We start with empty sketches until begin() loads saved ones
+}
+
+void LuxProfile::begin() {
+	this->preferences.begin(LUX_PROFILE_NAMESPACE, false);
+	
+	/// We restore each hour that was saved before the last reboot
+	int restoredHours = 0;
+	for (int hour = 0; hour < HOURS_PER_DAY; hour++) {
+		char key[8];
+		getHourKey(hour, key, sizeof(key));
+		
+		size_t expected = QuantileSketch::BUCKET_COUNT * sizeof(uint16_t);
+		if (this->preferences.getBytesLength(key) != expected) {
+			continue;
+		}
+		
+		this->preferences.getBytes(key, this->hourly[hour].getBuckets(), expected);
+		this->hourly[hour].recount();
+		restoredHours++;
+	}
+	
+	LOG_INFO("LuxProfile: Restored %d hourly sketches", restoredHours);
+}
+
+void LuxProfile::addSample(int hour, float lux) {
+	if (hour < 0 || hour >= HOURS_PER_DAY) {
+		return;
+	}
+	
+	/// We persist the finished hour once the clock moves on
+	if (hour != this->currentHour) {
+		if (this->currentHour >= 0) {
+			this->saveHour(this->currentHour);
+		}
+		this->currentHour = hour;
+	}
+	
+	this->hourly[hour].add(lux);
+	this->dirtyHours |= (1UL << hour);
+}
+
+void LuxProfile::save() {
+	for (int hour = 0; hour < HOURS_PER_DAY; hour++) {
+		this->saveHour(hour);
+	}
+}
+
+const QuantileSketch& LuxProfile::getHour(int hour) const {
+	return this->hourly[constrain(hour, 0, HOURS_PER_DAY - 1)];
+}
+
+float LuxProfile::getHourlyQuantile(int hour, float quantile) const {
+	return this->getHour(hour).getQuantile(quantile);
+}
+
+float LuxProfile::getDailyQuantile(float quantile) const {
+	QuantileSketch day;
+	day.merge(this->hourly, HOURS_PER_DAY);
+	return day.getQuantile(quantile);
+}
+
+size_t LuxProfile::exportSlice(size_t offset, uint8_t* buffer, size_t bufferSize) const {
+	/// We write a small header so the host can check the bucket layout
+	uint8_t header[EXPORT_HEADER_SIZE] = {};
+	memcpy(header, EXPORT_MAGIC, sizeof(EXPORT_MAGIC));
+	header[4] = HOURS_PER_DAY;
+	header[5] = QuantileSketch::BUCKET_COUNT;
+	float minLux = QuantileSketch::MIN_LUX;
+	float gamma = QuantileSketch::GAMMA;
+	memcpy(header + 8, &minLux, sizeof(float));
+	memcpy(header + 12, &gamma, sizeof(float));
+	
+	/// The raw counters follow, hour by hour (ESP32 is little-endian like the file format)
+	const size_t hourBytes = QuantileSketch::BUCKET_COUNT * sizeof(uint16_t);
+	size_t written = 0;
+	while (written < bufferSize && offset < EXPORT_SIZE) {
+		const uint8_t* source;
+		size_t available;
+		if (offset < EXPORT_HEADER_SIZE) {
+			source = header + offset;
+			available = EXPORT_HEADER_SIZE - offset;
+		} else {
+			size_t position = offset - EXPORT_HEADER_SIZE;
+			source = (const uint8_t*)this->hourly[position / hourBytes].getBuckets() + position % hourBytes;
+			available = hourBytes - position % hourBytes;
+		}
+		
+		size_t length = min(available, bufferSize - written);
+		memcpy(buffer + written, source, length);
+		written += length;
+		offset += length;
+	}
+	return written;
+}
+
+void LuxProfile::clear() {
+	for (int hour = 0; hour < HOURS_PER_DAY; hour++) {
+		this->hourly[hour].clear();
+	}
+	this->dirtyHours = 0;
+	this->preferences.clear();
+	
+	LOG_INFO("LuxProfile: Cleared all hourly sketches");
+}
+
+void LuxProfile::saveHour(int hour) {
+	if ((this->dirtyHours & (1UL << hour)) == 0) {
+		return;
+	}
+	
+	char key[8];
+	getHourKey(hour, key, sizeof(key));
+	this->preferences.putBytes(key, this->hourly[hour].getBuckets(), QuantileSketch::BUCKET_COUNT * sizeof(uint16_t));
+	this->dirtyHours &= ~(1UL << hour);
+}
+
+void LuxProfile::getHourKey(int hour, char* key, size_t keySize) {
+	snprintf(key, keySize, "h%02d", hour);
+}
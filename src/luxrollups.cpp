@@ -0,0 +1,199 @@
+///
+/// LuxRollups Implementation
+/// 
+/// A parent bucket closes when the first child bucket of the next parent
+/// interval closes, so the open quarter-hour and hour never include the
+/// minute that is still being filled.
+///
+
+#include "luxrollups.h"
+
+static const uint32_t LEVEL_RESOLUTION[] = { 60, 900, 3600 };
+
+RollupRing::RollupRing(RollupBucket* slots, size_t capacity, uint32_t resolutionSeconds)
+	: slots(slots)
+	, capacity(capacity)
+	, resolution(resolutionSeconds)
+	, head(0)
+	, size(0)
+	, newestStart(0)
+{
+	/// We start empty; slots are written before they are ever read
+}
+
+void RollupRing::push(uint32_t start, const RollupBucket& bucket) {
+	/// We fill intervals without data so bucket times stay implicit
+	if (this->size > 0 && start > this->newestStart) {
+		uint32_t gaps = (start - this->newestStart) / this->resolution - 1;
+		gaps = min(gaps, (uint32_t)this->capacity);
+		
+		RollupBucket empty = { NAN, NAN, NAN, 0, 0 };
+		for (uint32_t i = 0; i < gaps; i++) {
+			this->slots[this->head] = empty;
+			this->head = (this->head + 1) % this->capacity;
+			this->size = min(this->size + 1, this->capacity);
+		}
+	}
+	
+	this->slots[this->head] = bucket;
+	this->head = (this->head + 1) % this->capacity;
+	this->size = min(this->size + 1, this->capacity);
+	this->newestStart = start;
+}
+
+size_t RollupRing::getSize() const {
+	return this->size;
+}
+
+const RollupBucket& RollupRing::getBucket(size_t index) const {
+	size_t oldest = (this->head + this->capacity - this->size) % this->capacity;
+	return this->slots[(oldest + index) % this->capacity];
+}
+
+uint32_t RollupRing::getBucketStart(size_t index) const {
+	return this->newestStart - (uint32_t)(this->size - 1 - index) * this->resolution;
+}
+
+size_t RollupRing::findFirst(uint32_t timestamp) const {
+	if (this->size == 0) {
+		return 0;
+	}
+	
+	/// We compute the index directly since buckets are contiguous
+	uint32_t oldestStart = this->getBucketStart(0);
+	if (timestamp < oldestStart + this->resolution) {
+		return 0;
+	}
+	return min((size_t)((timestamp - oldestStart) / this->resolution), this->size);
+}
+
+uint32_t RollupRing::getResolution() const {
+	return this->resolution;
+}
+
+LuxRollups::LuxRollups(TimeManager* timeManager)
+	: timeManager(timeManager)
+	, rings{
+		RollupRing(minuteSlots, ROLLUP_MINUTE_SLOTS, LEVEL_RESOLUTION[0]),
+		RollupRing(quarterSlots, ROLLUP_QUARTER_SLOTS, LEVEL_RESOLUTION[1]),
+		RollupRing(hourSlots, ROLLUP_HOUR_SLOTS, LEVEL_RESOLUTION[2])
+	}
+	, lastSampleMillis(0)
+	, lastRelayOn(false)
+{
+	for (int level = 0; level < LEVEL_COUNT; level++) {
+		resetOpen(this->open[level], 0);
+	}
+}
+
+void LuxRollups::addSample(float lux, bool relayOn) {
+	unsigned long now = millis();
+	
+	/// We credit the relay state held since the previous reading, capped at
+	/// one minute so a long gap without readings is not counted as on-time
+	unsigned long elapsed = this->lastSampleMillis > 0 ? now - this->lastSampleMillis : 0;
+	uint32_t relayOnMs = this->lastRelayOn ? min(elapsed, 60000UL) : 0;
+	this->lastSampleMillis = now;
+	this->lastRelayOn = relayOn;
+	
+	if (!this->timeManager || !this->timeManager->hasValidTime()) {
+		return;
+	}
+	
+	uint32_t timestamp = this->timeManager->getEpochTime();
+	uint32_t minuteStart = timestamp - timestamp % LEVEL_RESOLUTION[0];
+	OpenBucket& minute = this->open[0];
+	
+	minute.relayOnMs += relayOnMs;
+	if (minute.start != minuteStart) {
+		if (minute.start != 0) {
+			this->closeBucket(0);
+		}
+		resetOpen(minute, minuteStart);
+	}
+	
+	minute.minLux = min(minute.minLux, lux);
+	minute.maxLux = max(minute.maxLux, lux);
+	minute.luxSum += lux;
+	minute.count++;
+}
+
+const RollupRing& LuxRollups::getRing(RollupResolution resolution) const {
+	return this->rings[(int)resolution];
+}
+
+RollupBucket LuxRollups::getOpenBucket(RollupResolution resolution) const {
+	return toBucket(this->open[(int)resolution]);
+}
+
+uint32_t LuxRollups::getOpenBucketStart(RollupResolution resolution) const {
+	return this->open[(int)resolution].start;
+}
+
+const char* LuxRollups::getResolutionName(RollupResolution resolution) {
+	switch (resolution) {
+		case RollupResolution::Minute: return "1m";
+		case RollupResolution::QuarterHour: return "15m";
+		case RollupResolution::Hour: return "1h";
+		default: return "unknown";
+	}
+}
+
+bool LuxRollups::parseResolution(const char* name, RollupResolution& resolution) {
+	for (int level = 0; level < LEVEL_COUNT; level++) {
+		if (strcmp(name, getResolutionName((RollupResolution)level)) == 0) {
+			resolution = (RollupResolution)level;
+			return true;
+		}
+	}
+	return false;
+}
+
+void LuxRollups::closeBucket(int level) {
+	OpenBucket& closing = this->open[level];
+	this->rings[level].push(closing.start, toBucket(closing));
+	
+	if (level + 1 >= LEVEL_COUNT) {
+		return;
+	}
+	
+	/// We cascade the closed bucket into its parent, closing the parent first
+	/// if this bucket belongs to the next parent interval
+	OpenBucket& parent = this->open[level + 1];
+	uint32_t parentStart = closing.start - closing.start % LEVEL_RESOLUTION[level + 1];
+	if (parent.start != parentStart) {
+		if (parent.start != 0) {
+			this->closeBucket(level + 1);
+		}
+		resetOpen(parent, parentStart);
+	}
+	mergeInto(parent, closing);
+}
+
+void LuxRollups::mergeInto(OpenBucket& target, const OpenBucket& source) {
+	target.minLux = min(target.minLux, source.minLux);
+	target.maxLux = max(target.maxLux, source.maxLux);
+	target.luxSum += source.luxSum;
+	target.count += source.count;
+	target.relayOnMs += source.relayOnMs;
+}
+
+RollupBucket LuxRollups::toBucket(const OpenBucket& bucket) {
+	RollupBucket result;
+	bool hasData = bucket.count > 0;
+	result.minLux = hasData ? bucket.minLux : NAN;
+	result.maxLux = hasData ? bucket.maxLux : NAN;
+	result.meanLux = hasData ? (float)(bucket.luxSum / bucket.count) : NAN;
+	result.count = min(bucket.count, (uint32_t)UINT16_MAX);
+	result.relayOnSeconds = min(bucket.relayOnMs / 1000, (uint32_t)UINT16_MAX);
+	return result;
+}
+
+void LuxRollups::resetOpen(OpenBucket& bucket, uint32_t start) {
+	bucket.start = start;
+	bucket.minLux = INFINITY;
+	bucket.maxLux = -INFINITY;
+	bucket.luxSum = 0.0;
+	bucket.count = 0;
+	bucket.relayOnMs = 0;
+}
@@ -8,11 +8,23 @@
 
 #include <Arduino.h>
 #include <Wire.h>
+#include <LittleFS.h>
 #include "wifimanager.h"
 #include "timemanager.h"
 #include "lightsensor.h"
 #include "relaycontroller.h"
 #include "plantcontroller.h"
+#include "luxprofile.h"
+#include "dailysummary.h"
+#include "telemetrypublisher.h"
+#include "httpserver.h"
+#include "looptimings.h"
+#include "timeseriesstore.h"
+#include "luxrollups.h"
+#include "otaupdater.h"
+#include "liveupdates.h"
+#include "sntpserver.h"
+#include "logger.h"
 #include "config.h"
 
 /// Component instances
@@ -21,6 +33,16 @@ TimeManager* timeManager;
 LightSensor* lightSensor;
 RelayController* relayController;
 PlantController* plantController;
+LuxProfile* luxProfile;
+DailySummary* dailySummary;
+TelemetryPublisher* telemetryPublisher;
+HttpServer* httpServer;
+TimeSeriesStore* timeSeriesStore;
+LuxRollups* luxRollups;
+OtaUpdater* otaUpdater;
+LiveUpdates* liveUpdates;
+SntpServer* sntpServer;
+LoopTimings loopTimings;
 
 void displaySystemStatus();
 void displayTimeStatus();
@@ -34,25 +56,28 @@ void displayFullSystemStatus();
 void displayConnectivityStatus();
 void displaySensorStatus();
 void displayRelayStatus();
+void prepareForRestart();
 
 void setup() {
 	/// We initialize serial communication for debugging
-	Serial.begin(115200);
+	Serial.begin(SERIAL_BAUD_RATE);
 	while (!Serial) {
 		delay(10);
 	}
 	
-	Serial.println("\n████████████████████████████████████████████████████████");
-	Serial.println("███ Smart Plant Light Controller - Full Integration ███");
-	Serial.println("████████████████████████████████████████████████████████");
-	Serial.println();
+	/// We drain log output in the background; during setup nothing is
+	/// time critical, so we wait for the UART rather than drop messages
+	logger.setWaitWhenFull(true);
+	logger.begin();
+	
+	LOG_INFO("████████████████████████████████████████");
+	LOG_INFO("███ Smart Plant Light Controller - Full Integration ███");
+	LOG_INFO("████████████████████████████████████████");
 	
 	/// We initialize I2C for the light sensor
-	Wire.begin(I2C_SDA_PIN, I2C_SCL_PIN);
-	Serial.print("I2C initialized - SDA: GPIO");
-	Serial.print(I2C_SDA_PIN);
-	Serial.print(", SCL: GPIO");
-	Serial.println(I2C_SCL_PIN);
+	Wire.begin(I2C_SDA_PIN, I2C_SCL_PIN, I2C_CLOCK_HZ);
+	LOG_INFO("I2C initialized - SDA: GPIO%d, SCL: GPIO%d, %lu kHz",
+		I2C_SDA_PIN, I2C_SCL_PIN, (unsigned long)(Wire.getClock() / 1000));
 	
 	/// We initialize all components in dependency order
 	initializeComponents();
@@ -64,22 +89,75 @@ void setup() {
 	plantController = new PlantController(wifiManager, timeManager, lightSensor, relayController);
 	plantController->begin();
 	
-	Serial.println();
-	Serial.println("🌱 Smart Plant Light Controller is now ACTIVE!");
-	Serial.println("The system will automatically control your plant lights based on:");
-	Serial.println("  📅 Time schedule AND 💡 ambient light levels");
-	Serial.println();
+	/// We start the daily history once all of its data sources exist
+	dailySummary = new DailySummary(timeManager, lightSensor, relayController, plantController);
+	dailySummary->begin();
+	
+	/// We keep low-resolution aggregates for long charts in RAM
+	luxRollups = new LuxRollups(timeManager);
+	
+#if TSDB_ENABLED
+	/// We keep the raw series in compressed form on flash
+	timeSeriesStore = new TimeSeriesStore(timeManager);
+	timeSeriesStore->begin();
+#endif
+	
+#if TELEMETRY_ENABLED
+	/// We start fleet telemetry; publishing runs in its own low-priority task
+	telemetryPublisher = new TelemetryPublisher(timeManager, lightSensor);
+	telemetryPublisher->begin();
+#endif
+	
+#if OTA_ENABLED
+	/// We check for delta firmware updates in a low-priority task
+	otaUpdater = new OtaUpdater();
+	otaUpdater->begin();
+#endif
+	
+#if SNTP_SERVER_ENABLED
+	/// We serve our time to the other units on site, answered from the idle loop
+	sntpServer = new SntpServer(timeManager);
+	if (!sntpServer->begin()) {
+		delete sntpServer;
+		sntpServer = nullptr;
+	}
+#endif
+	
+#if HTTP_ENABLED
+	/// We expose status and manual override over HTTP, served from the main loop
+	httpServer = new HttpServer(wifiManager, timeManager, lightSensor, relayController, plantController);
+	httpServer->attachHistory(dailySummary);
+	httpServer->attachProfile(luxProfile);
+	httpServer->attachTelemetry(telemetryPublisher);
+	httpServer->attachLoopTimings(&loopTimings);
+	httpServer->attachTimeSeries(timeSeriesStore);
+	httpServer->attachRollups(luxRollups);
+	httpServer->attachOta(otaUpdater);
+	
+	/// We push live readings to dashboards over WebSocket connections upgraded by the server
+	liveUpdates = new LiveUpdates(timeManager, lightSensor, relayController, plantController, dailySummary);
+	httpServer->attachLiveUpdates(liveUpdates);
+	httpServer->attachSntpServer(sntpServer);
+	httpServer->begin();
+#endif
+	
+	LOG_INFO("🌱 Smart Plant Light Controller is now ACTIVE!");
+	LOG_INFO("The system will automatically control your plant lights based on:");
+	LOG_INFO("  📅 Time schedule AND 💡 ambient light levels");
 	displaySystemConfiguration();
-	Serial.println();
+	
+	/// We never let logging hold up the control loop from here on
+	logger.setWaitWhenFull(false);
 }
 
 void loop() {
 	static unsigned long lastStatusDisplay = 0;
 	static unsigned long lastSensorUpdate = 0;
 	const unsigned long displayInterval = 15000;  /// Status every 15 seconds
-	const unsigned long sensorInterval = 2000;    /// Sensor updates every 2 seconds
+	const unsigned long sensorInterval = SENSOR_READ_INTERVAL_MS;
 	
 	unsigned long currentTime = millis();
+	unsigned long loopStartMicros = micros();
 	
 	/// We continuously update all components
 	wifiManager->update();
@@ -88,16 +166,100 @@ void loop() {
 		timeManager->update();
 	}
 	
+	/// We let the sensor wake up ahead of a read when it sleeps between samples
+	lightSensor->service();
+	
 	/// We update sensor readings regularly
 	if (currentTime - lastSensorUpdate >= sensorInterval) {
 		lastSensorUpdate = currentTime;
-		if (!lightSensor->updateReading()) {
-			Serial.println("⚠ Light sensor reading failed");
+		unsigned long sensorStartMicros = micros();
+		bool readingOk = lightSensor->updateReading();
+		loopTimings.sensor.record(micros() - sensorStartMicros);
+		
+		if (!readingOk) {
+			LOG_WARN("⚠ Light sensor reading failed");
+		} else if (timeManager && timeManager->hasValidTime()) {
+			/// We feed the hourly distribution only when we know which hour it is
+			luxProfile->addSample(timeManager->getCurrentHour(), lightSensor->getLastRawLux());
+			
+			if (timeSeriesStore) {
+				timeSeriesStore->addLux(lightSensor->getLastRawLux());
+			}
+		}
+		
+		/// A failed read leaves the previous values in place; adding them again would skew the aggregates
+		if (readingOk && lightSensor->isSensorHealthy()) {
+			dailySummary->addSample(lightSensor->getLastRawLux());
+			luxRollups->addSample(lightSensor->getLastRawLux(), relayController->getRelayState());
+			
+			if (telemetryPublisher) {
+				telemetryPublisher->addSample(lightSensor->getLastRawCounts(), lightSensor->getLastWhiteCounts());
+			}
+		}
+		
+		if (liveUpdates) {
+			liveUpdates->publish();
+		}
+		
+		/// We restart only after bus recovery has failed for a long time
+		if (lightSensor->needsRestart()) {
+			LOG_ERROR("✗ Light sensor unrecoverable - restarting controller");
+			prepareForRestart();
+			ESP.restart();
 		}
 	}
 	
 	/// We run the main plant control logic
+	unsigned long controlStartMicros = micros();
 	plantController->update();
+	loopTimings.control.record(micros() - controlStartMicros);
+	
+	/// We accumulate today's summary record
+	dailySummary->update();
+	
+	/// We forward every new control decision to history and telemetry
+	static unsigned long lastDecisionCount = 0;
+	if (plantController->getDecisionCount() != lastDecisionCount) {
+		lastDecisionCount = plantController->getDecisionCount();
+		
+		if (timeSeriesStore) {
+			timeSeriesStore->addDecision(plantController->getLastDecision(), plantController->getLastReason());
+		}
+		if (telemetryPublisher) {
+			telemetryPublisher->addDecision(plantController->getLastDecision(),
+				plantController->getLastReason(), relayController->getRelayState());
+		}
+		if (liveUpdates) {
+			liveUpdates->publish();
+		}
+	}
+	
+	if (timeSeriesStore) {
+		timeSeriesStore->addRelayState(relayController->getRelayState());
+		
+		/// We write slow series out after a while, so a crash or power loss costs at most that much
+		timeSeriesStore->update();
+	}
+	
+	/// We flush telemetry batches on their own schedule
+	if (telemetryPublisher) {
+		telemetryPublisher->update();
+	}
+	
+	/// We confirm a freshly updated image only once sensor, relay and storage have run healthy;
+	/// NTP is left out, so an internet outage during the trial cannot roll back good firmware
+	if (otaUpdater) {
+		bool locallyHealthy = plantController->areLocalComponentsHealthy()
+			&& dailySummary->isStorageReady() && (!timeSeriesStore || timeSeriesStore->isStorageReady());
+		otaUpdater->update(locallyHealthy);
+		
+		/// A rollback comes back here too, so history is saved before either restart
+		if (otaUpdater->isRebootPending()) {
+			LOG_INFO("🔄 OTA restart pending - saving state first");
+			prepareForRestart();
+			otaUpdater->restart();
+		}
+	}
 	
 	/// We display comprehensive status periodically
 	if (currentTime - lastStatusDisplay >= displayInterval) {
@@ -105,245 +267,310 @@ void loop() {
 		displayFullSystemStatus();
 	}
 	
-	/// We add a small delay to prevent system overload
-	delay(500);
+	loopTimings.work.record(micros() - loopStartMicros);
+	
+	/// We add a small delay to prevent system overload, serving HTTP and SNTP while
+	/// we wait so a request never waits longer than one poll interval to be picked up.
+	/// While a response streams we only yield briefly, so exports run at WiFi speed
+	unsigned long idleStart = millis();
+	do {
+		if (httpServer) {
+			httpServer->poll();
+		}
+		if (sntpServer) {
+			sntpServer->poll();
+		}
+		delay(httpServer && httpServer->isStreamingResponse() ? 1 : HTTP_POLL_INTERVAL_MS);
+	} while (millis() - idleStart < LOOP_DELAY_MS);
 }
 
 void initializeComponents() {
-	Serial.println("🔧 Initializing system components...");
+	LOG_INFO("🔧 Initializing system components...");
 	
 	/// We initialize WiFi manager
-	Serial.println("  📡 WiFi Manager...");
+	LOG_INFO("  📡 WiFi Manager...");
 	wifiManager = new WiFiManager(WIFI_SSID, WIFI_PASSWORD);
 	wifiManager->begin();
 	
 	/// We initialize relay controller (must be first for safety)
-	Serial.println("  🔌 Relay Controller...");
+	LOG_INFO("  🔌 Relay Controller...");
 	relayController = new RelayController(RELAY_PIN);
 	relayController->begin();
 	
 	/// We initialize light sensor
-	Serial.println("  💡 Light Sensor...");
+	LOG_INFO("  💡 Light Sensor...");
 	lightSensor = new LightSensor();
+	lightSensor->setSamplingInterval(SENSOR_READ_INTERVAL_MS);
 	if (!lightSensor->begin()) {
-		Serial.println("  ✗ Light sensor initialization failed!");
-		while (true) { delay(1000); }
+		/// We keep the controller running; the sensor recovers itself with backoff
+		LOG_ERROR("  ✗ Light sensor initialization failed - will keep retrying");
+	}
+	
+	/// We mount the flash filesystem used for history storage
+	LOG_INFO("  💾 Flash filesystem...");
+	if (!LittleFS.begin(true)) {
+		LOG_ERROR("  ✗ LittleFS mount failed - history will not be stored");
 	}
 	
-	Serial.println("✓ All components initialized");
+	/// We restore the hourly lux distributions from flash
+	LOG_INFO("  📊 Lux Profile...");
+	luxProfile = new LuxProfile();
+	luxProfile->begin();
+	
+	LOG_INFO("✓ All components initialized");
 }
 
 void waitForSystemReady() {
-	Serial.println("⏳ Waiting for system to be ready...");
+	LOG_INFO("⏳ Waiting for system to be ready...");
 	
 	/// We wait for WiFi connection
-	Serial.println("  📡 Waiting for WiFi connection...");
+	LOG_INFO("  📡 Waiting for WiFi connection...");
 	unsigned long wifiStartTime = millis();
 	const unsigned long wifiTimeout = 60000; /// 60 second timeout
 	
 	while (!wifiManager->isConnected() && millis() - wifiStartTime < wifiTimeout) {
 		wifiManager->update();
 		delay(1000);
-		Serial.print(".");
 	}
-	Serial.println();
 	
 	if (wifiManager->isConnected()) {
-		Serial.println("  ✓ WiFi connected");
+		LOG_INFO("  ✓ WiFi connected");
 		
 		/// We initialize time manager after WiFi is ready
-		Serial.println("  ⏰ Time Manager...");
+		LOG_INFO("  ⏰ Time Manager...");
 		timeManager = new TimeManager(NTP_SERVER, TIMEZONE_OFFSET_HOURS);
 		timeManager->begin();
 		
 		/// We wait for initial time sync
-		Serial.println("  ⏰ Waiting for time synchronization...");
+		LOG_INFO("  ⏰ Waiting for time synchronization...");
 		unsigned long timeStartTime = millis();
 		const unsigned long timeTimeout = 30000; /// 30 second timeout
 		
 		while (!timeManager->hasValidTime() && millis() - timeStartTime < timeTimeout) {
 			timeManager->update();
 			delay(1000);
-			Serial.print(".");
 		}
-		Serial.println();
 		
 		if (timeManager->hasValidTime()) {
-			Serial.println("  ✓ Time synchronized");
+			LOG_INFO("  ✓ Time synchronized");
 		} else {
-			Serial.println("  ⚠ Time sync failed - continuing with limited functionality");
+			LOG_WARN("  ⚠ Time sync failed - continuing with limited functionality");
 		}
 	} else {
-		Serial.println("  ⚠ WiFi connection failed - continuing without time sync");
+		LOG_WARN("  ⚠ WiFi connection failed - continuing without time sync");
 		timeManager = nullptr;
 	}
 	
 	/// We take initial sensor readings
-	Serial.println("  💡 Taking initial sensor readings...");
+	LOG_INFO("  💡 Taking initial sensor readings...");
 	for (int i = 0; i < 5; i++) {
 		lightSensor->updateReading();
 		delay(500);
 	}
 	
-	Serial.println("✓ System ready for operation");
+	LOG_INFO("✓ System ready for operation");
 }
 
 void displaySystemConfiguration() {
-	Serial.println("━━━ System Configuration ━━━");
-	Serial.print("📅 Schedule: ");
-	Serial.print(LIGHT_START_HOUR);
-	Serial.print(":00 - ");
-	Serial.print(LIGHT_END_HOUR);
-	Serial.print(":00 ");
-	if (LIGHT_START_HOUR > LIGHT_END_HOUR) {
-		Serial.println("(overnight schedule)");
-	} else {
-		Serial.println("(daytime schedule)");
-	}
-	
-	Serial.print("💡 Light threshold: ");
-	Serial.print(LIGHT_THRESHOLD_LUX);
-	Serial.println(" lux");
-	
-	Serial.print("🔄 Check interval: ");
-	Serial.print(CHECK_INTERVAL_MS / 1000);
-	Serial.println(" seconds");
-	
-	Serial.print("🔌 Relay pin: GPIO");
-	Serial.println(RELAY_PIN);
+	LOG_INFO("━━━ System Configuration ━━━");
+	LOG_INFO("📅 Schedule: %d:00 - %d:00 (%s schedule)", LIGHT_START_HOUR, LIGHT_END_HOUR,
+		LIGHT_START_HOUR > LIGHT_END_HOUR ? "overnight" : "daytime");
+	LOG_INFO("💡 Light threshold: %.2f lux", LIGHT_THRESHOLD_LUX);
+	LOG_INFO("🔄 Check interval: %d seconds", CHECK_INTERVAL_MS / 1000);
+	LOG_INFO("🔌 Relay pin: GPIO%d", RELAY_PIN);
 }
 
 void displayFullSystemStatus() {
-	Serial.println("━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━");
-	Serial.println("                 🌱 SYSTEM STATUS 🌱");
-	Serial.println("━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━");
+	LOG_INFO("━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━");
+	LOG_INFO("           🌱 SYSTEM STATUS 🌱");
+	LOG_INFO("━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━");
 	
 	/// We display connectivity status
 	displayConnectivityStatus();
-	Serial.println();
 	
 	/// We display time status
 	displayTimeStatus();
-	Serial.println();
 	
 	/// We display sensor status
 	displaySensorStatus();
-	Serial.println();
 	
 	/// We display relay status
 	displayRelayStatus();
-	Serial.println();
 	
 	/// We display control logic status
 	displayControlStatus();
 	
-	Serial.println("━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━");
-	Serial.println();
+	LOG_INFO("━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━");
 }
 
 void displayConnectivityStatus() {
-	Serial.print("📡 WiFi: ");
 	if (wifiManager->isConnected()) {
-		Serial.print("✅ CONNECTED (");
-		Serial.print(wifiManager->getLocalIP());
-		Serial.print(", ");
-		Serial.print(wifiManager->getSignalStrength());
-		Serial.println(" dBm)");
+		LOG_INFO("📡 WiFi: ✅ CONNECTED (%s, %d dBm)",
+			wifiManager->getLocalIP().c_str(), wifiManager->getSignalStrength());
 	} else {
-		Serial.println("❌ DISCONNECTED");
+		LOG_INFO("📡 WiFi: ❌ DISCONNECTED");
+	}
+	
+	if (telemetryPublisher) {
+		LOG_INFO("📨 MQTT: %s (%lu acked, %d queued, %lu dropped, %lu msg/h, %lu B/h)",
+			telemetryPublisher->isConnected() ? "✅ CONNECTED" : "❌ OFFLINE",
+			telemetryPublisher->getMessagesAcked(), telemetryPublisher->getQueueDepth(),
+			telemetryPublisher->getMessagesDropped(), telemetryPublisher->getMessagesPerHour(),
+			telemetryPublisher->getWireBytesPerHour());
+		if (telemetryPublisher->getSpoolDepth() > 0) {
+			LOG_INFO("💾 Telemetry spool: %lu/%lu messages waiting in flash",
+				(unsigned long)telemetryPublisher->getSpoolDepth(), (unsigned long)telemetryPublisher->getSpoolCapacity());
+		}
+		const TlsClient* tls = telemetryPublisher->getTlsClient();
+		if (tls) {
+			LOG_INFO("🔒 TLS: %lu full, %lu resumed, %lu failed handshakes, last %lu ms (%lu ms CPU)",
+				tls->getFullHandshakes(), tls->getResumedHandshakes(), tls->getFailedHandshakes(),
+				tls->getLastHandshake().handshakeMs, tls->getLastHandshake().cpuMs);
+		}
+	}
+	
+	if (httpServer) {
+		LOG_INFO("🌐 HTTP: %lu requests, %lu errors (p99 %luus)",
+			httpServer->getRequestCount(), httpServer->getErrorCount(),
+			httpServer->getRequestLatency().getPercentile(99));
+	}
+	
+	if (sntpServer) {
+		LOG_INFO("🕰 SNTP: %lu served, %lu unsynced, %lu malformed (p50 %luus)",
+			sntpServer->getRequestsServed(), sntpServer->getRequestsUnsynced(),
+			sntpServer->getRequestsMalformed(), sntpServer->getServeLatency().getPercentile(50));
+	}
+	
+	if (otaUpdater) {
+		bool failed = otaUpdater->getState() == OtaState::Failed;
+		LOG_INFO("📦 OTA: %s%s, %lu updates, %lu failures%s%s",
+			OtaUpdater::getStateString(otaUpdater->getState()),
+			otaUpdater->isPendingConfirmation() ? " (awaiting confirmation)" : "",
+			otaUpdater->getUpdateCount(), otaUpdater->getFailureCount(),
+			failed ? " - " : "", failed ? otaUpdater->getLastError() : "");
+	}
+	
+	LOG_INFO("📝 Log: %lu messages, %lu dropped, %lu truncated, peak %lu/%lu slots",
+		logger.getMessagesLogged(), logger.getMessagesDropped(), logger.getMessagesTruncated(),
+		(unsigned long)logger.getHighWaterMark(), (unsigned long)Logger::SLOT_COUNT);
+	if (SYSLOG_ENABLED) {
+		LOG_INFO("📝 Syslog: %lu forwarded in %lu datagrams, %lu dropped",
+			logger.getSyslogMessagesSent(), logger.getSyslogDatagramsSent(), logger.getSyslogMessagesDropped());
 	}
 }
 
 void displayTimeStatus() {
-	Serial.print("⏰ Time: ");
 	if (timeManager && timeManager->hasValidTime()) {
-		Serial.print("✅ ");
-		Serial.print(timeManager->getCurrentTimeString());
-		Serial.print(" (synced ");
-		Serial.print(timeManager->getTimeSinceLastSync() / 1000);
-		Serial.println("s ago)");
+		LOG_INFO("⏰ Time: ✅ %s (synced %lus ago)",
+			timeManager->getCurrentTimeString().c_str(), timeManager->getTimeSinceLastSync() / 1000);
 	} else {
-		Serial.println("❌ NO VALID TIME");
+		LOG_INFO("⏰ Time: ❌ NO VALID TIME");
 	}
 }
 
 void displaySensorStatus() {
-	Serial.print("💡 Light: ");
 	if (lightSensor->isSensorHealthy()) {
 		float lux = lightSensor->getCurrentLux();
-		Serial.print("✅ ");
-		Serial.print(lux, 1);
-		Serial.print(" lux (");
-		Serial.print(lux < LIGHT_THRESHOLD_LUX ? "DARK" : "BRIGHT");
-		Serial.println(")");
+		LOG_INFO("💡 Light: ✅ %.1f lux (%s)", lux, lux < LIGHT_THRESHOLD_LUX ? "DARK" : "BRIGHT");
+		LOG_INFO("    Spectrum: ALS/WHITE %.2f, daylight %.0f%% (%.1f lux)",
+			lightSensor->getSpectralRatio(), lightSensor->getDaylightFraction() * 100.0f,
+			lightSensor->getDaylightLux());
+		
+		if (timeManager && timeManager->hasValidTime()) {
+			const QuantileSketch& hour = luxProfile->getHour(timeManager->getCurrentHour());
+			LOG_INFO("    This hour: p10 %.1f / p50 %.1f / p90 %.1f lux (%lu samples)",
+				hour.getQuantile(0.1f), hour.getQuantile(0.5f), hour.getQuantile(0.9f),
+				(unsigned long)hour.getCount());
+		}
+		
+		LOG_INFO("    Power: %s (~%.1f uA)",
+			LightSensor::getPowerModeString(lightSensor->getPowerMode()), lightSensor->getEstimatedSupplyCurrent());
+	} else if (lightSensor->isRecovering()) {
+		LOG_INFO("💡 Light: ❌ SENSOR LOST (recovering for %lus, %lu attempts)",
+			lightSensor->getTimeSinceFailure() / 1000, lightSensor->getRecoveryAttempts());
 	} else {
-		Serial.println("❌ SENSOR FAILURE");
+		LOG_INFO("💡 Light: ❌ SENSOR FAILURE");
+	}
+	
+	const LatencyHistogram& busLatency = lightSensor->getTransactionLatency();
+	LOG_INFO("    I2C: %lu transactions, %lu errors, %lu retried (p50 %luus, p99 %luus, max %luus)",
+		lightSensor->getTransactionCount(), lightSensor->getTransactionErrors(),
+		lightSensor->getTransactionRetries(), busLatency.getPercentile(50),
+		busLatency.getPercentile(99), busLatency.getMax());
+	
+	if (lightSensor->getRecoveryCount() > 0) {
+		LOG_INFO("    Recoveries: %lu (last %lums, longest %lums)", lightSensor->getRecoveryCount(),
+			lightSensor->getLastRecoveryDuration(), lightSensor->getLongestRecoveryDuration());
 	}
 }
 
 void displayRelayStatus() {
 	bool relayOn = relayController->getRelayState();
-	Serial.print("🔌 Relay: ");
-	Serial.print(relayOn ? "✅ ON" : "⭕ OFF");
-	Serial.print(" (");
-	Serial.print(plantController->getRelayChanges());
-	Serial.println(" changes total)");
+	LOG_INFO("🔌 Relay: %s (%lu changes total)", relayOn ? "✅ ON" : "⭕ OFF", plantController->getRelayChanges());
 }
 
 void displayControlStatus() {
-	Serial.print("🤖 Control: ");
 	if (plantController->areAllComponentsHealthy()) {
-		Serial.print("✅ ACTIVE - ");
-		
 		/// We show the current logic decision
-		ControlDecision decision = plantController->getLastDecision();
-		ControlReason reason = plantController->getLastReason();
-		
-		switch (decision) {
+		const char* decisionText = "⏳ WAITING";
+		switch (plantController->getLastDecision()) {
 			case ControlDecision::TurnOn:
-				Serial.print("🌙 LIGHTS ON");
+				decisionText = "🌙 LIGHTS ON";
 				break;
 			case ControlDecision::TurnOff:
-				Serial.print("☀️ LIGHTS OFF");
+				decisionText = "☀️ LIGHTS OFF";
 				break;
 			case ControlDecision::KeepCurrent:
-				Serial.print("↔️ NO CHANGE");
+				decisionText = "↔️ NO CHANGE";
 				break;
 			case ControlDecision::WaitForData:
-				Serial.print("⏳ WAITING");
+				decisionText = "⏳ WAITING";
 				break;
 		}
 		
-		Serial.print(" (");
-		switch (reason) {
+		const char* reasonText = "system issue";
+		switch (plantController->getLastReason()) {
 			case ControlReason::OutOfSchedule:
-				Serial.print("out of schedule");
+				reasonText = "out of schedule";
 				break;
 			case ControlReason::InScheduleDark:
-				Serial.print("in schedule + dark");
+				reasonText = "in schedule + dark";
 				break;
 			case ControlReason::InScheduleBright:
-				Serial.print("in schedule + bright");
+				reasonText = "in schedule + bright";
 				break;
 			default:
-				Serial.print("system issue");
+				reasonText = "system issue";
 				break;
 		}
-		Serial.println(")");
 		
-		Serial.print("    Decisions made: ");
-		Serial.println(plantController->getDecisionCount());
+		LOG_INFO("🤖 Control: ✅ ACTIVE - %s (%s)", decisionText, reasonText);
+		LOG_INFO("    Decisions made: %lu", plantController->getDecisionCount());
+		
+		DailySummaryRecord today = dailySummary->getCurrentRecord();
+		LOG_INFO("    Today: lamp %d min, %d switches, DLI %.2f mol/m2",
+			today.lampOnMinutes, today.switchCount, today.dliCentimol / 100.0f);
+		
+		if (timeSeriesStore) {
+			LOG_INFO("    History: %.2f B/sample, %.1f KB/day, ~%.0f days retained, %.4f erase cycles/block/day",
+				timeSeriesStore->getBytesPerSample(), timeSeriesStore->getBytesPerDay() / 1024.0f,
+				timeSeriesStore->getEstimatedRetentionDays(), timeSeriesStore->getWearCyclesPerDay());
+		}
 		
 	} else {
-		Serial.println("❌ DEGRADED (missing data)");
+		LOG_INFO("🤖 Control: ❌ DEGRADED (missing data)");
 	}
 }
 
-/// We clean up memory on program end
-void cleanup() {
-	if (plantController) { delete plantController; plantController = nullptr; }
-	if (relayController) { delete relayController; relayController = nullptr; }
-	if (lightSensor) { delete lightSensor; lightSensor = nullptr; }
-	if (timeManager) { delete timeManager; timeManager = nullptr; }
-	if (wifiManager) { delete wifiManager; wifiManager = nullptr; }
+/// We run this right before the OTA and sensor recovery restarts, the only ways the
+/// firmware ends. Objects stay allocated, since the restart frees everything anyway,
+/// so this only switches the lamp off and saves what would be lost with RAM.
+void prepareForRestart() {
+	relayController->emergencyStop();
+	if (timeSeriesStore) {
+		timeSeriesStore->flush();
+	}
+	luxProfile->save();
+	dailySummary->checkpoint();
+	logger.flush();
 }
\ No newline at end of file
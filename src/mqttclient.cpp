@@ -0,0 +1,267 @@
+///
+/// MqttClient Implementation
+/// 
+/// We follow the MQTT 3.1.1 wire format directly. Incoming data is
+/// limited to CONNACK, PUBACK and PINGRESP because we never subscribe.
+///
+
+#include "mqttclient.h"
+
+static constexpr uint8_t MQTT_CONNECT = 0x10;
+static constexpr uint8_t MQTT_CONNACK = 0x20;
+static constexpr uint8_t MQTT_PUBLISH = 0x30;
+static constexpr uint8_t MQTT_PUBACK = 0x40;
+static constexpr uint8_t MQTT_PINGREQ = 0xC0;
+static constexpr uint8_t MQTT_PINGRESP = 0xD0;
+static constexpr uint8_t MQTT_DISCONNECT = 0xE0;
+static constexpr uint8_t MQTT_CLEAN_SESSION = 0x02;
+
+MqttClient::MqttClient(Client* client)
+	: client(client)
+	, sessionEstablished(false)
+	, keepAliveSeconds(60)
+	, lastSendTime(0)
+	, lastReceiveTime(0)
+	, pingOutstanding(false)
+	, bytesSent(0)
+	, bytesReceived(0)
+{
+	/// We do not own the client; its lifetime is managed by the caller
+}
+
+bool MqttClient::connect(const char* host, uint16_t port, const char* clientId,
+						uint16_t keepAliveSeconds, unsigned long timeoutMs) {
+	this->sessionEstablished = false;
+	this->keepAliveSeconds = keepAliveSeconds;
+	
+	if (!this->client->connect(host, port)) {
+		return false;
+	}
+	
+	/// We build the CONNECT packet: protocol "MQTT" level 4, clean session, no credentials
+	size_t clientIdLength = strlen(clientId);
+	uint8_t packet[64];
+	if (clientIdLength > sizeof(packet) - 16) {
+		this->client->stop();
+		return false;
+	}
+	
+	size_t remaining = 10 + 2 + clientIdLength;
+	size_t pos = 0;
+	packet[pos++] = MQTT_CONNECT;
+	pos += encodeRemainingLength(packet + pos, remaining);
+	const uint8_t variableHeader[] = { 0x00, 0x04, 'M', 'Q', 'T', 'T', 0x04, MQTT_CLEAN_SESSION,
+		(uint8_t)(keepAliveSeconds >> 8), (uint8_t)keepAliveSeconds };
+	memcpy(packet + pos, variableHeader, sizeof(variableHeader));
+	pos += sizeof(variableHeader);
+	packet[pos++] = (uint8_t)(clientIdLength >> 8);
+	packet[pos++] = (uint8_t)clientIdLength;
+	memcpy(packet + pos, clientId, clientIdLength);
+	pos += clientIdLength;
+	
+	if (!this->writeAll(packet, pos)) {
+		this->client->stop();
+		return false;
+	}
+	
+	/// We wait for CONNACK with return code 0
+	unsigned long startTime = millis();
+	while (millis() - startTime < timeoutMs) {
+		if (this->client->available() > 0) {
+			uint8_t body[4];
+			size_t bodyLength = 0;
+			uint8_t type = this->readPacket(body, sizeof(body), bodyLength);
+			if (type == MQTT_CONNACK && bodyLength == 2 && body[1] == 0x00) {
+				this->sessionEstablished = true;
+				this->pingOutstanding = false;
+				this->lastReceiveTime = millis();
+				return true;
+			}
+			break;
+		}
+		delay(10);
+	}
+	
+	this->client->stop();
+	return false;
+}
+
+void MqttClient::disconnect() {
+	if (this->client->connected()) {
+		const uint8_t packet[] = { MQTT_DISCONNECT, 0x00 };
+		(void)this->writeAll(packet, sizeof(packet));
+	}
+	this->client->stop();
+	this->sessionEstablished = false;
+}
+
+bool MqttClient::isConnected() {
+	if (this->sessionEstablished && !this->client->connected()) {
+		this->sessionEstablished = false;
+	}
+	return this->sessionEstablished;
+}
+
+bool MqttClient::publish(const char* topic, const uint8_t* payload, size_t length,
+						uint8_t qos, uint16_t packetId, bool dup) {
+	if (!this->isConnected()) {
+		return false;
+	}
+	
+	size_t topicLength = strlen(topic);
+	size_t remaining = 2 + topicLength + (qos > 0 ? 2 : 0) + length;
+	
+	/// We send the header and topic from a small buffer, then the payload in place
+	uint8_t header[80];
+	if (topicLength > sizeof(header) - 10) {
+		return false;
+	}
+	
+	size_t pos = 0;
+	header[pos++] = MQTT_PUBLISH | (dup ? 0x08 : 0x00) | (qos << 1);
+	pos += encodeRemainingLength(header + pos, remaining);
+	header[pos++] = (uint8_t)(topicLength >> 8);
+	header[pos++] = (uint8_t)topicLength;
+	memcpy(header + pos, topic, topicLength);
+	pos += topicLength;
+	if (qos > 0) {
+		header[pos++] = (uint8_t)(packetId >> 8);
+		header[pos++] = (uint8_t)packetId;
+	}
+	
+	return this->writeAll(header, pos) && this->writeAll(payload, length);
+}
+
+uint16_t MqttClient::loop() {
+	if (!this->isConnected()) {
+		return 0;
+	}
+	
+	unsigned long now = millis();
+	unsigned long keepAliveMs = this->keepAliveSeconds * 1000UL;
+	
+	/// We drop the session if the broker stayed silent for 1.5 keep-alive periods
+	if (now - this->lastReceiveTime > keepAliveMs + keepAliveMs / 2) {
+		this->client->stop();
+		this->sessionEstablished = false;
+		return 0;
+	}
+	
+	/// We ping when we have been quiet for most of the keep-alive period
+	if (!this->pingOutstanding && now - this->lastSendTime > keepAliveMs * 3 / 4) {
+		const uint8_t packet[] = { MQTT_PINGREQ, 0x00 };
+		if (this->writeAll(packet, sizeof(packet))) {
+			this->pingOutstanding = true;
+		}
+	}
+	
+	if (this->client->available() <= 0) {
+		return 0;
+	}
+	
+	uint8_t body[4];
+	size_t bodyLength = 0;
+	uint8_t type = this->readPacket(body, sizeof(body), bodyLength);
+	
+	switch (type) {
+		case MQTT_PUBACK:
+			if (bodyLength == 2) {
+				return (uint16_t)((body[0] << 8) | body[1]);
+			}
+			break;
+		case MQTT_PINGRESP:
+			this->pingOutstanding = false;
+			break;
+		default:
+			break;
+	}
+	return 0;
+}
+
+unsigned long MqttClient::getBytesSent() const {
+	return this->bytesSent;
+}
+
+unsigned long MqttClient::getBytesReceived() const {
+	return this->bytesReceived;
+}
+
+bool MqttClient::writeAll(const uint8_t* data, size_t length) {
+	size_t written = 0;
+	while (written < length) {
+		size_t chunk = this->client->write(data + written, length - written);
+		if (chunk == 0) {
+			this->client->stop();
+			this->sessionEstablished = false;
+			return false;
+		}
+		written += chunk;
+	}
+	
+	this->bytesSent += length;
+	this->lastSendTime = millis();
+	return true;
+}
+
+size_t MqttClient::encodeRemainingLength(uint8_t* out, size_t length) {
+	/// We use the MQTT base-128 encoding, 7 bits per byte with a continuation bit
+	size_t pos = 0;
+	do {
+		uint8_t digit = length % 128;
+		length /= 128;
+		if (length > 0) {
+			digit |= 0x80;
+		}
+		out[pos++] = digit;
+	} while (length > 0 && pos < 4);
+	return pos;
+}
+
+uint8_t MqttClient::readPacket(uint8_t* body, size_t bodySize, size_t& bodyLength) {
+	int header = this->readByte(1000);
+	if (header < 0) {
+		return 0;
+	}
+	
+	/// We decode the remaining length (at most 4 bytes)
+	size_t remaining = 0;
+	size_t multiplier = 1;
+	for (int i = 0; i < 4; i++) {
+		int digit = this->readByte(1000);
+		if (digit < 0) {
+			return 0;
+		}
+		remaining += (digit & 0x7F) * multiplier;
+		multiplier *= 128;
+		if ((digit & 0x80) == 0) {
+			break;
+		}
+	}
+	
+	/// We keep what fits and discard the rest of unexpected large packets
+	bodyLength = 0;
+	for (size_t i = 0; i < remaining; i++) {
+		int value = this->readByte(1000);
+		if (value < 0) {
+			return 0;
+		}
+		if (i < bodySize) {
+			body[bodyLength++] = (uint8_t)value;
+		}
+	}
+	
+	this->bytesReceived += 2 + remaining;
+	this->lastReceiveTime = millis();
+	return (uint8_t)header & 0xF0;
+}
+
+int MqttClient::readByte(unsigned long timeoutMs) {
+	unsigned long startTime = millis();
+	while (this->client->available() <= 0) {
+		if (millis() - startTime >= timeoutMs || !this->client->connected()) {
+			return -1;
+		}
+		delay(1);
+	}
+	return this->client->read();
+}
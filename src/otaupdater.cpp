@@ -0,0 +1,610 @@
+///
+/// OtaUpdater Implementation
+/// 
+/// The running image is hashed once in the task at startup (about a
+/// second for 1 MB) and sent to the server as the patch base. A patch is
+/// accepted only if the base hash matches and the SHA-256 of everything
+/// we wrote matches the target hash in the patch header.
+///
+
+#include "otaupdater.h"
+#include "logger.h"
+#include <Update.h>
+#include <esp_ota_ops.h>
+#include <mbedtls/sha256.h>
+
+static const char PATCH_MAGIC[] = "PLD1";
+static const uint8_t IMAGE_MAGIC = 0xE9;
+
+static const uint8_t OP_END = 0x00;
+static const uint8_t OP_COPY = 0x01;
+static const uint8_t OP_INSERT = 0x02;
+
+/// We take control of confirming new images instead of letting the core
+/// mark them valid before setup() runs
+extern "C" bool verifyRollbackLater() {
+	return true;
+}
+
+static uint32_t readUInt32(const uint8_t* source) {
+	return (uint32_t)source[0] | ((uint32_t)source[1] << 8) | ((uint32_t)source[2] << 16) | ((uint32_t)source[3] << 24);
+}
+
+static void toHex(const uint8_t* data, size_t length, char* target) {
+	static const char digits[] = "0123456789abcdef";
+	for (size_t i = 0; i < length; i++) {
+		target[i * 2] = digits[data[i] >> 4];
+		target[i * 2 + 1] = digits[data[i] & 0x0F];
+	}
+	target[length * 2] = '\0';
+}
+
+OtaUpdater::OtaUpdater()
+	: state(OtaState::Idle)
+	, lastError("")
+	, checkRequested(false)
+	, pendingConfirmation(false)
+	, rollbackReason(nullptr)
+	, healthySince(0)
+	, bootTime(0)
+	, runningPartition(nullptr)
+	, runningSize(0)
+	, contentRemaining(0)
+	, bytesDownloaded(0)
+	, imageBytes(0)
+	, bytesCopied(0)
+	, lastDuration(0)
+	, lastUpdateDelta(false)
+	, checkCount(0)
+	, updateCount(0)
+	, failureCount(0)
+{
+	memset(this->runningHash, 0, sizeof(this->runningHash));
+	this->runningHashHex[0] = '\0';
+}
+
+void OtaUpdater::begin() {
+	this->bootTime = millis();
+	this->runningPartition = esp_ota_get_running_partition();
+	this->runningSize = ESP.getSketchSize();
+	this->preferences.begin("ota", false);
+	
+	esp_ota_img_states_t imageState;
+	bool bootloaderPending = esp_ota_get_state_partition(this->runningPartition, &imageState) == ESP_OK
+		&& imageState == ESP_OTA_IMG_PENDING_VERIFY;
+	bool storedPending = this->preferences.getBool("pending", false);
+	
+	/// We detect that the new image never started: the bootloader fell back on its own
+	char target[17] = "";
+	this->preferences.getString("target", target, sizeof(target));
+	if (storedPending && strcmp(target, this->runningPartition->label) != 0) {
+		LOG_WARN("⚠ OTA: new image did not boot - running previous image");
+		this->preferences.putBool("pending", false);
+		storedPending = false;
+		this->failureCount++;
+		this->lastError = "new image did not boot";
+		this->state = OtaState::Failed;
+	}
+	
+	this->pendingConfirmation = bootloaderPending || storedPending;
+	if (this->pendingConfirmation) {
+		uint8_t attempts = this->preferences.getUChar("attempts", 0) + 1;
+		this->preferences.putUChar("attempts", attempts);
+		
+		LOG_INFO("OTA: new image on %s awaiting confirmation (boot %d/%d)",
+			this->runningPartition->label, attempts, OTA_MAX_BOOT_ATTEMPTS);
+		
+		/// Nothing has been recorded yet this early, so we can roll back at once
+		if (attempts > OTA_MAX_BOOT_ATTEMPTS) {
+			this->rollBack("too many unconfirmed boots");
+		}
+	}
+	
+	/// We run downloads at low priority on the network core
+	xTaskCreatePinnedToCore(taskEntry, "ota", 6144, this, 1, nullptr, 0);
+	
+	LOG_INFO("✓ OTA: running from %s, update server %s:%d",
+		this->runningPartition->label, OTA_SERVER_HOST, OTA_SERVER_PORT);
+}
+
+void OtaUpdater::update(bool healthy) {
+	if (!this->pendingConfirmation || this->rollbackReason) {
+		return;
+	}
+	
+	unsigned long now = millis();
+	if (!healthy) {
+		this->healthySince = 0;
+	} else if (this->healthySince == 0) {
+		this->healthySince = now;
+	} else if (now - this->healthySince >= OTA_CONFIRM_AFTER_MS) {
+		this->confirmImage();
+		return;
+	}
+	
+	/// The loop saves its state before it calls restart(), which rolls back
+	if (now - this->bootTime >= OTA_CONFIRM_TIMEOUT_MS) {
+		this->rollbackReason = "not confirmed in time";
+	}
+}
+
+void OtaUpdater::requestCheck() {
+	this->checkRequested = true;
+}
+
+bool OtaUpdater::isRebootPending() const {
+	return this->state == OtaState::ReadyToReboot || this->rollbackReason != nullptr;
+}
+
+void OtaUpdater::restart() {
+	if (this->rollbackReason) {
+		const char* reason = this->rollbackReason;
+		this->rollbackReason = nullptr;
+		this->rollBack(reason);
+		return;
+	}
+	ESP.restart();
+}
+
+bool OtaUpdater::isPendingConfirmation() const {
+	return this->pendingConfirmation;
+}
+
+OtaState OtaUpdater::getState() const {
+	return this->state;
+}
+
+const char* OtaUpdater::getStateString(OtaState state) {
+	switch (state) {
+		case OtaState::Idle: return "idle";
+		case OtaState::Checking: return "checking";
+		case OtaState::Downloading: return "downloading";
+		case OtaState::UpToDate: return "up-to-date";
+		case OtaState::ReadyToReboot: return "ready-to-reboot";
+		case OtaState::Failed: return "failed";
+		default: return "unknown";
+	}
+}
+
+const char* OtaUpdater::getLastError() const {
+	return this->lastError;
+}
+
+const char* OtaUpdater::getRunningHash() const {
+	return this->runningHashHex;
+}
+
+unsigned long OtaUpdater::getBytesDownloaded() const {
+	return this->bytesDownloaded;
+}
+
+unsigned long OtaUpdater::getImageBytes() const {
+	return this->imageBytes;
+}
+
+unsigned long OtaUpdater::getBytesCopied() const {
+	return this->bytesCopied;
+}
+
+unsigned long OtaUpdater::getLastDuration() const {
+	return this->lastDuration;
+}
+
+bool OtaUpdater::wasLastUpdateDelta() const {
+	return this->lastUpdateDelta;
+}
+
+unsigned long OtaUpdater::getCheckCount() const {
+	return this->checkCount;
+}
+
+unsigned long OtaUpdater::getUpdateCount() const {
+	return this->updateCount;
+}
+
+unsigned long OtaUpdater::getFailureCount() const {
+	return this->failureCount;
+}
+
+void OtaUpdater::taskEntry(void* parameter) {
+	static_cast<OtaUpdater*>(parameter)->runTask();
+}
+
+void OtaUpdater::runTask() {
+	if (this->hashPartition(this->runningPartition, this->runningSize, this->runningHash)) {
+		toHex(this->runningHash, HASH_SIZE, this->runningHashHex);
+	}
+	
+	/// We make the first check a minute after boot, then every interval
+	unsigned long lastCheck = millis();
+	unsigned long waitTime = 60000;
+	
+	while (true) {
+		bool due = this->checkRequested || millis() - lastCheck >= waitTime;
+		bool allowed = this->runningHashHex[0] != '\0'
+			&& !this->pendingConfirmation
+			&& this->state != OtaState::ReadyToReboot
+			&& WiFi.status() == WL_CONNECTED;
+		
+		if (due && allowed) {
+			this->checkRequested = false;
+			this->checkForUpdate();
+			lastCheck = millis();
+			waitTime = OTA_CHECK_INTERVAL_MS;
+		}
+		
+		vTaskDelay(pdMS_TO_TICKS(1000));
+	}
+}
+
+void OtaUpdater::checkForUpdate() {
+	this->checkCount++;
+	this->state = OtaState::Checking;
+	this->bytesDownloaded = 0;
+	this->imageBytes = 0;
+	this->bytesCopied = 0;
+	unsigned long startTime = millis();
+	
+	int status = this->openRequest();
+	if (status == 204 || status == 304) {
+		this->client.stop();
+		this->state = OtaState::UpToDate;
+		return;
+	}
+	if (status != 200) {
+		this->fail(status == 0 ? "server unreachable" : "unexpected server response");
+		return;
+	}
+	
+	this->state = OtaState::Downloading;
+	uint8_t magic[4];
+	if (!this->readBody(magic, 1)) {
+		this->fail("empty response");
+		return;
+	}
+	
+	bool applied = false;
+	if (magic[0] == (uint8_t)PATCH_MAGIC[0]) {
+		if (!this->readBody(magic + 1, 3) || memcmp(magic, PATCH_MAGIC, 4) != 0) {
+			this->fail("bad patch magic");
+			return;
+		}
+		this->lastUpdateDelta = true;
+		applied = this->applyPatch();
+	} else if (magic[0] == IMAGE_MAGIC) {
+		this->lastUpdateDelta = false;
+		applied = this->applyFullImage(magic[0]);
+	} else {
+		this->fail("unknown payload");
+		return;
+	}
+	
+	this->client.stop();
+	if (!applied) {
+		return;
+	}
+	
+	/// We remember where we came from so a bad image can be undone without the bootloader
+	const esp_partition_t* target = esp_ota_get_next_update_partition(nullptr);
+	this->preferences.putString("previous", this->runningPartition->label);
+	this->preferences.putString("target", target ? target->label : "");
+	this->preferences.putUChar("attempts", 0);
+	this->preferences.putBool("pending", true);
+	
+	this->lastDuration = millis() - startTime;
+	this->updateCount++;
+	this->state = OtaState::ReadyToReboot;
+	
+	LOG_INFO("✓ OTA: %s applied, %lu bytes downloaded for a %lu byte image in %lu ms",
+		this->lastUpdateDelta ? "delta" : "full image", this->bytesDownloaded, this->imageBytes, this->lastDuration);
+}
+
+int OtaUpdater::openRequest() {
+	this->contentRemaining = 0;
+	if (!this->client.connect(OTA_SERVER_HOST, OTA_SERVER_PORT, OTA_READ_TIMEOUT_MS)) {
+		return 0;
+	}
+	
+	/// We use HTTP/1.0 so the body is never chunked
+	char request[200];
+	int length = snprintf(request, sizeof(request),
+		"GET /firmware?from=%s&size=%lu HTTP/1.0\r\nHost: %s\r\n\r\n",
+		this->runningHashHex, (unsigned long)this->runningSize, OTA_SERVER_HOST);
+	if (this->client.write((const uint8_t*)request, length) != (size_t)length) {
+		return 0;
+	}
+	
+	char line[128];
+	if (!this->readLine(line, sizeof(line)) || strncmp(line, "HTTP/1.", 7) != 0) {
+		return 0;
+	}
+	int status = atoi(line + 9);
+	
+	bool hasLength = false;
+	while (this->readLine(line, sizeof(line)) && line[0] != '\0') {
+		if (strncasecmp(line, "Content-Length:", 15) == 0) {
+			this->contentRemaining = strtoul(line + 15, nullptr, 10);
+			hasLength = true;
+		}
+	}
+	
+	/// We insist on a length so a truncated download is always detected
+	if (status == 200 && !hasLength) {
+		return -1;
+	}
+	return status;
+}
+
+bool OtaUpdater::applyPatch() {
+	uint8_t header[8 + HASH_SIZE * 2];
+	if (!this->readBody(header, sizeof(header))) {
+		this->fail("truncated patch header");
+		return false;
+	}
+	
+	uint32_t oldSize = readUInt32(header);
+	uint32_t newSize = readUInt32(header + 4);
+	const uint8_t* oldHash = header + 8;
+	const uint8_t* newHash = header + 8 + HASH_SIZE;
+	
+	/// We refuse patches made against any image but the one we run
+	uint8_t baseHash[HASH_SIZE];
+	if (oldSize == this->runningSize) {
+		memcpy(baseHash, this->runningHash, HASH_SIZE);
+	} else if (oldSize > this->runningPartition->size
+		|| !this->hashPartition(this->runningPartition, oldSize, baseHash)) {
+		this->fail("patch base out of range");
+		return false;
+	}
+	if (memcmp(baseHash, oldHash, HASH_SIZE) != 0) {
+		this->fail("patch base mismatch");
+		return false;
+	}
+	
+	if (!Update.begin(newSize)) {
+		this->fail("cannot begin update");
+		return false;
+	}
+	
+	mbedtls_sha256_context sha;
+	mbedtls_sha256_init(&sha);
+	mbedtls_sha256_starts(&sha, 0);
+	
+	bool ok = true;
+	while (ok) {
+		uint8_t opcode;
+		if (!this->readBody(&opcode, 1)) {
+			ok = false;
+			this->fail("truncated patch");
+			break;
+		}
+		if (opcode == OP_END) {
+			break;
+		}
+		
+		uint32_t offset = 0;
+		uint32_t length = 0;
+		if (opcode == OP_COPY) {
+			ok = this->readVarint(offset) && this->readVarint(length) && offset + length <= oldSize;
+		} else if (opcode == OP_INSERT) {
+			ok = this->readVarint(length);
+		} else {
+			ok = false;
+		}
+		if (!ok || this->imageBytes + length > newSize) {
+			ok = false;
+			this->fail("malformed patch");
+			break;
+		}
+		
+		/// We move each operation through the shared buffer in pieces
+		while (length > 0 && ok) {
+			size_t chunk = min((size_t)length, BUFFER_SIZE);
+			if (opcode == OP_COPY) {
+				ok = esp_partition_read(this->runningPartition, offset, this->buffer, chunk) == ESP_OK;
+				offset += chunk;
+				this->bytesCopied += chunk;
+			} else {
+				ok = this->readBody(this->buffer, chunk);
+			}
+			
+			if (!ok || Update.write(this->buffer, chunk) != chunk) {
+				ok = false;
+				this->fail(opcode == OP_COPY ? "copy failed" : "download or write failed");
+				break;
+			}
+			
+			mbedtls_sha256_update(&sha, this->buffer, chunk);
+			this->imageBytes += chunk;
+			length -= chunk;
+		}
+	}
+	
+	uint8_t resultHash[HASH_SIZE];
+	mbedtls_sha256_finish(&sha, resultHash);
+	mbedtls_sha256_free(&sha);
+	
+	if (ok && (this->imageBytes != newSize || memcmp(resultHash, newHash, HASH_SIZE) != 0)) {
+		ok = false;
+		this->fail("result hash mismatch");
+	}
+	
+	if (!ok) {
+		Update.abort();
+		return false;
+	}
+	
+	/// We let Update validate the image and switch the boot partition
+	if (!Update.end()) {
+		this->fail(Update.errorString());
+		return false;
+	}
+	return true;
+}
+
+bool OtaUpdater::applyFullImage(uint8_t firstByte) {
+	size_t total = this->contentRemaining + 1;
+	if (!Update.begin(total)) {
+		this->fail("cannot begin update");
+		return false;
+	}
+	
+	this->buffer[0] = firstByte;
+	size_t filled = 1;
+	while (this->imageBytes < total) {
+		size_t chunk = min(total - this->imageBytes, BUFFER_SIZE) - filled;
+		if (!this->readBody(this->buffer + filled, chunk)) {
+			Update.abort();
+			this->fail("download failed");
+			return false;
+		}
+		
+		chunk += filled;
+		filled = 0;
+		if (Update.write(this->buffer, chunk) != chunk) {
+			Update.abort();
+			this->fail("write failed");
+			return false;
+		}
+		this->imageBytes += chunk;
+	}
+	
+	if (!Update.end()) {
+		this->fail(Update.errorString());
+		return false;
+	}
+	return true;
+}
+
+bool OtaUpdater::readRaw(uint8_t* target, size_t length) {
+	unsigned long lastProgress = millis();
+	while (length > 0) {
+		int available = this->client.available();
+		if (available <= 0) {
+			if (!this->client.connected() || millis() - lastProgress >= OTA_READ_TIMEOUT_MS) {
+				return false;
+			}
+			/// We sleep instead of spinning so the control loop keeps the CPU
+			vTaskDelay(pdMS_TO_TICKS(5));
+			continue;
+		}
+		
+		int bytesRead = this->client.read(target, min((size_t)available, length));
+		if (bytesRead <= 0) {
+			continue;
+		}
+		
+		target += bytesRead;
+		length -= bytesRead;
+		this->bytesDownloaded += bytesRead;
+		lastProgress = millis();
+	}
+	return true;
+}
+
+bool OtaUpdater::readLine(char* line, size_t size) {
+	size_t length = 0;
+	while (true) {
+		uint8_t c;
+		if (!this->readRaw(&c, 1)) {
+			return false;
+		}
+		if (c == '\n') {
+			break;
+		}
+		if (c != '\r') {
+			if (length + 1 >= size) {
+				return false;
+			}
+			line[length++] = c;
+		}
+	}
+	line[length] = '\0';
+	return true;
+}
+
+bool OtaUpdater::readBody(uint8_t* target, size_t length) {
+	if (length > this->contentRemaining || !this->readRaw(target, length)) {
+		return false;
+	}
+	this->contentRemaining -= length;
+	return true;
+}
+
+bool OtaUpdater::readVarint(uint32_t& value) {
+	value = 0;
+	for (int shift = 0; shift < 35; shift += 7) {
+		uint8_t byte;
+		if (!this->readBody(&byte, 1)) {
+			return false;
+		}
+		value |= (uint32_t)(byte & 0x7F) << shift;
+		if (!(byte & 0x80)) {
+			return true;
+		}
+	}
+	return false;
+}
+
+bool OtaUpdater::hashPartition(const esp_partition_t* partition, uint32_t length, uint8_t* hash) {
+	mbedtls_sha256_context sha;
+	mbedtls_sha256_init(&sha);
+	mbedtls_sha256_starts(&sha, 0);
+	
+	bool ok = true;
+	for (uint32_t offset = 0; offset < length && ok; offset += BUFFER_SIZE) {
+		size_t chunk = min((uint32_t)BUFFER_SIZE, length - offset);
+		ok = esp_partition_read(partition, offset, this->buffer, chunk) == ESP_OK;
+		if (ok) {
+			mbedtls_sha256_update(&sha, this->buffer, chunk);
+		}
+	}
+	
+	mbedtls_sha256_finish(&sha, hash);
+	mbedtls_sha256_free(&sha);
+	return ok;
+}
+
+void OtaUpdater::fail(const char* reason) {
+	this->failureCount++;
+	this->lastError = reason;
+	this->state = OtaState::Failed;
+	this->client.stop();
+	
+	LOG_WARN("✗ OTA: %s", reason);
+}
+
+void OtaUpdater::confirmImage() {
+	esp_ota_mark_app_valid_cancel_rollback();
+	this->preferences.putBool("pending", false);
+	this->preferences.putUChar("attempts", 0);
+	this->pendingConfirmation = false;
+	
+	LOG_INFO("✓ OTA: image on %s confirmed", this->runningPartition->label);
+}
+
+void OtaUpdater::rollBack(const char* reason) {
+	LOG_WARN("✗ OTA: rolling back - %s", reason);
+	this->preferences.putBool("pending", false);
+	this->preferences.putUChar("attempts", 0);
+	
+	esp_ota_img_states_t imageState;
+	if (esp_ota_get_state_partition(this->runningPartition, &imageState) == ESP_OK
+		&& imageState == ESP_OTA_IMG_PENDING_VERIFY) {
+		/// We let the bootloader restore the previous image; this does not return
+		esp_ota_mark_app_invalid_rollback_and_reboot();
+	}
+	
+	/// We fall back to switching the boot partition ourselves
+	char previous[17] = "";
+	this->preferences.getString("previous", previous, sizeof(previous));
+	const esp_partition_t* partition = esp_partition_find_first(ESP_PARTITION_TYPE_APP, ESP_PARTITION_SUBTYPE_ANY, previous);
+	if (partition && partition != this->runningPartition && esp_ota_set_boot_partition(partition) == ESP_OK) {
+		delay(100);
+		ESP.restart();
+	}
+	
+	/// We keep running the new image rather than restarting into nothing
+	LOG_ERROR("✗ OTA: no previous image to roll back to");
+	this->pendingConfirmation = false;
+}
@@ -8,6 +8,7 @@
 ///
 
 #include "plantcontroller.h"
+#include "logger.h"
 #include "config.h"
 
 PlantController::PlantController(WiFiManager* wifiManager, TimeManager* timeManager, 
@@ -32,30 +33,18 @@ PlantController::PlantController(WiFiManager* wifiManager, TimeManager* timeMana
 }
 
 void PlantController::begin() {
-	Serial.println("PlantController: Initializing intelligent plant light control");
+	LOG_INFO("PlantController: Initializing intelligent plant light control");
 	
 	/// We display the control configuration
-	Serial.print("Schedule: ");
-	Serial.print(this->scheduleStartHour);
-	Serial.print(":00 to ");
-	Serial.print(this->scheduleEndHour);
-	Serial.println(":00");
-	
-	Serial.print("Light threshold: ");
-	Serial.print(this->lightThresholdLux);
-	Serial.println(" lux");
-	
-	Serial.print("Update interval: ");
-	Serial.print(this->updateInterval / 1000);
-	Serial.println(" seconds");
-	
-	Serial.print("Automatic control: ");
-	Serial.println(this->automaticControlEnabled ? "ENABLED" : "DISABLED");
+	LOG_INFO("Schedule: %d:00 to %d:00", this->scheduleStartHour, this->scheduleEndHour);
+	LOG_INFO("Light threshold: %.2f lux", this->lightThresholdLux);
+	LOG_INFO("Update interval: %lu seconds", this->updateInterval / 1000);
+	LOG_INFO("Automatic control: %s", this->automaticControlEnabled ? "ENABLED" : "DISABLED");
 	
 	/// We perform initial evaluation
 	this->forceUpdate();
 	
-	Serial.println("PlantController: ✓ Initialized and ready");
+	LOG_INFO("PlantController: ✓ Initialized and ready");
 }
 
 void PlantController::update() {
@@ -89,7 +78,7 @@ void PlantController::update() {
 }
 
 void PlantController::forceUpdate() {
-	Serial.println("PlantController: Forcing immediate evaluation...");
+	LOG_INFO("PlantController: Forcing immediate evaluation...");
 	
 	ControlReason reason;
 	ControlDecision decision = this->analyzeConditions(reason);
@@ -119,6 +108,10 @@ bool PlantController::areAllComponentsHealthy() const {
 	return this->validateComponents(dummyReason);
 }
 
+bool PlantController::areLocalComponentsHealthy() const {
+	return this->lightSensor->isSensorHealthy() && this->relayController->isReady();
+}
+
 unsigned long PlantController::getDecisionCount() const {
 	return this->decisionCount;
 }
@@ -129,12 +122,11 @@ unsigned long PlantController::getRelayChanges() const {
 
 void PlantController::setAutomaticControl(bool enabled) {
 	this->automaticControlEnabled = enabled;
-	Serial.print("PlantController: Automatic control ");
-	Serial.println(enabled ? "ENABLED" : "DISABLED");
+	LOG_INFO("PlantController: Automatic control %s", enabled ? "ENABLED" : "DISABLED");
 	
 	if (!enabled) {
 		/// We turn off lights when disabling automatic control for safety
-		Serial.println("PlantController: Turning off lights (automatic control disabled)");
+		LOG_INFO("PlantController: Turning off lights (automatic control disabled)");
 		this->relayController->setRelayState(false);
 	}
 }
@@ -143,6 +135,18 @@ bool PlantController::isAutomaticControlEnabled() const {
 	return this->automaticControlEnabled;
 }
 
+int PlantController::getScheduleStartHour() const {
+	return this->scheduleStartHour;
+}
+
+int PlantController::getScheduleEndHour() const {
+	return this->scheduleEndHour;
+}
+
+float PlantController::getLightThreshold() const {
+	return this->lightThresholdLux;
+}
+
 ControlDecision PlantController::analyzeConditions(ControlReason& reason) const {
 	/// We first validate that all components are working
 	if (!this->validateComponents(reason)) {
@@ -156,10 +160,15 @@ ControlDecision PlantController::analyzeConditions(ControlReason& reason) const
 	}
 	
 	/// We're in schedule, so check ambient light conditions
-	bool ambientLightLow = this->isAmbientLightLow();
+	/// Without samples we know nothing about the light, so we wait instead of guessing
+	LightLevel ambientLight = this->getAmbientLightLevel();
+	if (ambientLight == LightLevel::Unknown) {
+		reason = ControlReason::SensorFailure;
+		return ControlDecision::WaitForData;
+	}
 	bool relayCurrentlyOn = this->relayController->getRelayState();
 	
-	if (ambientLightLow) {
+	if (ambientLight == LightLevel::Below) {
 		/// We want lights on because it's dark
 		reason = ControlReason::InScheduleDark;
 		return relayCurrentlyOn ? ControlDecision::KeepCurrent : ControlDecision::TurnOn;
@@ -175,51 +184,54 @@ bool PlantController::isWithinSchedule() const {
 	return this->timeManager->isTimeInRange(this->scheduleStartHour, this->scheduleEndHour);
 }
 
-bool PlantController::isAmbientLightLow() const {
+LightLevel PlantController::getAmbientLightLevel() const {
+#if SPECTRAL_DAYLIGHT_ENABLED
+	/// We only count daylight while our lamps are on, otherwise they would
+	/// brighten the room past the threshold and switch themselves off
+	if (this->relayController->getRelayState()) {
+		return this->lightSensor->compareDaylightToThreshold(this->lightThresholdLux);
+	}
+#endif
+	
 	/// We use the light sensor's threshold comparison
-	return this->lightSensor->isBelowThreshold(this->lightThresholdLux);
+	return this->lightSensor->compareToThreshold(this->lightThresholdLux);
 }
 
 bool PlantController::shouldRelayBeOn() const {
 	/// We combine schedule and light conditions
-	return this->isWithinSchedule() && this->isAmbientLightLow();
+	return this->isWithinSchedule() && this->getAmbientLightLevel() == LightLevel::Below;
 }
 
 void PlantController::executeDecision(ControlDecision decision, ControlReason reason) {
-	Serial.print("PlantController: Decision - ");
-	Serial.print(this->getDecisionString(decision));
-	Serial.print(" (");
-	Serial.print(this->getReasonString(reason));
-	Serial.println(")");
+	LOG_INFO("PlantController: Decision - %s (%s)",
+		this->getDecisionString(decision), this->getReasonString(reason));
 	
 	/// We handle each decision type
 	switch (decision) {
 		case ControlDecision::TurnOn:
 			if (this->relayController->setRelayState(true)) {
 				this->relayChanges++;
-				Serial.println("PlantController: ✓ Lights turned ON");
+				LOG_INFO("PlantController: ✓ Lights turned ON");
 			} else {
-				Serial.println("PlantController: ⏳ Cannot turn ON (relay safety interval)");
+				LOG_WARN("PlantController: ⏳ Cannot turn ON (relay safety interval)");
 			}
 			break;
 			
 		case ControlDecision::TurnOff:
 			if (this->relayController->setRelayState(false)) {
 				this->relayChanges++;
-				Serial.println("PlantController: ✓ Lights turned OFF");
+				LOG_INFO("PlantController: ✓ Lights turned OFF");
 			} else {
-				Serial.println("PlantController: ⏳ Cannot turn OFF (relay safety interval)");
+				LOG_WARN("PlantController: ⏳ Cannot turn OFF (relay safety interval)");
 			}
 			break;
 			
 		case ControlDecision::KeepCurrent:
-			Serial.print("PlantController: ↔ Keeping current state (");
-			Serial.print(this->relayController->getRelayState() ? "ON" : "OFF");
-			Serial.println(")");
+			LOG_DEBUG("PlantController: ↔ Keeping current state (%s)", this->relayController->getRelayState() ? "ON" : "OFF");
 			break;
 			
 		case ControlDecision::WaitForData:
-			Serial.println("PlantController: ⏳ Waiting for valid data");
+			LOG_DEBUG("PlantController: ⏳ Waiting for valid data");
 			break;
 	}
 }
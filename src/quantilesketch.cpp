@@ -0,0 +1,118 @@
+///
+/// QuantileSketch Implementation
+/// 
+/// We keep the sketch a plain array of 16-bit counters so it can be
+/// persisted and exported byte-for-byte without any conversion.
+///
+
+#include "quantilesketch.h"
+
+QuantileSketch::QuantileSketch() {
+	this->clear();
+}
+
+void QuantileSketch::add(float lux) {
+	int index = getBucketIndex(lux);
+	
+	/// We halve all buckets before a counter would overflow
+	if (this->buckets[index] == UINT16_MAX) {
+		this->decay();
+	}
+	
+	this->buckets[index]++;
+	this->count++;
+}
+
+void QuantileSketch::merge(const QuantileSketch& other) {
+	this->merge(&other, 1);
+}
+
+void QuantileSketch::merge(const QuantileSketch* others, size_t count) {
+	/// We add at full width first; halving after every overflow would favour the last inputs
+	uint32_t sums[BUCKET_COUNT];
+	uint32_t largest = 0;
+	for (int i = 0; i < BUCKET_COUNT; i++) {
+		sums[i] = this->buckets[i];
+		for (size_t j = 0; j < count; j++) {
+			sums[i] += others[j].buckets[i];
+		}
+		if (sums[i] > largest) {
+			largest = sums[i];
+		}
+	}
+	
+	/// One common shift brings every bucket back into 16 bits
+	int shift = 0;
+	while ((largest >> shift) > UINT16_MAX) {
+		shift++;
+	}
+	
+	for (int i = 0; i < BUCKET_COUNT; i++) {
+		this->buckets[i] = (uint16_t)(sums[i] >> shift);
+	}
+	this->recount();
+}
+
+void QuantileSketch::clear() {
+	for (int i = 0; i < BUCKET_COUNT; i++) {
+		this->buckets[i] = 0;
+	}
+	this->count = 0;
+}
+
+uint32_t QuantileSketch::getCount() const {
+	return this->count;
+}
+
+float QuantileSketch::getQuantile(float quantile) const {
+	if (this->count == 0) {
+		return NAN;
+	}
+	
+	/// We find the first bucket whose cumulative count reaches the rank
+	uint32_t rank = (uint32_t)(constrain(quantile, 0.0f, 1.0f) * (this->count - 1)) + 1;
+	uint32_t seen = 0;
+	int index = 0;
+	for (; index < BUCKET_COUNT; index++) {
+		seen += this->buckets[index];
+		if (seen >= rank) {
+			break;
+		}
+	}
+	
+	if (index == 0) {
+		return 0.0f;
+	}
+	return MIN_LUX * powf(GAMMA, index - 0.5f);
+}
+
+const uint16_t* QuantileSketch::getBuckets() const {
+	return this->buckets;
+}
+
+uint16_t* QuantileSketch::getBuckets() {
+	return this->buckets;
+}
+
+void QuantileSketch::recount() {
+	this->count = 0;
+	for (int i = 0; i < BUCKET_COUNT; i++) {
+		this->count += this->buckets[i];
+	}
+}
+
+int QuantileSketch::getBucketIndex(float lux) {
+	if (!(lux >= MIN_LUX)) {
+		return 0; /// We also catch NaN here
+	}
+	
+	int index = 1 + (int)(logf(lux / MIN_LUX) / logf(GAMMA));
+	return min(index, BUCKET_COUNT - 1);
+}
+
+void QuantileSketch::decay() {
+	for (int i = 0; i < BUCKET_COUNT; i++) {
+		this->buckets[i] >>= 1;
+	}
+	this->recount();
+}
@@ -7,10 +7,12 @@
 ///
 
 #include "relaycontroller.h"
+#include "logger.h"
 #include "config.h"
 
 RelayController::RelayController(int relayPin) 
 	: relayPin(relayPin)
+	, ready(false)
 	, currentState(false)
 	, lastSwitchTime(0)
 	, minSwitchInterval(MIN_SWITCH_INTERVAL_MS)
@@ -28,8 +30,9 @@ void RelayController::begin() {
 	this->updateRelayHardware(false);
 	this->currentState = false;
 	this->lastSwitchTime = millis();
+	this->ready = true;
 	
-	Serial.println("RelayController: Initialized with relay OFF");
+	LOG_INFO("RelayController: Initialized with relay OFF");
 }
 
 bool RelayController::setRelayState(bool state) {
@@ -41,9 +44,8 @@ bool RelayController::setRelayState(bool state) {
 	
 	/// We enforce minimum time interval between switches to protect hardware
 	if (!this->canSwitchRelay()) {
-		Serial.print("RelayController: Switch blocked - minimum interval not met. Time since last: ");
-		Serial.print(this->getTimeSinceLastSwitch());
-		Serial.println("ms");
+		LOG_WARN("RelayController: Switch blocked - minimum interval not met. Time since last: %lums",
+			this->getTimeSinceLastSwitch());
 		return false;
 	}
 	
@@ -52,8 +54,7 @@ bool RelayController::setRelayState(bool state) {
 	this->currentState = state;
 	this->lastSwitchTime = millis();
 	
-	Serial.print("RelayController: State changed to ");
-	Serial.println(state ? "ON" : "OFF");
+	LOG_INFO("RelayController: State changed to %s", state ? "ON" : "OFF");
 	
 	return true;
 }
@@ -81,7 +82,11 @@ void RelayController::emergencyStop() {
 	this->currentState = false;
 	this->lastSwitchTime = millis();
 	
-	Serial.println("RelayController: EMERGENCY STOP activated");
+	LOG_WARN("RelayController: EMERGENCY STOP activated");
+}
+
+bool RelayController::isReady() const {
+	return this->ready;
 }
 
 void RelayController::updateRelayHardware(bool state) {
@@ -0,0 +1,245 @@
+///
+/// ResponseWriter Implementation
+/// 
+/// We frame each flush as exactly one chunk. Sockets are written with
+/// MSG_DONTWAIT, the same way LiveUpdates writes its clients.
+///
+
+#include "responsewriter.h"
+#include "config.h"
+#include <sys/socket.h>
+#include <errno.h>
+
+ResponseWriter::ResponseWriter(uint8_t* buffer, size_t capacity, uint8_t* backlog, size_t backlogCapacity)
+	: buffer(buffer)
+	, capacity(capacity)
+	, length(0)
+	, backlog(backlog)
+	, backlogCapacity(backlogCapacity)
+	, backlogLength(0)
+	, client(nullptr)
+	, chunked(false)
+	, inBody(false)
+	, failed(false)
+	, lastProgressAt(0)
+	, bytesSent(0)
+{
+	/// We never own the buffers; callers give us static storage
+}
+
+void ResponseWriter::attach(WiFiClient* client) {
+	this->client = client;
+	this->length = 0;
+	this->backlogLength = 0;
+	this->chunked = false;
+	this->inBody = false;
+	this->failed = false;
+	this->lastProgressAt = millis();
+}
+
+void ResponseWriter::beginResponse(int statusCode, const char* contentType, long contentLength,
+								const char* extraHeaders) {
+	this->length = 0;
+	this->inBody = false;
+	this->chunked = contentLength < 0;
+	
+	this->printf("HTTP/1.1 %d %s\r\n", statusCode, getStatusText(statusCode));
+	this->printf("Content-Type: %s\r\n", contentType);
+	if (this->chunked) {
+		this->print("Transfer-Encoding: chunked\r\n");
+	} else {
+		this->printf("Content-Length: %ld\r\n", contentLength);
+	}
+	if (extraHeaders) {
+		this->print(extraHeaders);
+	}
+	this->print("Connection: close\r\n\r\n");
+	
+	/// We send headers unframed, everything after them goes into chunks
+	this->flush();
+	this->inBody = true;
+}
+
+void ResponseWriter::print(const char* text) {
+	this->write((const uint8_t*)text, strlen(text));
+}
+
+void ResponseWriter::printf(const char* format, ...) {
+	va_list args;
+	va_start(args, format);
+	int needed = vsnprintf((char*)this->buffer + this->length, this->capacity - this->length, format, args);
+	va_end(args);
+	
+	if (needed < 0) {
+		return;
+	}
+	
+	if ((size_t)needed < this->capacity - this->length) {
+		this->length += needed;
+		return;
+	}
+	
+	/// We did not fit; flush and format again into the empty buffer
+	this->flush();
+	va_start(args, format);
+	needed = vsnprintf((char*)this->buffer, this->capacity, format, args);
+	va_end(args);
+	this->length = min((size_t)max(needed, 0), this->capacity - 1);
+}
+
+void ResponseWriter::write(const uint8_t* data, size_t length) {
+	while (length > 0) {
+		size_t space = this->capacity - this->length;
+		if (space == 0) {
+			this->flush();
+			continue;
+		}
+		
+		size_t chunk = min(space, length);
+		memcpy(this->buffer + this->length, data, chunk);
+		this->length += chunk;
+		data += chunk;
+		length -= chunk;
+	}
+}
+
+void ResponseWriter::printJsonString(const char* text) {
+	char escaped[8];
+	this->print("\"");
+	for (const char* c = text; *c; c++) {
+		if (*c == '"' || *c == '\\') {
+			escaped[0] = '\\';
+			escaped[1] = *c;
+			this->write((const uint8_t*)escaped, 2);
+		} else if ((uint8_t)*c < 0x20) {
+			snprintf(escaped, sizeof(escaped), "\\u%04x", (uint8_t)*c);
+			this->print(escaped);
+		} else {
+			this->write((const uint8_t*)c, 1);
+		}
+	}
+	this->print("\"");
+}
+
+void ResponseWriter::flush() {
+	if (this->length == 0) {
+		return;
+	}
+	this->sendRaw(this->buffer, this->length);
+	this->length = 0;
+}
+
+void ResponseWriter::end() {
+	this->flush();
+	if (this->chunked && this->inBody) {
+		static const uint8_t terminator[] = { '0', '\r', '\n', '\r', '\n' };
+		this->chunked = false; /// We send the terminator unframed
+		this->sendRaw(terminator, sizeof(terminator));
+	}
+	this->inBody = false;
+}
+
+void ResponseWriter::drain() {
+	if (this->backlogLength == 0 || !this->client || this->failed) {
+		return;
+	}
+	
+	size_t written = this->writeSocket(this->backlog, this->backlogLength);
+	memmove(this->backlog, this->backlog + written, this->backlogLength - written);
+	this->backlogLength -= written;
+	
+	if (this->backlogLength > 0 && millis() - this->lastProgressAt >= HTTP_SEND_STALL_MS) {
+		this->failed = true;
+	}
+}
+
+size_t ResponseWriter::getPending() const {
+	return this->length;
+}
+
+size_t ResponseWriter::getBacklog() const {
+	return this->backlogLength;
+}
+
+unsigned long ResponseWriter::getBytesSent() const {
+	return this->bytesSent;
+}
+
+bool ResponseWriter::hasFailed() const {
+	return this->failed;
+}
+
+const char* ResponseWriter::getStatusText(int statusCode) {
+	switch (statusCode) {
+		case 101: return "Switching Protocols";
+		case 200: return "OK";
+		case 202: return "Accepted";
+		case 204: return "No Content";
+		case 304: return "Not Modified";
+		case 400: return "Bad Request";
+		case 404: return "Not Found";
+		case 405: return "Method Not Allowed";
+		case 408: return "Request Timeout";
+		case 413: return "Payload Too Large";
+		case 500: return "Internal Server Error";
+		case 503: return "Service Unavailable";
+		default: return "Unknown";
+	}
+}
+
+void ResponseWriter::sendRaw(const uint8_t* data, size_t length) {
+	if (!this->client || this->failed) {
+		return;
+	}
+	
+	/// We frame body data as one chunk: hex size, CRLF, data, CRLF
+	bool framed = this->chunked && this->inBody;
+	if (framed) {
+		char chunkHeader[12];
+		size_t headerLength = snprintf(chunkHeader, sizeof(chunkHeader), "%X\r\n", (unsigned)length);
+		this->queue((const uint8_t*)chunkHeader, headerLength);
+	}
+	this->queue(data, length);
+	if (framed) {
+		this->queue((const uint8_t*)"\r\n", 2);
+	}
+}
+
+void ResponseWriter::queue(const uint8_t* data, size_t length) {
+	/// New bytes may only go straight out once nothing is waiting before them
+	this->drain();
+	if (this->failed) {
+		return;
+	}
+	if (this->backlogLength == 0) {
+		size_t written = this->writeSocket(data, length);
+		data += written;
+		length -= written;
+	}
+	if (length == 0 || this->failed) {
+		return;
+	}
+	
+	/// Socket and backlog both full means the client stopped reading
+	if (length > this->backlogCapacity - this->backlogLength) {
+		this->failed = true;
+		return;
+	}
+	memcpy(this->backlog + this->backlogLength, data, length);
+	this->backlogLength += length;
+}
+
+size_t ResponseWriter::writeSocket(const uint8_t* data, size_t length) {
+	ssize_t written = send(this->client->fd(), data, length, MSG_DONTWAIT);
+	if (written < 0) {
+		if (errno != EAGAIN && errno != EWOULDBLOCK) {
+			this->failed = true;
+		}
+		return 0;
+	}
+	if (written > 0) {
+		this->lastProgressAt = millis();
+	}
+	this->bytesSent += written;
+	return written;
+}
@@ -0,0 +1,180 @@
+///
+/// SntpServer Implementation
+/// 
+/// Packet layout follows RFC 4330 section 4. We answer version 1 to 4
+/// client requests (mode 3) with a server reply (mode 4) of the same
+/// version and copy the client's transmit timestamp into the originate
+/// field, which is how the client matches the reply to its request.
+///
+
+#include "sntpserver.h"
+#include "logger.h"
+#include <sys/socket.h>
+#include <netinet/in.h>
+#include <fcntl.h>
+#include <unistd.h>
+
+static constexpr uint16_t NTP_PORT = 123;
+static constexpr uint8_t NTP_MODE_CLIENT = 3;
+static constexpr uint8_t NTP_MODE_SERVER = 4;
+static constexpr int8_t NTP_PRECISION = -10;                 /// log2 seconds: we count milliseconds
+static constexpr uint64_t NTP_UNIX_OFFSET_S = 2208988800ULL; /// 1900-01-01 to 1970-01-01
+static constexpr uint64_t DRIFT_PPM = 15;                    /// RFC 5905 frequency tolerance
+
+SntpServer::SntpServer(const TimeManager* timeManager)
+	: timeManager(timeManager)
+	, socketFd(-1)
+	, requestsServed(0)
+	, requestsUnsynced(0)
+	, requestsMalformed(0)
+	, sendFailures(0)
+{
+}
+
+SntpServer::~SntpServer() {
+	if (this->socketFd >= 0) {
+		close(this->socketFd);
+	}
+}
+
+bool SntpServer::begin() {
+	int fd = socket(AF_INET, SOCK_DGRAM, IPPROTO_UDP);
+	if (fd < 0) {
+		LOG_ERROR("SntpServer: ✗ Could not create socket");
+		return false;
+	}
+	fcntl(fd, F_SETFL, fcntl(fd, F_GETFL, 0) | O_NONBLOCK);
+	
+	struct sockaddr_in local = {};
+	local.sin_family = AF_INET;
+	local.sin_port = htons(NTP_PORT);
+	local.sin_addr.s_addr = htonl(INADDR_ANY);
+	if (bind(fd, (struct sockaddr*)&local, sizeof(local)) != 0) {
+		LOG_ERROR("SntpServer: ✗ Could not bind UDP port %u", NTP_PORT);
+		close(fd);
+		return false;
+	}
+	
+	this->socketFd = fd;
+	LOG_INFO("SntpServer: Serving time on UDP port %u, stratum %d", NTP_PORT, SNTP_SERVER_STRATUM);
+	return true;
+}
+
+void SntpServer::poll() {
+	if (this->socketFd < 0) {
+		return;
+	}
+	
+	for (int i = 0; i < SNTP_MAX_REQUESTS_PER_POLL; i++) {
+		uint8_t request[PACKET_SIZE];
+		struct sockaddr_in client = {};
+		socklen_t clientLength = sizeof(client);
+		ssize_t length = recvfrom(this->socketFd, request, sizeof(request), MSG_DONTWAIT,
+			(struct sockaddr*)&client, &clientLength);
+		if (length < 0) {
+			return;
+		}
+		
+		/// We stamp the receive time before anything else touches the request
+		unsigned long startMicros = micros();
+		uint64_t receiveMs = this->canServe() ? this->timeManager->getUtcMillis() : 0;
+		
+		/// Longer requests carry extension fields or a MAC; recvfrom() cut them, we ignore them
+		uint8_t version = (request[0] >> 3) & 0x07;
+		if (length < (ssize_t)PACKET_SIZE || (request[0] & 0x07) != NTP_MODE_CLIENT || version < 1 || version > 4) {
+			this->requestsMalformed++;
+			continue;
+		}
+		if (receiveMs == 0) {
+			this->requestsUnsynced++;
+			continue;
+		}
+		
+		uint8_t reply[PACKET_SIZE];
+		this->buildReply(request, reply);
+		writeTimestamp(reply + 32, receiveMs);
+		writeTimestamp(reply + 40, this->timeManager->getUtcMillis());
+		
+		/// A full send buffer drops the reply; the client simply asks again
+		ssize_t sent = sendto(this->socketFd, reply, sizeof(reply), MSG_DONTWAIT,
+			(struct sockaddr*)&client, clientLength);
+		if (sent == (ssize_t)sizeof(reply)) {
+			this->requestsServed++;
+			this->serveLatency.record(micros() - startMicros);
+		} else {
+			this->sendFailures++;
+		}
+	}
+}
+
+unsigned long SntpServer::getRequestsServed() const {
+	return this->requestsServed;
+}
+
+unsigned long SntpServer::getRequestsUnsynced() const {
+	return this->requestsUnsynced;
+}
+
+unsigned long SntpServer::getRequestsMalformed() const {
+	return this->requestsMalformed;
+}
+
+unsigned long SntpServer::getSendFailures() const {
+	return this->sendFailures;
+}
+
+const LatencyHistogram& SntpServer::getServeLatency() const {
+	return this->serveLatency;
+}
+
+bool SntpServer::canServe() const {
+	return this->timeManager && this->timeManager->hasValidTime()
+		&& this->timeManager->getTimeSinceLastSync() < SNTP_MAX_SYNC_AGE_MS;
+}
+
+void SntpServer::buildReply(const uint8_t* request, uint8_t* reply) const {
+	memset(reply, 0, PACKET_SIZE);
+	
+	/// LI 0 (no warning), the client's version, mode 4; poll interval copied from the request
+	reply[0] = (request[0] & 0x38) | NTP_MODE_SERVER;
+	reply[1] = SNTP_SERVER_STRATUM;
+	reply[2] = request[2];
+	reply[3] = (uint8_t)NTP_PRECISION;
+	
+	/// Root delay: our round trip to the upstream server
+	writeShort(reply + 4, this->timeManager->getNtpRoundTrip().getPercentile(50));
+	
+	/// Root dispersion: error right after a sync, growing with the drift since
+	uint64_t sinceSyncMs = this->timeManager->getTimeSinceLastSync();
+	writeShort(reply + 8, (uint64_t)SNTP_CLOCK_ERROR_MS * 1000 + sinceSyncMs * DRIFT_PPM / 1000);
+	
+	/// Reference ID: the upstream server's IPv4 address, as stratum 2+ servers report it
+	IPAddress upstream;
+	if (this->timeManager->getServerCache().getAddress(upstream)) {
+		for (int i = 0; i < 4; i++) {
+			reply[12 + i] = upstream[i];
+		}
+	}
+	
+	writeTimestamp(reply + 16, this->timeManager->getLastSyncUtcMillis());
+	
+	/// Originate: the client's transmit timestamp, unchanged
+	memcpy(reply + 24, request + 40, 8);
+}
+
+void SntpServer::writeTimestamp(uint8_t* field, uint64_t utcMs) {
+	uint32_t seconds = (uint32_t)(utcMs / 1000 + NTP_UNIX_OFFSET_S);
+	uint32_t fraction = (uint32_t)(((utcMs % 1000) << 32) / 1000);
+	for (int i = 0; i < 4; i++) {
+		field[i] = seconds >> (24 - 8 * i);
+		field[4 + i] = fraction >> (24 - 8 * i);
+	}
+}
+
+void SntpServer::writeShort(uint8_t* field, uint64_t microseconds) {
+	uint64_t value = (microseconds << 16) / 1000000;
+	uint32_t clamped = value > UINT32_MAX ? UINT32_MAX : (uint32_t)value;
+	for (int i = 0; i < 4; i++) {
+		field[i] = clamped >> (24 - 8 * i);
+	}
+}
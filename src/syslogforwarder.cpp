@@ -0,0 +1,143 @@
+///
+/// SyslogForwarder Implementation
+/// 
+/// We must not log from here: we run inside the logger's drain task, and
+/// anything we logged would come straight back to us. Failures only show
+/// up in the counters.
+///
+
+#include "syslogforwarder.h"
+#include <WiFi.h>
+#include <sys/socket.h>
+#include <netinet/in.h>
+#include <arpa/inet.h>
+#include <fcntl.h>
+#include <unistd.h>
+
+/// RFC 5424 header without a timestamp; the collector stamps receipt time
+static const char* SYSLOG_LINE_FORMAT = "<%u>1 - " SYSLOG_HOSTNAME " plantlight - - - ";
+static constexpr size_t SYSLOG_HEADER_MAX = 28 + sizeof(SYSLOG_HOSTNAME);
+
+static_assert(SYSLOG_MAX_DATAGRAM >= SYSLOG_HEADER_MAX + LOG_SLOT_SIZE + 1,
+	"SYSLOG_MAX_DATAGRAM must hold at least one message");
+
+SyslogForwarder::SyslogForwarder()
+	: batchLength(0)
+	, batchMessages(0)
+	, batchStartedAt(0)
+	, socketFd(-1)
+	, messagesSent(0)
+	, messagesDropped(0)
+	, datagramsSent(0)
+	, bytesSent(0)
+{
+}
+
+void SyslogForwarder::append(uint8_t severity, const char* text, size_t length) {
+	/// We drop at once while offline instead of holding messages nobody can receive
+	if (WiFi.status() != WL_CONNECTED) {
+		this->messagesDropped++;
+		return;
+	}
+	
+	if (this->batchLength + SYSLOG_HEADER_MAX + length + 1 > sizeof(this->batch)) {
+		this->sendBatch();
+	}
+	if (this->batchMessages == 0) {
+		this->batchStartedAt = millis();
+	}
+	
+	char* line = this->batch + this->batchLength;
+	int headerLength = snprintf(line, SYSLOG_HEADER_MAX, SYSLOG_LINE_FORMAT,
+		(unsigned)(SYSLOG_FACILITY * 8 + (severity & 0x07)));
+	if (headerLength < 0 || headerLength >= (int)SYSLOG_HEADER_MAX) {
+		this->messagesDropped++;
+		return;
+	}
+	
+	/// Lines are split on newlines, so a message must not contain any
+	char* body = line + headerLength;
+	for (size_t i = 0; i < length; i++) {
+		body[i] = (text[i] == '\n' || text[i] == '\r') ? ' ' : text[i];
+	}
+	body[length] = '\n';
+	this->batchLength += headerLength + length + 1;
+	this->batchMessages++;
+}
+
+void SyslogForwarder::poll() {
+	if (this->batchMessages > 0 && millis() - this->batchStartedAt >= SYSLOG_BATCH_INTERVAL_MS) {
+		this->sendBatch();
+	}
+}
+
+void SyslogForwarder::flush() {
+	if (this->batchMessages > 0) {
+		this->sendBatch();
+	}
+}
+
+unsigned long SyslogForwarder::getMessagesSent() const {
+	return this->messagesSent;
+}
+
+unsigned long SyslogForwarder::getMessagesDropped() const {
+	return this->messagesDropped;
+}
+
+unsigned long SyslogForwarder::getDatagramsSent() const {
+	return this->datagramsSent;
+}
+
+unsigned long SyslogForwarder::getBytesSent() const {
+	return this->bytesSent;
+}
+
+bool SyslogForwarder::ensureSocket() {
+	if (WiFi.status() != WL_CONNECTED) {
+		return false;
+	}
+	if (this->socketFd >= 0) {
+		return true;
+	}
+	
+	int fd = socket(AF_INET, SOCK_DGRAM, IPPROTO_UDP);
+	if (fd < 0) {
+		return false;
+	}
+	fcntl(fd, F_SETFL, fcntl(fd, F_GETFL, 0) | O_NONBLOCK);
+	
+	/// A connected UDP socket lets us use send() and keeps the address lookup out of every batch
+	struct sockaddr_in collector = {};
+	collector.sin_family = AF_INET;
+	collector.sin_port = htons(SYSLOG_PORT);
+	collector.sin_addr.s_addr = inet_addr(SYSLOG_HOST);
+	if (connect(fd, (struct sockaddr*)&collector, sizeof(collector)) != 0) {
+		close(fd);
+		return false;
+	}
+	this->socketFd = fd;
+	return true;
+}
+
+void SyslogForwarder::sendBatch() {
+	if (this->batchMessages == 0) {
+		return;
+	}
+	
+	/// We drop the batch rather than wait when the stack has no room for it
+	ssize_t written = -1;
+	if (this->ensureSocket()) {
+		written = send(this->socketFd, this->batch, this->batchLength, MSG_DONTWAIT);
+	}
+	if (written == (ssize_t)this->batchLength) {
+		this->messagesSent += this->batchMessages;
+		this->datagramsSent++;
+		this->bytesSent += written;
+	} else {
+		this->messagesDropped += this->batchMessages;
+	}
+	
+	this->batchLength = 0;
+	this->batchMessages = 0;
+}
@@ -0,0 +1,555 @@
+///
+/// TelemetryPublisher Implementation
+/// 
+/// We split the work between the loop thread, which only appends to the
+/// batch and encodes it once per minute, and a low-priority task that
+/// owns the socket. The two only meet at the outbound queue. Flash I/O for
+/// the spool also happens only on the task.
+///
+
+#include "telemetrypublisher.h"
+#include "logger.h"
+#include "cborwriter.h"
+
+static constexpr uint8_t TELEMETRY_FORMAT_VERSION = 1;
+
+#if MQTT_TLS_ENABLED
+static constexpr uint16_t TELEMETRY_BROKER_PORT = MQTT_TLS_PORT;
+/// mbedtls needs several KB of stack for the key exchange
+static constexpr uint32_t TELEMETRY_TASK_STACK = 10240;
+#else
+static constexpr uint16_t TELEMETRY_BROKER_PORT = MQTT_BROKER_PORT;
+static constexpr uint32_t TELEMETRY_TASK_STACK = 6144;
+#endif
+
+TelemetryPublisher::TelemetryPublisher(TimeManager* timeManager, LightSensor* lightSensor)
+	: timeManager(timeManager)
+	, lightSensor(lightSensor)
+	, mqtt(&networkClient)
+	, lastConnectAttempt(0)
+	, reconnectInterval(5000)
+	, nextPacketId(1)
+	, connected(false)
+	, sampleCount(0)
+	, decisionCount(0)
+	, batchStartTime(0)
+	, batchEpoch(0)
+	, queueMutex(nullptr)
+	, queueHead(0)
+	, queueCount(0)
+	, spoolReady(false)
+	, backlogBuffer(nullptr)
+	, backlogLength(0)
+	, backlogMessages(0)
+	, backlogConsumed(0)
+	, backlogPacketId(0)
+	, backlogSentAt(0)
+	, lastBacklogAck(0)
+	, drainStartTime(0)
+	, drainMessages(0)
+	, drainBytes(0)
+	, startTime(0)
+	, messagesQueued(0)
+	, messagesAcked(0)
+	, messagesDropped(0)
+	, retransmissions(0)
+	, connectionCount(0)
+	, payloadBytes(0)
+	, messagesFlushed(0)
+	, backlogBatches(0)
+	, flushMessagesPerSecond(0.0f)
+	, flushBytesPerSecond(0.0f)
+{
+	for (int i = 0; i < TELEMETRY_QUEUE_DEPTH; i++) {
+		this->queue[i].state = SlotState::Free;
+	}
+	
+	/// We derive a stable client id from the chip's MAC address
+	uint32_t chipId = (uint32_t)(ESP.getEfuseMac() >> 24);
+	snprintf(this->clientId, sizeof(this->clientId), "plantlight-%06lx", (unsigned long)(chipId & 0xFFFFFF));
+	snprintf(this->topic, sizeof(this->topic), "%s/%s/telemetry", MQTT_TOPIC_PREFIX, this->clientId);
+	snprintf(this->backlogTopic, sizeof(this->backlogTopic), "%s/backlog", this->topic);
+}
+
+void TelemetryPublisher::begin() {
+	this->queueMutex = xSemaphoreCreateMutex();
+	this->startTime = millis();
+	this->resetBatch();
+	
+	/// We allocate the backlog batch buffer once; without the spool we keep the RAM queue only
+	this->spoolReady = this->spool.begin();
+	if (this->spoolReady) {
+		this->backlogBuffer = new uint8_t[TELEMETRY_FLUSH_MAX_BYTES];
+	}
+	
+#if MQTT_TLS_ENABLED
+	/// We parse the CA and set up TLS once here instead of on every connect
+	if (!this->networkClient.begin(MQTT_TLS_CA_CERT_PATH)) {
+		LOG_ERROR("TelemetryPublisher: ✗ TLS unavailable, telemetry will stay offline");
+	}
+#endif
+	
+	/// We run the network side at low priority so it can never starve the control loop
+	xTaskCreatePinnedToCore(taskEntry, "telemetry", TELEMETRY_TASK_STACK, this, 1, nullptr, 0);
+	
+	LOG_INFO("TelemetryPublisher: Publishing to %s:%d%s topic %s", MQTT_BROKER_HOST, TELEMETRY_BROKER_PORT,
+		MQTT_TLS_ENABLED ? " (TLS)" : "", this->topic);
+}
+
+void TelemetryPublisher::addSample(uint16_t alsCounts, uint16_t whiteCounts) {
+	if (this->sampleCount >= MAX_BATCH_SAMPLES) {
+		this->flushBatch();
+	}
+	
+	BatchSample& sample = this->samples[this->sampleCount++];
+	sample.offsetDs = (uint16_t)min((millis() - this->batchStartTime) / 100UL, 65535UL);
+	sample.alsCounts = alsCounts;
+	sample.whiteCounts = whiteCounts;
+}
+
+void TelemetryPublisher::addDecision(ControlDecision decision, ControlReason reason, bool relayOn) {
+	if (this->decisionCount >= MAX_BATCH_DECISIONS) {
+		this->flushBatch();
+	}
+	
+	BatchDecision& entry = this->decisions[this->decisionCount++];
+	entry.offsetDs = (uint16_t)min((millis() - this->batchStartTime) / 100UL, 65535UL);
+	entry.decision = (uint8_t)decision;
+	entry.reason = (uint8_t)reason;
+	entry.relayOn = relayOn;
+}
+
+void TelemetryPublisher::update() {
+	if (millis() - this->batchStartTime >= TELEMETRY_BATCH_INTERVAL_MS) {
+		this->flushBatch();
+	}
+}
+
+bool TelemetryPublisher::isConnected() const {
+	return this->connected;
+}
+
+int TelemetryPublisher::getQueueDepth() const {
+	return this->queueCount;
+}
+
+unsigned long TelemetryPublisher::getMessagesQueued() const {
+	return this->messagesQueued;
+}
+
+unsigned long TelemetryPublisher::getMessagesAcked() const {
+	return this->messagesAcked;
+}
+
+unsigned long TelemetryPublisher::getMessagesDropped() const {
+	return this->messagesDropped;
+}
+
+unsigned long TelemetryPublisher::getRetransmissions() const {
+	return this->retransmissions;
+}
+
+unsigned long TelemetryPublisher::getConnectionCount() const {
+	return this->connectionCount;
+}
+
+const TlsClient* TelemetryPublisher::getTlsClient() const {
+#if MQTT_TLS_ENABLED
+	return &this->networkClient;
+#else
+	return nullptr;
+#endif
+}
+
+unsigned long TelemetryPublisher::getPayloadBytes() const {
+	return this->payloadBytes;
+}
+
+unsigned long TelemetryPublisher::getWireBytes() const {
+	return this->mqtt.getBytesSent();
+}
+
+uint32_t TelemetryPublisher::getSpoolDepth() const {
+	return this->spool.getDepth();
+}
+
+uint32_t TelemetryPublisher::getSpoolCapacity() const {
+	return this->spool.getCapacity();
+}
+
+unsigned long TelemetryPublisher::getMessagesSpooled() const {
+	return this->spool.getMessagesSpooled();
+}
+
+unsigned long TelemetryPublisher::getMessagesFlushed() const {
+	return this->messagesFlushed;
+}
+
+unsigned long TelemetryPublisher::getSpoolOverwritten() const {
+	return this->spool.getMessagesOverwritten();
+}
+
+unsigned long TelemetryPublisher::getBacklogBatches() const {
+	return this->backlogBatches;
+}
+
+float TelemetryPublisher::getFlushMessagesPerSecond() const {
+	return this->flushMessagesPerSecond;
+}
+
+float TelemetryPublisher::getFlushBytesPerSecond() const {
+	return this->flushBytesPerSecond;
+}
+
+unsigned long TelemetryPublisher::getMessagesPerHour() const {
+	unsigned long uptime = millis() - this->startTime;
+	if (uptime < 60000) {
+		return 0; /// We need at least a minute before the rate means anything
+	}
+	return (unsigned long)((uint64_t)this->messagesAcked * 3600000ULL / uptime);
+}
+
+unsigned long TelemetryPublisher::getWireBytesPerHour() const {
+	unsigned long uptime = millis() - this->startTime;
+	if (uptime < 60000) {
+		return 0;
+	}
+	return (unsigned long)((uint64_t)this->getWireBytes() * 3600000ULL / uptime);
+}
+
+void TelemetryPublisher::resetBatch() {
+	this->sampleCount = 0;
+	this->decisionCount = 0;
+	this->batchStartTime = millis();
+	this->batchEpoch = this->timeManager ? this->timeManager->getEpochTime() : 0;
+}
+
+void TelemetryPublisher::flushBatch() {
+	if (this->sampleCount == 0 && this->decisionCount == 0) {
+		this->resetBatch();
+		return;
+	}
+	
+	xSemaphoreTake(this->queueMutex, portMAX_DELAY);
+	
+	/// We keep the queue bounded by dropping the oldest message. Acked slots are
+	/// released first, so only a message the broker never confirmed counts as dropped
+	this->compactQueue();
+	if (this->queueCount == TELEMETRY_QUEUE_DEPTH) {
+		this->queue[this->queueHead].state = SlotState::Free;
+		this->messagesDropped++;
+		this->compactQueue();
+	}
+	
+	OutboundMessage& message = this->queue[(this->queueHead + this->queueCount) % TELEMETRY_QUEUE_DEPTH];
+	
+	/// We encode { v, t, up, k, s: [dt, als, white, ...], d: [dt, decision, reason, relay, ...] }
+	/// Time offsets are deltas to the previous entry in 0.1 s so they usually fit in one byte
+	CborWriter writer(message.payload, sizeof(message.payload));
+	writer.beginMap(6);
+	writer.writeKey("v");
+	writer.writeUInt(TELEMETRY_FORMAT_VERSION);
+	writer.writeKey("t");
+	writer.writeUInt(this->batchEpoch);
+	writer.writeKey("up");
+	writer.writeUInt(this->batchStartTime / 1000);
+	writer.writeKey("k");
+	writer.writeFloat(this->lightSensor->countsToLux(1));
+	
+	writer.writeKey("s");
+	writer.beginArray(this->sampleCount * 3);
+	uint16_t previous = 0;
+	for (int i = 0; i < this->sampleCount; i++) {
+		writer.writeUInt(this->samples[i].offsetDs - previous);
+		writer.writeUInt(this->samples[i].alsCounts);
+		writer.writeUInt(this->samples[i].whiteCounts);
+		previous = this->samples[i].offsetDs;
+	}
+	
+	writer.writeKey("d");
+	writer.beginArray(this->decisionCount * 4);
+	previous = 0;
+	for (int i = 0; i < this->decisionCount; i++) {
+		writer.writeUInt(this->decisions[i].offsetDs - previous);
+		writer.writeUInt(this->decisions[i].decision);
+		writer.writeUInt(this->decisions[i].reason);
+		writer.writeBool(this->decisions[i].relayOn);
+		previous = this->decisions[i].offsetDs;
+	}
+	
+	if (writer.hasOverflowed()) {
+		this->messagesDropped++;
+	} else {
+		message.state = SlotState::Pending;
+		message.attempts = 0;
+		message.packetId = 0;
+		message.length = writer.getLength();
+		this->queueCount++;
+		this->messagesQueued++;
+	}
+	
+	xSemaphoreGive(this->queueMutex);
+	
+	if (writer.hasOverflowed()) {
+		LOG_WARN("TelemetryPublisher: ✗ Batch exceeds TELEMETRY_MAX_PAYLOAD, dropped");
+	}
+	
+	this->resetBatch();
+}
+
+void TelemetryPublisher::taskEntry(void* parameter) {
+	static_cast<TelemetryPublisher*>(parameter)->runTask();
+}
+
+void TelemetryPublisher::runTask() {
+	for (;;) {
+		this->serviceConnection();
+		vTaskDelay(pdMS_TO_TICKS(50));
+	}
+}
+
+void TelemetryPublisher::serviceConnection() {
+	if (WiFi.status() != WL_CONNECTED) {
+		if (this->mqtt.isConnected()) {
+			this->mqtt.disconnect();
+		}
+		this->connected = false;
+		this->spillQueue();
+		return;
+	}
+	
+	if (!this->mqtt.isConnected()) {
+		this->connected = false;
+		this->spillQueue();
+		if (millis() - this->lastConnectAttempt < this->reconnectInterval) {
+			return;
+		}
+		this->lastConnectAttempt = millis();
+		
+		if (!this->mqtt.connect(MQTT_BROKER_HOST, TELEMETRY_BROKER_PORT, this->clientId, MQTT_KEEPALIVE_S, 5000)) {
+			/// We back off exponentially like the WiFi manager, capped at 5 minutes
+			this->reconnectInterval = min(this->reconnectInterval * 2, 300000UL);
+			return;
+		}
+		
+		this->reconnectInterval = 5000;
+		this->connectionCount++;
+		this->connected = true;
+		
+		/// We start a clean session, so everything unacknowledged is sent again
+		this->backlogPacketId = 0;
+		xSemaphoreTake(this->queueMutex, portMAX_DELAY);
+		for (int i = 0; i < TELEMETRY_QUEUE_DEPTH; i++) {
+			if (this->queue[i].state == SlotState::InFlight) {
+				this->queue[i].state = SlotState::Pending;
+			}
+		}
+		xSemaphoreGive(this->queueMutex);
+	}
+	
+	/// We drain all acknowledgements that arrived since the last pass
+	uint16_t ackedId;
+	while ((ackedId = this->mqtt.loop()) != 0) {
+		if (ackedId == this->backlogPacketId) {
+			this->handleBacklogAck();
+		} else {
+			this->handleAck(ackedId);
+		}
+	}
+	
+	this->sendPending();
+	this->sendBacklog();
+}
+
+void TelemetryPublisher::sendPending() {
+	for (;;) {
+		xSemaphoreTake(this->queueMutex, portMAX_DELAY);
+		
+		/// We find the oldest message that is pending or whose ack timed out
+		int inFlight = 0;
+		OutboundMessage* next = nullptr;
+		for (int i = 0; i < this->queueCount; i++) {
+			OutboundMessage& message = this->queue[(this->queueHead + i) % TELEMETRY_QUEUE_DEPTH];
+			bool timedOut = message.state == SlotState::InFlight && millis() - message.sentAt >= MQTT_ACK_TIMEOUT_MS;
+			if (message.state == SlotState::InFlight && !timedOut) {
+				inFlight++;
+			} else if (!next && (message.state == SlotState::Pending || timedOut)) {
+				next = &message;
+			}
+		}
+		
+		if (!next || inFlight >= MQTT_MAX_INFLIGHT) {
+			xSemaphoreGive(this->queueMutex);
+			return;
+		}
+		
+		/// We copy the payload so the loop thread can keep enqueueing while we write
+		bool retransmit = next->attempts > 0;
+		if (!retransmit) {
+			next->packetId = this->nextPacketId++;
+			if (this->nextPacketId == 0) {
+				this->nextPacketId = 1;
+			}
+		}
+		uint16_t packetId = next->packetId;
+		size_t length = next->length;
+		memcpy(this->sendBuffer, next->payload, length);
+		next->state = MQTT_QOS > 0 ? SlotState::InFlight : SlotState::Free;
+		next->attempts++;
+		next->sentAt = millis();
+		xSemaphoreGive(this->queueMutex);
+		
+		bool sent = this->mqtt.publish(this->topic, this->sendBuffer, length, MQTT_QOS, packetId, retransmit);
+		
+		xSemaphoreTake(this->queueMutex, portMAX_DELAY);
+		if (!sent) {
+			/// We put it back; the slot may have been dropped meanwhile, which is fine
+			if (next->packetId == packetId && next->state != SlotState::Free) {
+				next->state = SlotState::Pending;
+			}
+		} else {
+			if (retransmit) {
+				this->retransmissions++;
+			}
+			if (MQTT_QOS == 0) {
+				this->messagesAcked++;
+				this->payloadBytes += length;
+				this->compactQueue();
+			}
+		}
+		xSemaphoreGive(this->queueMutex);
+		
+		if (!sent) {
+			return;
+		}
+	}
+}
+
+void TelemetryPublisher::spillQueue() {
+	if (!this->spoolReady) {
+		return;
+	}
+	
+	/// A batch in flight is read from flash again after we reconnect, and an
+	/// interrupted drain does not count towards the flush rate
+	this->backlogPacketId = 0;
+	this->drainStartTime = 0;
+	
+	for (;;) {
+		/// We take the oldest message out under the lock but write flash without it
+		xSemaphoreTake(this->queueMutex, portMAX_DELAY);
+		this->compactQueue();
+		if (this->queueCount == 0) {
+			xSemaphoreGive(this->queueMutex);
+			return;
+		}
+		OutboundMessage& message = this->queue[this->queueHead];
+		size_t length = message.length;
+		memcpy(this->sendBuffer, message.payload, length);
+		message.state = SlotState::Free;
+		this->compactQueue();
+		xSemaphoreGive(this->queueMutex);
+		
+		if (!this->spool.push(this->sendBuffer, length)) {
+			xSemaphoreTake(this->queueMutex, portMAX_DELAY);
+			this->messagesDropped++;
+			xSemaphoreGive(this->queueMutex);
+		}
+	}
+}
+
+void TelemetryPublisher::sendBacklog() {
+	if (!this->spoolReady) {
+		return;
+	}
+	
+	if (this->backlogPacketId != 0) {
+		/// We send an unacknowledged batch again with the same packet id
+		if (millis() - this->backlogSentAt >= MQTT_ACK_TIMEOUT_MS
+			&& this->mqtt.publish(this->backlogTopic, this->backlogBuffer, this->backlogLength, 1,
+				this->backlogPacketId, true)) {
+			this->backlogSentAt = millis();
+			this->retransmissions++;
+		}
+		return;
+	}
+	
+	/// We let fresh messages go first and pace the batches so the backlog never hogs the link
+	if (this->spool.getDepth() == 0 || millis() - this->lastBacklogAck < TELEMETRY_FLUSH_INTERVAL_MS) {
+		return;
+	}
+	xSemaphoreTake(this->queueMutex, portMAX_DELAY);
+	int queued = this->queueCount;
+	xSemaphoreGive(this->queueMutex);
+	if (queued > 0) {
+		return;
+	}
+	
+	this->backlogLength = this->spool.readBatch(this->backlogBuffer, TELEMETRY_FLUSH_MAX_BYTES,
+		this->backlogMessages, this->backlogConsumed);
+	if (this->backlogLength == 0) {
+		/// Nothing readable; we release whatever corrupt slots we stepped over
+		this->spool.release(this->backlogConsumed);
+		return;
+	}
+	
+	if (this->drainStartTime == 0) {
+		this->drainStartTime = millis();
+		this->drainMessages = 0;
+		this->drainBytes = 0;
+		LOG_INFO("TelemetryPublisher: Flushing %lu spooled message(s)", (unsigned long)this->spool.getDepth());
+	}
+	
+	uint16_t packetId = this->nextPacketId++;
+	if (this->nextPacketId == 0) {
+		this->nextPacketId = 1;
+	}
+	
+	/// We always ask for an acknowledgement; only that lets us release the spool
+	if (this->mqtt.publish(this->backlogTopic, this->backlogBuffer, this->backlogLength, 1, packetId, false)) {
+		this->backlogPacketId = packetId;
+		this->backlogSentAt = millis();
+		this->backlogBatches++;
+	}
+}
+
+void TelemetryPublisher::handleBacklogAck() {
+	this->spool.release(this->backlogConsumed);
+	this->messagesFlushed += this->backlogMessages;
+	this->drainMessages += this->backlogMessages;
+	this->drainBytes += this->backlogLength;
+	this->backlogPacketId = 0;
+	this->lastBacklogAck = millis();
+	
+	if (this->spool.getDepth() == 0 && this->drainStartTime != 0) {
+		unsigned long elapsed = max(millis() - this->drainStartTime, 1UL);
+		this->flushMessagesPerSecond = this->drainMessages * 1000.0f / elapsed;
+		this->flushBytesPerSecond = this->drainBytes * 1000.0f / elapsed;
+		this->drainStartTime = 0;
+		LOG_INFO("TelemetryPublisher: ✓ Flushed %lu spooled message(s) in %lu ms (%.0f B/s)",
+			this->drainMessages, elapsed, this->flushBytesPerSecond);
+	}
+}
+
+void TelemetryPublisher::handleAck(uint16_t packetId) {
+	xSemaphoreTake(this->queueMutex, portMAX_DELAY);
+	for (int i = 0; i < this->queueCount; i++) {
+		OutboundMessage& message = this->queue[(this->queueHead + i) % TELEMETRY_QUEUE_DEPTH];
+		if (message.state == SlotState::InFlight && message.packetId == packetId) {
+			message.state = SlotState::Free;
+			this->messagesAcked++;
+			this->payloadBytes += message.length;
+			break;
+		}
+	}
+	this->compactQueue();
+	xSemaphoreGive(this->queueMutex);
+}
+
+void TelemetryPublisher::compactQueue() {
+	/// We release acknowledged slots from the head; out-of-order acks wait their turn
+	while (this->queueCount > 0 && this->queue[this->queueHead].state == SlotState::Free) {
+		this->queueHead = (this->queueHead + 1) % TELEMETRY_QUEUE_DEPTH;
+		this->queueCount--;
+	}
+}
@@ -0,0 +1,223 @@
+///
+/// TelemetrySpool Implementation
+/// 
+/// Slot n of the ring file holds sequence numbers n, n + SLOTS, ... so
+/// the newest header tells us where writing continues after a reset.
+/// Writes go straight to a preallocated slot, so the file never grows.
+///
+
+#include "telemetryspool.h"
+#include "logger.h"
+#include "cborwriter.h"
+#include <LittleFS.h>
+
+static const char* TELEMETRY_SPOOL_PATH = "/telemetry.spool";
+static const char* TELEMETRY_SPOOL_TAIL_PATH = "/telemetry.tail";
+
+TelemetrySpool::TelemetrySpool()
+	: ready(false)
+	, head(1)
+	, tail(1)
+	, messagesSpooled(0)
+	, messagesReleased(0)
+	, messagesOverwritten(0)
+	, corruptSlots(0)
+{
+}
+
+bool TelemetrySpool::begin() {
+	const size_t ringSize = TELEMETRY_SPOOL_SLOTS * SLOT_SIZE;
+	
+	/// We preallocate the whole ring so slot writes never grow the file
+	File file = LittleFS.open(TELEMETRY_SPOOL_PATH, FILE_READ);
+	bool valid = file && file.size() == ringSize;
+	file.close();
+	
+	if (!valid) {
+		file = LittleFS.open(TELEMETRY_SPOOL_PATH, FILE_WRITE);
+		if (!file) {
+			LOG_ERROR("TelemetrySpool: ✗ Cannot create spool file");
+			return false;
+		}
+		
+		uint8_t empty[SLOT_SIZE];
+		memset(empty, 0, sizeof(empty));
+		for (int i = 0; i < TELEMETRY_SPOOL_SLOTS; i++) {
+			file.write(empty, sizeof(empty));
+		}
+		file.close();
+		LittleFS.remove(TELEMETRY_SPOOL_TAIL_PATH);
+		LOG_INFO("TelemetrySpool: Created %d slot spool (%lu KB)", TELEMETRY_SPOOL_SLOTS,
+			(unsigned long)(ringSize / 1024));
+	}
+	
+	/// We continue after the newest slot written; only headers are read here
+	file = LittleFS.open(TELEMETRY_SPOOL_PATH, FILE_READ);
+	if (!file) {
+		return false;
+	}
+	uint32_t newest = 0;
+	for (int i = 0; i < TELEMETRY_SPOOL_SLOTS; i++) {
+		SlotHeader header;
+		file.seek(i * SLOT_SIZE, SeekSet);
+		if (file.read((uint8_t*)&header, sizeof(header)) == sizeof(header) && header.sequence > newest) {
+			newest = header.sequence;
+		}
+	}
+	file.close();
+	this->head = newest + 1;
+	
+	uint32_t released = 1;
+	File tailFile = LittleFS.open(TELEMETRY_SPOOL_TAIL_PATH, FILE_READ);
+	if (tailFile) {
+		tailFile.read((uint8_t*)&released, sizeof(released));
+		tailFile.close();
+	}
+	uint32_t oldest = this->head > TELEMETRY_SPOOL_SLOTS ? this->head - TELEMETRY_SPOOL_SLOTS : 1;
+	this->tail = constrain(released, oldest, this->head);
+	
+	this->ready = true;
+	LOG_INFO("TelemetrySpool: Ready, %lu message(s) waiting", (unsigned long)this->getDepth());
+	return true;
+}
+
+bool TelemetrySpool::push(const uint8_t* payload, size_t length) {
+	if (!this->ready || length > TELEMETRY_MAX_PAYLOAD) {
+		return false;
+	}
+	
+	SlotHeader header;
+	header.sequence = this->head;
+	header.length = (uint16_t)length;
+	header.checksum = updateChecksum(updateChecksum(0xFFFF, (const uint8_t*)&header, 6), payload, length);
+	
+	File file = LittleFS.open(TELEMETRY_SPOOL_PATH, "r+");
+	if (!file) {
+		return false;
+	}
+	file.seek((header.sequence % TELEMETRY_SPOOL_SLOTS) * SLOT_SIZE, SeekSet);
+	bool written = file.write((const uint8_t*)&header, sizeof(header)) == sizeof(header)
+		&& file.write(payload, length) == length;
+	file.close();
+	if (!written) {
+		return false;
+	}
+	
+	/// We keep the newest data; a full ring loses its oldest message
+	this->head++;
+	if (this->head - this->tail > TELEMETRY_SPOOL_SLOTS) {
+		this->tail++;
+		this->messagesOverwritten++;
+	}
+	this->messagesSpooled++;
+	return true;
+}
+
+size_t TelemetrySpool::readBatch(uint8_t* buffer, size_t capacity, int& messages, uint32_t& consumed) {
+	messages = 0;
+	consumed = 0;
+	if (!this->ready || this->head == this->tail || capacity < 3 + TELEMETRY_MAX_PAYLOAD) {
+		return 0;
+	}
+	
+	File file = LittleFS.open(TELEMETRY_SPOOL_PATH, FILE_READ);
+	if (!file) {
+		return 0;
+	}
+	
+	/// We leave room for the largest array header we write (up to 65535 items) and close the gap later
+	size_t length = 3;
+	uint32_t sequence = this->tail;
+	while (sequence != this->head && messages < 0xFFFF) {
+		SlotHeader header;
+		file.seek((sequence % TELEMETRY_SPOOL_SLOTS) * SLOT_SIZE, SeekSet);
+		if (file.read((uint8_t*)&header, sizeof(header)) != sizeof(header)) {
+			break;
+		}
+		
+		bool valid = header.sequence == sequence && header.length <= TELEMETRY_MAX_PAYLOAD;
+		if (valid && length + header.length > capacity) {
+			break;
+		}
+		if (valid) {
+			uint16_t checksum = updateChecksum(0xFFFF, (const uint8_t*)&header, 6);
+			valid = file.read(buffer + length, header.length) == header.length
+				&& updateChecksum(checksum, buffer + length, header.length) == header.checksum;
+		}
+		
+		/// We skip slots a reset interrupted; they are released with the batch
+		if (valid) {
+			length += header.length;
+			messages++;
+		} else {
+			this->corruptSlots++;
+		}
+		sequence++;
+	}
+	file.close();
+	
+	consumed = sequence - this->tail;
+	if (messages == 0) {
+		return 0;
+	}
+	
+	uint8_t arrayHeader[3];
+	CborWriter writer(arrayHeader, sizeof(arrayHeader));
+	writer.beginArray(messages);
+	size_t headerLength = writer.getLength();
+	memmove(buffer + headerLength, buffer + 3, length - 3);
+	memcpy(buffer, arrayHeader, headerLength);
+	return length - 3 + headerLength;
+}
+
+void TelemetrySpool::release(uint32_t count) {
+	count = min(count, this->getDepth());
+	if (count == 0) {
+		return;
+	}
+	this->tail += count;
+	this->messagesReleased += count;
+	this->saveTail();
+}
+
+uint32_t TelemetrySpool::getDepth() const {
+	return this->head - this->tail;
+}
+
+uint32_t TelemetrySpool::getCapacity() const {
+	return TELEMETRY_SPOOL_SLOTS;
+}
+
+unsigned long TelemetrySpool::getMessagesSpooled() const {
+	return this->messagesSpooled;
+}
+
+unsigned long TelemetrySpool::getMessagesReleased() const {
+	return this->messagesReleased;
+}
+
+unsigned long TelemetrySpool::getMessagesOverwritten() const {
+	return this->messagesOverwritten;
+}
+
+unsigned long TelemetrySpool::getCorruptSlots() const {
+	return this->corruptSlots;
+}
+
+void TelemetrySpool::saveTail() {
+	File file = LittleFS.open(TELEMETRY_SPOOL_TAIL_PATH, FILE_WRITE);
+	if (file) {
+		file.write((const uint8_t*)&this->tail, sizeof(this->tail));
+		file.close();
+	}
+}
+
+uint16_t TelemetrySpool::updateChecksum(uint16_t crc, const uint8_t* data, size_t length) {
+	for (size_t i = 0; i < length; i++) {
+		crc ^= (uint16_t)data[i] << 8;
+		for (int bit = 0; bit < 8; bit++) {
+			crc = (crc & 0x8000) ? (crc << 1) ^ 0x1021 : crc << 1;
+		}
+	}
+	return crc;
+}
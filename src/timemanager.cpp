@@ -7,17 +7,23 @@
 ///
 
 #include "timemanager.h"
+#include "logger.h"
 #include "config.h"
 
 TimeManager::TimeManager(const char* ntpServer, int timezoneOffsetHours)
 	: ntpServer(ntpServer)
+	, serverCache(ntpServer, "ntpdns")
 	, timezoneOffsetSeconds(timezoneOffsetHours * 3600)
-	, syncInterval(NTP_UPDATE_INTERVAL_MS)
+	, syncInterval(SNTP_SERVER_ENABLED ? SNTP_MASTER_SYNC_INTERVAL_MS : NTP_UPDATE_INTERVAL_MS)
 	, lastSyncAttempt(0)
 	, lastSuccessfulSync(0)
 	, syncCount(0)
+	, syncFailures(0)
 	, timeValid(false)
+	, syncUtcMillis(0)
+	, syncAnchorMillis(0)
 {
+	this->serverAddress[0] = '\0';
 	/// We create the NTP client with our timezone offset
 	this->ntpClient = new NTPClient(this->ntpUDP, this->ntpServer, this->timezoneOffsetSeconds);
 }
@@ -30,31 +36,29 @@ TimeManager::~TimeManager() {
 void TimeManager::begin() {
 	/// We initialize the NTP client
 	this->ntpClient->begin();
+	this->serverCache.begin();
 	
 	/// We set update interval (how often client fetches internally)
 	this->ntpClient->setUpdateInterval(this->syncInterval);
 	
-	Serial.println("TimeManager: NTP client initialized");
-	Serial.print("NTP server: ");
-	Serial.println(this->ntpServer);
-	Serial.print("Timezone offset: ");
-	Serial.print(this->timezoneOffsetSeconds / 3600);
-	Serial.println(" hours");
+	LOG_INFO("TimeManager: NTP client initialized");
+	LOG_INFO("NTP server: %s", this->ntpServer);
+	LOG_INFO("Timezone offset: %d hours", this->timezoneOffsetSeconds / 3600);
 	
 	/// We attempt initial time sync
 	bool syncResult = this->syncTime();
 	if (!syncResult) {
-		Serial.println("TimeManager: Initial sync failed, will retry later");
+		LOG_WARN("TimeManager: Initial sync failed, will retry later");
 	}
 }
 
 void TimeManager::update() {
 	/// We check if it's time for a sync
 	if (this->needsSync() && this->shouldAttemptSync()) {
-		Serial.println("TimeManager: Performing scheduled sync...");
+		LOG_INFO("TimeManager: Performing scheduled sync...");
 		bool syncResult = this->syncTime();
 		if (!syncResult) {
-			Serial.println("TimeManager: Scheduled sync failed, will retry later");
+			LOG_WARN("TimeManager: Scheduled sync failed, will retry later");
 		}
 	}
 	
@@ -65,25 +69,47 @@ void TimeManager::update() {
 bool TimeManager::syncTime() {
 	this->lastSyncAttempt = millis();
 	
-	Serial.println("TimeManager: Synchronizing with NTP server...");
+	LOG_INFO("TimeManager: Synchronizing with NTP server...");
 	
-	/// We force an update from the NTP client
-	bool success = this->ntpClient->forceUpdate();
+	/// We look the name up only when the cached answer expired; failures keep the old addresses
+	bool haveAddress = this->serverCache.refresh();
+	int attempts = haveAddress ? constrain(this->serverCache.getAddressCount(), 1, NTP_SERVER_ATTEMPTS) : 1;
+	
+	bool success = false;
+	for (int attempt = 0; attempt < attempts && !success; attempt++) {
+		this->selectServer();
+		
+		/// We force an update from the NTP client and time just the request
+		unsigned long startMicros = micros();
+		unsigned long startMillis = millis();
+		success = this->ntpClient->forceUpdate();
+		if (success) {
+			this->ntpRoundTrip.record(micros() - startMicros);
+			this->serverCache.markGood();
+			
+			/// NTPClient drops the fraction, so we take the middle of the server's second,
+			/// and the answer left the server about halfway through our round trip
+			this->syncUtcMillis = (uint64_t)(this->ntpClient->getEpochTime() - this->timezoneOffsetSeconds) * 1000 + 500;
+			this->syncAnchorMillis = startMillis + (millis() - startMillis) / 2;
+		} else {
+			this->syncFailures++;
+			LOG_WARN("TimeManager: No answer from %s", this->serverAddress[0] ? this->serverAddress : this->ntpServer);
+			this->serverCache.rotate();
+		}
+	}
 	
 	if (success) {
 		this->lastSuccessfulSync = millis();
 		this->syncCount++;
 		this->timeValid = true;
 		
-		Serial.println("TimeManager: ✓ Time sync successful");
-		Serial.print("Current time: ");
-		Serial.println(this->getCurrentTimeString());
-		Serial.print("Current date: ");
-		Serial.println(this->getCurrentDateString());
+		LOG_INFO("TimeManager: ✓ Time sync successful");
+		LOG_INFO("Current time: %s", this->getCurrentTimeString().c_str());
+		LOG_INFO("Current date: %s", this->getCurrentDateString().c_str());
 		
 		return true;
 	} else {
-		Serial.println("TimeManager: ✗ Time sync failed");
+		LOG_WARN("TimeManager: ✗ Time sync failed");
 		/// We don't invalidate existing time on failure - keep using last known time
 		return false;
 	}
@@ -107,6 +133,28 @@ int TimeManager::getCurrentMinute() const {
 	return this->ntpClient->getMinutes();
 }
 
+unsigned long TimeManager::getEpochTime() const {
+	if (!this->hasValidTime()) {
+		return 0;
+	}
+	return this->ntpClient->getEpochTime();
+}
+
+uint64_t TimeManager::getUtcMillis() const {
+	if (!this->hasValidTime()) {
+		return 0;
+	}
+	return this->syncUtcMillis + (millis() - this->syncAnchorMillis);
+}
+
+uint64_t TimeManager::getLastSyncUtcMillis() const {
+	return this->syncUtcMillis;
+}
+
+unsigned long TimeManager::getEpochDay() const {
+	return this->getEpochTime() / 86400;
+}
+
 String TimeManager::getCurrentTimeString() const {
 	if (!this->hasValidTime()) {
 		return "No Time Available";
@@ -186,6 +234,33 @@ unsigned long TimeManager::getSyncCount() const {
 	return this->syncCount;
 }
 
+unsigned long TimeManager::getSyncFailures() const {
+	return this->syncFailures;
+}
+
+const DnsCache& TimeManager::getServerCache() const {
+	return this->serverCache;
+}
+
+const LatencyHistogram& TimeManager::getNtpRoundTrip() const {
+	return this->ntpRoundTrip;
+}
+
+void TimeManager::selectServer() {
+	IPAddress address;
+	if (!this->serverCache.getAddress(address)) {
+		/// Without any address NTPClient resolves the name itself, as before
+		this->serverAddress[0] = '\0';
+		this->ntpClient->setPoolServerName(this->ntpServer);
+		return;
+	}
+	
+	/// A dotted quad is parsed by lwIP directly, so NTPClient's beginPacket() makes no DNS query
+	snprintf(this->serverAddress, sizeof(this->serverAddress), "%u.%u.%u.%u",
+		address[0], address[1], address[2], address[3]);
+	this->ntpClient->setPoolServerName(this->serverAddress);
+}
+
 bool TimeManager::shouldAttemptSync() const {
 	/// We don't attempt sync too frequently to avoid overloading NTP servers
 	const unsigned long minSyncInterval = 60000; /// Minimum 1 minute between attempts
@@ -0,0 +1,323 @@
+///
+/// TimeSeriesBlock Implementation
+/// 
+/// Timestamps use the Gorilla delta-of-delta buckets with second
+/// resolution: a steady 2 s cadence costs one bit per sample. Float
+/// values reuse the previous leading/trailing zero window when the XOR
+/// fits inside it, which is the common case for slowly changing light.
+///
+
+#include "timeseriesblock.h"
+
+/// Worst case: '1111' + 32-bit delta-of-delta, and '11' + 5 + 5 + 32 value bits
+static constexpr size_t MAX_SAMPLE_BITS = 36 + 44;
+
+/// Encoding of a delta-of-delta bucket: prefix bits, prefix length, payload length
+struct DeltaBucket {
+	uint8_t prefix;
+	uint8_t prefixLength;
+	uint8_t payloadLength;
+};
+
+static const DeltaBucket DELTA_BUCKETS[] = {
+	{ 0b10, 2, 7 },
+	{ 0b110, 3, 9 },
+	{ 0b1110, 4, 12 }
+};
+
+static void writeUInt16(uint8_t* target, uint16_t value) {
+	target[0] = value & 0xFF;
+	target[1] = value >> 8;
+}
+
+static void writeUInt32(uint8_t* target, uint32_t value) {
+	for (int i = 0; i < 4; i++) {
+		target[i] = (value >> (i * 8)) & 0xFF;
+	}
+}
+
+static uint16_t readUInt16(const uint8_t* source) {
+	return source[0] | (source[1] << 8);
+}
+
+static uint32_t readUInt32(const uint8_t* source) {
+	return (uint32_t)source[0] | ((uint32_t)source[1] << 8) | ((uint32_t)source[2] << 16) | ((uint32_t)source[3] << 24);
+}
+
+/// We map a column bit position to its byte: timestamps forward, values backward
+static size_t columnByte(bool valueColumn, size_t position) {
+	return valueColumn
+		? TimeSeriesBlock::BLOCK_SIZE - 1 - position / 8
+		: TimeSeriesBlock::HEADER_SIZE + position / 8;
+}
+
+TimeSeriesBlock::TimeSeriesBlock()
+	: type(TimeSeriesType::FloatXor)
+	, count(0)
+	, firstTimestamp(0)
+	, lastTimestamp(0)
+	, lastDelta(0)
+	, lastValue(0)
+	, lastLeading(0xFF)
+	, lastTrailing(0)
+	, timeBits(0)
+	, valueBits(0)
+{
+	this->reset(TimeSeriesType::FloatXor);
+}
+
+void TimeSeriesBlock::reset(TimeSeriesType type) {
+	memset(this->data, 0, sizeof(this->data));
+	this->type = type;
+	this->count = 0;
+	this->firstTimestamp = 0;
+	this->lastTimestamp = 0;
+	this->lastDelta = 0;
+	this->lastValue = 0;
+	this->lastLeading = 0xFF;
+	this->lastTrailing = 0;
+	this->timeBits = 0;
+	this->valueBits = 0;
+	this->writeHeader();
+}
+
+bool TimeSeriesBlock::append(uint32_t timestamp, uint32_t value) {
+	/// We check against the worst case so a sample is never split across blocks
+	if (HEADER_SIZE * 8 + this->timeBits + this->valueBits + MAX_SAMPLE_BITS > BLOCK_SIZE * 8) {
+		return false;
+	}
+	
+	if (this->count == 0) {
+		/// We keep the first timestamp in the header and the first value verbatim
+		this->firstTimestamp = timestamp;
+		this->writeBits(true, value, this->type == TimeSeriesType::FloatXor ? 32 : 8);
+	} else {
+		this->encodeTimestamp(timestamp);
+		this->encodeValue(value);
+	}
+	
+	this->lastTimestamp = timestamp;
+	this->lastValue = value;
+	this->count++;
+	this->writeHeader();
+	return true;
+}
+
+const uint8_t* TimeSeriesBlock::getData() const {
+	return this->data;
+}
+
+uint16_t TimeSeriesBlock::getCount() const {
+	return this->count;
+}
+
+uint32_t TimeSeriesBlock::getFirstTimestamp() const {
+	return this->firstTimestamp;
+}
+
+uint32_t TimeSeriesBlock::getLastTimestamp() const {
+	return this->lastTimestamp;
+}
+
+size_t TimeSeriesBlock::getUsedBits() const {
+	return this->timeBits + this->valueBits;
+}
+
+bool TimeSeriesBlock::isValid(const uint8_t* data) {
+	if (data[0] != MAGIC || readUInt16(data + 2) == 0) {
+		return false;
+	}
+	
+	TimeSeriesType type = (TimeSeriesType)data[1];
+	if (type != TimeSeriesType::FloatXor && type != TimeSeriesType::SmallInt) {
+		return false;
+	}
+	
+	return HEADER_SIZE * 8 + readUInt16(data + 8) + readUInt16(data + 10) <= BLOCK_SIZE * 8;
+}
+
+uint32_t TimeSeriesBlock::readFirstTimestamp(const uint8_t* data) {
+	return readUInt32(data + 4);
+}
+
+size_t TimeSeriesBlock::getColumnBytes(const uint8_t* data, bool valueColumn) {
+	return (readUInt16(data + (valueColumn ? 10 : 8)) + 7) / 8;
+}
+
+void TimeSeriesBlock::encodeTimestamp(uint32_t timestamp) {
+	int32_t delta = (int32_t)(timestamp - this->lastTimestamp);
+	int32_t deltaOfDelta = delta - this->lastDelta;
+	this->lastDelta = delta;
+	
+	if (deltaOfDelta == 0) {
+		this->writeBits(false, 0, 1);
+		return;
+	}
+	
+	for (const DeltaBucket& bucket : DELTA_BUCKETS) {
+		int32_t bias = (1 << (bucket.payloadLength - 1)) - 1;
+		if (deltaOfDelta >= -bias && deltaOfDelta <= bias + 1) {
+			this->writeBits(false, bucket.prefix, bucket.prefixLength);
+			this->writeBits(false, (uint32_t)(deltaOfDelta + bias), bucket.payloadLength);
+			return;
+		}
+	}
+	
+	this->writeBits(false, 0b1111, 4);
+	this->writeBits(false, (uint32_t)deltaOfDelta, 32);
+}
+
+void TimeSeriesBlock::encodeValue(uint32_t value) {
+	if (this->type == TimeSeriesType::SmallInt) {
+		if (value == this->lastValue) {
+			this->writeBits(true, 0, 1);
+		} else {
+			this->writeBits(true, 1, 1);
+			this->writeBits(true, value & 0xFF, 8);
+		}
+		return;
+	}
+	
+	uint32_t xorValue = value ^ this->lastValue;
+	if (xorValue == 0) {
+		this->writeBits(true, 0, 1);
+		return;
+	}
+	
+	uint8_t leading = min(__builtin_clz(xorValue), 31);
+	uint8_t trailing = __builtin_ctz(xorValue);
+	
+	if (this->lastLeading != 0xFF && leading >= this->lastLeading && trailing >= this->lastTrailing) {
+		/// We reuse the previous window and only send its meaningful bits
+		uint8_t length = 32 - this->lastLeading - this->lastTrailing;
+		this->writeBits(true, 0b10, 2);
+		this->writeBits(true, xorValue >> this->lastTrailing, length);
+		return;
+	}
+	
+	uint8_t length = 32 - leading - trailing;
+	this->writeBits(true, 0b11, 2);
+	this->writeBits(true, leading, 5);
+	this->writeBits(true, length - 1, 5);
+	this->writeBits(true, xorValue >> trailing, length);
+	this->lastLeading = leading;
+	this->lastTrailing = trailing;
+}
+
+void TimeSeriesBlock::writeHeader() {
+	this->data[0] = MAGIC;
+	this->data[1] = (uint8_t)this->type;
+	writeUInt16(this->data + 2, this->count);
+	writeUInt32(this->data + 4, this->firstTimestamp);
+	writeUInt16(this->data + 8, this->timeBits);
+	writeUInt16(this->data + 10, this->valueBits);
+}
+
+void TimeSeriesBlock::writeBits(bool valueColumn, uint32_t bits, uint8_t length) {
+	size_t& position = valueColumn ? this->valueBits : this->timeBits;
+	for (int bit = length - 1; bit >= 0; bit--) {
+		if ((bits >> bit) & 1) {
+			this->data[columnByte(valueColumn, position)] |= 0x80 >> (position % 8);
+		}
+		position++;
+	}
+}
+
+TimeSeriesBlockReader::TimeSeriesBlockReader(const uint8_t* data)
+	: data(data)
+	, type(TimeSeriesType::FloatXor)
+	, count(0)
+	, index(0)
+	, lastTimestamp(0)
+	, lastDelta(0)
+	, lastValue(0)
+	, lastLeading(0xFF)
+	, lastTrailing(0)
+	, timePosition(0)
+	, valuePosition(0)
+{
+	if (data) {
+		this->reset(data);
+	}
+}
+
+void TimeSeriesBlockReader::reset(const uint8_t* data) {
+	/// We decode lazily in next()
+	this->data = data;
+	this->type = (TimeSeriesType)data[1];
+	this->count = TimeSeriesBlock::isValid(data) ? readUInt16(data + 2) : 0;
+	this->index = 0;
+	this->lastTimestamp = readUInt32(data + 4);
+	this->lastDelta = 0;
+	this->lastValue = 0;
+	this->lastLeading = 0xFF;
+	this->lastTrailing = 0;
+	this->timePosition = 0;
+	this->valuePosition = 0;
+}
+
+bool TimeSeriesBlockReader::next(uint32_t& timestamp, uint32_t& value) {
+	if (this->index >= this->count) {
+		return false;
+	}
+	
+	if (this->index == 0) {
+		this->lastValue = this->readBits(true, this->type == TimeSeriesType::FloatXor ? 32 : 8);
+	} else {
+		/// We decode the delta-of-delta prefix: count leading ones up to four
+		int ones = 0;
+		while (ones < 4 && this->readBits(false, 1)) {
+			ones++;
+		}
+		
+		int32_t deltaOfDelta = 0;
+		if (ones == 4) {
+			deltaOfDelta = (int32_t)this->readBits(false, 32);
+		} else if (ones > 0) {
+			const DeltaBucket& bucket = DELTA_BUCKETS[ones - 1];
+			int32_t bias = (1 << (bucket.payloadLength - 1)) - 1;
+			deltaOfDelta = (int32_t)this->readBits(false, bucket.payloadLength) - bias;
+		}
+		this->lastDelta += deltaOfDelta;
+		this->lastTimestamp += this->lastDelta;
+		
+		if (this->type == TimeSeriesType::SmallInt) {
+			if (this->readBits(true, 1)) {
+				this->lastValue = this->readBits(true, 8);
+			}
+		} else if (this->readBits(true, 1)) {
+			if (this->readBits(true, 1)) {
+				this->lastLeading = this->readBits(true, 5);
+				uint8_t length = this->readBits(true, 5) + 1;
+				this->lastTrailing = 32 - this->lastLeading - length;
+				this->lastValue ^= this->readBits(true, length) << this->lastTrailing;
+			} else {
+				uint8_t length = 32 - this->lastLeading - this->lastTrailing;
+				this->lastValue ^= this->readBits(true, length) << this->lastTrailing;
+			}
+		}
+	}
+	
+	this->index++;
+	timestamp = this->lastTimestamp;
+	value = this->lastValue;
+	return true;
+}
+
+TimeSeriesType TimeSeriesBlockReader::getType() const {
+	return this->type;
+}
+
+uint16_t TimeSeriesBlockReader::getCount() const {
+	return this->count;
+}
+
+uint32_t TimeSeriesBlockReader::readBits(bool valueColumn, uint8_t length) {
+	size_t& position = valueColumn ? this->valuePosition : this->timePosition;
+	uint32_t bits = 0;
+	for (uint8_t i = 0; i < length; i++) {
+		bits = (bits << 1) | ((this->data[columnByte(valueColumn, position)] >> (7 - position % 8)) & 1);
+		position++;
+	}
+	return bits;
+}
@@ -0,0 +1,178 @@
+///
+/// TimeSeriesQuery Implementation
+/// 
+/// We assume timestamps never decrease within a series, which holds as
+/// long as NTP does not step the clock backwards; a step only makes the
+/// query start or stop one block early.
+///
+
+#include "timeseriesquery.h"
+#include <LittleFS.h>
+
+TimeSeriesQuery::TimeSeriesQuery(const TimeSeriesStore* store)
+	: store(store)
+	, reader()
+	, series(TimeSeries::Lux)
+	, from(0)
+	, to(0)
+	, segment(0)
+	, blockIndex(0)
+	, readingOpenBlock(false)
+	, done(true)
+	, blocksRead(0)
+	, headerReads(0)
+{
+	memset(this->buffer, 0, sizeof(this->buffer));
+	this->reader.reset(this->buffer);
+}
+
+void TimeSeriesQuery::begin(TimeSeries series, uint32_t from, uint32_t to) {
+	this->series = series;
+	this->from = from;
+	this->to = to;
+	this->readingOpenBlock = false;
+	this->done = from > to;
+	this->blocksRead = 0;
+	this->headerReads = 0;
+	
+	/// We start with an empty reader; the first next() loads the start block
+	memset(this->buffer, 0, TimeSeriesBlock::HEADER_SIZE);
+	this->reader.reset(this->buffer);
+	
+	this->segment = this->store->findSegment(series, from);
+	this->seekWithinSegment();
+}
+
+bool TimeSeriesQuery::next(uint32_t& timestamp, uint32_t& value) {
+	while (!this->done) {
+		if (!this->reader.next(timestamp, value)) {
+			if (!this->loadNextBlock()) {
+				this->done = true;
+			}
+			continue;
+		}
+		
+		if (timestamp < this->from) {
+			continue;
+		}
+		if (timestamp > this->to) {
+			this->done = true;
+			break;
+		}
+		return true;
+	}
+	return false;
+}
+
+const uint8_t* TimeSeriesQuery::nextBlock() {
+	if (this->done || !this->loadNextBlock() || this->reader.getCount() == 0) {
+		this->done = true;
+		return nullptr;
+	}
+	
+	/// Blocks are in time order, so the first one starting after the range ends the query
+	if (TimeSeriesBlock::readFirstTimestamp(this->buffer) > this->to) {
+		this->done = true;
+		return nullptr;
+	}
+	return this->buffer;
+}
+
+bool TimeSeriesQuery::isDone() const {
+	return this->done;
+}
+
+unsigned long TimeSeriesQuery::getBlocksRead() const {
+	return this->blocksRead;
+}
+
+unsigned long TimeSeriesQuery::getHeaderReads() const {
+	return this->headerReads;
+}
+
+float TimeSeriesQuery::toFloat(uint32_t value) {
+	float result;
+	memcpy(&result, &value, sizeof(result));
+	return result;
+}
+
+bool TimeSeriesQuery::loadNextBlock() {
+	if (this->readingOpenBlock) {
+		return false;
+	}
+	
+	while (true) {
+		/// We skip segments that retention deleted while the query was running
+		if (this->segment < this->store->getFirstSegment(this->series)) {
+			this->segment = this->store->getFirstSegment(this->series);
+			this->blockIndex = 0;
+		}
+		
+		if (this->readBlock(this->segment, this->blockIndex)) {
+			this->blockIndex++;
+			break;
+		}
+		
+		if (this->segment >= this->store->getLastSegment(this->series)) {
+			/// We finish with the samples that have not reached flash yet
+			memcpy(this->buffer, this->store->getOpenBlock(this->series).getData(), TimeSeriesBlock::BLOCK_SIZE);
+			this->readingOpenBlock = true;
+			break;
+		}
+		
+		this->segment++;
+		this->blockIndex = 0;
+	}
+	
+	this->blocksRead++;
+	this->reader.reset(this->buffer);
+	return true;
+}
+
+void TimeSeriesQuery::seekWithinSegment() {
+	this->blockIndex = 0;
+	
+	char path[40];
+	TimeSeriesStore::formatSegmentPath(this->series, this->segment, path, sizeof(path));
+	File file = LittleFS.open(path, FILE_READ);
+	if (!file) {
+		return;
+	}
+	
+	/// We look for the last block that starts at or before the range start
+	uint8_t header[TimeSeriesBlock::HEADER_SIZE];
+	int low = 0;
+	int high = (int)(file.size() / TimeSeriesBlock::BLOCK_SIZE) - 1;
+	while (low < high) {
+		int middle = low + (high - low + 1) / 2;
+		file.seek((size_t)middle * TimeSeriesBlock::BLOCK_SIZE, SeekSet);
+		bool valid = file.read(header, sizeof(header)) == sizeof(header) && TimeSeriesBlock::isValid(header);
+		this->headerReads++;
+		
+		if (valid && TimeSeriesBlock::readFirstTimestamp(header) <= this->from) {
+			low = middle;
+		} else {
+			high = middle - 1;
+		}
+	}
+	file.close();
+	
+	this->blockIndex = max(low, 0);
+}
+
+bool TimeSeriesQuery::readBlock(uint32_t segment, uint16_t block) {
+	char path[40];
+	TimeSeriesStore::formatSegmentPath(this->series, segment, path, sizeof(path));
+	File file = LittleFS.open(path, FILE_READ);
+	if (!file) {
+		return false;
+	}
+	
+	size_t offset = (size_t)block * TimeSeriesBlock::BLOCK_SIZE;
+	bool ok = offset + TimeSeriesBlock::BLOCK_SIZE <= file.size()
+		&& file.seek(offset, SeekSet)
+		&& file.read(this->buffer, TimeSeriesBlock::BLOCK_SIZE) == TimeSeriesBlock::BLOCK_SIZE;
+	file.close();
+	
+	return ok && TimeSeriesBlock::isValid(this->buffer);
+}
@@ -0,0 +1,472 @@
+///
+/// TimeSeriesStore Implementation
+/// 
+/// Segment files live in /ts and are named <series>-<number>.seg. A
+/// segment is always a whole number of blocks, so block n of a segment
+/// starts at n * TSDB_BLOCK_SIZE.
+///
+
+#include "timeseriesstore.h"
+#include "logger.h"
+#include <LittleFS.h>
+
+static const char* TSDB_DIRECTORY = "/ts";
+
+/// LittleFS erase block size on the ESP32 flash
+static constexpr size_t FS_BLOCK_SIZE = 4096;
+
+TimeSeriesStore::TimeSeriesStore(TimeManager* timeManager)
+	: timeManager(timeManager)
+	, storageReady(false)
+	, relayKnown(false)
+	, lastRelayState(false)
+	, skippedSamples(0)
+	, writeErrors(0)
+	, segmentsDeleted(0)
+{
+	for (int i = 0; i < SERIES_COUNT; i++) {
+		this->series[i].block.reset(getSeriesType((TimeSeries)i));
+		this->series[i].firstSegment = 1;
+		this->series[i].lastSegment = 1;
+		this->series[i].blocksInSegment = 0;
+		this->series[i].sampleCount = 0;
+		this->series[i].blocksWritten = 0;
+		this->series[i].savedCount = 0;
+		this->series[i].dirtySince = 0;
+		memset(this->series[i].segmentStart, 0, sizeof(this->series[i].segmentStart));
+	}
+}
+
+void TimeSeriesStore::begin() {
+	if (!LittleFS.exists(TSDB_DIRECTORY) && !LittleFS.mkdir(TSDB_DIRECTORY)) {
+		LOG_ERROR("✗ Time-series store: cannot create directory");
+		return;
+	}
+	
+	this->scanSegments();
+	this->loadIndex();
+	this->storageReady = true;
+	this->loadOpenBlocks();
+	
+	const SeriesState& lux = this->series[(int)TimeSeries::Lux];
+	LOG_INFO("✓ Time-series store ready: %lu lux segments, %lu KB free",
+		(unsigned long)(lux.lastSegment - lux.firstSegment + (lux.blocksInSegment > 0 ? 1 : 0)),
+		(unsigned long)((LittleFS.totalBytes() - LittleFS.usedBytes()) / 1024));
+}
+
+void TimeSeriesStore::addLux(float lux) {
+	/// We drop low mantissa bits so that the XOR of neighbouring readings has long zero runs
+	uint32_t raw;
+	memcpy(&raw, &lux, sizeof(raw));
+	raw &= ~((1UL << (23 - TSDB_LUX_MANTISSA_BITS)) - 1);
+	this->appendSample(TimeSeries::Lux, raw);
+}
+
+void TimeSeriesStore::addRelayState(bool on) {
+	if (this->relayKnown && on == this->lastRelayState) {
+		return;
+	}
+	
+	/// We only remember the state once it is actually stored
+	if (this->timeManager && this->timeManager->hasValidTime()) {
+		this->relayKnown = true;
+		this->lastRelayState = on;
+	}
+	this->appendSample(TimeSeries::Relay, on ? 1 : 0);
+}
+
+void TimeSeriesStore::addDecision(ControlDecision decision, ControlReason reason) {
+	this->appendSample(TimeSeries::Decision, ((uint8_t)decision << 4) | ((uint8_t)reason & 0x0F));
+}
+
+void TimeSeriesStore::update() {
+	for (int i = 0; i < SERIES_COUNT; i++) {
+		const SeriesState& state = this->series[i];
+		if (state.block.getCount() > state.savedCount && millis() - state.dirtySince >= TSDB_FLUSH_INTERVAL_MS) {
+			this->saveOpenBlock((TimeSeries)i);
+			return;
+		}
+	}
+}
+
+void TimeSeriesStore::flush() {
+	for (int i = 0; i < SERIES_COUNT; i++) {
+		if (this->series[i].block.getCount() > this->series[i].savedCount) {
+			this->saveOpenBlock((TimeSeries)i);
+		}
+	}
+}
+
+const char* TimeSeriesStore::getSeriesName(TimeSeries series) {
+	switch (series) {
+		case TimeSeries::Lux: return "lux";
+		case TimeSeries::Relay: return "relay";
+		case TimeSeries::Decision: return "decision";
+		default: return "unknown";
+	}
+}
+
+bool TimeSeriesStore::parseSeriesName(const char* name, TimeSeries& series) {
+	for (int i = 0; i < SERIES_COUNT; i++) {
+		if (strcmp(name, getSeriesName((TimeSeries)i)) == 0) {
+			series = (TimeSeries)i;
+			return true;
+		}
+	}
+	return false;
+}
+
+void TimeSeriesStore::formatSegmentPath(TimeSeries series, uint32_t segment, char* buffer, size_t size) {
+	snprintf(buffer, size, "%s/%s-%08lu.seg", TSDB_DIRECTORY, getSeriesName(series), (unsigned long)segment);
+}
+
+void TimeSeriesStore::formatOpenBlockPath(TimeSeries series, char* buffer, size_t size) {
+	snprintf(buffer, size, "%s/%s.open", TSDB_DIRECTORY, getSeriesName(series));
+}
+
+uint32_t TimeSeriesStore::getFirstSegment(TimeSeries series) const {
+	return this->series[(int)series].firstSegment;
+}
+
+uint32_t TimeSeriesStore::getLastSegment(TimeSeries series) const {
+	return this->series[(int)series].lastSegment;
+}
+
+uint32_t TimeSeriesStore::findSegment(TimeSeries series, uint32_t timestamp) const {
+	const SeriesState& state = this->series[(int)series];
+	
+	/// We look for the last segment that starts at or before the timestamp
+	uint32_t low = state.firstSegment;
+	uint32_t high = state.blocksInSegment > 0 ? state.lastSegment : state.lastSegment - 1;
+	if (high < low || state.segmentStart[low % TSDB_INDEX_SEGMENTS] > timestamp) {
+		return state.firstSegment;
+	}
+	
+	while (low < high) {
+		uint32_t middle = low + (high - low + 1) / 2;
+		if (state.segmentStart[middle % TSDB_INDEX_SEGMENTS] <= timestamp) {
+			low = middle;
+		} else {
+			high = middle - 1;
+		}
+	}
+	return low;
+}
+
+uint32_t TimeSeriesStore::getSegmentStart(TimeSeries series, uint32_t segment) const {
+	return this->series[(int)series].segmentStart[segment % TSDB_INDEX_SEGMENTS];
+}
+
+const TimeSeriesBlock& TimeSeriesStore::getOpenBlock(TimeSeries series) const {
+	return this->series[(int)series].block;
+}
+
+unsigned long TimeSeriesStore::getSampleCount(TimeSeries series) const {
+	return this->series[(int)series].sampleCount;
+}
+
+unsigned long TimeSeriesStore::getSkippedSamples() const {
+	return this->skippedSamples;
+}
+
+unsigned long TimeSeriesStore::getBlocksWritten() const {
+	unsigned long total = 0;
+	for (int i = 0; i < SERIES_COUNT; i++) {
+		total += this->series[i].blocksWritten;
+	}
+	return total;
+}
+
+unsigned long TimeSeriesStore::getBytesWritten() const {
+	return this->getBlocksWritten() * TSDB_BLOCK_SIZE;
+}
+
+unsigned long TimeSeriesStore::getWriteErrors() const {
+	return this->writeErrors;
+}
+
+bool TimeSeriesStore::isStorageReady() const {
+	return this->storageReady;
+}
+
+unsigned long TimeSeriesStore::getSegmentsDeleted() const {
+	return this->segmentsDeleted;
+}
+
+float TimeSeriesStore::getBytesPerSample() const {
+	const SeriesState& lux = this->series[(int)TimeSeries::Lux];
+	if (lux.sampleCount == 0) {
+		return 0.0f;
+	}
+	
+	/// We count written blocks in full and the open block by the bits it actually uses
+	float bytes = lux.blocksWritten * (float)TSDB_BLOCK_SIZE
+		+ TimeSeriesBlock::HEADER_SIZE + lux.block.getUsedBits() / 8.0f;
+	return bytes / lux.sampleCount;
+}
+
+float TimeSeriesStore::getBytesPerDay() const {
+	const float samplesPerDay = 86400000.0f / SENSOR_READ_INTERVAL_MS;
+	return this->getBytesPerSample() * samplesPerDay;
+}
+
+float TimeSeriesStore::getEstimatedRetentionDays() const {
+	float bytesPerDay = this->getBytesPerDay();
+	size_t totalBytes = LittleFS.totalBytes();
+	if (bytesPerDay <= 0.0f || totalBytes <= TSDB_MIN_FREE_BYTES) {
+		return 0.0f;
+	}
+	return (totalBytes - TSDB_MIN_FREE_BYTES) / bytesPerDay;
+}
+
+float TimeSeriesStore::getWearCyclesPerDay() const {
+	size_t fsBlocks = LittleFS.totalBytes() / FS_BLOCK_SIZE;
+	if (fsBlocks == 0) {
+		return 0.0f;
+	}
+	
+	float appendsPerDay = this->getBytesPerDay() / TSDB_BLOCK_SIZE;
+	float programmedPerDay = appendsPerDay * (TSDB_BLOCK_SIZE + FS_BLOCK_SIZE);
+	return programmedPerDay / FS_BLOCK_SIZE / fsBlocks;
+}
+
+void TimeSeriesStore::appendSample(TimeSeries series, uint32_t value) {
+	/// We cannot place samples on the time axis without a valid clock
+	if (!this->timeManager || !this->timeManager->hasValidTime()) {
+		this->skippedSamples++;
+		return;
+	}
+	
+	SeriesState& state = this->series[(int)series];
+	uint32_t timestamp = this->timeManager->getEpochTime();
+	
+	if (!state.block.append(timestamp, value)) {
+		this->writeBlock(series);
+		(void)state.block.append(timestamp, value);
+	}
+	if (state.block.getCount() == state.savedCount + 1) {
+		state.dirtySince = millis();
+	}
+	state.sampleCount++;
+}
+
+void TimeSeriesStore::writeBlock(TimeSeries series) {
+	SeriesState& state = this->series[(int)series];
+	
+	if (this->storageReady) {
+		if (state.blocksInSegment >= TSDB_SEGMENT_BLOCKS) {
+			state.lastSegment++;
+			state.blocksInSegment = 0;
+		}
+		this->enforceRetention();
+		
+		if (state.blocksInSegment == 0) {
+			state.segmentStart[state.lastSegment % TSDB_INDEX_SEGMENTS] = state.block.getFirstTimestamp();
+		}
+		
+		char path[40];
+		formatSegmentPath(series, state.lastSegment, path, sizeof(path));
+		
+		/// We append the whole block in one write so flash sees a single program
+		File file = LittleFS.open(path, FILE_APPEND);
+		size_t written = file ? file.write(state.block.getData(), TSDB_BLOCK_SIZE) : 0;
+		if (file) {
+			file.close();
+		}
+		
+		if (written == TSDB_BLOCK_SIZE) {
+			state.blocksInSegment++;
+			state.blocksWritten++;
+		} else {
+			/// We start a fresh segment so a torn write never breaks block alignment
+			this->writeErrors++;
+			state.lastSegment++;
+			state.blocksInSegment = 0;
+		}
+	}
+	
+	/// The sealed block supersedes its checkpoint
+	if (state.savedCount > 0) {
+		char path[40];
+		formatOpenBlockPath(series, path, sizeof(path));
+		LittleFS.remove(path);
+		state.savedCount = 0;
+	}
+	
+	state.block.reset(getSeriesType(series));
+}
+
+void TimeSeriesStore::saveOpenBlock(TimeSeries series) {
+	SeriesState& state = this->series[(int)series];
+	if (!this->storageReady) {
+		return;
+	}
+	
+	/// We leave out the unused bytes between the columns, as /api/export does
+	const uint8_t* data = state.block.getData();
+	size_t timeBytes = TimeSeriesBlock::HEADER_SIZE + TimeSeriesBlock::getColumnBytes(data, false);
+	size_t valueBytes = TimeSeriesBlock::getColumnBytes(data, true);
+	
+	char path[40];
+	formatOpenBlockPath(series, path, sizeof(path));
+	File file = LittleFS.open(path, FILE_WRITE);
+	size_t written = 0;
+	if (file) {
+		written = file.write(data, timeBytes);
+		written += file.write(data + TSDB_BLOCK_SIZE - valueBytes, valueBytes);
+		file.close();
+	}
+	
+	if (written == timeBytes + valueBytes) {
+		state.savedCount = state.block.getCount();
+	} else {
+		this->writeErrors++;
+	}
+}
+
+void TimeSeriesStore::loadOpenBlocks() {
+	static uint8_t image[TSDB_BLOCK_SIZE];
+	char path[40];
+	
+	for (int i = 0; i < SERIES_COUNT; i++) {
+		formatOpenBlockPath((TimeSeries)i, path, sizeof(path));
+		if (!LittleFS.exists(path)) {
+			continue;
+		}
+		
+		/// We put the two columns back at their ends of the block
+		memset(image, 0, sizeof(image));
+		File file = LittleFS.open(path, FILE_READ);
+		bool valid = file && file.read(image, TimeSeriesBlock::HEADER_SIZE) == TimeSeriesBlock::HEADER_SIZE
+			&& TimeSeriesBlock::isValid(image);
+		if (valid) {
+			size_t timeBytes = TimeSeriesBlock::getColumnBytes(image, false);
+			size_t valueBytes = TimeSeriesBlock::getColumnBytes(image, true);
+			valid = file.size() == TimeSeriesBlock::HEADER_SIZE + timeBytes + valueBytes
+				&& file.read(image + TimeSeriesBlock::HEADER_SIZE, timeBytes) == timeBytes
+				&& file.read(image + TSDB_BLOCK_SIZE - valueBytes, valueBytes) == valueBytes;
+		}
+		if (file) {
+			file.close();
+		}
+		if (!valid) {
+			LittleFS.remove(path);
+			continue;
+		}
+		
+		/// Re-appending the samples also restores the encoder state
+		SeriesState& state = this->series[i];
+		TimeSeriesBlockReader reader(image);
+		uint32_t timestamp;
+		uint32_t value;
+		while (reader.next(timestamp, value)) {
+			(void)state.block.append(timestamp, value);
+		}
+		state.savedCount = state.block.getCount();
+	}
+}
+
+void TimeSeriesStore::enforceRetention() {
+	/// We keep every series within the ring of index slots
+	for (int i = 0; i < SERIES_COUNT; i++) {
+		while (this->series[i].lastSegment - this->series[i].firstSegment >= TSDB_INDEX_SEGMENTS - 1) {
+			this->deleteOldestSegment(i);
+		}
+	}
+	
+	while (LittleFS.totalBytes() - LittleFS.usedBytes() < TSDB_MIN_FREE_BYTES) {
+		/// We trim the series holding the most segments; that is lux in practice
+		int victim = -1;
+		uint32_t mostSegments = 0;
+		for (int i = 0; i < SERIES_COUNT; i++) {
+			uint32_t closedSegments = this->series[i].lastSegment - this->series[i].firstSegment;
+			if (closedSegments > mostSegments) {
+				mostSegments = closedSegments;
+				victim = i;
+			}
+		}
+		
+		if (victim < 0) {
+			return;
+		}
+		
+		this->deleteOldestSegment(victim);
+	}
+}
+
+void TimeSeriesStore::deleteOldestSegment(int series) {
+	char path[40];
+	formatSegmentPath((TimeSeries)series, this->series[series].firstSegment, path, sizeof(path));
+	LittleFS.remove(path);
+	this->series[series].firstSegment++;
+	this->segmentsDeleted++;
+}
+
+void TimeSeriesStore::scanSegments() {
+	bool found[SERIES_COUNT] = { false, false, false };
+	
+	File directory = LittleFS.open(TSDB_DIRECTORY);
+	File entry = directory.openNextFile();
+	while (entry) {
+		const char* name = entry.name();
+		const char* slash = strrchr(name, '/');
+		name = slash ? slash + 1 : name;
+		
+		for (int i = 0; i < SERIES_COUNT; i++) {
+			const char* prefix = getSeriesName((TimeSeries)i);
+			size_t prefixLength = strlen(prefix);
+			if (strncmp(name, prefix, prefixLength) != 0 || name[prefixLength] != '-') {
+				continue;
+			}
+			
+			uint32_t segment = strtoul(name + prefixLength + 1, nullptr, 10);
+			SeriesState& state = this->series[i];
+			if (!found[i] || segment < state.firstSegment) {
+				state.firstSegment = segment;
+			}
+			if (!found[i] || segment >= state.lastSegment) {
+				state.lastSegment = segment;
+				state.blocksInSegment = entry.size() / TSDB_BLOCK_SIZE;
+				
+				/// We never append behind a torn block
+				if (entry.size() % TSDB_BLOCK_SIZE != 0) {
+					state.blocksInSegment = TSDB_SEGMENT_BLOCKS;
+				}
+			}
+			found[i] = true;
+		}
+		
+		entry = directory.openNextFile();
+	}
+}
+
+void TimeSeriesStore::loadIndex() {
+	uint8_t header[TimeSeriesBlock::HEADER_SIZE];
+	char path[40];
+	
+	for (int i = 0; i < SERIES_COUNT; i++) {
+		SeriesState& state = this->series[i];
+		
+		/// We delete anything beyond the index ring before reading headers
+		while (state.lastSegment - state.firstSegment >= TSDB_INDEX_SEGMENTS) {
+			this->deleteOldestSegment(i);
+		}
+		
+		for (uint32_t segment = state.firstSegment; segment <= state.lastSegment; segment++) {
+			formatSegmentPath((TimeSeries)i, segment, path, sizeof(path));
+			File file = LittleFS.open(path, FILE_READ);
+			bool valid = file && file.read(header, sizeof(header)) == sizeof(header) && TimeSeriesBlock::isValid(header);
+			if (file) {
+				file.close();
+			}
+			
+			/// We carry the previous start across missing segments so the index stays sorted
+			uint32_t previous = segment > state.firstSegment ? state.segmentStart[(segment - 1) % TSDB_INDEX_SEGMENTS] : 0;
+			state.segmentStart[segment % TSDB_INDEX_SEGMENTS] = valid ? TimeSeriesBlock::readFirstTimestamp(header) : previous;
+		}
+	}
+}
+
+TimeSeriesType TimeSeriesStore::getSeriesType(TimeSeries series) {
+	return series == TimeSeries::Lux ? TimeSeriesType::FloatXor : TimeSeriesType::SmallInt;
+}
@@ -0,0 +1,363 @@
+///
+/// TlsClient Implementation
+/// 
+/// mbedtls does not tell us after the fact whether a session was resumed,
+/// but it only verifies certificates during a full handshake. So our
+/// verify callback, which only records that it ran, tells the two kinds
+/// apart.
+///
+
+#include "tlsclient.h"
+#include "logger.h"
+#include <LittleFS.h>
+#include <mbedtls/net_sockets.h>
+
+TlsClient::TlsClient()
+	: configured(false)
+	, established(false)
+	, sessionCached(false)
+	, peeked(-1)
+	, certificateChecked(false)
+	, waitMs(0)
+	, handshakeBytes(0)
+	, fullHandshakes(0)
+	, resumedHandshakes(0)
+	, failedHandshakes(0)
+	, handshakeMsTotal(0)
+	, handshakeCpuMsTotal(0)
+	, lastHandshake()
+{
+	mbedtls_entropy_init(&this->entropy);
+	mbedtls_ctr_drbg_init(&this->drbg);
+	mbedtls_x509_crt_init(&this->caCert);
+	mbedtls_ssl_config_init(&this->config);
+	mbedtls_ssl_init(&this->ssl);
+	mbedtls_ssl_session_init(&this->session);
+}
+
+TlsClient::~TlsClient() {
+	this->stop();
+	mbedtls_ssl_session_free(&this->session);
+	mbedtls_ssl_free(&this->ssl);
+	mbedtls_ssl_config_free(&this->config);
+	mbedtls_x509_crt_free(&this->caCert);
+	mbedtls_ctr_drbg_free(&this->drbg);
+	mbedtls_entropy_free(&this->entropy);
+}
+
+bool TlsClient::begin(const char* caCertPath) {
+	if (this->configured) {
+		return true;
+	}
+	
+	/// We parse the CA once; mbedtls wants PEM with its terminating NUL
+	File file = LittleFS.open(caCertPath, FILE_READ);
+	if (!file) {
+		LOG_ERROR("TlsClient: ✗ CA certificate %s not found", caCertPath);
+		return false;
+	}
+	size_t size = file.size();
+	unsigned char* pem = new unsigned char[size + 1];
+	size_t bytesRead = file.read(pem, size);
+	file.close();
+	pem[bytesRead] = '\0';
+	int result = mbedtls_x509_crt_parse(&this->caCert, pem, bytesRead + 1);
+	delete[] pem;
+	if (result != 0) {
+		LOG_ERROR("TlsClient: ✗ Invalid CA certificate (-0x%04x)", (unsigned)-result);
+		return false;
+	}
+	
+	static const char personalization[] = "plantlight-tls";
+	result = mbedtls_ctr_drbg_seed(&this->drbg, mbedtls_entropy_func, &this->entropy,
+		(const unsigned char*)personalization, sizeof(personalization) - 1);
+	if (result == 0) {
+		result = mbedtls_ssl_config_defaults(&this->config, MBEDTLS_SSL_IS_CLIENT,
+			MBEDTLS_SSL_TRANSPORT_STREAM, MBEDTLS_SSL_PRESET_DEFAULT);
+	}
+	if (result != 0) {
+		LOG_ERROR("TlsClient: ✗ TLS setup failed (-0x%04x)", (unsigned)-result);
+		return false;
+	}
+	
+	mbedtls_ssl_conf_authmode(&this->config, MBEDTLS_SSL_VERIFY_REQUIRED);
+	mbedtls_ssl_conf_ca_chain(&this->config, &this->caCert, nullptr);
+	mbedtls_ssl_conf_rng(&this->config, mbedtls_ctr_drbg_random, &this->drbg);
+	mbedtls_ssl_conf_verify(&this->config, verifyCallback, this);
+#if defined(MBEDTLS_SSL_SESSION_TICKETS)
+	/// We accept tickets, so servers that keep no session cache can resume us too
+	mbedtls_ssl_conf_session_tickets(&this->config, MBEDTLS_SSL_SESSION_TICKETS_ENABLED);
+#endif
+
+	/// We allocate the record buffers once; every connection after this only resets the context
+	result = mbedtls_ssl_setup(&this->ssl, &this->config);
+	if (result != 0) {
+		LOG_ERROR("TlsClient: ✗ TLS context allocation failed (-0x%04x)", (unsigned)-result);
+		return false;
+	}
+	mbedtls_ssl_set_bio(&this->ssl, this, sendCallback, receiveCallback, nullptr);
+	
+	this->configured = true;
+	return true;
+}
+
+int TlsClient::connect(IPAddress ip, uint16_t port) {
+	if (!this->configured) {
+		return 0;
+	}
+	this->stop();
+	
+	unsigned long startTime = millis();
+	if (!this->tcp.connect(ip, port)) {
+		return 0;
+	}
+	return this->handshake(ip.toString().c_str(), millis() - startTime) ? 1 : 0;
+}
+
+int TlsClient::connect(const char* host, uint16_t port) {
+	if (!this->configured) {
+		return 0;
+	}
+	this->stop();
+	
+	unsigned long startTime = millis();
+	if (!this->tcp.connect(host, port)) {
+		return 0;
+	}
+	return this->handshake(host, millis() - startTime) ? 1 : 0;
+}
+
+size_t TlsClient::write(uint8_t byte) {
+	return this->write(&byte, 1);
+}
+
+size_t TlsClient::write(const uint8_t* buffer, size_t size) {
+	if (!this->established) {
+		return 0;
+	}
+	
+	size_t written = 0;
+	unsigned long startTime = millis();
+	while (written < size) {
+		int result = mbedtls_ssl_write(&this->ssl, buffer + written, size - written);
+		if (result > 0) {
+			written += result;
+			continue;
+		}
+		if ((result == MBEDTLS_ERR_SSL_WANT_WRITE || result == MBEDTLS_ERR_SSL_WANT_READ)
+				&& millis() - startTime < TLS_WRITE_TIMEOUT_MS) {
+			delay(1);
+			continue;
+		}
+		this->stop();
+		break;
+	}
+	return written;
+}
+
+int TlsClient::available() {
+	int buffered = this->pendingBytes();
+	return this->peeked >= 0 ? buffered + 1 : buffered;
+}
+
+int TlsClient::read() {
+	uint8_t byte;
+	return this->read(&byte, 1) == 1 ? byte : -1;
+}
+
+int TlsClient::read(uint8_t* buffer, size_t size) {
+	if (size == 0) {
+		return 0;
+	}
+	
+	size_t count = 0;
+	if (this->peeked >= 0) {
+		buffer[count++] = (uint8_t)this->peeked;
+		this->peeked = -1;
+	}
+	if (count < size && this->pendingBytes() > 0) {
+		int result = mbedtls_ssl_read(&this->ssl, buffer + count, size - count);
+		if (result > 0) {
+			count += result;
+		}
+	}
+	return count > 0 ? (int)count : -1;
+}
+
+int TlsClient::peek() {
+	if (this->peeked < 0) {
+		this->peeked = this->read();
+	}
+	return this->peeked;
+}
+
+void TlsClient::flush() {
+}
+
+void TlsClient::stop() {
+	/// We keep the cached session; that is what makes the next connect cheap
+	if (this->established) {
+		mbedtls_ssl_close_notify(&this->ssl);
+		this->established = false;
+	}
+	this->tcp.stop();
+	this->peeked = -1;
+}
+
+uint8_t TlsClient::connected() {
+	if (!this->established) {
+		return 0;
+	}
+	return this->tcp.connected() || this->available() > 0;
+}
+
+TlsClient::operator bool() {
+	return this->connected();
+}
+
+void TlsClient::clearSession() {
+	mbedtls_ssl_session_free(&this->session);
+	mbedtls_ssl_session_init(&this->session);
+	this->sessionCached = false;
+}
+
+unsigned long TlsClient::getFullHandshakes() const {
+	return this->fullHandshakes;
+}
+
+unsigned long TlsClient::getResumedHandshakes() const {
+	return this->resumedHandshakes;
+}
+
+unsigned long TlsClient::getFailedHandshakes() const {
+	return this->failedHandshakes;
+}
+
+unsigned long TlsClient::getHandshakeMsTotal() const {
+	return this->handshakeMsTotal;
+}
+
+unsigned long TlsClient::getHandshakeCpuMsTotal() const {
+	return this->handshakeCpuMsTotal;
+}
+
+const TlsHandshakeStats& TlsClient::getLastHandshake() const {
+	return this->lastHandshake;
+}
+
+bool TlsClient::hasSession() const {
+	return this->sessionCached;
+}
+
+bool TlsClient::handshake(const char* host, unsigned long tcpConnectMs) {
+	mbedtls_ssl_session_reset(&this->ssl);
+	mbedtls_ssl_set_hostname(&this->ssl, host);
+	bool offered = this->sessionCached && mbedtls_ssl_set_session(&this->ssl, &this->session) == 0;
+	
+	this->certificateChecked = false;
+	this->waitMs = 0;
+	this->handshakeBytes = 0;
+	unsigned long startTime = millis();
+	
+	int result;
+	while ((result = mbedtls_ssl_handshake(&this->ssl)) != 0) {
+		bool waiting = result == MBEDTLS_ERR_SSL_WANT_READ || result == MBEDTLS_ERR_SSL_WANT_WRITE;
+		if (!waiting || millis() - startTime >= TLS_HANDSHAKE_TIMEOUT_MS || !this->tcp.connected()) {
+			break;
+		}
+		
+		/// Time spent here is network latency, not our CPU
+		unsigned long waitStart = millis();
+		delay(1);
+		this->waitMs += millis() - waitStart;
+	}
+	
+	if (result != 0) {
+		this->failedHandshakes++;
+		this->tcp.stop();
+		LOG_WARN("TlsClient: ✗ Handshake with %s failed (-0x%04x)", host, (unsigned)-result);
+		
+		/// We cannot tell a stale session from other failures, so the retry starts from scratch
+		if (offered) {
+			this->clearSession();
+		}
+		return false;
+	}
+	
+	unsigned long elapsed = millis() - startTime;
+	this->lastHandshake.resumed = !this->certificateChecked;
+	this->lastHandshake.tcpConnectMs = tcpConnectMs;
+	this->lastHandshake.handshakeMs = elapsed;
+	this->lastHandshake.cpuMs = elapsed > this->waitMs ? elapsed - this->waitMs : 0;
+	this->lastHandshake.bytesReceived = this->handshakeBytes;
+	this->handshakeMsTotal += elapsed;
+	this->handshakeCpuMsTotal += this->lastHandshake.cpuMs;
+	if (this->lastHandshake.resumed) {
+		this->resumedHandshakes++;
+	} else {
+		this->fullHandshakes++;
+	}
+	
+	/// We keep the newest session; a server may issue a fresh ticket on every handshake
+	this->clearSession();
+	this->sessionCached = mbedtls_ssl_get_session(&this->ssl, &this->session) == 0;
+	
+	this->established = true;
+	this->peeked = -1;
+	LOG_INFO("TlsClient: %s handshake with %s in %lu ms (%lu ms CPU, TCP %lu ms, %lu B received)",
+		this->lastHandshake.resumed ? "Resumed" : "Full", host, elapsed, this->lastHandshake.cpuMs,
+		tcpConnectMs, this->handshakeBytes);
+	return true;
+}
+
+int TlsClient::pendingBytes() {
+	if (!this->established) {
+		return 0;
+	}
+	
+	/// A zero-length read makes mbedtls decrypt the next record without consuming it
+	int buffered = (int)mbedtls_ssl_get_bytes_avail(&this->ssl);
+	if (buffered == 0 && this->tcp.available() > 0) {
+		int result = mbedtls_ssl_read(&this->ssl, nullptr, 0);
+		if (result < 0 && result != MBEDTLS_ERR_SSL_WANT_READ && result != MBEDTLS_ERR_SSL_WANT_WRITE) {
+			/// Close notify or a broken record; either way the connection is over
+			this->established = false;
+			this->tcp.stop();
+			return 0;
+		}
+		buffered = (int)mbedtls_ssl_get_bytes_avail(&this->ssl);
+	}
+	return buffered;
+}
+
+int TlsClient::sendCallback(void* context, const unsigned char* buffer, size_t length) {
+	TlsClient* self = static_cast<TlsClient*>(context);
+	if (!self->tcp.connected()) {
+		return MBEDTLS_ERR_NET_CONN_RESET;
+	}
+	size_t written = self->tcp.write(buffer, length);
+	return written > 0 ? (int)written : MBEDTLS_ERR_SSL_WANT_WRITE;
+}
+
+int TlsClient::receiveCallback(void* context, unsigned char* buffer, size_t length) {
+	TlsClient* self = static_cast<TlsClient*>(context);
+	if (self->tcp.available() <= 0) {
+		return self->tcp.connected() ? MBEDTLS_ERR_SSL_WANT_READ : MBEDTLS_ERR_NET_CONN_RESET;
+	}
+	int bytesRead = self->tcp.read(buffer, length);
+	if (bytesRead <= 0) {
+		return MBEDTLS_ERR_SSL_WANT_READ;
+	}
+	self->handshakeBytes += bytesRead;
+	return bytesRead;
+}
+
+int TlsClient::verifyCallback(void* context, mbedtls_x509_crt* certificate, int depth, uint32_t* flags) {
+	(void)certificate;
+	(void)depth;
+	(void)flags;
+	
+	/// We leave the verdict to mbedtls; we only note that a chain was checked
+	static_cast<TlsClient*>(context)->certificateChecked = true;
+	return 0;
+}
@@ -0,0 +1,26 @@
+///
+/// WebAssets Implementation
+/// 
+/// The asset table is generated into the build directory by
+/// tools/pio_web_assets.py before every build.
+///
+
+#include "webassets.h"
+#include "webassets_data.h"
+
+const WebAsset* findWebAsset(const char* path) {
+	for (const WebAsset& asset : webAssets) {
+		if (strcmp(asset.path, path) == 0) {
+			return &asset;
+		}
+	}
+	return nullptr;
+}
+
+size_t getWebAssetBytes() {
+	size_t total = 0;
+	for (const WebAsset& asset : webAssets) {
+		total += asset.length;
+	}
+	return total;
+}
@@ -7,6 +7,7 @@
 ///
 
 #include "wifimanager.h"
+#include "logger.h"
 #include "config.h"
 
 WiFiManager::WiFiManager(const char* ssid, const char* password)
@@ -32,9 +33,8 @@ void WiFiManager::begin() {
 	/// We disable auto-reconnect to handle it ourselves
 	WiFi.setAutoReconnect(false);
 	
-	Serial.println("WiFiManager: Initialized");
-	Serial.print("Target network: ");
-	Serial.println(this->ssid);
+	LOG_INFO("WiFiManager: Initialized");
+	LOG_INFO("Target network: %s", this->ssid);
 	
 	/// We attempt initial connection
 	this->connect();
@@ -45,7 +45,7 @@ void WiFiManager::update() {
 	
 	/// We check if we need to attempt reconnection
 	if (this->currentStatus != WiFiStatus::Connected && this->shouldAttemptReconnect()) {
-		Serial.println("WiFiManager: Attempting reconnection...");
+		LOG_INFO("WiFiManager: Attempting reconnection...");
 		this->connect();
 	}
 }
@@ -55,11 +55,7 @@ bool WiFiManager::connect() {
 	this->connectionAttempts++;
 	this->currentStatus = WiFiStatus::Connecting;
 	
-	Serial.print("WiFiManager: Connecting to ");
-	Serial.print(this->ssid);
-	Serial.print(" (attempt #");
-	Serial.print(this->connectionAttempts);
-	Serial.println(")");
+	LOG_INFO("WiFiManager: Connecting to %s (attempt #%lu)", this->ssid, this->connectionAttempts);
 	
 	/// We start the connection process
 	WiFi.begin(this->ssid, this->password);
@@ -69,9 +65,7 @@ bool WiFiManager::connect() {
 	while (WiFi.status() != WL_CONNECTED && 
 		millis() - startTime < this->connectionTimeout) {
 		delay(250);
-		Serial.print(".");
 	}
-	Serial.println();
 	
 	/// We check if connection was successful
 	if (WiFi.status() == WL_CONNECTED) {
@@ -79,12 +73,9 @@ bool WiFiManager::connect() {
 		this->lastSuccessfulConnection = millis();
 		this->reconnectInterval = 30000; /// We reset to base interval on success
 		
-		Serial.println("WiFiManager: ✓ Connected successfully");
-		Serial.print("IP address: ");
-		Serial.println(WiFi.localIP());
-		Serial.print("Signal strength: ");
-		Serial.print(WiFi.RSSI());
-		Serial.println(" dBm");
+		LOG_INFO("WiFiManager: ✓ Connected successfully");
+		LOG_INFO("IP address: %s", WiFi.localIP().toString().c_str());
+		LOG_INFO("Signal strength: %d dBm", WiFi.RSSI());
 		
 		return true;
 	} else {
@@ -94,10 +85,8 @@ bool WiFiManager::connect() {
 		/// This prevents overwhelming the network with rapid retry attempts
 		this->reconnectInterval = min(this->reconnectInterval * 2, 300000UL); /// Cap at 5 minutes
 		
-		Serial.println("WiFiManager: ✗ Connection failed");
-		Serial.print("Next attempt in ");
-		Serial.print(this->reconnectInterval / 1000);
-		Serial.println(" seconds");
+		LOG_WARN("WiFiManager: ✗ Connection failed");
+		LOG_INFO("Next attempt in %lu seconds", this->reconnectInterval / 1000);
 		
 		return false;
 	}
@@ -133,7 +122,7 @@ unsigned long WiFiManager::getTimeSinceLastConnection() const {
 }
 
 void WiFiManager::forceReconnect() {
-	Serial.println("WiFiManager: Forcing reconnection...");
+	LOG_INFO("WiFiManager: Forcing reconnection...");
 	WiFi.disconnect();
 	delay(100);
 	this->currentStatus = WiFiStatus::Disconnected;
@@ -171,7 +160,7 @@ void WiFiManager::updateStatus() {
 		case WL_CONNECTION_LOST:
 		case WL_DISCONNECTED:
 			if (this->currentStatus == WiFiStatus::Connected) {
-				Serial.println("WiFiManager: Connection lost");
+				LOG_WARN("WiFiManager: Connection lost");
 				this->currentStatus = WiFiStatus::Disconnected;
 			}
 			break;
@@ -0,0 +1,153 @@
+#!/usr/bin/env python3
+"""Export stored history from the controller (GET /api/export) to CSV.
+
+Fetches a series as compressed blocks (format=blocks) and decodes them on
+the host, which moves several times less data over WiFi than the CSV the
+controller can render itself. Each block arrives as its 12-byte header,
+the timestamp column and then the value column (see
+include/timeseriesblock.h). Blocks are sent whole, so samples outside the
+requested range are filtered here.
+
+Usage: history_export.py --host 192.168.1.57 --series lux [--from 1718000000] [--to ...] -o lux.csv
+       history_export.py --file lux.tsb --series lux -o lux.csv
+"""
+
+import argparse
+import csv
+import struct
+import sys
+import time
+import urllib.request
+
+BLOCK_SIZE = 2048  # TSDB_BLOCK_SIZE
+HEADER = struct.Struct("<BBHIHH")
+MAGIC = 0xD7
+FLOAT_XOR = 1
+DELTA_BUCKETS = [(2, 7), (3, 9), (4, 12)]  # (prefix length, payload length)
+DECISIONS = ["TURN ON", "TURN OFF", "KEEP CURRENT", "WAIT FOR DATA"]
+REASONS = ["Outside schedule", "In schedule + dark", "In schedule + bright",
+           "No valid time", "Sensor failure", "Relay busy"]
+
+
+class Column:
+    """Reads bits MSB first; the value column is stored back to front."""
+
+    def __init__(self, data, backwards):
+        self.data = data[::-1] if backwards else data
+        self.position = 0
+
+    def bits(self, length):
+        value = 0
+        for _ in range(length):
+            byte = self.data[self.position // 8]
+            value = (value << 1) | ((byte >> (7 - self.position % 8)) & 1)
+            self.position += 1
+        return value
+
+
+def decode_block(header, times, values):
+    _, kind, count, timestamp, _, _ = header
+    time_column = Column(times, False)
+    value_column = Column(values, True)
+    value = value_column.bits(32 if kind == FLOAT_XOR else 8)
+    delta = 0
+    leading = trailing = 0
+    yield timestamp, value
+
+    for _ in range(count - 1):
+        ones = 0
+        while ones < 4 and time_column.bits(1):
+            ones += 1
+        if ones == 4:
+            delta_of_delta = struct.unpack("<i", struct.pack("<I", time_column.bits(32)))[0]
+        elif ones:
+            payload = DELTA_BUCKETS[ones - 1][1]
+            delta_of_delta = time_column.bits(payload) - ((1 << (payload - 1)) - 1)
+        else:
+            delta_of_delta = 0
+        delta += delta_of_delta
+        timestamp = (timestamp + delta) & 0xFFFFFFFF
+
+        if kind != FLOAT_XOR:
+            if value_column.bits(1):
+                value = value_column.bits(8)
+        elif value_column.bits(1):
+            if value_column.bits(1):
+                leading = value_column.bits(5)
+                length = value_column.bits(5) + 1
+                trailing = 32 - leading - length
+            else:
+                length = 32 - leading - trailing
+            value ^= value_column.bits(length) << trailing
+        yield timestamp, value
+
+
+def read_blocks(stream):
+    """Yield (header, timestamp column, value column) from a block export."""
+    while True:
+        raw = stream.read(HEADER.size)
+        if not raw:
+            return
+        if len(raw) < HEADER.size:
+            raise ValueError("export ends inside a block header")
+        header = HEADER.unpack(raw)
+        if header[0] != MAGIC:
+            raise ValueError(f"bad block magic {header[0]:#04x}")
+        times = stream.read((header[4] + 7) // 8)
+        values = stream.read((header[5] + 7) // 8)
+        yield header, times, values
+
+
+def row(series, timestamp, value):
+    if series == "lux":
+        return [timestamp, f"{struct.unpack('<f', struct.pack('<I', value))[0]:.2f}"]
+    if series == "relay":
+        return [timestamp, value]
+    decision, reason = value >> 4, value & 0x0F
+    return [timestamp, DECISIONS[decision] if decision < len(DECISIONS) else "UNKNOWN",
+            REASONS[reason] if reason < len(REASONS) else "Unknown reason"]
+
+
+def main():
+    parser = argparse.ArgumentParser(description=__doc__.splitlines()[0])
+    source = parser.add_mutually_exclusive_group(required=True)
+    source.add_argument("--host", help="controller address")
+    source.add_argument("--file", help="saved format=blocks export")
+    parser.add_argument("--series", choices=["lux", "relay", "decision"], default="lux")
+    parser.add_argument("--from", dest="start", type=int, default=0, help="local epoch seconds")
+    parser.add_argument("--to", dest="end", type=int, default=0xFFFFFFFF)
+    parser.add_argument("-o", "--output", default="-")
+    args = parser.parse_args()
+
+    if args.host:
+        url = (f"http://{args.host}/api/export?series={args.series}&format=blocks"
+               f"&from={args.start}&to={args.end}")
+        stream = urllib.request.urlopen(url, timeout=30)
+    else:
+        stream = open(args.file, "rb")
+
+    output = sys.stdout if args.output == "-" else open(args.output, "w", newline="")
+    writer = csv.writer(output)
+    writer.writerow({"lux": ["timestamp", "lux"], "relay": ["timestamp", "relay"],
+                     "decision": ["timestamp", "decision", "reason"]}[args.series])
+
+    started = time.monotonic()
+    blocks = samples = wire_bytes = 0
+    for header, times, values in read_blocks(stream):
+        blocks += 1
+        wire_bytes += HEADER.size + len(times) + len(values)
+        for timestamp, value in decode_block(header, times, values):
+            if args.start <= timestamp <= args.end:
+                writer.writerow(row(args.series, timestamp, value))
+                samples += 1
+
+    elapsed = max(time.monotonic() - started, 1e-6)
+    if output is not sys.stdout:
+        output.close()
+    print(f"[export] {samples} samples from {blocks} blocks, {wire_bytes} B received "
+          f"({wire_bytes / max(samples, 1):.2f} B/sample), {wire_bytes / elapsed / 1024:.0f} KB/s",
+          file=sys.stderr)
+
+
+if __name__ == "__main__":
+    main()
@@ -0,0 +1,277 @@
+#!/usr/bin/env python3
+"""Decode the controller's binary log frames (LOG_BINARY=1).
+
+The firmware sends, per log call, the address of the call site's format
+string relative to logFormatAnchor plus the raw argument values, in a
+COBS frame ending in 0x00 (see include/logger.h). The format strings are
+recovered from the firmware's ELF symbol table: every call site keeps its
+string in a local static named logFormat. String arguments that live in
+flash are sent as addresses too, so the table also carries the read-only
+data section they point into.
+
+Usage: log_decoder.py extract .pio/build/esp32dev/firmware.elf -o logstrings.json
+       log_decoder.py decode --table logstrings.json --port /dev/ttyUSB0 [--baud 115200]
+       log_decoder.py decode --elf firmware.elf --file capture.bin [--stats]
+"""
+
+import argparse
+import base64
+import json
+import re
+import struct
+import sys
+import time
+
+ANCHOR_SYMBOL = "logFormatAnchor"
+FORMAT_SYMBOL = re.compile(r"9logFormat(_\d+|__\d+_)?$")
+CONVERSION = re.compile(r"%(?:%|[-+ #0]*\d*(?:\.\d+)?(?:hh|h|ll|l|z)?([diuxXofFeEgGsc]))")
+LEVELS = {"E": "ERROR", "W": "WARN", "I": "INFO", "D": "DEBUG"}
+
+
+def read_elf_symbols(path):
+    """Return ({name: (address, size)}, section_at(address)) for a 32 or 64 bit ELF.
+
+    section_at returns (start address, contents) of the loaded section holding address.
+    """
+    with open(path, "rb") as f:
+        data = f.read()
+    if data[:4] != b"\x7fELF":
+        raise ValueError(f"{path} is not an ELF file")
+    is64 = data[4] == 2
+    endian = "<" if data[5] == 1 else ">"
+
+    if is64:
+        shoff, = struct.unpack_from(endian + "Q", data, 0x28)
+        shentsize, shnum, shstrndx = struct.unpack_from(endian + "HHH", data, 0x3A)
+    else:
+        shoff, = struct.unpack_from(endian + "I", data, 0x20)
+        shentsize, shnum, shstrndx = struct.unpack_from(endian + "HHH", data, 0x2E)
+
+    sections = []
+    for i in range(shnum):
+        base = shoff + i * shentsize
+        if is64:
+            name, kind, _, addr, offset, size, link, _, _, entsize = struct.unpack_from(endian + "IIQQQQIIQQ", data, base)
+        else:
+            name, kind, _, addr, offset, size, link, _, _, entsize = struct.unpack_from(endian + "IIIIIIIIII", data, base)
+        sections.append((name, kind, addr, offset, size, link, entsize))
+
+    symbols = {}
+    for _, kind, _, offset, size, link, entsize in sections:
+        if kind != 2:  # SHT_SYMTAB
+            continue
+        strtab = sections[link]
+        for i in range(size // entsize):
+            base = offset + i * entsize
+            if is64:
+                name, _, _, _, value, symsize = struct.unpack_from(endian + "IBBHQQ", data, base)
+            else:
+                name, value, symsize, _, _, _ = struct.unpack_from(endian + "IIIBBH", data, base)
+            end = data.index(b"\0", strtab[3] + name)
+            symbols[data[strtab[3] + name:end].decode("ascii", "replace")] = (value, symsize)
+
+    def section_at(address):
+        for _, kind, addr, offset, secsize, _, _ in sections:
+            if kind != 8 and addr <= address < addr + secsize:  # skip SHT_NOBITS
+                return addr, data[offset:offset + secsize]
+        raise ValueError(f"address {address:#x} is not in a loaded section")
+
+    return symbols, section_at
+
+
+def extract(elf_path):
+    symbols, section_at = read_elf_symbols(elf_path)
+    if ANCHOR_SYMBOL not in symbols:
+        raise ValueError(f"{ANCHOR_SYMBOL} not found - was the firmware built with LOG_BINARY=1?")
+    anchor = symbols[ANCHOR_SYMBOL][0]
+
+    formats = {}
+    for name, (address, size) in symbols.items():
+        if FORMAT_SYMBOL.search(name) and size > 1:
+            start, contents = section_at(address)
+            text = contents[address - start:address - start + size].rstrip(b"\0")
+            formats[str(address - anchor)] = text.decode("utf-8", "replace")
+
+    start, contents = section_at(anchor)
+    rodata = {"offset": start - anchor, "data": base64.b64encode(contents).decode("ascii")}
+    return {"elf": elf_path, "formats": formats, "rodata": rodata}
+
+
+def cobs_decode(frame):
+    out = bytearray()
+    i = 0
+    while i < len(frame):
+        code = frame[i]
+        if code == 0 or i + code > len(frame) + 1:
+            raise ValueError("bad COBS frame")
+        out += frame[i + 1:i + code]
+        i += code
+        if code < 0xFF and i < len(frame):
+            out.append(0)
+    return bytes(out)
+
+
+class Reader:
+    def __init__(self, payload, rodata):
+        self.payload = payload
+        self.rodata = rodata
+        self.pos = 0
+
+    def varint(self):
+        value = shift = 0
+        while True:
+            byte = self.payload[self.pos]
+            self.pos += 1
+            value |= (byte & 0x7F) << shift
+            shift += 7
+            if not byte & 0x80:
+                return value
+
+    def signed(self):
+        value = self.varint()
+        return (value >> 1) ^ -(value & 1)
+
+    def float32(self):
+        value, = struct.unpack_from("<f", self.payload, self.pos)
+        self.pos += 4
+        return value
+
+    def string(self):
+        header = self.varint()
+        if header & 1:
+            offset = (header >> 2) ^ -((header >> 1) & 1)
+            start = offset - self.rodata[0]
+            if not 0 <= start < len(self.rodata[1]):
+                raise ValueError(f"string offset {offset} is outside the read-only data")
+            end = self.rodata[1].index(b"\0", start)
+            return self.rodata[1][start:end].decode("utf-8", "replace")
+        length = header >> 1
+        text = self.payload[self.pos:self.pos + length].decode("utf-8", "replace")
+        self.pos += length
+        return text
+
+
+def format_record(formats, rodata, payload):
+    reader = Reader(payload, rodata)
+    key = str(reader.signed())
+    if key not in formats:
+        raise KeyError(f"unknown format id {key} - is the string table from this build?")
+    level, fmt = formats[key][0], formats[key][1:]
+
+    args = []
+    for match in CONVERSION.finditer(fmt):
+        conversion = match.group(1)
+        if conversion is None:
+            continue
+        if conversion in "di":
+            args.append(reader.signed())
+        elif conversion in "uxXoc":
+            args.append(reader.varint())
+        elif conversion == "s":
+            args.append(reader.string())
+        else:
+            args.append(reader.float32())
+
+    # Python's % has no length modifiers beyond a single ignored l
+    python_fmt = re.sub(r"(%[-+ #0]*\d*(?:\.\d+)?)(?:hh|h|ll|l|z)([diuxXo])", r"\1\2", fmt)
+    return level, python_fmt % tuple(args)
+
+
+def frames(stream, live=False):
+    """Yield (frame, complete) for each 0x00-terminated frame; a live port never ends."""
+    buffer = bytearray()
+    while True:
+        chunk = stream.read(max(stream.in_waiting, 1)) if live else stream.read(256)
+        if not chunk:
+            if buffer:
+                yield bytes(buffer), False
+            return
+        buffer += chunk
+        while True:
+            end = buffer.find(b"\0")
+            if end < 0:
+                break
+            yield bytes(buffer[:end]), True
+            del buffer[:end + 1]
+
+
+def load_table(elf=None, table_path=None):
+    """Return (formats, rodata) from a firmware ELF or a table written by extract."""
+    if elf:
+        table = extract(elf)
+    else:
+        with open(table_path) as f:
+            table = json.load(f)
+    return table["formats"], (table["rodata"]["offset"], base64.b64decode(table["rodata"]["data"]))
+
+
+def decode(args):
+    formats, rodata = load_table(args.elf, args.table)
+
+    if args.port:
+        import serial  # pyserial, only needed for live capture
+        stream = serial.Serial(args.port, args.baud, timeout=None)
+    else:
+        stream = open(args.file, "rb") if args.file != "-" else sys.stdin.buffer
+
+    records = bad = wire_bytes = text_bytes = 0
+    try:
+        for frame, complete in frames(stream, live=bool(args.port)):
+            wire_bytes += len(frame) + 1
+            if not complete or not frame:
+                continue
+            try:
+                level, text = format_record(formats, rodata, cobs_decode(frame))
+            except (ValueError, KeyError, IndexError, struct.error, TypeError) as error:
+                bad += 1
+                print(f"[decoder] skipped frame: {error}", file=sys.stderr)
+                continue
+            records += 1
+            text_bytes += len(text.encode("utf-8")) + 2
+            prefix = time.strftime("%H:%M:%S ") if args.timestamps else ""
+            marker = "" if level == "I" else LEVELS.get(level, level) + " "
+            print(f"{prefix}{marker}{text}", flush=True)
+    except KeyboardInterrupt:
+        pass
+
+    if args.stats:
+        print(f"[decoder] {records} records, {bad} bad frames | binary {wire_bytes} B, "
+              f"as text {text_bytes} B ({text_bytes / max(wire_bytes, 1):.1f}x), "
+              f"{wire_bytes / max(records, 1):.1f} B/record", file=sys.stderr)
+
+
+def main():
+    parser = argparse.ArgumentParser(description=__doc__.splitlines()[0])
+    commands = parser.add_subparsers(dest="command", required=True)
+
+    extract_parser = commands.add_parser("extract", help="write the format string table of a build")
+    extract_parser.add_argument("elf")
+    extract_parser.add_argument("-o", "--output", default="-")
+
+    decode_parser = commands.add_parser("decode", help="decode frames from a port or capture file")
+    source = decode_parser.add_mutually_exclusive_group(required=True)
+    source.add_argument("--table", help="string table written by extract")
+    source.add_argument("--elf", help="firmware.elf to extract the table from")
+    inputs = decode_parser.add_mutually_exclusive_group(required=True)
+    inputs.add_argument("--port")
+    inputs.add_argument("--file", help="capture file, - for stdin")
+    decode_parser.add_argument("--baud", type=int, default=115200)
+    decode_parser.add_argument("--timestamps", action="store_true")
+    decode_parser.add_argument("--stats", action="store_true", help="report bytes on the wire vs. as text")
+
+    args = parser.parse_args()
+    if args.command == "extract":
+        table = extract(args.elf)
+        output = json.dumps(table, indent=1, ensure_ascii=False)
+        if args.output == "-":
+            print(output)
+        else:
+            with open(args.output, "w") as f:
+                f.write(output)
+            print(f"[decoder] {len(table['formats'])} format strings -> {args.output}", file=sys.stderr)
+    else:
+        decode(args)
+
+
+if __name__ == "__main__":
+    main()
@@ -0,0 +1,146 @@
+#!/usr/bin/env python3
+"""Build a COPY/INSERT firmware patch for the controller's OtaUpdater.
+
+The patch reuses every run of at least 32 bytes that also exists in the old
+image and carries the rest verbatim. Layout matches include/otaupdater.h:
+"PLD1", old size, new size, old SHA-256, new SHA-256, then opcodes
+0x01 COPY offset length, 0x02 INSERT length data, 0x00 END (LEB128 varints).
+
+Usage: make_delta.py old.bin new.bin patch.bin
+       make_delta.py --apply old.bin patch.bin out.bin
+"""
+
+import argparse
+import hashlib
+import struct
+import sys
+
+MAGIC = b"PLD1"
+OP_END, OP_COPY, OP_INSERT = 0x00, 0x01, 0x02
+BLOCK = 32
+STEP = 4
+
+
+def varint(value):
+    out = bytearray()
+    while True:
+        byte = value & 0x7F
+        value >>= 7
+        if value:
+            out.append(byte | 0x80)
+        else:
+            out.append(byte)
+            return bytes(out)
+
+
+def read_varint(data, pos):
+    value = shift = 0
+    while True:
+        byte = data[pos]
+        pos += 1
+        value |= (byte & 0x7F) << shift
+        shift += 7
+        if not byte & 0x80:
+            return value, pos
+
+
+def make_delta(old, new):
+    # Index old blocks at a small step so shifted code still lines up.
+    index = {}
+    for offset in range(0, len(old) - BLOCK + 1, STEP):
+        index.setdefault(old[offset:offset + BLOCK], offset)
+
+    ops = []
+    literal_start = 0
+    pos = 0
+    while pos + BLOCK <= len(new):
+        match = index.get(new[pos:pos + BLOCK])
+        if match is None:
+            pos += 1
+            continue
+
+        # Extend the match both ways, never back past pending literals.
+        start, old_start = pos, match
+        while start > literal_start and old_start > 0 and new[start - 1] == old[old_start - 1]:
+            start -= 1
+            old_start -= 1
+        end, old_end = pos + BLOCK, match + BLOCK
+        while end < len(new) and old_end < len(old) and new[end] == old[old_end]:
+            end += 1
+            old_end += 1
+
+        if start > literal_start:
+            ops.append((OP_INSERT, new[literal_start:start]))
+        ops.append((OP_COPY, old_start, end - start))
+        literal_start = pos = end
+
+    if literal_start < len(new):
+        ops.append((OP_INSERT, new[literal_start:]))
+
+    out = bytearray(MAGIC)
+    out += struct.pack("<II", len(old), len(new))
+    out += hashlib.sha256(old).digest() + hashlib.sha256(new).digest()
+    for op in ops:
+        if op[0] == OP_COPY:
+            out += bytes([OP_COPY]) + varint(op[1]) + varint(op[2])
+        else:
+            out += bytes([OP_INSERT]) + varint(len(op[1])) + op[1]
+    out.append(OP_END)
+    return bytes(out)
+
+
+def apply_delta(old, patch):
+    if patch[:4] != MAGIC:
+        raise ValueError("not a patch")
+    old_size, new_size = struct.unpack_from("<II", patch, 4)
+    old_hash, new_hash = patch[12:44], patch[44:76]
+    if hashlib.sha256(old[:old_size]).digest() != old_hash:
+        raise ValueError("patch base mismatch")
+
+    out = bytearray()
+    pos = 76
+    while patch[pos] != OP_END:
+        op = patch[pos]
+        if op == OP_COPY:
+            offset, pos = read_varint(patch, pos + 1)
+            length, pos = read_varint(patch, pos)
+            out += old[offset:offset + length]
+        elif op == OP_INSERT:
+            length, pos = read_varint(patch, pos + 1)
+            out += patch[pos:pos + length]
+            pos += length
+        else:
+            raise ValueError(f"bad opcode {op:#x}")
+
+    if len(out) != new_size or hashlib.sha256(out).digest() != new_hash:
+        raise ValueError("result hash mismatch")
+    return bytes(out)
+
+
+def main():
+    parser = argparse.ArgumentParser(description=__doc__.splitlines()[0])
+    parser.add_argument("--apply", action="store_true", help="apply a patch instead of creating one")
+    parser.add_argument("first")
+    parser.add_argument("second")
+    parser.add_argument("output")
+    args = parser.parse_args()
+
+    with open(args.first, "rb") as f:
+        old = f.read()
+    with open(args.second, "rb") as f:
+        second = f.read()
+
+    if args.apply:
+        result = apply_delta(old, second)
+    else:
+        result = make_delta(old, second)
+        assert apply_delta(old, result) == second
+        print(f"{len(second)} B image -> {len(result)} B patch "
+              f"({100.0 * len(result) / max(len(second), 1):.1f}%)", file=sys.stderr)
+
+    with open(args.output, "wb") as f:
+        f.write(result)
+
+
+if __name__ == "__main__":
+    main()
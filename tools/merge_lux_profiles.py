@@ -0,0 +1,86 @@
+#!/usr/bin/env python3
+"""Merge hourly lux quantile profiles exported by several controllers.
+
+Each input file is the binary image served by GET /api/profile, e.g.
+fetched with `curl -o unit1.bin http://<controller>/api/profile`:
+a 16-byte header ("LXQ1", hours, buckets, min lux, gamma) followed by
+24 x 80 little-endian uint16 bucket counters. Sketches merge exactly by
+adding counters, so the fleet profile is as accurate as a single unit's.
+
+Usage: merge_lux_profiles.py profile1.bin [profile2.bin ...] [-o merged.bin]
+"""
+
+import argparse
+import math
+import struct
+import sys
+
+HEADER = struct.Struct("<4sBBxxff")
+QUANTILES = (0.1, 0.5, 0.9)
+
+
+def load_profile(path):
+    with open(path, "rb") as handle:
+        data = handle.read()
+    magic, hours, buckets, min_lux, gamma = HEADER.unpack_from(data, 0)
+    if magic != b"LXQ1":
+        raise ValueError(f"{path}: not a lux profile export")
+    expected = HEADER.size + hours * buckets * 2
+    if len(data) != expected:
+        raise ValueError(f"{path}: expected {expected} bytes, got {len(data)}")
+    counts = struct.unpack_from(f"<{hours * buckets}H", data, HEADER.size)
+    rows = [list(counts[h * buckets:(h + 1) * buckets]) for h in range(hours)]
+    return (hours, buckets, min_lux, gamma), rows
+
+
+def quantile(row, q, min_lux, gamma):
+    total = sum(row)
+    if total == 0:
+        return math.nan
+    rank = int(q * (total - 1)) + 1
+    seen = 0
+    for index, count in enumerate(row):
+        seen += count
+        if seen >= rank:
+            return 0.0 if index == 0 else min_lux * gamma ** (index - 0.5)
+    return math.nan
+
+
+def main():
+    parser = argparse.ArgumentParser(description=__doc__, formatter_class=argparse.RawDescriptionHelpFormatter)
+    parser.add_argument("profiles", nargs="+", help="exported profile images")
+    parser.add_argument("-o", "--output", help="write the merged profile image here")
+    args = parser.parse_args()
+
+    layout, merged = load_profile(args.profiles[0])
+    for path in args.profiles[1:]:
+        other_layout, rows = load_profile(path)
+        if other_layout != layout:
+            sys.exit(f"{path}: bucket layout differs from {args.profiles[0]}")
+        for hour, row in enumerate(rows):
+            merged[hour] = [a + b for a, b in zip(merged[hour], row)]
+
+    hours, buckets, min_lux, gamma = layout
+    print(f"{'hour':>4} {'samples':>9} {'p10':>9} {'p50':>9} {'p90':>9}")
+    for hour, row in enumerate(merged):
+        values = [quantile(row, q, min_lux, gamma) for q in QUANTILES]
+        print(f"{hour:>4} {sum(row):>9} " + " ".join(f"{v:>9.1f}" for v in values))
+
+    day = [sum(column) for column in zip(*merged)]
+    values = [quantile(day, q, min_lux, gamma) for q in QUANTILES]
+    print(f"{'day':>4} {sum(day):>9} " + " ".join(f"{v:>9.1f}" for v in values))
+
+    if args.output:
+        # Merged counters may exceed 16 bits; scale down uniformly to keep the shape
+        peak = max(max(row) for row in merged)
+        shift = 0
+        while (peak >> shift) > 0xFFFF:
+            shift += 1
+        with open(args.output, "wb") as handle:
+            handle.write(HEADER.pack(b"LXQ1", hours, buckets, min_lux, gamma))
+            for row in merged:
+                handle.write(struct.pack(f"<{buckets}H", *[c >> shift for c in row]))
+
+
+if __name__ == "__main__":
+    main()
@@ -0,0 +1,205 @@
+#!/usr/bin/env python3
+"""Local MQTT broker stand-in for measuring controller telemetry.
+
+Accepts MQTT 3.1.1 connections, acknowledges QoS 1 publishes, decodes the
+controller's CBOR batches and reports bytes on the wire and messages per
+hour. Messages spooled while the controller was offline arrive on
+<topic>/backlog as a CBOR array of batches and are counted separately. It
+is not a real broker: nothing is forwarded to subscribers.
+
+With --tls-cert/--tls-key it listens over TLS (MQTT_TLS_ENABLED) and
+reports for every connection whether the controller resumed its previous
+TLS session or needed a full handshake.
+
+Usage: mqtt_broker_standin.py [--port 1883] [--report 60] [--drop-acks 0.0]
+       mqtt_broker_standin.py --port 8883 --tls-cert broker.crt --tls-key broker.key
+"""
+
+import argparse
+import asyncio
+import random
+import ssl
+import struct
+import time
+
+CONNECT, CONNACK, PUBLISH, PUBACK = 0x10, 0x20, 0x30, 0x40
+PINGREQ, PINGRESP, DISCONNECT = 0xC0, 0xD0, 0xE0
+
+
+class Stats:
+    def __init__(self):
+        self.started = time.monotonic()
+        self.bytes_in = 0
+        self.bytes_out = 0
+        self.messages = 0
+        self.duplicates = 0
+        self.payload_bytes = 0
+        self.samples = 0
+        self.decisions = 0
+        self.backlog_messages = 0
+        self.backlog_batches = 0
+        self.tls_full = 0
+        self.tls_resumed = 0
+
+    def report(self):
+        hours = max(time.monotonic() - self.started, 1.0) / 3600.0
+        print(f"[stand-in] {self.messages} msgs ({self.duplicates} dup), "
+              f"{self.samples} samples, {self.decisions} decisions, "
+              f"{self.backlog_batches} backlog batches in {self.backlog_messages} msgs | "
+              f"wire in {self.bytes_in} B, out {self.bytes_out} B | "
+              f"{self.messages / hours:.0f} msg/h, {self.bytes_in / hours:.0f} B/h in, "
+              f"{self.payload_bytes / max(self.samples, 1):.1f} payload B/sample"
+              + (f" | TLS {self.tls_full} full, {self.tls_resumed} resumed" if self.tls_full + self.tls_resumed else ""))
+
+
+def decode_cbor(data, pos=0):
+    """Decode one CBOR item (the subset CborWriter produces)."""
+    initial = data[pos]
+    major, info = initial >> 5, initial & 0x1F
+    pos += 1
+    if major == 7:
+        if info == 20:
+            return False, pos
+        if info == 21:
+            return True, pos
+        if info == 26:
+            return struct.unpack(">f", data[pos:pos + 4])[0], pos + 4
+        raise ValueError(f"unsupported simple value {info}")
+    if info < 24:
+        arg = info
+    else:
+        size = {24: 1, 25: 2, 26: 4, 27: 8}[info]
+        arg = int.from_bytes(data[pos:pos + size], "big")
+        pos += size
+    if major == 0:
+        return arg, pos
+    if major == 1:
+        return -1 - arg, pos
+    if major == 3:
+        return data[pos:pos + arg].decode(), pos + arg
+    if major == 4:
+        items = []
+        for _ in range(arg):
+            item, pos = decode_cbor(data, pos)
+            items.append(item)
+        return items, pos
+    if major == 5:
+        result = {}
+        for _ in range(arg):
+            key, pos = decode_cbor(data, pos)
+            result[key], pos = decode_cbor(data, pos)
+        return result, pos
+    raise ValueError(f"unsupported major type {major}")
+
+
+async def read_packet(reader):
+    header = await reader.readexactly(1)
+    remaining, multiplier, length_bytes = 0, 1, 0
+    while True:
+        digit = (await reader.readexactly(1))[0]
+        length_bytes += 1
+        remaining += (digit & 0x7F) * multiplier
+        multiplier *= 128
+        if not digit & 0x80:
+            break
+    body = await reader.readexactly(remaining)
+    return header[0], body, 1 + length_bytes + remaining
+
+
+async def handle_client(reader, writer, stats, args):
+    peer = writer.get_extra_info("peername")
+    seen_ids = set()
+    tls = writer.get_extra_info("ssl_object")
+    if tls:
+        if tls.session_reused:
+            stats.tls_resumed += 1
+        else:
+            stats.tls_full += 1
+        print(f"[stand-in] TLS {tls.version()} from {peer}: "
+              f"{'resumed session' if tls.session_reused else 'full handshake'}")
+    try:
+        while True:
+            header, body, size = await read_packet(reader)
+            stats.bytes_in += size
+            kind = header & 0xF0
+            response = None
+            if kind == CONNECT:
+                client_len = struct.unpack(">H", body[10:12])[0]
+                print(f"[stand-in] CONNECT from {peer}: {body[12:12 + client_len].decode()}")
+                response = bytes([CONNACK, 2, 0, 0])
+            elif kind == PUBLISH:
+                qos = (header >> 1) & 0x03
+                topic_len = struct.unpack(">H", body[:2])[0]
+                pos = 2 + topic_len
+                packet_id = None
+                if qos:
+                    packet_id = struct.unpack(">H", body[pos:pos + 2])[0]
+                    pos += 2
+                payload = body[pos:]
+                if header & 0x08 and packet_id in seen_ids:
+                    stats.duplicates += 1
+                else:
+                    seen_ids.add(packet_id)
+                    stats.messages += 1
+                    stats.payload_bytes += len(payload)
+                    topic = body[2:2 + topic_len].decode()
+                    batch, _ = decode_cbor(payload)
+                    batches = [batch]
+                    if topic.endswith("/backlog"):
+                        # The payload is a CBOR array whose items are the batches that were spooled
+                        batches = batch
+                        stats.backlog_messages += 1
+                        stats.backlog_batches += len(batches)
+                    for item in batches:
+                        stats.samples += len(item.get("s", [])) // 3
+                        stats.decisions += len(item.get("d", [])) // 4
+                    if args.verbose:
+                        print(f"[stand-in] {topic}: {batch}")
+                if qos and random.random() >= args.drop_acks:
+                    response = bytes([PUBACK, 2]) + struct.pack(">H", packet_id)
+            elif kind == PINGREQ:
+                response = bytes([PINGRESP, 0])
+            elif kind == DISCONNECT:
+                break
+            if response:
+                writer.write(response)
+                stats.bytes_out += len(response)
+                await writer.drain()
+    except (asyncio.IncompleteReadError, ConnectionResetError):
+        pass
+    finally:
+        print(f"[stand-in] {peer} disconnected")
+        writer.close()
+
+
+async def main():
+    parser = argparse.ArgumentParser(description=__doc__, formatter_class=argparse.RawDescriptionHelpFormatter)
+    parser.add_argument("--port", type=int, default=1883)
+    parser.add_argument("--report", type=float, default=60.0, help="seconds between reports")
+    parser.add_argument("--drop-acks", type=float, default=0.0, help="fraction of PUBACKs to drop")
+    parser.add_argument("--verbose", action="store_true", help="print every decoded batch")
+    parser.add_argument("--tls-cert", help="server certificate (PEM); enables TLS")
+    parser.add_argument("--tls-key", help="server private key (PEM)")
+    args = parser.parse_args()
+
+    context = None
+    if args.tls_cert:
+        # OpenSSL keeps a server-side session cache and issues tickets by default
+        context = ssl.SSLContext(ssl.PROTOCOL_TLS_SERVER)
+        context.load_cert_chain(args.tls_cert, args.tls_key)
+
+    stats = Stats()
+    server = await asyncio.start_server(lambda r, w: handle_client(r, w, stats, args), "0.0.0.0", args.port,
+                                        ssl=context)
+    print(f"[stand-in] listening on port {args.port}{' (TLS)' if context else ''}")
+    async with server:
+        while True:
+            await asyncio.sleep(args.report)
+            stats.report()
+
+
+if __name__ == "__main__":
+    try:
+        asyncio.run(main())
+    except KeyboardInterrupt:
+        pass
@@ -0,0 +1,99 @@
+#!/usr/bin/env python3
+"""Local update server for the controller's delta OTA.
+
+Serves GET /firmware?from=<sha256>&size=<n>. When the device already runs
+the current image we answer 204. When the image it runs is in the archive
+we send a COPY/INSERT patch (built once and cached), otherwise the full
+image. Every image passed with --firmware is archived by its hash so the
+next build can be patched against it.
+
+Usage: ota_server.py --firmware .pio/build/esp32dev/firmware.bin
+                     [--archive ota_archive] [--port 8070]
+"""
+
+import argparse
+import hashlib
+import os
+import shutil
+import sys
+from http.server import BaseHTTPRequestHandler, ThreadingHTTPServer
+from urllib.parse import parse_qs, urlparse
+
+sys.path.insert(0, os.path.dirname(os.path.abspath(__file__)))
+from make_delta import make_delta  # noqa: E402
+
+
+class FirmwareStore:
+    def __init__(self, firmware, archive):
+        self.archive = archive
+        os.makedirs(archive, exist_ok=True)
+        with open(firmware, "rb") as f:
+            self.image = f.read()
+        self.hash = hashlib.sha256(self.image).hexdigest()
+        target = os.path.join(archive, self.hash + ".bin")
+        if not os.path.exists(target):
+            shutil.copyfile(firmware, target)
+
+    def patch_from(self, running_hash, running_size):
+        base = os.path.join(self.archive, running_hash + ".bin")
+        if not os.path.exists(base):
+            return None
+        cached = os.path.join(self.archive, f"{running_hash}-{self.hash}.pld")
+        if not os.path.exists(cached):
+            with open(base, "rb") as f:
+                old = f.read()
+            if len(old) != running_size:
+                return None
+            with open(cached, "wb") as f:
+                f.write(make_delta(old, self.image))
+        with open(cached, "rb") as f:
+            return f.read()
+
+
+def handler_for(store):
+    class Handler(BaseHTTPRequestHandler):
+        def do_GET(self):
+            url = urlparse(self.path)
+            if url.path != "/firmware":
+                self.send_error(404)
+                return
+            query = parse_qs(url.query)
+            running = query.get("from", [""])[0].lower()
+            size = int(query.get("size", ["0"])[0] or 0)
+
+            if running == store.hash:
+                self.send_response(204)
+                self.end_headers()
+                self.log_message("%s is up to date", running[:12])
+                return
+
+            body = store.patch_from(running, size)
+            kind = "patch"
+            if body is None or len(body) >= len(store.image):
+                body, kind = store.image, "full image"
+
+            self.send_response(200)
+            self.send_header("Content-Type", "application/octet-stream")
+            self.send_header("Content-Length", str(len(body)))
+            self.end_headers()
+            self.wfile.write(body)
+            self.log_message("%s -> %s: %s, %d B (%.1f%% of image)", running[:12], store.hash[:12],
+                             kind, len(body), 100.0 * len(body) / len(store.image))
+
+    return Handler
+
+
+def main():
+    parser = argparse.ArgumentParser(description=__doc__.splitlines()[0])
+    parser.add_argument("--firmware", required=True)
+    parser.add_argument("--archive", default="ota_archive")
+    parser.add_argument("--port", type=int, default=8070)
+    args = parser.parse_args()
+
+    store = FirmwareStore(args.firmware, args.archive)
+    print(f"[ota] serving {store.hash[:12]} ({len(store.image)} B) on port {args.port}")
+    ThreadingHTTPServer(("", args.port), handler_for(store)).serve_forever()
+
+
+if __name__ == "__main__":
+    main()
@@ -0,0 +1,19 @@
+"""PlatformIO post-build step: write the binary log string table next to firmware.elf.
+
+Decode with: tools/log_decoder.py decode --table .pio/build/<env>/logstrings.json --port <port>
+"""
+
+import os
+import subprocess
+
+Import("env")  # noqa: F821 - provided by SCons
+
+
+def extract_log_strings(source, target, env):
+    elf = str(target[0])
+    output = os.path.join(env.subst("$BUILD_DIR"), "logstrings.json")
+    decoder = os.path.join(env.subst("$PROJECT_DIR"), "tools", "log_decoder.py")
+    subprocess.call([env.subst("$PYTHONEXE"), decoder, "extract", elf, "-o", output])
+
+
+env.AddPostAction("$BUILD_DIR/${PROGNAME}.elf", extract_log_strings)  # noqa: F821
@@ -0,0 +1,17 @@
+"""PlatformIO pre-build step: compress web/ into webassets_data.h in the build directory.
+
+The header is only rewritten when the dashboard changed, so unchanged
+builds do not recompile src/webassets.cpp.
+"""
+
+import os
+import subprocess
+
+Import("env")  # noqa: F821 - provided by SCons
+
+output_dir = os.path.join(env.subst("$BUILD_DIR"), "web")  # noqa: F821
+script = os.path.join(env.subst("$PROJECT_DIR"), "tools", "web_assets.py")  # noqa: F821
+subprocess.check_call([env.subst("$PYTHONEXE"), script,  # noqa: F821
+                       os.path.join(env.subst("$PROJECT_DIR"), "web"),  # noqa: F821
+                       "-o", os.path.join(output_dir, "webassets_data.h")])
+env.Append(CPPPATH=[output_dir])  # noqa: F821
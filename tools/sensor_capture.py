@@ -0,0 +1,179 @@
+#!/usr/bin/env python3
+"""Capture the light sensor's raw sample stream to a CSV file.
+
+Starts a stream with POST /api/stream, then reads the COBS frames the
+controller sends over serial at the stream baud rate (see
+include/lightsensor.h for the packet layout). Every sample becomes one CSV
+row. Log messages framed in between go to stderr, decoded with
+log_decoder.py when the firmware logs in binary. Gaps in the sequence
+numbers are counted as dropped samples.
+
+Usage: sensor_capture.py --port /dev/ttyUSB0 --host 192.168.1.57 --seconds 60 -o capture.csv
+       sensor_capture.py --port /dev/ttyUSB0 --seconds 60 -o capture.csv   (stream started elsewhere)
+"""
+
+import argparse
+import binascii
+import csv
+import json
+import os
+import struct
+import sys
+import time
+import urllib.request
+
+sys.path.insert(0, os.path.dirname(os.path.abspath(__file__)))
+from log_decoder import cobs_decode, format_record, load_table  # noqa: E402
+
+PACKET = struct.Struct("<BIIHHHfH")
+SAMPLE_TYPE = ord("S")
+TEXT_TYPE = ord("L")
+BINARY_TYPE = ord("B")
+
+
+def request_stream(host, seconds):
+    request = urllib.request.Request(f"http://{host}/api/stream?seconds={seconds}", method="POST")
+    with urllib.request.urlopen(request, timeout=5) as response:
+        return json.load(response)
+
+
+def open_port(port, baud):
+    import serial  # pyserial
+    # We keep DTR/RTS low; toggling them resets most ESP32 boards
+    connection = serial.Serial()
+    connection.port = port
+    connection.baudrate = baud
+    connection.timeout = 0.2
+    connection.dtr = False
+    connection.rts = False
+    connection.open()
+    return connection
+
+
+class Capture:
+    def __init__(self, writer, log_table):
+        self.writer = writer
+        self.log_table = log_table
+        self.synced = False
+        self.samples = self.dropped = self.bad = self.logs = 0
+        self.expected = None
+        self.epoch = 0
+        self.last_micros = None
+        self.first_us = self.last_us = None
+        self.intervals = []
+
+    def handle(self, frame):
+        try:
+            data = cobs_decode(frame)
+        except ValueError:
+            data = b""
+        if not data:
+            self.reject("bad COBS frame")
+            return
+
+        kind = data[0]
+        if kind == SAMPLE_TYPE and len(data) == PACKET.size:
+            self.sample(data)
+        elif kind == TEXT_TYPE and self.synced:
+            self.logs += 1
+            print(data[1:].decode("utf-8", "replace"), file=sys.stderr)
+        elif kind == BINARY_TYPE and self.synced:
+            self.logs += 1
+            if self.log_table:
+                try:
+                    _, text = format_record(self.log_table[0], self.log_table[1], data[1:])
+                    print(text, file=sys.stderr)
+                except (ValueError, KeyError, IndexError, struct.error, TypeError):
+                    self.reject("undecodable log record")
+        else:
+            self.reject(f"unexpected frame type {kind:#04x}")
+
+    def reject(self, reason):
+        # Before the first good sample we are still reading bytes sent at the console baud rate
+        if self.synced:
+            self.bad += 1
+            print(f"[capture] {reason}", file=sys.stderr)
+
+    def sample(self, data):
+        if binascii.crc_hqx(data[:-2], 0xFFFF) != struct.unpack_from("<H", data, len(data) - 2)[0]:
+            self.reject("checksum mismatch")
+            return
+        _, sequence, micros, als, white, integration_ms, lux_per_count, _ = PACKET.unpack(data)
+        self.synced = True
+
+        if self.expected is not None and sequence != self.expected:
+            if sequence > self.expected:
+                self.dropped += sequence - self.expected
+            else:
+                print(f"[capture] sequence restarted at {sequence}", file=sys.stderr)
+        self.expected = sequence + 1
+
+        # We unwrap the device's 32-bit micros() into a monotonic timestamp
+        if self.last_micros is not None and micros < self.last_micros:
+            self.epoch += 1 << 32
+        self.last_micros = micros
+        device_us = self.epoch + micros
+        if self.last_us is not None:
+            self.intervals.append(device_us - self.last_us)
+        self.first_us = device_us if self.first_us is None else self.first_us
+        self.last_us = device_us
+
+        self.samples += 1
+        self.writer.writerow([sequence, device_us, f"{time.time():.6f}", als, white,
+                              integration_ms, f"{als * lux_per_count:.4f}"])
+
+    def report(self):
+        print(f"[capture] {self.samples} samples, {self.dropped} dropped, {self.bad} bad frames, "
+              f"{self.logs} log messages", file=sys.stderr)
+        if len(self.intervals) > 1:
+            intervals = sorted(self.intervals)
+            span = (self.last_us - self.first_us) / 1e6
+            print(f"[capture] {(self.samples - 1) / span:.2f} samples/s over {span:.1f} s, interval "
+                  f"p50 {intervals[len(intervals) // 2] / 1000:.2f} ms, "
+                  f"max {intervals[-1] / 1000:.2f} ms", file=sys.stderr)
+
+
+def main():
+    parser = argparse.ArgumentParser(description=__doc__.splitlines()[0])
+    parser.add_argument("--port", required=True)
+    parser.add_argument("--baud", type=int, default=921600, help="STREAM_BAUD_RATE of the firmware")
+    parser.add_argument("--host", help="controller address; starts the stream over HTTP")
+    parser.add_argument("--seconds", type=int, default=60)
+    parser.add_argument("-o", "--output", required=True, help="CSV file to write")
+    tables = parser.add_mutually_exclusive_group()
+    tables.add_argument("--elf", help="firmware.elf, to decode binary log messages")
+    tables.add_argument("--table", help="logstrings.json, to decode binary log messages")
+    args = parser.parse_args()
+
+    log_table = load_table(args.elf, args.table) if args.elf or args.table else None
+
+    port = open_port(args.port, args.baud)
+    if args.host:
+        print(f"[capture] {request_stream(args.host, args.seconds)}", file=sys.stderr)
+
+    # We read a little past the end so the stream's last frames arrive
+    deadline = time.monotonic() + args.seconds + 1
+    with open(args.output, "w", newline="") as f:
+        writer = csv.writer(f)
+        writer.writerow(["sequence", "device_us", "host_time", "als", "white", "integration_ms", "lux"])
+        capture = Capture(writer, log_table)
+        buffer = bytearray()
+        try:
+            while time.monotonic() < deadline:
+                buffer += port.read(max(port.in_waiting, 1))
+                while True:
+                    end = buffer.find(b"\0")
+                    if end < 0:
+                        break
+                    if end > 0:
+                        capture.handle(bytes(buffer[:end]))
+                    del buffer[:end + 1]
+        except KeyboardInterrupt:
+            if args.host:
+                request_stream(args.host, 0)
+    port.close()
+    capture.report()
+
+
+if __name__ == "__main__":
+    main()
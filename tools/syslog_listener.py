@@ -0,0 +1,102 @@
+#!/usr/bin/env python3
+"""Local syslog collector stand-in for checking the controller's log forwarding.
+
+Receives the UDP datagrams SyslogForwarder sends (see
+include/syslogforwarder.h), splits each one into its newline-separated
+RFC 5424 messages and prints them with their severity. Reports datagrams,
+messages per datagram and bytes received, so batching can be checked
+without a real collector. Messages the controller dropped never arrive;
+compare with "syslog" in /api/counters.
+
+Usage: syslog_listener.py [--port 5514] [--report 60] [--quiet] [-o log.txt]
+"""
+
+import argparse
+import re
+import socket
+import sys
+import time
+
+LINE = re.compile(r"^<(\d{1,3})>1 (\S+) (\S+) (\S+) (\S+) (\S+) (\S+) ?(.*)$")
+SEVERITIES = ["EMERG", "ALERT", "CRIT", "ERROR", "WARN", "NOTICE", "INFO", "DEBUG"]
+
+
+class Stats:
+    def __init__(self):
+        self.started = time.monotonic()
+        self.datagrams = 0
+        self.messages = 0
+        self.malformed = 0
+        self.bytes = 0
+        self.largest = 0
+
+    def report(self):
+        elapsed = max(time.monotonic() - self.started, 1e-6)
+        print(f"[syslog] {self.datagrams} datagrams, {self.messages} msgs "
+              f"({self.messages / max(self.datagrams, 1):.1f} per datagram, {self.malformed} malformed) | "
+              f"{self.bytes} B, largest datagram {self.largest} B | "
+              f"{self.messages / elapsed:.1f} msg/s", file=sys.stderr)
+
+
+def parse(line):
+    """Return (severity, hostname, message) of one RFC 5424 line, or None."""
+    match = LINE.match(line)
+    if not match:
+        return None
+    priority = int(match.group(1))
+    return SEVERITIES[priority & 0x07], match.group(3), match.group(8)
+
+
+def main():
+    parser = argparse.ArgumentParser(description=__doc__.splitlines()[0])
+    parser.add_argument("--port", type=int, default=5514, help="SYSLOG_PORT of the firmware (514 needs root)")
+    parser.add_argument("--report", type=float, default=60.0, help="seconds between reports")
+    parser.add_argument("--quiet", action="store_true", help="only print reports")
+    parser.add_argument("-o", "--output", help="also append received messages to this file")
+    args = parser.parse_args()
+
+    sock = socket.socket(socket.AF_INET, socket.SOCK_DGRAM)
+    sock.bind(("0.0.0.0", args.port))
+    sock.settimeout(1.0)
+    output = open(args.output, "a") if args.output else None
+    print(f"[syslog] listening on UDP port {args.port}", file=sys.stderr)
+
+    stats = Stats()
+    next_report = time.monotonic() + args.report
+    try:
+        while True:
+            try:
+                data, peer = sock.recvfrom(65535)
+            except socket.timeout:
+                data = None
+            if data:
+                stats.datagrams += 1
+                stats.bytes += len(data)
+                stats.largest = max(stats.largest, len(data))
+                for line in data.decode("utf-8", "replace").splitlines():
+                    if not line:
+                        continue
+                    parsed = parse(line)
+                    if not parsed:
+                        stats.malformed += 1
+                        print(f"[syslog] malformed from {peer[0]}: {line!r}", file=sys.stderr)
+                        continue
+                    stats.messages += 1
+                    text = f"{time.strftime('%H:%M:%S')} {peer[0]} {parsed[1]} {parsed[0]:<5} {parsed[2]}"
+                    if not args.quiet:
+                        print(text)
+                    if output:
+                        output.write(text + "\n")
+            if time.monotonic() >= next_report:
+                stats.report()
+                next_report += args.report
+    except KeyboardInterrupt:
+        pass
+    finally:
+        stats.report()
+        if output:
+            output.close()
+
+
+if __name__ == "__main__":
+    main()
@@ -0,0 +1,126 @@
+#!/usr/bin/env python3
+"""Compress the dashboard in web/ into a C header the firmware serves from flash.
+
+Every file is gzipped here, once, at maximum compression and with a zero
+timestamp so the same sources always give the same bytes. Its strong ETag
+is a hash of those bytes. Pages refer to the other assets as name?v=<hash>,
+so those can be cached for a year as immutable while the pages themselves
+are revalidated, and a repeat visit costs a single 304. The controller
+never compresses anything or copies a file into RAM (see src/webassets.cpp).
+
+Usage: web_assets.py web -o webassets_data.h
+"""
+
+import argparse
+import gzip
+import hashlib
+import os
+import re
+import sys
+
+CONTENT_TYPES = {
+    ".html": "text/html; charset=utf-8",
+    ".js": "text/javascript; charset=utf-8",
+    ".css": "text/css; charset=utf-8",
+    ".svg": "image/svg+xml",
+    ".png": "image/png",
+    ".ico": "image/x-icon",
+}
+PAGES = (".html",)
+
+
+def compress(data):
+    return gzip.compress(data, compresslevel=9, mtime=0)
+
+
+def etag(data):
+    return hashlib.sha256(data).hexdigest()[:16]
+
+
+def build(directory):
+    """Return [(path, content type, etag, immutable, gzipped bytes, source size)]."""
+    names = sorted(name for name in os.listdir(directory)
+                   if os.path.isfile(os.path.join(directory, name)))
+    unknown = [name for name in names if os.path.splitext(name)[1] not in CONTENT_TYPES]
+    if unknown:
+        raise ValueError(f"no content type for {', '.join(unknown)}")
+
+    sources = {}
+    for name in names:
+        with open(os.path.join(directory, name), "rb") as f:
+            sources[name] = f.read()
+
+    # We hash the static assets first so pages can embed their versions
+    assets = []
+    versions = {}
+    for name in names:
+        if name.endswith(PAGES):
+            continue
+        data = compress(sources[name])
+        versions[name] = etag(data)
+        assets.append((name, data, True))
+
+    for name in names:
+        if not name.endswith(PAGES):
+            continue
+        page = sources[name]
+        for asset, version in versions.items():
+            page = re.sub(rb'(["\'])' + re.escape(asset.encode()) + rb'\1',
+                          b'"' + asset.encode() + b"?v=" + version.encode() + b'"', page)
+        assets.append((name, compress(page), False))
+
+    result = []
+    for name, data, immutable in assets:
+        path = "/" if name == "index.html" else "/" + name
+        result.append((path, CONTENT_TYPES[os.path.splitext(name)[1]], etag(data), immutable,
+                       data, len(sources[name])))
+    return result
+
+
+def render(assets):
+    lines = ["/// Generated by tools/web_assets.py from web/ - do not edit", ""]
+    for index, (path, _, _, _, data, _) in enumerate(assets):
+        lines.append(f"/// {path}")
+        lines.append(f"static const uint8_t webAssetData{index}[] = {{")
+        for offset in range(0, len(data), 16):
+            lines.append("\t" + ", ".join(f"0x{byte:02x}" for byte in data[offset:offset + 16]) + ",")
+        lines.append("};")
+        lines.append("")
+
+    lines.append("static const WebAsset webAssets[] = {")
+    for index, (path, content_type, tag, immutable, data, _) in enumerate(assets):
+        lines.append(f'\t{{"{path}", "{content_type}", "\\"{tag}\\"", {"true" if immutable else "false"}, '
+                     f"webAssetData{index}, sizeof(webAssetData{index})}},")
+    lines.append("};")
+    return "\n".join(lines) + "\n"
+
+
+def write_if_changed(path, text):
+    """Leave an unchanged header alone so nothing is rebuilt."""
+    if os.path.exists(path):
+        with open(path) as f:
+            if f.read() == text:
+                return False
+    os.makedirs(os.path.dirname(os.path.abspath(path)), exist_ok=True)
+    with open(path, "w") as f:
+        f.write(text)
+    return True
+
+
+def main():
+    parser = argparse.ArgumentParser(description=__doc__.splitlines()[0])
+    parser.add_argument("directory", help="dashboard sources, normally web/")
+    parser.add_argument("-o", "--output", required=True, help="header to write")
+    args = parser.parse_args()
+
+    assets = build(args.directory)
+    changed = write_if_changed(args.output, render(assets))
+    for path, _, tag, immutable, data, size in assets:
+        print(f"[web] {path:<12} {size:>6} -> {len(data):>5} B  {tag}{'  immutable' if immutable else ''}",
+              file=sys.stderr)
+    print(f"[web] {sum(len(a[4]) for a in assets)} B of flash in {len(assets)} assets"
+          f"{'' if changed else ', header unchanged'}", file=sys.stderr)
+
+
+if __name__ == "__main__":
+    main()
@@ -0,0 +1,185 @@
+"use strict";
+
+// Live values are pushed over /ws (see include/liveupdates.h for the frame
+// layout); /api/status fills in the rest and stands in while the socket is down
+const STATUS_INTERVAL_MS = 60000;
+const FALLBACK_INTERVAL_MS = 5000;
+const RECONNECT_MS = 5000;
+const HISTORY_INTERVAL_MS = 300000;
+const HISTORY_SECONDS = 86400;
+
+const DECISIONS = ["TURN ON", "TURN OFF", "KEEP CURRENT", "WAIT FOR DATA"];
+const REASONS = ["Outside schedule", "In schedule + dark", "In schedule + bright",
+	"No valid time", "Sensor failure", "Relay busy"];
+
+const $ = (id) => document.getElementById(id);
+let deviceTime = 0;
+let live = null;
+let liveState = new Array(8).fill(0);
+let fallbackTimer = null;
+
+function hour(value) {
+	return String(value).padStart(2, "0") + ":00";
+}
+
+function showStatus(status) {
+	deviceTime = status.time_valid ? status.time : 0;
+
+	const sensor = status.sensor;
+	$("lux").textContent = sensor.lux === null ? "–" : sensor.lux.toFixed(1);
+	$("sensor").textContent = sensor.healthy
+		? (sensor.below_threshold ? "below threshold" : "above threshold") + " · " + sensor.power_mode
+		: (sensor.recovering ? "sensor recovering" : "sensor failure");
+
+	$("relay").textContent = status.relay.on ? "ON" : "OFF";
+	$("relay").classList.toggle("on", status.relay.on);
+	$("decision").textContent = status.control.decision + " · " + status.control.reason;
+	$("automatic").checked = status.control.automatic;
+
+	const schedule = status.schedule;
+	$("schedule").textContent = hour(schedule.start_hour) + "–" + hour(schedule.end_hour);
+	$("threshold").textContent = (schedule.active ? "active" : "inactive") + " · below " + schedule.threshold_lux + " lux";
+
+	if (status.today) {
+		$("dli").textContent = status.today.dli.toFixed(2);
+		$("today").textContent = status.today.lamp_on_min + " min lamp on · " + status.today.switches + " switches";
+	}
+}
+
+function drawHistory(rows) {
+	const canvas = $("history");
+	const context = canvas.getContext("2d");
+	const width = canvas.width;
+	const height = canvas.height;
+	const style = getComputedStyle(document.documentElement);
+	context.clearRect(0, 0, width, height);
+	if (!rows.length || !deviceTime) {
+		return;
+	}
+
+	const start = deviceTime - HISTORY_SECONDS;
+	const x = (time) => (time - start) / HISTORY_SECONDS * width;
+	const slot = width / (HISTORY_SECONDS / 900);
+	const maxLux = Math.max(1, ...rows.map((row) => row[2] || 0));
+
+	// We shade each bucket by the share of it the lamp was on
+	context.fillStyle = style.getPropertyValue("--lamp");
+	for (const row of rows) {
+		context.globalAlpha = Math.min(1, row[5] / 900) * 0.5;
+		context.fillRect(x(row[0]), 0, slot, height);
+	}
+	context.globalAlpha = 1;
+
+	context.strokeStyle = style.getPropertyValue("--accent");
+	context.lineWidth = 2;
+	context.beginPath();
+	rows.forEach((row, index) => {
+		const y = height - (row[3] || 0) / maxLux * (height - 20);
+		index ? context.lineTo(x(row[0]) + slot / 2, y) : context.moveTo(x(row[0]) + slot / 2, y);
+	});
+	context.stroke();
+
+	context.fillStyle = style.getPropertyValue("--muted");
+	context.font = "12px system-ui";
+	context.fillText(maxLux.toFixed(0) + " lux", 4, 14);
+}
+
+function showLive(state) {
+	const [deciLux, relay, decision, automatic, time, healthy, dli, lampOnMinutes] = state;
+	deviceTime = time;
+	$("lux").textContent = healthy ? (deciLux / 10).toFixed(1) : "–";
+	$("relay").textContent = relay ? "ON" : "OFF";
+	$("relay").classList.toggle("on", relay === 1);
+	$("decision").textContent = (DECISIONS[decision >> 4] || "UNKNOWN") + " · " + (REASONS[decision & 15] || "Unknown reason");
+	$("automatic").checked = automatic === 1;
+	$("dli").textContent = (dli / 100).toFixed(2);
+}
+
+// Each field in the mask is a zigzag varint to add to its previous value;
+// keyframes start from zero, so they carry absolute values
+function applyFrame(buffer) {
+	const bytes = new Uint8Array(buffer);
+	let position = 2;
+	if (bytes[0] & 1) {
+		liveState.fill(0);
+	}
+	for (let field = 0; field < 8; field++) {
+		if (!(bytes[1] & (1 << field))) {
+			continue;
+		}
+		let value = 0;
+		let shift = 0;
+		let byte;
+		do {
+			byte = bytes[position++];
+			value += (byte & 0x7f) * 2 ** shift;
+			shift += 7;
+		} while (byte & 0x80);
+		liveState[field] = (liveState[field] + (value % 2 ? -(value + 1) / 2 : value / 2)) | 0;
+	}
+	showLive(liveState);
+}
+
+function setConnection(text, online) {
+	$("connection").textContent = text;
+	$("connection").classList.toggle("offline", !online);
+}
+
+function connectLive() {
+	live = new WebSocket("ws://" + location.host + "/ws");
+	live.binaryType = "arraybuffer";
+	live.onopen = () => {
+		clearInterval(fallbackTimer);
+		fallbackTimer = null;
+		setConnection("live", true);
+	};
+	live.onmessage = (event) => applyFrame(event.data);
+	live.onclose = () => {
+		// We poll until the controller takes us back, e.g. when all its slots are busy
+		if (!fallbackTimer) {
+			fallbackTimer = setInterval(refreshStatus, FALLBACK_INTERVAL_MS);
+		}
+		setTimeout(connectLive, RECONNECT_MS);
+	};
+}
+
+async function fetchJson(url, options) {
+	const response = await fetch(url, options);
+	if (!response.ok) {
+		throw new Error(url + ": " + response.status);
+	}
+	return response.json();
+}
+
+async function refreshStatus() {
+	try {
+		showStatus(await fetchJson("/api/status"));
+		if (!live || live.readyState !== WebSocket.OPEN) {
+			setConnection("polling", true);
+		}
+	} catch (error) {
+		setConnection("offline", false);
+	}
+}
+
+async function refreshHistory() {
+	if (!deviceTime) {
+		return;
+	}
+	try {
+		const rollup = await fetchJson("/api/rollup?res=15m&from=" + (deviceTime - HISTORY_SECONDS));
+		drawHistory(rollup.rows);
+	} catch (error) {
+		// We keep the last chart; the next refresh tries again
+	}
+}
+
+$("automatic").addEventListener("change", async (event) => {
+	await fetchJson("/api/override", { method: "POST", body: "automatic=" + event.target.checked });
+	refreshStatus();
+});
+
+refreshStatus().then(refreshHistory);
+connectLive();
+setInterval(refreshStatus, STATUS_INTERVAL_MS);
+setInterval(refreshHistory, HISTORY_INTERVAL_MS);